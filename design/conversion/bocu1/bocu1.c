@@ -31,6 +31,23 @@
 
 #include "bocu1.h"
 
+/*
+ * Use SSE2 for decoding runs of single-byte differences.
+ * SSE2 is always available on x86-64, and on 32-bit x86 only if the
+ * compiler is told to use it; define BOCU1_USE_SSE2 as 0 to disable it.
+ */
+#ifndef BOCU1_USE_SSE2
+#   if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#       define BOCU1_USE_SSE2 1
+#   else
+#       define BOCU1_USE_SSE2 0
+#   endif
+#endif
+
+#if BOCU1_USE_SSE2
+#   include <emmintrin.h>
+#endif
+
 /* BOCU-1 implementation functions ------------------------------------------ */
 
 /**
@@ -191,6 +208,190 @@ encodeBocu1(int32_t *pPrev, int32_t c) {
     return packDiff(c-prev);
 }
 
+/**
+ * Implementation of bocu1_encodeString() and bocu1_encodeCheckpoints().
+ * Writes BOCU1_RESET before each interval-th code point
+ * and records the following byte offsets in index[].
+ *
+ * @param interval number of code points between checkpoints, or 0 for none
+ * @see bocu1_encodeCheckpoints
+ */
+static int32_t
+encodeString(const UChar *s, int32_t length, int32_t interval,
+             uint8_t *dest, int32_t capacity,
+             int32_t *index, int32_t indexCapacity, int32_t *pIndexLength) {
+    int32_t prev, block, c, packed, count, i, destLength, limit;
+    int32_t cpIndex, nextCheckpoint, indexLength;
+
+    prev=BOCU1_ASCII_PREV;
+    i=destLength=0;
+    cpIndex=indexLength=0;
+    nextCheckpoint= interval>0 ? interval : 0x7fffffff;
+    while(i<length) {
+        if(cpIndex==nextCheckpoint) {
+            /* reset the state so that decoding can start after this byte */
+            if(destLength<capacity) {
+                dest[destLength]=BOCU1_RESET;
+            }
+            ++destLength;
+            prev=BOCU1_ASCII_PREV;
+            if(indexLength<indexCapacity) {
+                index[indexLength]=destLength;
+            }
+            ++indexLength;
+            nextCheckpoint= nextCheckpoint<=0x7fffffff-interval ? nextCheckpoint+interval : 0x7fffffff;
+        }
+
+        /*
+         * Fast path for prev in a small-script block below Hiragana:
+         * For c in the same block, c-prev is -0x40..0x3f (single byte)
+         * and bocu1Prev(c)==prev.
+         * Each such character and space write exactly one byte,
+         * so the loop is bounded by the remaining capacity
+         * and by the next checkpoint.
+         */
+        if(prev<0x3040) {
+            block=prev&~0x7f;
+            limit= length-i<=capacity-destLength ? length : i+(capacity-destLength);
+            if(limit-i>nextCheckpoint-cpIndex) {
+                limit=i+(nextCheckpoint-cpIndex);
+            }
+            while(i<limit) {
+                c=s[i];
+                if((uint32_t)(c-block)<=0x7f && c>0x20) {
+                    dest[destLength++]=(uint8_t)(BOCU1_MIDDLE+(c-prev));
+                } else if(c==0x20) {
+                    dest[destLength++]=0x20;
+                } else {
+                    break;
+                }
+                ++i;
+                ++cpIndex;
+            }
+            if(i==length) {
+                break;
+            } else if(cpIndex==nextCheckpoint) {
+                continue;
+            }
+        }
+
+        /* any other code point, same as encodeBocu1() */
+        UTF_NEXT_CHAR(s, i, length, c);
+        ++cpIndex;
+        if(c<=0x20) {
+            if(c!=0x20) {
+                prev=BOCU1_ASCII_PREV;
+            }
+            packed=0x01000000|c;
+        } else {
+            packed=packDiff(c-prev);
+            prev=bocu1Prev(c);
+        }
+
+        count=BOCU1_LENGTH_FROM_PACKED(packed);
+        if(count<=capacity-destLength) {
+            switch(count) {
+            case 4:
+                dest[destLength++]=(uint8_t)(packed>>24);
+                /* fall through */
+            case 3:
+                dest[destLength++]=(uint8_t)(packed>>16);
+                /* fall through */
+            case 2:
+                dest[destLength++]=(uint8_t)(packed>>8);
+                /* fall through */
+            case 1:
+                dest[destLength++]=(uint8_t)packed;
+                /* fall through */
+            default:
+                break;
+            }
+        } else {
+            /* overflow: only count from here on */
+            destLength+=count;
+        }
+    }
+
+    if(pIndexLength!=NULL) {
+        *pIndexLength=indexLength;
+    }
+    return destLength;
+}
+
+/**
+ * BOCU-1 encoder function for a whole UTF-16 string.
+ * Produces the same bytes as encodeBocu1() for each code point
+ * starting from the initial state, but writes them directly
+ * and handles runs of characters from the same small-script block
+ * (including spaces) in a tight loop:
+ * Those are encoded as single bytes and leave "prev" unchanged.
+ *
+ * Only complete byte sequences are written; if the output does not fit,
+ * then the function continues to count so that the caller can
+ * allocate a large enough buffer and call it again.
+ * The output is not NUL-terminated.
+ *
+ * @param s input UTF-16 string
+ * @param length number of UChar code units in s
+ * @param dest output byte array, can be NULL if capacity==0
+ * @param capacity number of bytes available at dest
+ * @return number of bytes needed for the complete BOCU-1 string
+ *         (>capacity if it did not fit), or -1 for illegal arguments
+ */
+U_CFUNC int32_t
+bocu1_encodeString(const UChar *s, int32_t length, uint8_t *dest, int32_t capacity) {
+    if(s==NULL || length<0 || capacity<0 || (dest==NULL && capacity>0)) {
+        /* illegal argument */
+        return -1;
+    }
+    return encodeString(s, length, 0, dest, capacity, NULL, 0, NULL);
+}
+
+/**
+ * BOCU-1 encoder function for a whole UTF-16 string, with checkpoints
+ * for random access.
+ * Same as bocu1_encodeString() but writes a BOCU1_RESET byte before
+ * code point number interval, 2*interval, 3*interval etc.
+ * The reset byte costs one byte per checkpoint plus a longer difference
+ * for the following code point if it is not in the ASCII block.
+ *
+ * Decoding can start right after any reset byte with an initial
+ * Bocu1Rx state. The byte offsets after the reset bytes are written
+ * to index[], which is the optional side index for bocu1_seek():
+ * index[k-1] is the offset of code point number k*interval.
+ * The index is not needed to decode the whole string.
+ *
+ * Like for the output bytes, if the index does not fit,
+ * then only the entries that fit are written but all are counted.
+ *
+ * @param s input UTF-16 string
+ * @param length number of UChar code units in s
+ * @param interval number of code points between checkpoints, >0
+ * @param dest output byte array, can be NULL if capacity==0
+ * @param capacity number of bytes available at dest
+ * @param index output array for the checkpoint byte offsets,
+ *        can be NULL if indexCapacity==0
+ * @param indexCapacity number of int32_t entries available at index
+ * @param pIndexLength receives the number of checkpoints, can be NULL
+ * @return number of bytes needed for the complete BOCU-1 string
+ *         (>capacity if it did not fit), or -1 for illegal arguments
+ *
+ * @see bocu1_seek
+ */
+U_CFUNC int32_t
+bocu1_encodeCheckpoints(const UChar *s, int32_t length, int32_t interval,
+                        uint8_t *dest, int32_t capacity,
+                        int32_t *index, int32_t indexCapacity, int32_t *pIndexLength) {
+    if( s==NULL || length<0 || interval<=0 ||
+        capacity<0 || (dest==NULL && capacity>0) ||
+        indexCapacity<0 || (index==NULL && indexCapacity>0)
+    ) {
+        /* illegal argument */
+        return -1;
+    }
+    return encodeString(s, length, interval, dest, capacity, index, indexCapacity, pIndexLength);
+}
+
 /**
  * Function for BOCU-1 decoder; handles multi-byte lead bytes.
  *
@@ -375,3 +576,316 @@ decodeBocu1(Bocu1Rx *pRx, uint8_t b) {
         return decodeBocu1TrailByte(pRx, b);
     }
 }
+
+/**
+ * Decode a run of single-byte differences and spaces
+ * for prev in a small-script block below Hiragana.
+ * For such prev, the single-byte code points stay in the same 128-block,
+ * so prev does not change and each byte b yields prev-BOCU1_MIDDLE+b:
+ * There is no dependency between the bytes.
+ *
+ * With SSE2, 16 bytes at a time are checked and widened;
+ * the rest of the run is decoded one byte at a time.
+ *
+ * @param prev "previous code point" state value, <0x3040
+ * @param s input bytes
+ * @param length number of input bytes, not more than the output capacity
+ * @param dest output UTF-16 array
+ * @return number of bytes decoded, each to one UChar;
+ *         s[return value] is the first byte that is neither
+ *         a single-byte difference nor a space
+ */
+static int32_t
+decodeSingleBytes(int32_t prev, const uint8_t *s, int32_t length, UChar *dest) {
+    int32_t base, i;
+    uint8_t b;
+
+    base=prev-BOCU1_MIDDLE;
+    i=0;
+
+#if BOCU1_USE_SSE2
+    {
+        __m128i bytes, isSingleOrSpace, isSpace, lo, hi, spaceLo, spaceHi;
+        const __m128i zero=_mm_setzero_si128();
+        const __m128i minusOne=_mm_set1_epi8(-1);
+        const __m128i startNeg2=_mm_set1_epi8((char)BOCU1_START_NEG_2);
+        const __m128i space=_mm_set1_epi8(0x20);
+        const __m128i base16=_mm_set1_epi16((short)base);
+        const __m128i space16=_mm_set1_epi16(0x20);
+
+        while(length-i>=16) {
+            bytes=_mm_loadu_si128((const __m128i *)(s+i));
+
+            /* single-byte leads are BOCU1_START_NEG_2..+0x7f, i.e., b-BOCU1_START_NEG_2>=0 as int8_t */
+            isSpace=_mm_cmpeq_epi8(bytes, space);
+            isSingleOrSpace=_mm_or_si128(
+                _mm_cmpgt_epi8(_mm_sub_epi8(bytes, startNeg2), minusOne),
+                isSpace);
+            if(_mm_movemask_epi8(isSingleOrSpace)!=0xffff) {
+                break;
+            }
+
+            /* widen to 16 bits, add base, and put back the spaces */
+            lo=_mm_add_epi16(_mm_unpacklo_epi8(bytes, zero), base16);
+            hi=_mm_add_epi16(_mm_unpackhi_epi8(bytes, zero), base16);
+            spaceLo=_mm_unpacklo_epi8(isSpace, isSpace);
+            spaceHi=_mm_unpackhi_epi8(isSpace, isSpace);
+            lo=_mm_or_si128(_mm_andnot_si128(spaceLo, lo), _mm_and_si128(spaceLo, space16));
+            hi=_mm_or_si128(_mm_andnot_si128(spaceHi, hi), _mm_and_si128(spaceHi, space16));
+            _mm_storeu_si128((__m128i *)(dest+i), lo);
+            _mm_storeu_si128((__m128i *)(dest+i+8), hi);
+            i+=16;
+        }
+    }
+#endif
+
+    while(i<length) {
+        b=s[i];
+        if((uint8_t)(b-BOCU1_START_NEG_2)<(BOCU1_START_POS_2-BOCU1_START_NEG_2)) {
+            dest[i]=(UChar)(base+b);
+        } else if(b==0x20) {
+            dest[i]=0x20;
+        } else {
+            break;
+        }
+        ++i;
+    }
+    return i;
+}
+
+/**
+ * BOCU-1 decoder function for a buffer of bytes, for streaming.
+ * Produces the same code points as decodeBocu1() for each byte,
+ * but decodes runs of single-byte differences, spaces and C0 controls
+ * directly in a loop, as well as complete two-byte sequences,
+ * and calls decodeBocu1() only for longer or split sequences,
+ * illegal sequences and the reset byte.
+ *
+ * The decoder state is kept in *pRx like for decodeBocu1(), so a
+ * byte sequence may be split across buffers: Call this function
+ * again with the same Bocu1Rx and the next buffer.
+ *
+ * The function stops when the source is consumed, when the target is full,
+ * or after an illegal byte sequence.
+ * A byte that would yield a supplementary code point with only one
+ * UChar left in the target is not consumed.
+ *
+ * @param pRx pointer to the decoder state structure;
+ *        the initial values should be 0, see decodeBocu1()
+ * @param pSource pointer to the source pointer; moved past the consumed bytes
+ * @param sourceLimit pointer to after the last source byte
+ * @param pTarget pointer to the UTF-16 target pointer; moved past the output
+ * @param targetLimit pointer to after the last target UChar
+ * @return
+ *      0 if the source is consumed or the target is full
+ *        (compare *pSource with sourceLimit)
+ *     <-1 if an illegal byte sequence ends before *pSource,
+ *        with the state reset like in decodeBocu1()
+ */
+U_CFUNC int32_t
+bocu1_decodeBuffer(Bocu1Rx *pRx,
+                   const uint8_t **pSource, const uint8_t *sourceLimit,
+                   UChar **pTarget, const UChar *targetLimit) {
+    const uint8_t *source;
+    UChar *target;
+    Bocu1Rx saved;
+    int32_t prev, c, t, length, result;
+    uint8_t b;
+
+    if(pRx==NULL || pSource==NULL || *pSource==NULL || pTarget==NULL || *pTarget==NULL) {
+        /* illegal argument */
+        return -99;
+    }
+
+    if(pRx->prev==0) {
+        /* lenient handling of initial 0 values */
+        pRx->prev=BOCU1_ASCII_PREV;
+        pRx->count=0;
+    }
+
+    source=*pSource;
+    target=*pTarget;
+    prev=pRx->prev;
+    result=0;
+    while(source<sourceLimit && target<targetLimit) {
+        b=*source;
+        if(pRx->count==0) {
+            /*
+             * Fast path for prev in a small-script block below Hiragana:
+             * Single-byte differences stay in the same 128-block,
+             * so they yield BMP code points and do not change prev.
+             * Each such byte and space yield exactly one UChar.
+             */
+            if(prev<0x3040) {
+                length=(int32_t)(sourceLimit-source);
+                if(length>(targetLimit-target)) {
+                    length=(int32_t)(targetLimit-target);
+                }
+                c=decodeSingleBytes(prev, source, length, target);
+                source+=c;
+                target+=c;
+                if(c==length) {
+                    continue;
+                }
+                b=*source;
+            }
+
+            if(b<=0x20) {
+                /* C0 control code or space, see decodeBocu1() */
+                if(b!=0x20) {
+                    prev=BOCU1_ASCII_PREV;
+                }
+                *target++=b;
+                ++source;
+                continue;
+            } else if(b>=BOCU1_START_NEG_2 && b<BOCU1_START_POS_2) {
+                /* single-byte difference from any prev */
+                c=prev+((int32_t)b-BOCU1_MIDDLE);
+                if(c<=0xffff) {
+                    *target++=(UChar)c;
+                } else if(targetLimit-target>=2) {
+                    *target++=UTF16_LEAD(c);
+                    *target++=UTF16_TRAIL(c);
+                } else {
+                    break;
+                }
+                prev=bocu1Prev(c);
+                ++source;
+                continue;
+            } else if( (BOCU1_START_NEG_3<=b && b<BOCU1_START_POS_3) &&
+                       (sourceLimit-source)>=2
+            ) {
+                /* complete two-byte sequence (b is not a single-byte lead here) */
+                t=source[1];
+                if(t<=0x20) {
+                    t=bocu1ByteToTrail[t];
+                } else {
+                    t-=BOCU1_TRAIL_BYTE_OFFSET;
+                }
+                if(b>=BOCU1_START_POS_2) {
+                    c=prev+((int32_t)b-BOCU1_START_POS_2)*BOCU1_TRAIL_COUNT+(BOCU1_REACH_POS_1+1)+t;
+                } else {
+                    c=prev+((int32_t)b-BOCU1_START_NEG_2)*BOCU1_TRAIL_COUNT+BOCU1_REACH_NEG_1+t;
+                }
+                if(t>=0 && 0<=c && c<=0x10ffff) {
+                    if(c<=0xffff) {
+                        *target++=(UChar)c;
+                    } else if(targetLimit-target>=2) {
+                        *target++=UTF16_LEAD(c);
+                        *target++=UTF16_TRAIL(c);
+                    } else {
+                        break;
+                    }
+                    prev=bocu1Prev(c);
+                    source+=2;
+                    continue;
+                }
+                /* illegal trail byte or code point: let decodeBocu1() handle it */
+            }
+        }
+
+        /* multi-byte sequence or reset byte: use the state machine */
+        pRx->prev=prev;
+        saved=*pRx;
+        c=decodeBocu1(pRx, b);
+        if(c>0xffff && targetLimit-target<2) {
+            /* no room for the surrogate pair, do not consume the byte */
+            *pRx=saved;
+            break;
+        }
+        ++source;
+        prev=pRx->prev;
+        if(c>=0) {
+            if(c<=0xffff) {
+                *target++=(UChar)c;
+            } else {
+                *target++=UTF16_LEAD(c);
+                *target++=UTF16_TRAIL(c);
+            }
+        } else if(c<-1) {
+            result=c;
+            break;
+        }
+    }
+
+    pRx->prev=prev;
+    *pSource=source;
+    *pTarget=target;
+    return result;
+}
+
+/**
+ * Find code point number n in a BOCU-1 string that was written by
+ * bocu1_encodeCheckpoints(), for random access.
+ * Decodes from the last checkpoint at or before n, so at most interval-1
+ * code points are skipped, instead of decoding from the start.
+ * Without an index (indexLength==0), this works on any BOCU-1 string
+ * but decodes from the start.
+ *
+ * After this function, decoding with decodeBocu1() or bocu1_decodeBuffer()
+ * from the returned offset with the returned state yields code points
+ * starting with number n.
+ *
+ * @param s BOCU-1 bytes
+ * @param length number of bytes
+ * @param interval number of code points between checkpoints, as used for encoding
+ * @param index checkpoint offsets from bocu1_encodeCheckpoints(); can be NULL
+ *        if indexLength==0
+ * @param indexLength number of index entries; can be fewer than
+ *        were written, then the later checkpoints are not used
+ * @param n number of the code point to find, 0..number of code points in s
+ * @param pRx receives the decoder state at the returned offset
+ * @return byte offset of code point n (length if n is the number of code points),
+ *         or -1 if n is out of bounds, for illegal sequences and for illegal arguments
+ *
+ * @see bocu1_encodeCheckpoints
+ */
+U_CFUNC int32_t
+bocu1_seek(const uint8_t *s, int32_t length,
+           int32_t interval, const int32_t *index, int32_t indexLength,
+           int32_t n, Bocu1Rx *pRx) {
+    int32_t i, k, count, c;
+
+    if( s==NULL || length<0 || n<0 || pRx==NULL ||
+        indexLength<0 || (indexLength>0 && (index==NULL || interval<=0))
+    ) {
+        /* illegal argument */
+        return -1;
+    }
+
+    /* start at the last usable checkpoint */
+    k= indexLength>0 ? n/interval : 0;
+    if(k>indexLength) {
+        k=indexLength;
+    }
+    if(k>0) {
+        i=index[k-1];
+        count=k*interval;
+        if(i<0 || i>length) {
+            /* the index does not match the string */
+            return -1;
+        }
+    } else {
+        i=count=0;
+    }
+
+    /* the state is reset at a checkpoint */
+    pRx->prev=BOCU1_ASCII_PREV;
+    pRx->count=0;
+    pRx->diff=0;
+
+    /* skip n-count code points */
+    while(count<n) {
+        if(i==length) {
+            /* n is beyond the end */
+            return -1;
+        }
+        c=decodeBocu1(pRx, s[i++]);
+        if(c>=0) {
+            ++count;
+        } else if(c<-1) {
+            return -1;
+        }
+    }
+    return i;
+}
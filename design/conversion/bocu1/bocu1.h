@@ -227,7 +227,25 @@ packDiff(int32_t diff);
 U_CFUNC int32_t
 encodeBocu1(int32_t *pPrev, int32_t c);
 
+U_CFUNC int32_t
+bocu1_encodeString(const UChar *s, int32_t length, uint8_t *dest, int32_t capacity);
+
+U_CFUNC int32_t
+bocu1_encodeCheckpoints(const UChar *s, int32_t length, int32_t interval,
+                        uint8_t *dest, int32_t capacity,
+                        int32_t *index, int32_t indexCapacity, int32_t *pIndexLength);
+
 U_CFUNC int32_t
 decodeBocu1(Bocu1Rx *pRx, uint8_t b);
 
+U_CFUNC int32_t
+bocu1_decodeBuffer(Bocu1Rx *pRx,
+                   const uint8_t **pSource, const uint8_t *sourceLimit,
+                   UChar **pTarget, const UChar *targetLimit);
+
+U_CFUNC int32_t
+bocu1_seek(const uint8_t *s, int32_t length,
+           int32_t interval, const int32_t *index, int32_t indexLength,
+           int32_t n, Bocu1Rx *pRx);
+
 #endif
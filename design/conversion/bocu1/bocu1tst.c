@@ -18,7 +18,9 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /*
  * Standard ICU header.
@@ -316,6 +318,360 @@ testDiff() {
            level[0], level[1], level[2]);
 }
 
+/**
+ * Compare bocu1_encodeString() with writeString() for one string,
+ * for each destination capacity from 0 to beyond the output length.
+ * Test function.
+ *
+ * @return number of errors
+ */
+static int32_t
+checkEncodeString(const UChar *s, int32_t length) {
+    uint8_t expected[400], bocu1[400];
+    int32_t expectedLength, capacity, bocu1Length, countErrors;
+
+    expectedLength=writeString(s, length, expected);
+    countErrors=0;
+    for(capacity=0; capacity<=expectedLength+1; ++capacity) {
+        memset(bocu1, 0x5a, sizeof(bocu1));
+        bocu1Length=bocu1_encodeString(s, length, capacity>0 ? bocu1 : NULL, capacity);
+        if(bocu1Length!=expectedLength) {
+            printf("bocu1_encodeString(capacity %ld)=%ld!=%ld=writeString()\n",
+                   (long)capacity, (long)bocu1Length, (long)expectedLength);
+            ++countErrors;
+        } else if(capacity>=expectedLength && 0!=memcmp(bocu1, expected, expectedLength)) {
+            printf("bocu1_encodeString(capacity %ld) writes different bytes than writeString()\n",
+                   (long)capacity);
+            ++countErrors;
+        } else if(capacity<expectedLength && bocu1[capacity]!=0x5a) {
+            printf("bocu1_encodeString(capacity %ld) writes beyond the capacity\n", (long)capacity);
+            ++countErrors;
+        }
+    }
+    return countErrors;
+}
+
+/*
+ * Test strings for the bulk functions,
+ * switching between their fast paths (ASCII, space, other small scripts)
+ * and all other cases.
+ */
+static const UChar
+testStrings[][12]={
+    { 0x48, 0x65, 0x6c, 0x6c, 0x6f, 0x2c, 0x20, 0x77, 0x6f, 0x72, 0x6c, 0x64 },
+    { 0x41, 0x9, 0x42, 0xa, 0xd, 0x20, 0x20, 0x7e, 0x7f, 0x21, 0, 0x43 },
+    { 0x4d, 0xfc, 0x6c, 0x6c, 0x65, 0x72, 0x20, 0xdf, 0xe9, 0x20, 0x61, 0x7f },
+    { 0x41f, 0x440, 0x438, 0x432, 0x435, 0x442, 0x20, 0x43c, 0x438, 0x440, 0x21, 0x2e },
+    { 0x3042, 0x3044, 0x3000, 0x3001, 0x30a2, 0x4e00, 0x9fa5, 0x9fa6, 0x9f90, 0x20, 0x4e8c, 0x41 },
+    { 0xac00, 0xd7a3, 0xd7a4, 0x20, 0xd800, 0xdc00, 0xdbff, 0xdfff, 0xd800, 0x41, 0xdc00, 0xdfff },
+    { 0x2f7f, 0x2f80, 0x2fff, 0x303f, 0x3040, 0x303f, 0x7f, 0x80, 0xff, 0x100, 0xfeff, 0xffff },
+    { 0x5d0, 0x5d1, 0x20, 0x5d2, 0x5ea, 0x2e, 0x20, 0x661, 0x662, 0x1, 0x663, 0x20 }
+};
+
+#define TEST_STRINGS_COUNT ((int32_t)(sizeof(testStrings)/sizeof(testStrings[0])))
+
+/**
+ * Test bocu1_encodeString() against the per-code point encoder,
+ * called when there are no command line arguments.
+ */
+static void
+testEncodeString() {
+    UChar s[12*TEST_STRINGS_COUNT];
+    int32_t i, j, length, countErrors;
+
+    countErrors=0;
+    for(i=0; i<TEST_STRINGS_COUNT; ++i) {
+        countErrors+=checkEncodeString(testStrings[i], 12);
+    }
+
+    /* all strings concatenated, and some substrings starting in the middle */
+    length=0;
+    for(i=0; i<TEST_STRINGS_COUNT; ++i) {
+        for(j=0; j<12; ++j) {
+            s[length++]=testStrings[i][j];
+        }
+    }
+    for(i=0; i<length; i+=7) {
+        countErrors+=checkEncodeString(s+i, length-i);
+    }
+
+    if(bocu1_encodeString(NULL, 0, NULL, 0)!=-1 || bocu1_encodeString(s, 1, NULL, 1)!=-1) {
+        puts("bocu1_encodeString() does not reject illegal arguments");
+        ++countErrors;
+    }
+
+    if(countErrors==0) {
+        puts("bocu1_encodeString() works fine");
+    } else {
+        printf("bocu1_encodeString() differs from encodeBocu1() in %ld cases\n", (long)countErrors);
+    }
+}
+
+/**
+ * Compare bocu1_decodeBuffer() with decodeBocu1() for one byte sequence,
+ * which may contain illegal sequences.
+ * The bytes are passed to bocu1_decodeBuffer() in chunks of several sizes,
+ * with several target capacities per call,
+ * to test resuming across buffer boundaries.
+ * Test function.
+ *
+ * @return number of errors
+ */
+static int32_t
+checkDecodeBuffer(const uint8_t *bytes, int32_t length) {
+    static const int32_t chunkSizes[]={ 1, 2, 3, 5, 0x7fffffff };
+    static const int32_t capacities[]={ 1, 2, 3, 1000 };
+
+    UChar expected[1000], actual[1000];
+    int32_t expectedErrors[400], actualErrors[400];
+    Bocu1Rx rx;
+    const uint8_t *source, *sourceLimit;
+    UChar *target;
+    int32_t c, i, j, k, capacity, expectedLength, expectedErrorsLength, actualErrorsLength, countErrors;
+
+    /* reference: decode byte by byte, continue after errors */
+    memset(&rx, 0, sizeof(rx));
+    expectedLength=expectedErrorsLength=0;
+    for(i=0; i<length; ++i) {
+        c=decodeBocu1(&rx, bytes[i]);
+        if(c>=0) {
+            UTF_APPEND_CHAR_UNSAFE(expected, expectedLength, c);
+        } else if(c<-1) {
+            expectedErrors[expectedErrorsLength++]=i+1;
+        }
+    }
+
+    countErrors=0;
+    for(j=0; j<(int32_t)(sizeof(chunkSizes)/sizeof(chunkSizes[0])); ++j) {
+        for(k=0; k<(int32_t)(sizeof(capacities)/sizeof(capacities[0])); ++k) {
+            memset(&rx, 0, sizeof(rx));
+            source=bytes;
+            target=actual;
+            actualErrorsLength=0;
+            capacity=capacities[k];
+            while(source<bytes+length) {
+                const uint8_t *oldSource=source;
+                UChar *oldTarget=target;
+
+                sourceLimit= bytes+length-source<=chunkSizes[j] ? bytes+length : source+chunkSizes[j];
+                c=bocu1_decodeBuffer(&rx, &source, sourceLimit, &target, target+capacity);
+                if(source>sourceLimit || target>oldTarget+capacity) {
+                    printf("bocu1_decodeBuffer(chunks of %ld, capacity %ld) goes beyond a limit\n",
+                           (long)chunkSizes[j], (long)capacity);
+                    ++countErrors;
+                    break;
+                }
+                if(c<-1) {
+                    actualErrors[actualErrorsLength++]=(int32_t)(source-bytes);
+                } else if(source==oldSource && target==oldTarget) {
+                    if(capacity>=2) {
+                        printf("bocu1_decodeBuffer(chunks of %ld, capacity %ld) makes no progress\n",
+                               (long)chunkSizes[j], (long)capacity);
+                        ++countErrors;
+                        break;
+                    }
+                    /* a supplementary code point needs 2 UChars */
+                    capacity=2;
+                    continue;
+                }
+                capacity=capacities[k];
+            }
+
+            if( (target-actual)!=expectedLength ||
+                0!=memcmp(actual, expected, expectedLength*U_SIZEOF_UCHAR) ||
+                actualErrorsLength!=expectedErrorsLength ||
+                0!=memcmp(actualErrors, expectedErrors, expectedErrorsLength*4)
+            ) {
+                printf("bocu1_decodeBuffer(chunks of %ld, capacity %ld) differs from decodeBocu1()\n",
+                       (long)chunkSizes[j], (long)capacities[k]);
+                ++countErrors;
+            }
+        }
+    }
+    return countErrors;
+}
+
+/**
+ * Test bocu1_decodeBuffer() against the per-byte decoder,
+ * called when there are no command line arguments.
+ * Uses the BOCU-1 forms of the test strings, long runs of single-byte
+ * differences (for the SSE2 code) interrupted at each position,
+ * and pseudo-random bytes.
+ */
+static void
+testDecodeBuffer() {
+    /* blocks of single-byte runs: ASCII (negative base), Cyrillic, Hebrew */
+    static const UChar runStarts[3]={ 0x21, 0x400, 0x5d0 };
+
+    uint8_t bytes[400];
+    UChar s[12*TEST_STRINGS_COUNT];
+    uint32_t random;
+    int32_t i, j, k, length, countErrors;
+
+    countErrors=0;
+    length=0;
+    for(i=0; i<TEST_STRINGS_COUNT; ++i) {
+        countErrors+=checkDecodeBuffer(bytes, writeString(testStrings[i], 12, bytes));
+        for(j=0; j<12; ++j) {
+            s[length++]=testStrings[i][j];
+        }
+    }
+    countErrors+=checkDecodeBuffer(bytes, writeString(s, length, bytes));
+
+    /* 40-character runs with spaces, and with a character from another block at position k */
+    for(i=0; i<3; ++i) {
+        for(k=0; k<=40; ++k) {
+            for(j=0; j<40; ++j) {
+                s[j]= j%7==6 ? 0x20 : (UChar)(runStarts[i]+(j*5)%0x50);
+            }
+            if(k<40) {
+                s[k]= (k&1) ? 0xa : 0x4e00;
+            }
+            countErrors+=checkDecodeBuffer(bytes, writeString(s, 40, bytes));
+        }
+    }
+
+    /* random bytes, with illegal sequences */
+    random=1;
+    for(i=0; i<300; ++i) {
+        length=1+i%100;
+        for(j=0; j<length; ++j) {
+            random=random*1103515245+12345;
+            bytes[j]=(uint8_t)(random>>16);
+        }
+        countErrors+=checkDecodeBuffer(bytes, length);
+    }
+
+    if(countErrors==0) {
+        puts("bocu1_decodeBuffer() works fine");
+    } else {
+        printf("bocu1_decodeBuffer() differs from decodeBocu1() in %ld cases\n", (long)countErrors);
+    }
+}
+
+/**
+ * Test bocu1_encodeCheckpoints() and bocu1_seek(),
+ * called when there are no command line arguments.
+ * For several intervals, checks that the output decodes to the input,
+ * that the index points after reset bytes,
+ * that the output is the same for each capacity as far as it fits,
+ * and that seeking to each code point with the whole index, part of it
+ * and none of it yields the rest of the string.
+ */
+static void
+testCheckpoints() {
+    static const int32_t intervals[]={ 1, 2, 3, 7, 16, 1000 };
+
+    UChar s[12*TEST_STRINGS_COUNT+40];
+    UChar32 codePoints[12*TEST_STRINGS_COUNT+40];
+    uint8_t bytes[1000], prefix[1000];
+    int32_t index[200], prefixIndex[200];
+    Bocu1Rx rx;
+    int32_t c, i, j, k, n, length, countCodePoints, interval, bytesLength, indexLength, offset;
+    int32_t capacity, prefixLength, prefixIndexLength, countErrors;
+
+    /* the test strings and a Cyrillic run */
+    length=0;
+    for(i=0; i<TEST_STRINGS_COUNT; ++i) {
+        for(j=0; j<12; ++j) {
+            s[length++]=testStrings[i][j];
+        }
+    }
+    for(j=0; j<40; ++j) {
+        s[length++]=(UChar)(0x430+j%0x20);
+    }
+    countCodePoints=i=0;
+    while(i<length) {
+        UTF_NEXT_CHAR(s, i, length, c);
+        codePoints[countCodePoints++]=c;
+    }
+
+    countErrors=0;
+    for(k=0; k<(int32_t)(sizeof(intervals)/sizeof(intervals[0])); ++k) {
+        interval=intervals[k];
+        bytesLength=bocu1_encodeCheckpoints(s, length, interval, bytes, sizeof(bytes),
+                                            index, sizeof(index)/4, &indexLength);
+        if(indexLength!=(countCodePoints-1)/interval) {
+            printf("bocu1_encodeCheckpoints(interval %ld) writes %ld index entries, expected %ld\n",
+                   (long)interval, (long)indexLength, (long)((countCodePoints-1)/interval));
+            ++countErrors;
+            continue;
+        }
+        for(i=0; i<indexLength; ++i) {
+            if(index[i]<1 || index[i]>bytesLength || bytes[index[i]-1]!=BOCU1_RESET) {
+                printf("bocu1_encodeCheckpoints(interval %ld) index[%ld]=%ld is not after a reset byte\n",
+                       (long)interval, (long)i, (long)index[i]);
+                ++countErrors;
+            }
+        }
+
+        /*
+         * preflighting and truncated output:
+         * the output must be the same as far as it is written,
+         * and only the last byte sequence (up to 4 bytes) may be missing
+         */
+        for(capacity=0; capacity<=bytesLength; ++capacity) {
+            memset(prefix, 0x5a, sizeof(prefix));
+            prefixLength=bocu1_encodeCheckpoints(s, length, interval,
+                                                 capacity>0 ? prefix : NULL, capacity,
+                                                 prefixIndex, capacity/4, &prefixIndexLength);
+            for(i=0; i<capacity && prefix[i]==bytes[i]; ++i) {}
+            for(n=i; n<=capacity && prefix[n]==0x5a; ++n) {}
+            if( prefixLength!=bytesLength || prefixIndexLength!=indexLength ||
+                n<=capacity || i<capacity-3 ||
+                0!=memcmp(prefixIndex, index, (capacity/4<indexLength ? capacity/4 : indexLength)*4)
+            ) {
+                printf("bocu1_encodeCheckpoints(interval %ld, capacity %ld) differs from the full output\n",
+                       (long)interval, (long)capacity);
+                ++countErrors;
+            }
+        }
+
+        /* seek to each code point */
+        for(j=0; j<3; ++j) {
+            /* whole index, half of it, none */
+            prefixIndexLength= j==0 ? indexLength : j==1 ? indexLength/2 : 0;
+            for(n=0; n<=countCodePoints; ++n) {
+                offset=bocu1_seek(bytes, bytesLength, interval, index, prefixIndexLength, n, &rx);
+                if(offset<0) {
+                    printf("bocu1_seek(interval %ld, %ld index entries, code point %ld) fails\n",
+                           (long)interval, (long)prefixIndexLength, (long)n);
+                    ++countErrors;
+                    continue;
+                }
+                for(i=n; offset<bytesLength;) {
+                    c=decodeBocu1(&rx, bytes[offset++]);
+                    if(c>=0 && (i>=countCodePoints || c!=codePoints[i++])) {
+                        break;
+                    }
+                }
+                if(offset<bytesLength || i!=countCodePoints) {
+                    printf("bocu1_seek(interval %ld, %ld index entries, code point %ld) "
+                           "does not yield the rest of the string\n",
+                           (long)interval, (long)prefixIndexLength, (long)n);
+                    ++countErrors;
+                }
+            }
+            if(bocu1_seek(bytes, bytesLength, interval, index, prefixIndexLength, n, &rx)!=-1) {
+                printf("bocu1_seek(interval %ld, code point %ld) does not fail beyond the end\n",
+                       (long)interval, (long)n);
+                ++countErrors;
+            }
+        }
+    }
+
+    if(bocu1_encodeCheckpoints(s, length, 0, bytes, sizeof(bytes), NULL, 0, NULL)!=-1) {
+        puts("bocu1_encodeCheckpoints() does not reject interval 0");
+        ++countErrors;
+    }
+
+    if(countErrors==0) {
+        puts("bocu1_encodeCheckpoints() and bocu1_seek() work fine");
+    } else {
+        printf("bocu1_encodeCheckpoints() and bocu1_seek() fail in %ld cases\n", (long)countErrors);
+    }
+}
+
 /**
  * BOCU-1 test function for strings,
  * called when there is one filename argument on the command line.
@@ -364,6 +720,12 @@ testText(FILE *in) {
         if(k!=j || 0!=memcmp(u, v, 2*j)) {
             fprintf(stderr, "error: readString(writeString()) does not roundtrip at file code point index %ld\n", totalUChars);
         }
+        if(checkEncodeString(u, j)!=0) {
+            fprintf(stderr, "error: bocu1_encodeString()!=writeString() at file code point index %ld\n", (long)totalUChars);
+        }
+        if(checkDecodeBuffer(bocu1, i)!=0) {
+            fprintf(stderr, "error: bocu1_decodeBuffer()!=decodeBocu1() at file code point index %ld\n", (long)totalUChars);
+        }
 
         totalUChars+=j;
         totalBytes+=i;
@@ -474,6 +836,197 @@ decodeFile(FILE *in, FILE *out) {
             inLength, inCount, outLength);
 }
 
+/**
+ * Time the decoding of short snippets at pseudo-random code points
+ * with bocu1_seek() from checkpoints versus from the start.
+ * Called by timeFile().
+ *
+ * @param u UTF-16 text
+ * @param length number of UChars in u
+ * @param bocu1 buffer for the BOCU-1 text with checkpoints
+ * @param capacity number of bytes at bocu1
+ * @param v buffer for the snippet
+ */
+static void
+timeSnippets(const UChar *u, int32_t length, uint8_t *bocu1, int32_t capacity, UChar *v) {
+    enum { INTERVAL=256, SNIPPET_LENGTH=80 };
+
+    const uint8_t *source;
+    UChar *target;
+    int32_t *index;
+    Bocu1Rx rx;
+    clock_t start;
+    double seconds[2];
+    uint32_t random;
+    int32_t c, i, j, countCodePoints, bocu1Length, plainLength, indexLength, n, rounds[2];
+
+    countCodePoints=i=0;
+    while(i<length) {
+        UTF_NEXT_CHAR(u, i, length, c);
+        ++countCodePoints;
+    }
+    if(countCodePoints==0) {
+        return;
+    }
+
+    index=(int32_t *)malloc((countCodePoints/INTERVAL+1)*4);
+    if(index==NULL) {
+        fprintf(stderr, "error: unable to allocate the checkpoint index\n");
+        return;
+    }
+    plainLength=bocu1_encodeString(u, length, NULL, 0);
+    bocu1Length=bocu1_encodeCheckpoints(u, length, INTERVAL, bocu1, capacity,
+                                        index, countCodePoints/INTERVAL+1, &indexLength);
+    if(bocu1Length>capacity) {
+        fprintf(stderr, "error: the BOCU-1 text with checkpoints does not fit into the buffer\n");
+        free(index);
+        return;
+    }
+
+    /* j==0: with the index, j==1: from the start */
+    for(j=0; j<2; ++j) {
+        random=1;
+        rounds[j]=0;
+        start=clock();
+        do {
+            random=random*1103515245+12345;
+            n=(int32_t)((random>>8)%(uint32_t)countCodePoints);
+            memset(&rx, 0, sizeof(rx));
+            source=bocu1+bocu1_seek(bocu1, bocu1Length, INTERVAL, index, j==0 ? indexLength : 0, n, &rx);
+            target=v;
+            bocu1_decodeBuffer(&rx, &source, bocu1+bocu1Length, &target, v+SNIPPET_LENGTH);
+            ++rounds[j];
+        } while((seconds[j]=(double)(clock()-start)/CLOCKS_PER_SEC)<1.);
+    }
+
+    printf("    checkpoints every %ld code points: +%ld bytes (%.2f%%), index %ld bytes\n",
+           (long)INTERVAL, (long)(bocu1Length-plainLength),
+           (bocu1Length-plainLength)*100./plainLength, (long)indexLength*4);
+    printf("    %ld-UChar snippet via bocu1_seek() from checkpoints %10.2f us\n",
+           (long)SNIPPET_LENGTH, seconds[0]*1e6/rounds[0]);
+    printf("    %ld-UChar snippet via bocu1_seek() from the start   %10.2f us\n",
+           (long)SNIPPET_LENGTH, seconds[1]*1e6/rounds[1]);
+
+    free(index);
+}
+
+/**
+ * Throughput comparison of bocu1_encodeString() with the per-code point
+ * encodeBocu1() as used in writeString(),
+ * and of bocu1_decodeBuffer() with the per-byte decodeBocu1()
+ * as used in readString().
+ * Called when the first command line argument is "time".
+ *
+ * Reads the whole UTF-8 file into one UTF-16 string,
+ * encodes it and decodes the result repeatedly with each function
+ * for at least a second, and checks that the outputs are the same.
+ * bocu1_decodeBuffer() is called on 4kB chunks like for streaming.
+ * Finally, times random access with and without checkpoints.
+ */
+static void
+timeFile(FILE *in) {
+    uint8_t *utf8, *expected, *bocu1;
+    const uint8_t *source, *sourceLimit;
+    UChar *u, *v, *target;
+    UChar32 c;
+    Bocu1Rx rx;
+    clock_t start;
+    double seconds[4];
+    long fileLength;
+    int32_t i, length, expectedLength, bocu1Length, vLength, rounds[4];
+
+    fseek(in, 0, SEEK_END);
+    fileLength=ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    /* UTF-16 needs at most as many units as there are UTF-8 bytes, BOCU-1 at most 4 bytes each */
+    utf8=(uint8_t *)malloc(fileLength+1);
+    u=(UChar *)malloc((fileLength+1)*U_SIZEOF_UCHAR);
+    v=(UChar *)malloc((fileLength+1)*U_SIZEOF_UCHAR);
+    expected=(uint8_t *)malloc((fileLength+1)*4);
+    bocu1=(uint8_t *)malloc((fileLength+1)*4);
+    if(utf8==NULL || u==NULL || v==NULL || expected==NULL || bocu1==NULL) {
+        fprintf(stderr, "error: unable to allocate memory for %ld bytes of input\n", fileLength);
+        return;
+    }
+    fileLength=(long)fread(utf8, 1, fileLength, in);
+
+    /* convert the file from UTF-8 to UTF-16 */
+    i=length=0;
+    while(i<fileLength) {
+        UTF8_NEXT_CHAR_SAFE(utf8, i, fileLength, c, FALSE);
+        UTF_APPEND_CHAR_UNSAFE(u, length, c);
+    }
+
+    /* per-code point API */
+    rounds[0]=0;
+    start=clock();
+    do {
+        expectedLength=writeString(u, length, expected);
+        ++rounds[0];
+    } while((seconds[0]=(double)(clock()-start)/CLOCKS_PER_SEC)<1.);
+
+    /* bulk API */
+    rounds[1]=0;
+    start=clock();
+    do {
+        bocu1Length=bocu1_encodeString(u, length, bocu1, (length+1)*4);
+        ++rounds[1];
+    } while((seconds[1]=(double)(clock()-start)/CLOCKS_PER_SEC)<1.);
+
+    if(bocu1Length!=expectedLength || 0!=memcmp(bocu1, expected, expectedLength)) {
+        fprintf(stderr, "error: bocu1_encodeString()!=writeString() for the file contents\n");
+    }
+
+    /* per-byte decoder */
+    rounds[2]=0;
+    start=clock();
+    do {
+        vLength=readString(expected, expectedLength, v);
+        ++rounds[2];
+    } while((seconds[2]=(double)(clock()-start)/CLOCKS_PER_SEC)<1.);
+
+    if(vLength!=length || 0!=memcmp(u, v, length*U_SIZEOF_UCHAR)) {
+        fprintf(stderr, "error: readString() does not roundtrip the file contents\n");
+    }
+
+    /* bulk decoder on 4kB chunks */
+    rounds[3]=0;
+    start=clock();
+    do {
+        memset(&rx, 0, sizeof(rx));
+        source=expected;
+        target=v;
+        while(source<expected+expectedLength) {
+            sourceLimit= expected+expectedLength-source<=4096 ? expected+expectedLength : source+4096;
+            bocu1_decodeBuffer(&rx, &source, sourceLimit, &target, v+length);
+        }
+        ++rounds[3];
+    } while((seconds[3]=(double)(clock()-start)/CLOCKS_PER_SEC)<1.);
+
+    if((target-v)!=length || 0!=memcmp(u, v, length*U_SIZEOF_UCHAR)) {
+        fprintf(stderr, "error: bocu1_decodeBuffer() does not roundtrip the file contents\n");
+    }
+
+    printf("    %ld UChars -> %ld BOCU-1 bytes\n", (long)length, (long)expectedLength);
+    printf("    encodeBocu1()        %8.2f ns/UChar\n", seconds[0]*1e9/rounds[0]/length);
+    printf("    bocu1_encodeString() %8.2f ns/UChar  (%.2fx)\n",
+           seconds[1]*1e9/rounds[1]/length,
+           (seconds[0]/rounds[0])/(seconds[1]/rounds[1]));
+    printf("    decodeBocu1()        %8.2f ns/byte\n", seconds[2]*1e9/rounds[2]/expectedLength);
+    printf("    bocu1_decodeBuffer() %8.2f ns/byte   (%.2fx)\n",
+           seconds[3]*1e9/rounds[3]/expectedLength,
+           (seconds[2]/rounds[2])/(seconds[3]/rounds[3]));
+
+    timeSnippets(u, length, bocu1, (length+1)*4, v);
+
+    free(utf8);
+    free(u);
+    free(v);
+    free(expected);
+    free(bocu1);
+}
+
 /**
  * Main function of the BOCU-1 test and sample code.
  * For usage, run with command line "?" and see the source code above.
@@ -494,7 +1047,9 @@ main(int argc, const char *argv[]) {
                 "    bocu1 encode <filename> -> read UTF-8 <filename>,\n"
                 "                               convert to BOCU-1, write to bocu-1.txt\n\n"
                 "    bocu1 decode <filename> -> read BOCU-1 file bocu-1.txt,\n"
-                "                               convert to UTF-8, write to <filename>\n\n");
+                "                               convert to UTF-8, write to <filename>\n\n"
+                "    bocu1 time <filename> -> read UTF-8 <filename>, compare the throughput\n"
+                "                             of the per-character and bulk functions\n\n");
             return 0;
         } else if(argc>2 && strcmp(argv[1], "encode")==0) {
             /* convert a UTF-8 file to BOCU-1 */
@@ -532,6 +1087,17 @@ main(int argc, const char *argv[]) {
             decodeFile(in, out);
             fclose(out);
             fclose(in);
+        } else if(argc>2 && strcmp(argv[1], "time")==0) {
+            /* time the BOCU-1 encoder and decoder functions */
+            in=fopen(argv[2], "rb");
+            if(in==NULL) {
+                printf("unable to open UTF-8 input file \"%s\"\n", argv[2]);
+                return 1;
+            }
+
+            printf("timing BOCU-1 encoding of \"%s\"\n", argv[2]);
+            timeFile(in);
+            fclose(in);
         } else /* neither encode nor decode, test BOCU-1 on lines of input file */ {
             in=fopen(argv[1], "rb");
             if(in==NULL) {
@@ -549,6 +1115,9 @@ main(int argc, const char *argv[]) {
         }
     } else /* no arguments, test difference encoding */ {
         testDiff();
+        testEncodeString();
+        testDecodeBuffer();
+        testCheckpoints();
     }
 
     return 0;
@@ -22,27 +22,96 @@
 *
 *   Starting 2003oct09, canonucm handles m:n mappings as well, but requires
 *   a more elaborate build using the ICU common (icuuc) and toolutil libraries.
+*
+*   Without file arguments, canonucm reads the .ucm file from stdin and
+*   writes the canonicalized version to stdout.
+*   With file arguments, it canonicalizes each file into the destination
+*   directory (default: in place), running up to --jobs files at a time.
+*   Each file is handled in its own process because the ucm module exit()s
+*   on errors; a failure is reported for its file and the other files
+*   are still processed.
+*
+*   With --cache dir, each parsed and sorted file is also stored in binary form
+*   in that directory, keyed by a hash of its text; an unchanged file is then
+*   loaded from there instead of being parsed and sorted again.
 */
 
 #include "unicode/utypes.h"
+#include "unicode/putil.h"
+#include "cstring.h"
+#include "uoptions.h"
 #include "ucnv_ext.h"
 #include "ucm.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-extern int
-main(int argc, const char *argv[]) {
-    char line[200];
-    char *key, *value;
+#ifdef WIN32
+#   include <process.h>
+#else
+#   include <sys/types.h>
+#   include <sys/wait.h>
+#   include <unistd.h>
+#endif
 
-    UCMFile *ucm;
+enum {
+    MAX_JOBS=256,
+    MAX_PATH_LENGTH=1024
+};
+
+static UOption options[]={
+    UOPTION_HELP_H,
+    UOPTION_HELP_QUESTION_MARK,
+    UOPTION_DESTDIR,
+    UOPTION_DEF("jobs", 'j', UOPT_REQUIRES_ARG),
+    UOPTION_DEF("cache", 'c', UOPT_REQUIRES_ARG),
+    UOPTION_DEF("child", 0, UOPT_NO_ARG)    /* internal: one file, in this process */
+};
+
+enum {
+    OPT_HELP_H,
+    OPT_HELP_QUESTION_MARK,
+    OPT_DESTDIR,
+    OPT_JOBS,
+    OPT_CACHE,
+    OPT_CHILD
+};
+
+/* read the next line and set its number for ucm error messages */
+static char *
+readLine(UCMReader *reader, UCMFile *ucm) {
+    char *line=ucm_readLine(reader);
+    ucm->lineNumber=reader->lineNumber;
+    return line;
+}
+
+/* canonicalize the .ucm file from stdin to stdout */
+static int
+canonicalize() {
+    UCMReader reader;
+    char *line, *key, *value;
+    const char *cacheDir;
+    uint64_t hash;
+
+    UCMFile *ucm, *cached;
 
     ucm=ucm_open();
 
     /* parse the input file from stdin */
+    ucm_openReader(&reader, stdin);
+
+    /* with a cached UCMFile, the mapping lines are only skipped */
+    cacheDir= options[OPT_CACHE].doesOccur ? options[OPT_CACHE].value : NULL;
+    cached=NULL;
+    hash=0;
+    if(cacheDir!=NULL) {
+        hash=ucm_hashSource(reader.buffer, reader.length);
+        cached=ucm_openCachedFile(cacheDir, hash, reader.length);
+    }
+
     /* read and copy header */
     do {
-        if(gets(line)==NULL) {
+        if((line=readLine(&reader, ucm))==NULL) {
             fprintf(stderr, "error: no mapping section");
             return 1;
         }
@@ -50,7 +119,12 @@ main(int argc, const char *argv[]) {
     } while(ucm_parseHeaderLine(ucm, line, &key, &value) ||
             0!=strcmp(line, "CHARMAP"));
 
-    ucm_processStates(&ucm->states);
+    if(cached!=NULL) {
+        ucm_close(ucm);
+        ucm=cached;
+    } else {
+        ucm_processStates(&ucm->states);
+    }
 
     /*
      * If there is _no_ <icu:base> base table name, then parse the base table
@@ -62,7 +136,7 @@ main(int argc, const char *argv[]) {
     if(ucm->baseName[0]==0) {
         /* copy empty and comment lines before the first mapping */
         for(;;) {
-            if(gets(line)==NULL) {
+            if((line=readLine(&reader, ucm))==NULL) {
                 fprintf(stderr, "error: no mappings");
                 return 1;
             }
@@ -77,7 +151,9 @@ main(int argc, const char *argv[]) {
             /* ignore empty and comment lines */
             if(line[0]!=0 && line[0]!='#') {
                 if(0!=strcmp(line, "END CHARMAP")) {
-                    ucm_addMappingFromLine(ucm, line, TRUE);
+                    if(cached==NULL) {
+                        ucm_addMappingFromLine(ucm, line, TRUE);
+                    }
                 } else {
                     /* sort and write all mappings */
                     ucm_sortTable(ucm->base);
@@ -89,7 +165,7 @@ main(int argc, const char *argv[]) {
                 }
             }
             /* read the next line */
-            if(gets(line)==NULL) {
+            if((line=readLine(&reader, ucm))==NULL) {
                 fprintf(stderr, "incomplete charmap section\n");
                 return U_INVALID_TABLE_FORMAT;
             }
@@ -98,7 +174,7 @@ main(int argc, const char *argv[]) {
 
     /* do the same with an extension table section, ignore lines before it */
     for(;;) {
-        if(gets(line)==NULL) {
+        if((line=readLine(&reader, ucm))==NULL) {
             if(ucm->baseName[0]==0) {
                 break; /* the extension table is optional if we parsed a base table */
             } else {
@@ -107,10 +183,10 @@ main(int argc, const char *argv[]) {
             }
         }
         if(line[0]!=0 && line[0]!='#') {
-            if(strcmp(line, "CHARMAP")) {
-                /* process the extension table's charmap section, start with the line read above */
+            if(0==strcmp(line, "CHARMAP")) {
+                /* process the extension table's charmap section */
                 for(;;) {
-                    if(gets(line)==NULL) {
+                    if((line=readLine(&reader, ucm))==NULL) {
                         fprintf(stderr, "incomplete extension charmap section\n");
                         return U_INVALID_TABLE_FORMAT;
                     }
@@ -118,7 +194,9 @@ main(int argc, const char *argv[]) {
                     /* ignore empty and comment lines */
                     if(line[0]!=0 && line[0]!='#') {
                         if(0!=strcmp(line, "END CHARMAP")) {
-                            ucm_addMappingFromLine(ucm, line, FALSE);
+                            if(cached==NULL) {
+                                ucm_addMappingFromLine(ucm, line, FALSE);
+                            }
                         } else {
                             break;
                         }
@@ -139,10 +217,317 @@ main(int argc, const char *argv[]) {
         ucm_sortTable(ucm->ext);
         ucm_printTable(ucm->ext, stdout);
 
-        /* output "END CHARMAP" */
-        puts(line);
+        puts("END CHARMAP");
     }
 
+    if(cacheDir!=NULL && cached==NULL) {
+        ucm_writeCachedFile(ucm, cacheDir, hash, reader.length);
+    }
+
+    ucm_closeReader(&reader);
     ucm_close(ucm);
     return 0;
 }
+
+/* multi-file mode ---------------------------------------------------------- */
+
+/* get the output filename (destDir/basename, or inFile in place) and its temporary filename */
+static UBool
+getOutputFilenames(const char *inFile, const char *destDir,
+                   char outFile[MAX_PATH_LENGTH], char tmpFile[MAX_PATH_LENGTH]) {
+    const char *basename;
+
+    if(destDir!=NULL) {
+        basename=uprv_strrchr(inFile, U_FILE_SEP_CHAR);
+#ifdef WIN32
+        {
+            const char *slash=uprv_strrchr(inFile, '/');
+            if(slash!=NULL && (basename==NULL || slash>basename)) {
+                basename=slash;
+            }
+        }
+#endif
+        basename= basename==NULL ? inFile : basename+1;
+
+        if(uprv_strlen(destDir)+1+uprv_strlen(basename)+5>=MAX_PATH_LENGTH) {
+            return FALSE;
+        }
+        uprv_strcpy(outFile, destDir);
+        if(*destDir!=0 && outFile[uprv_strlen(outFile)-1]!=U_FILE_SEP_CHAR) {
+            uprv_strcat(outFile, U_FILE_SEP_STRING);
+        }
+        uprv_strcat(outFile, basename);
+    } else {
+        if(uprv_strlen(inFile)+5>=MAX_PATH_LENGTH) {
+            return FALSE;
+        }
+        uprv_strcpy(outFile, inFile);
+    }
+
+    uprv_strcpy(tmpFile, outFile);
+    uprv_strcat(tmpFile, ".tmp");
+    return TRUE;
+}
+
+/*
+ * Canonicalize one file in this process.
+ * Writes into a temporary file which replaces the output file only
+ * if the whole file was processed successfully.
+ * If the ucm module exit()s, then the parent removes the temporary file.
+ */
+static int
+canonicalizeFile(const char *inFile, const char *destDir) {
+    char outFile[MAX_PATH_LENGTH], tmpFile[MAX_PATH_LENGTH];
+    int result;
+
+    if(!getOutputFilenames(inFile, destDir, outFile, tmpFile)) {
+        fprintf(stderr, "canonucm: output path too long for %s\n", inFile);
+        return U_ILLEGAL_ARGUMENT_ERROR;
+    }
+    if(freopen(inFile, "r", stdin)==NULL) {
+        fprintf(stderr, "canonucm: unable to open %s\n", inFile);
+        return U_FILE_ACCESS_ERROR;
+    }
+    if(freopen(tmpFile, "w", stdout)==NULL) {
+        fprintf(stderr, "canonucm: unable to create %s\n", tmpFile);
+        return U_FILE_ACCESS_ERROR;
+    }
+
+    result=canonicalize();
+    if(fclose(stdout)!=0 && result==0) {
+        fprintf(stderr, "canonucm: error writing %s\n", tmpFile);
+        result=U_FILE_ACCESS_ERROR;
+    }
+    if(result==0) {
+        remove(outFile); /* rename() does not replace files on Windows */
+        if(rename(tmpFile, outFile)!=0) {
+            fprintf(stderr, "canonucm: unable to rename %s to %s\n", tmpFile, outFile);
+            result=U_FILE_ACCESS_ERROR;
+        }
+    }
+    if(result!=0) {
+        remove(tmpFile);
+    }
+    return result;
+}
+
+/* one file being canonicalized in a child process */
+typedef struct Job {
+#ifdef WIN32
+    intptr_t handle;
+#else
+    pid_t pid;
+    FILE *errors; /* the child's stderr, copied to ours when it is done */
+#endif
+    const char *inFile;
+} Job;
+
+/* report the result of a finished job; returns TRUE if it succeeded */
+static UBool
+finishJob(Job *job, const char *destDir, int status) {
+    char outFile[MAX_PATH_LENGTH], tmpFile[MAX_PATH_LENGTH];
+    UBool success;
+#ifdef WIN32
+    success=(UBool)(status==0);
+#else
+    char buffer[1024];
+    size_t i, start, length;
+    UBool atLineStart;
+
+    success=(UBool)(WIFEXITED(status) && WEXITSTATUS(status)==0);
+
+    /*
+     * copy the child's messages in chunks, so that long lines stay whole,
+     * and attribute each line to its file
+     */
+    rewind(job->errors);
+    atLineStart=TRUE;
+    while((length=fread(buffer, 1, sizeof(buffer), job->errors))>0) {
+        for(start=i=0; i<length; start=i) {
+            if(atLineStart) {
+                fprintf(stderr, "%s: ", job->inFile);
+            }
+            /* up to and including the next newline, or to the end of the chunk */
+            while(i<length && buffer[i++]!='\n') {}
+            fwrite(buffer+start, 1, i-start, stderr);
+            atLineStart=(UBool)(buffer[i-1]=='\n');
+        }
+    }
+    if(!atLineStart) {
+        fputc('\n', stderr);
+    }
+    fclose(job->errors);
+
+    if(WIFEXITED(status)) {
+        status=WEXITSTATUS(status);
+    }
+#endif
+
+    if(!success) {
+        fprintf(stderr, "canonucm: %s failed (%d)\n", job->inFile, status);
+
+        /* the child might have exit()ed before it could clean up */
+        if(getOutputFilenames(job->inFile, destDir, outFile, tmpFile)) {
+            remove(tmpFile);
+        }
+    }
+    return success;
+}
+
+/*
+ * Canonicalize the files with up to jobCount child processes.
+ * @return number of files that failed
+ */
+static int
+canonicalizeFiles(const char *argv0, const char *files[], int fileCount,
+                  const char *destDir, int jobCount) {
+    Job jobs[MAX_JOBS];
+    Job *job;
+    int i, j, running, failed, status;
+
+#ifndef WIN32
+    (void)argv0; /* unused: the children are fork()ed, not started from the executable */
+#endif
+    fflush(stdout);
+    fflush(stderr);
+
+    i=running=failed=0;
+    while(i<fileCount || running>0) {
+        if(i<fileCount && running<jobCount) {
+            /* start a job */
+            job=jobs+running;
+            job->inFile=files[i++];
+#ifdef WIN32
+            {
+                /* _spawnv() does not quote arguments */
+                char quotedDir[MAX_PATH_LENGTH+2], quotedFile[MAX_PATH_LENGTH+2];
+                char quotedCacheDir[MAX_PATH_LENGTH+2];
+                const char *args[8];
+                int n=0;
+
+                args[n++]=argv0;
+                args[n++]="--child";
+                if(destDir!=NULL) {
+                    sprintf(quotedDir, "\"%.*s\"", MAX_PATH_LENGTH-1, destDir);
+                    args[n++]="-d";
+                    args[n++]=quotedDir;
+                }
+                if(options[OPT_CACHE].doesOccur) {
+                    sprintf(quotedCacheDir, "\"%.*s\"", MAX_PATH_LENGTH-1, options[OPT_CACHE].value);
+                    args[n++]="-c";
+                    args[n++]=quotedCacheDir;
+                }
+                sprintf(quotedFile, "\"%.*s\"", MAX_PATH_LENGTH-1, job->inFile);
+                args[n++]=quotedFile;
+                args[n]=NULL;
+
+                job->handle=_spawnv(_P_NOWAIT, argv0, args);
+                if(job->handle==-1) {
+                    fprintf(stderr, "canonucm: unable to start a process for %s\n", job->inFile);
+                    ++failed;
+                    continue;
+                }
+            }
+#else
+            job->errors=tmpfile();
+            if(job->errors==NULL) {
+                fprintf(stderr, "canonucm: unable to create a temporary file for %s\n", job->inFile);
+                ++failed;
+                continue;
+            }
+            job->pid=fork();
+            if(job->pid==0) {
+                /* child: the ucm module may exit() */
+                dup2(fileno(job->errors), 2);
+                exit(canonicalizeFile(job->inFile, destDir));
+            } else if(job->pid<0) {
+                fprintf(stderr, "canonucm: unable to start a process for %s\n", job->inFile);
+                fclose(job->errors);
+                ++failed;
+                continue;
+            }
+#endif
+            ++running;
+        } else {
+            /* wait for a job to finish */
+#ifdef WIN32
+            /* there is no "wait for any" for _spawnv() processes, wait for the oldest one */
+            j=0;
+            if(_cwait(&status, jobs[0].handle, 0)==-1) {
+                status=-1;
+            }
+#else
+            pid_t pid=wait(&status);
+            if(pid<0) {
+                fprintf(stderr, "canonucm: wait() failed\n");
+                return failed+running+(fileCount-i);
+            }
+            for(j=0; j<running && jobs[j].pid!=pid; ++j) {}
+            if(j==running) {
+                continue; /* not one of ours */
+            }
+#endif
+            if(!finishJob(jobs+j, destDir, status)) {
+                ++failed;
+            }
+
+            /* remove the job, keeping the order of the others */
+            --running;
+            for(; j<running; ++j) {
+                jobs[j]=jobs[j+1];
+            }
+        }
+    }
+    return failed;
+}
+
+extern int
+main(int argc, const char *argv[]) {
+    const char *destDir;
+    int jobCount, failed;
+
+    argc=u_parseArgs(argc, (char **)argv, sizeof(options)/sizeof(options[0]), options);
+    if(argc<0 || options[OPT_HELP_H].doesOccur || options[OPT_HELP_QUESTION_MARK].doesOccur) {
+        fprintf(stderr,
+            "usage: %s < in.ucm > out.ucm\n"
+            "       %s [-d destdir] [-j jobs] [-c cachedir] file.ucm ...\n"
+            "\tcanonicalizes .ucm files; with file arguments, writes each\n"
+            "\tfile into destdir (default: in place), up to jobs at a time\n"
+            "options:\n"
+            "\t-h or -? or --help  this usage text\n"
+            "\t-d or --destdir     destination directory, followed by the path\n"
+            "\t-j or --jobs        number of files to process in parallel (default 1)\n"
+            "\t-c or --cache       directory for binary copies of parsed files (absolute path),\n"
+            "\t                    used instead of parsing unchanged files again\n",
+            argv[0], argv[0]);
+        return argc<0 ? U_ILLEGAL_ARGUMENT_ERROR : U_ZERO_ERROR;
+    }
+
+    if(argc==1) {
+        /* no file arguments: stdin to stdout */
+        return canonicalize();
+    }
+
+    destDir= options[OPT_DESTDIR].doesOccur ? options[OPT_DESTDIR].value : NULL;
+
+    if(options[OPT_CHILD].doesOccur) {
+        /* started by canonicalizeFiles() on Windows */
+        return canonicalizeFile(argv[1], destDir);
+    }
+
+    jobCount=1;
+    if(options[OPT_JOBS].doesOccur) {
+        jobCount=atoi(options[OPT_JOBS].value);
+        if(jobCount<1 || MAX_JOBS<jobCount) {
+            fprintf(stderr, "canonucm: the number of jobs must be 1..%d\n", MAX_JOBS);
+            return U_ILLEGAL_ARGUMENT_ERROR;
+        }
+    }
+
+    failed=canonicalizeFiles(argv[0], argv+1, argc-1, destDir, jobCount);
+    if(failed>0) {
+        fprintf(stderr, "canonucm: %d of %d files failed\n", failed, argc-1);
+        return U_INVALID_TABLE_FORMAT;
+    }
+    return 0;
+}
@@ -95,6 +95,14 @@ SOURCE=.\ucm.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\ucmcache.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\ucmext.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\ucmstate.c
 # End Source File
 # End Target
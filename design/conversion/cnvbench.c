@@ -0,0 +1,882 @@
+/*
+*******************************************************************************
+*
+*   Copyright (C) 2026, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+*
+*******************************************************************************
+*   file name:  cnvbench.c
+*   encoding:   US-ASCII
+*   tab size:   8 (not used)
+*   indentation:4
+*
+*   created on: 2026oct16
+*   created by: agent
+*
+*   This tool times two code paths of the conversion extension functions
+*   on the same data, so that an optimized path can be compared with
+*   the one that it replaces:
+*   - toUSections: toUnicode lookups of the double-byte codes of one set of
+*     mappings, in a toUTable whose trail byte sections are written dense
+*     (direct access) and in one where the same sections are written sparse
+*     (binary search)
+*   - fromUTrie: ucnv_extMatchFromURun() with a GB18030-style table
+*     where each BMP code point U+0080..U+7FFF has a four-byte mapping,
+*     written with the initial-code point trie and without it
+*     (search of the root section)
+*   - fromUSearch: ucnv_extSearchFromU() in one wide section with the scalar
+*     branch-free kernel and with the default one, which is the SSE2 or AVX2
+*     kernel where available
+*   - fromUMatchers: ucnv_extInitialMatchFromU() for simple conversion
+*     with the specialized matchers from ucnv_extOpenFromU() and with
+*     the generic one, for a table with only roundtrip mappings and
+*     for one with fallbacks
+*   - sortTable: ucm_sortTable() (radix sort) and ucm_sortTableByComparison()
+*     on the same shuffled table of 1:1 mappings
+*   - stateChain: ucm_processStates() on a chain of the maximum number of
+*     states, the worst case for summing up the state offsets
+*     (only one path; the multi-pass summing was replaced)
+*
+*   The tool writes the data itself in the ucnv_ext.h format,
+*   so that each path gets exactly the same mappings.
+*   It checks that both paths return the same results.
+*   Each path runs for at least 0.1 seconds per pass,
+*   and the best of several passes is reported.
+*/
+
+#include "unicode/utypes.h"
+#include "unicode/utf16.h"
+#include "cstring.h"
+#include "uoptions.h"
+#include "ucnv_ext.h"
+#include "ucm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+    /* toUSections: 3 of every 4 trail bytes 40..fe for each lead byte */
+    TO_U_FIRST_LEAD=0x81,
+    TO_U_LAST_LEAD=0xa0,
+    TO_U_FIRST_TRAIL=0x40,
+    TO_U_LAST_TRAIL=0xfe,
+    TO_U_LEADS=TO_U_LAST_LEAD-TO_U_FIRST_LEAD+1,
+    TO_U_TRAILS=TO_U_LAST_TRAIL-TO_U_FIRST_TRAIL+1,
+    TO_U_MAX_TABLE_LENGTH=1+TO_U_LEADS+TO_U_LEADS*(1+TO_U_TRAILS),
+
+    /* fromUTrie: U+0080..U+7FFF */
+    TRIE_START=0x80,
+    TRIE_LIMIT=0x8000,
+    TRIE_MAPPINGS=TRIE_LIMIT-TRIE_START,
+    TRIE_STAGE_1_LENGTH=TRIE_LIMIT>>UCNV_EXT_FROM_U_STAGE_1_SHIFT,
+    TRIE_STAGE_12_LENGTH=TRIE_STAGE_1_LENGTH*(1+UCNV_EXT_FROM_U_STAGE_2_MASK+1),
+    TRIE_STAGE_3_LENGTH=TRIE_LIMIT+UCNV_EXT_FROM_U_STAGE_3_MASK+1,
+
+    MATCH_CAPACITY=256,
+
+    /* fromUSearch: every other UChar from U+4E00, probed at and after each */
+    SEARCH_START=0x4e00,
+    SEARCH_LENGTH=0x4000,
+
+    /* fromUMatchers: U+4E00.., every 16th with an m:n mapping with U+0301 */
+    MATCHERS_START=0x4e00,
+    MATCHERS_MAPPINGS=0x1000,
+    MATCHERS_MAX_TABLE_LENGTH=1+MATCHERS_MAPPINGS+2*(MATCHERS_MAPPINGS/16),
+    MATCHERS_MAX_TEXT_LENGTH=MATCHERS_MAPPINGS+MATCHERS_MAPPINGS/16,
+
+    /* sortTable: U+20000.. with four-byte codes in a different order */
+    SORT_MAPPINGS=200000
+};
+
+static UOption options[]={
+    UOPTION_HELP_H,
+    UOPTION_HELP_QUESTION_MARK,
+    UOPTION_DEF("passes", 'p', UOPT_REQUIRES_ARG)
+};
+
+enum {
+    OPT_HELP_H,
+    OPT_HELP_QUESTION_MARK,
+    OPT_PASSES
+};
+
+static int32_t passes=5;
+
+/* timing ------------------------------------------------------------------- */
+
+/*
+ * One run of a code path over its data.
+ * Adds the time of the code under test to *pSeconds,
+ * sets *pCheck to a checksum of the results,
+ * and returns the number of items processed.
+ */
+typedef double
+RunFn(const void *context, uint32_t *pCheck, double *pSeconds);
+
+static double
+getSeconds() {
+    return (double)clock()/CLOCKS_PER_SEC;
+}
+
+/*
+ * Run a code path for at least 0.1 seconds per pass, print the best
+ * throughput, and return it in million items per second.
+ */
+static double
+timePath(const char *name, const char *items,
+         RunFn *run, const void *context, uint32_t *pCheck) {
+    double count, seconds, rate, bestRate;
+    int32_t pass;
+
+    bestRate=0.;
+    for(pass=0; pass<passes; ++pass) {
+        count=seconds=0.;
+        do {
+            count+=run(context, pCheck, &seconds);
+        } while(seconds<0.1);
+        rate=count/seconds/1e6;
+        if(rate>bestRate) {
+            bestRate=rate;
+        }
+    }
+    printf("  %-12s %8.3f M %s/s\n", name, bestRate, items);
+    return bestRate;
+}
+
+/* time two paths, check that they have the same results, and compare them */
+static void
+comparePaths(const char *benchmark, const char *items,
+             const char *oldName, RunFn *oldRun, const void *oldContext,
+             const char *newName, RunFn *newRun, const void *newContext) {
+    uint32_t oldCheck, newCheck;
+    double oldRate, newRate;
+
+    printf("%s:\n", benchmark);
+    oldRate=timePath(oldName, items, oldRun, oldContext, &oldCheck);
+    newRate=timePath(newName, items, newRun, newContext, &newCheck);
+    if(oldCheck!=newCheck) {
+        fprintf(stderr, "cnvbench: %s: %s and %s have different results\n",
+                benchmark, oldName, newName);
+        exit(U_INTERNAL_PROGRAM_ERROR);
+    }
+    printf("  %s/%s %.2f\n", newName, oldName, newRate/oldRate);
+}
+
+/* toUnicode sections ------------------------------------------------------- */
+
+typedef struct ToUData {
+    const uint32_t *toUTable;
+    const uint8_t *stream;
+    int32_t streamLength;
+} ToUData;
+
+static UBool
+isToUMapped(int32_t trail) {
+    return (UBool)((trail&3)!=3);
+}
+
+/*
+ * Write a toUTable with an initial section for the lead bytes and
+ * one trail byte section per lead byte, for the mappings of
+ * lead+trail to U+4E00.. in code order.
+ * Dense trail byte sections contain 0 values for the unmapped trail bytes
+ * in their range, sparse ones only the mapped trail bytes.
+ *
+ * @return length of the table
+ */
+static int32_t
+writeToUTable(uint32_t *table, UBool dense) {
+    UChar32 c;
+    int32_t lead, trail, length, count, section;
+
+    /* the initial section: lead bytes, always dense */
+    table[0]=UCNV_EXT_TO_U_MAKE_WORD(TO_U_LEADS, 0);
+    length=1+TO_U_LEADS;
+
+    c=0x4e00;
+    for(lead=TO_U_FIRST_LEAD; lead<=TO_U_LAST_LEAD; ++lead) {
+        table[1+lead-TO_U_FIRST_LEAD]=UCNV_EXT_TO_U_MAKE_WORD(lead, length);
+        section=length++;
+        count=0;
+        for(trail=TO_U_FIRST_TRAIL; trail<=TO_U_LAST_TRAIL; ++trail) {
+            if(isToUMapped(trail)) {
+                table[length++]=UCNV_EXT_TO_U_MAKE_WORD(trail,
+                    (UCNV_EXT_TO_U_MIN_CODE_POINT+c)|UCNV_EXT_TO_U_ROUNDTRIP_FLAG);
+                ++c;
+            } else if(dense) {
+                table[length++]=UCNV_EXT_TO_U_MAKE_WORD(trail, 0);
+            } else {
+                continue;
+            }
+            ++count;
+        }
+        table[section]=UCNV_EXT_TO_U_MAKE_WORD(count, 0);
+    }
+    return length;
+}
+
+/* look up each double-byte code of the stream in the lead and trail byte sections */
+static double
+lookUpToU(const void *context, uint32_t *pCheck, double *pSeconds) {
+    const ToUData *data=(const ToUData *)context;
+    const uint32_t *toUTable=data->toUTable, *toUSection;
+    const uint8_t *s, *limit;
+    uint32_t value, check;
+    double start;
+
+    check=0;
+    start=getSeconds();
+    for(s=data->stream, limit=s+data->streamLength; s<limit; s+=2) {
+        value=ucnv_extSearchToU(toUTable+1, (int32_t)UCNV_EXT_TO_U_GET_BYTE(toUTable[0]), s[0]);
+        toUSection=toUTable+UCNV_EXT_TO_U_GET_PARTIAL_INDEX(value);
+        value=ucnv_extSearchToU(toUSection+1, (int32_t)UCNV_EXT_TO_U_GET_BYTE(toUSection[0]), s[1]);
+        check=check*31+value;
+    }
+    *pSeconds+=getSeconds()-start;
+    *pCheck=check;
+    return data->streamLength/2;
+}
+
+static void
+benchToUSections() {
+    static uint32_t denseTable[TO_U_MAX_TABLE_LENGTH], sparseTable[TO_U_MAX_TABLE_LENGTH];
+    static uint8_t stream[2*TO_U_LEADS*TO_U_TRAILS];
+    ToUData dense, sparse;
+    uint32_t random;
+    int32_t i, j, lead, trail, length;
+    uint8_t b;
+
+    writeToUTable(denseTable, TRUE);
+    writeToUTable(sparseTable, FALSE);
+
+    /* all mapped codes, in a fixed random order */
+    length=0;
+    for(lead=TO_U_FIRST_LEAD; lead<=TO_U_LAST_LEAD; ++lead) {
+        for(trail=TO_U_FIRST_TRAIL; trail<=TO_U_LAST_TRAIL; ++trail) {
+            if(isToUMapped(trail)) {
+                stream[length++]=(uint8_t)lead;
+                stream[length++]=(uint8_t)trail;
+            }
+        }
+    }
+    random=1;
+    for(i=length/2-1; i>0; --i) {
+        random=random*1103515245+12345;
+        j=(int32_t)((random>>8)%(uint32_t)(i+1));
+        b=stream[2*i];
+        stream[2*i]=stream[2*j];
+        stream[2*j]=b;
+        b=stream[2*i+1];
+        stream[2*i+1]=stream[2*j+1];
+        stream[2*j+1]=b;
+    }
+
+    dense.toUTable=denseTable;
+    sparse.toUTable=sparseTable;
+    dense.stream=sparse.stream=stream;
+    dense.streamLength=sparse.streamLength=length;
+    comparePaths("toUSections", "codes",
+                 "sparse", lookUpToU, &sparse,
+                 "dense", lookUpToU, &dense);
+}
+
+/* fromUnicode data ---------------------------------------------------------- */
+
+/* the fromUnicode arrays of an extension data block; NULL stage12 for no trie */
+typedef struct FromUArrays {
+    const UChar *uchars;
+    const uint32_t *values;
+    int32_t length;
+    const char *bytes;
+    int32_t bytesLength;
+    const uint16_t *stage12;
+    int32_t stage1Length, stage12Length;
+    const uint32_t *stage3;
+    int32_t stage3Length;
+} FromUArrays;
+
+/* copy an array to the data block, 4-aligned; @return its index in units of size */
+static int32_t
+appendArray(int32_t *cx, int32_t *pOffset, const void *array, int32_t length, int32_t size) {
+    int32_t offset;
+
+    offset=*pOffset;
+    uprv_memcpy((char *)cx+offset, array, length*size);
+    *pOffset=(offset+length*size+3)&~3;
+    return offset/size;
+}
+
+/* write an extension data block (see ucnv_ext.h) with only fromUnicode data */
+static int32_t *
+writeFromUData(const FromUArrays *arrays) {
+    int32_t *cx;
+    int32_t size, offset;
+
+    size=UCNV_EXT_INDEXES_MIN_LENGTH*4+
+         arrays->length*6+arrays->bytesLength+arrays->stage12Length*2+arrays->stage3Length*4+16;
+    cx=(int32_t *)malloc(size);
+    if(cx==NULL) {
+        fprintf(stderr, "cnvbench: unable to allocate %ld bytes of extension data\n", (long)size);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    uprv_memset(cx, 0, size);
+    cx[UCNV_EXT_INDEXES_LENGTH]=UCNV_EXT_INDEXES_MIN_LENGTH;
+    offset=UCNV_EXT_INDEXES_MIN_LENGTH*4;
+
+    cx[UCNV_EXT_FROM_U_UCHARS_INDEX]=appendArray(cx, &offset, arrays->uchars, arrays->length, 2);
+    cx[UCNV_EXT_FROM_U_VALUES_INDEX]=appendArray(cx, &offset, arrays->values, arrays->length, 4);
+    cx[UCNV_EXT_FROM_U_LENGTH]=arrays->length;
+    cx[UCNV_EXT_FROM_U_BYTES_INDEX]=appendArray(cx, &offset, arrays->bytes, arrays->bytesLength, 1);
+    cx[UCNV_EXT_FROM_U_BYTES_LENGTH]=arrays->bytesLength;
+
+    if(arrays->stage12!=NULL) {
+        cx[UCNV_EXT_FROM_U_STAGE_12_INDEX]=appendArray(cx, &offset, arrays->stage12, arrays->stage12Length, 2);
+        cx[UCNV_EXT_FROM_U_STAGE_1_LENGTH]=arrays->stage1Length;
+        cx[UCNV_EXT_FROM_U_STAGE_12_LENGTH]=arrays->stage12Length;
+        cx[UCNV_EXT_FROM_U_STAGE_3_INDEX]=appendArray(cx, &offset, arrays->stage3, arrays->stage3Length, 4);
+        cx[UCNV_EXT_FROM_U_STAGE_3_LENGTH]=arrays->stage3Length;
+    }
+
+    cx[UCNV_EXT_SIZE]=offset;
+    return cx;
+}
+
+typedef struct FromUData {
+    const int32_t *cx;
+    const UChar *text;
+    int32_t textLength;
+} FromUData;
+
+static uint32_t
+checkResult(uint32_t check, const UCNVExtMatch *match) {
+    int32_t i;
+
+    check=check*31+(uint32_t)match->resultLength;
+    for(i=0; i<match->resultLength; ++i) {
+        check=check*31+(uint8_t)match->result[i];
+    }
+    return check;
+}
+
+/* match the whole text with ucnv_extMatchFromURun() */
+static double
+matchFromURun(const void *context, uint32_t *pCheck, double *pSeconds) {
+    const FromUData *data=(const FromUData *)context;
+    UCNVExtMatch matches[MATCH_CAPACITY];
+    uint32_t check;
+    double start;
+    int32_t i, j, count, consumed;
+
+    check=0;
+    start=getSeconds();
+    for(i=0; i<data->textLength; i+=consumed) {
+        count=ucnv_extMatchFromURun(NULL, data->cx, data->text+i, data->textLength-i,
+                                    matches, MATCH_CAPACITY, &consumed,
+                                    FALSE, TRUE);
+        for(j=0; j<count; ++j) {
+            check=checkResult(check, matches+j);
+        }
+        if(consumed==0) {
+            break;
+        }
+    }
+    *pSeconds+=getSeconds()-start;
+    *pCheck=check;
+    return data->textLength;
+}
+
+/*
+ * U+0080..U+7FFF map to consecutive four-byte sequences 81 30 81 30..,
+ * like in GB18030; the results are in fromUBytes[].
+ * With the trie, each code point is found with one trie lookup;
+ * without it, with a search of the one large root section.
+ */
+static void
+benchFromUTrie() {
+    static UChar uchars[1+TRIE_MAPPINGS], text[TRIE_MAPPINGS];
+    static uint32_t values[1+TRIE_MAPPINGS], stage3[TRIE_STAGE_3_LENGTH];
+    static uint16_t stage12[TRIE_STAGE_12_LENGTH];
+    static char bytes[4*TRIE_MAPPINGS];
+    FromUArrays arrays;
+    FromUData trie, sections;
+    uint32_t value, random;
+    int32_t i, j, n, stage2, block;
+    UChar c;
+
+    /* mappings and text */
+    for(n=0; n<TRIE_MAPPINGS; ++n) {
+        bytes[4*n]=(char)(0x81+n/12600);
+        bytes[4*n+1]=(char)(0x30+(n/1260)%10);
+        bytes[4*n+2]=(char)(0x81+(n/10)%126);
+        bytes[4*n+3]=(char)(0x30+n%10);
+        text[n]=(UChar)(TRIE_START+n);
+    }
+    random=1;
+    for(i=TRIE_MAPPINGS-1; i>0; --i) {
+        random=random*1103515245+12345;
+        j=(int32_t)((random>>8)%(uint32_t)(i+1));
+        c=text[i];
+        text[i]=text[j];
+        text[j]=c;
+    }
+
+    /* without the trie: one root section with all initial code points */
+    uchars[0]=(UChar)TRIE_MAPPINGS;
+    values[0]=0;
+    for(n=0; n<TRIE_MAPPINGS; ++n) {
+        uchars[1+n]=(UChar)(TRIE_START+n);
+        values[1+n]=UCNV_EXT_FROM_U_ROUNDTRIP_FLAG|((uint32_t)4<<UCNV_EXT_FROM_U_LENGTH_SHIFT)|(4*n);
+    }
+    uprv_memset(&arrays, 0, sizeof(arrays));
+    arrays.uchars=uchars;
+    arrays.values=values;
+    arrays.length=1+TRIE_MAPPINGS;
+    arrays.bytes=bytes;
+    arrays.bytesLength=4*TRIE_MAPPINGS;
+    sections.cx=writeFromUData(&arrays);
+
+    /*
+     * with the trie: stage 3 block 0 stays all-0 for U+0000..U+007F,
+     * and the fromUTable only has its reserved row 0
+     */
+    uprv_memset(stage3, 0, sizeof(stage3));
+    block=UCNV_EXT_FROM_U_STAGE_3_MASK+1;
+    for(i=0; i<TRIE_STAGE_1_LENGTH; ++i) {
+        stage2=TRIE_STAGE_1_LENGTH+i*(UCNV_EXT_FROM_U_STAGE_2_MASK+1);
+        stage12[i]=(uint16_t)stage2;
+        for(j=0; j<=UCNV_EXT_FROM_U_STAGE_2_MASK; ++j) {
+            c=(UChar)((i<<UCNV_EXT_FROM_U_STAGE_1_SHIFT)|(j<<UCNV_EXT_FROM_U_STAGE_2_SHIFT));
+            if(c<TRIE_START) {
+                stage12[stage2+j]=0;
+            } else {
+                stage12[stage2+j]=(uint16_t)block;
+                block+=UCNV_EXT_FROM_U_STAGE_3_MASK+1;
+            }
+        }
+    }
+    for(n=0; n<TRIE_MAPPINGS; ++n) {
+        c=(UChar)(TRIE_START+n);
+        value=values[1+n];
+        stage3[stage12[stage12[c>>UCNV_EXT_FROM_U_STAGE_1_SHIFT]+
+                        ((c>>UCNV_EXT_FROM_U_STAGE_2_SHIFT)&UCNV_EXT_FROM_U_STAGE_2_MASK)]+
+               (c&UCNV_EXT_FROM_U_STAGE_3_MASK)]=value;
+    }
+    uchars[0]=0;
+    values[0]=0;
+    arrays.length=1;
+    arrays.stage12=stage12;
+    arrays.stage1Length=TRIE_STAGE_1_LENGTH;
+    arrays.stage12Length=TRIE_STAGE_12_LENGTH;
+    arrays.stage3=stage3;
+    arrays.stage3Length=block;
+    trie.cx=writeFromUData(&arrays);
+
+    trie.text=sections.text=text;
+    trie.textLength=sections.textLength=TRIE_MAPPINGS;
+    comparePaths("fromUTrie", "chars",
+                 "sections", matchFromURun, &sections,
+                 "trie", matchFromURun, &trie);
+
+    free((void *)sections.cx);
+    free((void *)trie.cx);
+}
+
+/* wide fromUTable section search ------------------------------------------ */
+
+typedef struct SearchData {
+    const UChar *section, *probes;
+    int32_t search;
+} SearchData;
+
+static double
+searchSection(const void *context, uint32_t *pCheck, double *pSeconds) {
+    const SearchData *data=(const SearchData *)context;
+    uint32_t check;
+    double start;
+    int32_t i;
+
+    check=0;
+    start=getSeconds();
+    for(i=0; i<2*SEARCH_LENGTH; ++i) {
+        check=check*31+(uint32_t)ucnv_extSearchFromU(data->section, SEARCH_LENGTH, data->probes[i], data->search);
+    }
+    *pSeconds+=getSeconds()-start;
+    *pCheck=check;
+    return 2*SEARCH_LENGTH;
+}
+
+static void
+benchFromUSearch() {
+    static UChar section[SEARCH_LENGTH], probes[2*SEARCH_LENGTH];
+    SearchData wide, best;
+    uint32_t random;
+    int32_t i, j;
+    UChar c;
+
+    /* half of the probes are found, half are between two UChars */
+    for(i=0; i<SEARCH_LENGTH; ++i) {
+        section[i]=(UChar)(SEARCH_START+2*i);
+        probes[2*i]=section[i];
+        probes[2*i+1]=(UChar)(section[i]+1);
+    }
+    random=1;
+    for(i=2*SEARCH_LENGTH-1; i>0; --i) {
+        random=random*1103515245+12345;
+        j=(int32_t)((random>>8)%(uint32_t)(i+1));
+        c=probes[i];
+        probes[i]=probes[j];
+        probes[j]=c;
+    }
+
+    wide.section=best.section=section;
+    wide.probes=best.probes=probes;
+    wide.search=UCNV_EXT_FROM_U_SEARCH_WIDE;
+    best.search=UCNV_EXT_FROM_U_SEARCH_DEFAULT;
+    printf("fromUSearch: the default kernel is %s\n",
+           ucnv_extHasFromUSearch(UCNV_EXT_FROM_U_SEARCH_AVX2) ? "AVX2" :
+               ucnv_extHasFromUSearch(UCNV_EXT_FROM_U_SEARCH_SSE2) ? "SSE2" : "scalar");
+    comparePaths("fromUSearch", "searches",
+                 "scalar", searchSection, &wide,
+                 "default", searchSection, &best);
+}
+
+typedef struct MatcherData {
+    const int32_t *cx;
+    UConverterExt *ext;
+    const UChar *text;
+    int32_t textLength;
+} MatcherData;
+
+/* match each code point like simple, single-character conversion does */
+static double
+matchFromUSimple(const void *context, uint32_t *pCheck, double *pSeconds) {
+    const MatcherData *data=(const MatcherData *)context;
+    const UChar *s, *limit;
+    UErrorCode errorCode;
+    uint32_t value, check;
+    int32_t length;
+    double start;
+    UChar32 c;
+
+    check=0;
+    start=getSeconds();
+    for(s=data->text, limit=s+data->textLength; s<limit;) {
+        c=*s++;
+        value=0;
+        length=0;
+        errorCode=U_ZERO_ERROR;
+        ucnv_extInitialMatchFromU(NULL, data->ext, data->cx, c, &s, limit,
+                                  NULL, NULL, NULL, 0,
+                                  &value, &length,
+                                  FALSE, TRUE, &errorCode);
+        check=check*31+value+(uint32_t)length+(uint32_t)errorCode;
+    }
+    *pSeconds+=getSeconds()-start;
+    *pCheck=check;
+    return data->textLength;
+}
+
+/*
+ * U+4E00.. map to two-byte codes in one root section. Every 16th code point
+ * also starts an m:n mapping with U+0301, in a child section, and
+ * half of those are followed by U+0301 in the text.
+ * With fallbacks, every 8th code point has a fallback mapping instead,
+ * which is not used because the matching does not use fallbacks.
+ */
+static void
+benchFromUMatchersForTable(const char *benchmark, UBool withFallbacks) {
+    static UChar uchars[MATCHERS_MAX_TABLE_LENGTH], text[MATCHERS_MAX_TEXT_LENGTH];
+    static uint32_t values[MATCHERS_MAX_TABLE_LENGTH];
+    static int32_t order[MATCHERS_MAPPINGS];
+    UConverterExt ext;
+    FromUArrays arrays;
+    MatcherData specialized, generic;
+    uint32_t value, random;
+    int32_t i, j, k, length, textLength;
+    char byte;
+
+    /* root section, then the child sections */
+    uchars[0]=(UChar)MATCHERS_MAPPINGS;
+    values[0]=0;
+    length=1+MATCHERS_MAPPINGS;
+    for(k=0; k<MATCHERS_MAPPINGS; ++k) {
+        value=((uint32_t)2<<UCNV_EXT_FROM_U_LENGTH_SHIFT)|(uint32_t)(0x8140+k);
+        if(!withFallbacks || (k&7)!=0) {
+            value|=UCNV_EXT_FROM_U_ROUNDTRIP_FLAG;
+        }
+        uchars[1+k]=(UChar)(MATCHERS_START+k);
+        if((k&15)!=5) {
+            values[1+k]=value;
+        } else {
+            values[1+k]=(uint32_t)length;
+            uchars[length]=1;
+            values[length]=value;
+            uchars[length+1]=0x301;
+            values[length+1]=UCNV_EXT_FROM_U_ROUNDTRIP_FLAG|
+                             ((uint32_t)3<<UCNV_EXT_FROM_U_LENGTH_SHIFT)|(uint32_t)(0x8f0000+k);
+            length+=2;
+        }
+    }
+    byte=0;
+    uprv_memset(&arrays, 0, sizeof(arrays));
+    arrays.uchars=uchars;
+    arrays.values=values;
+    arrays.length=length;
+    arrays.bytes=&byte;
+    arrays.bytesLength=0;
+    specialized.cx=generic.cx=writeFromUData(&arrays);
+
+    /* all code points in a fixed random order */
+    for(k=0; k<MATCHERS_MAPPINGS; ++k) {
+        order[k]=k;
+    }
+    random=1;
+    for(i=MATCHERS_MAPPINGS-1; i>0; --i) {
+        random=random*1103515245+12345;
+        j=(int32_t)((random>>8)%(uint32_t)(i+1));
+        k=order[i];
+        order[i]=order[j];
+        order[j]=k;
+    }
+    textLength=0;
+    for(i=0; i<MATCHERS_MAPPINGS; ++i) {
+        k=order[i];
+        text[textLength++]=(UChar)(MATCHERS_START+k);
+        if((k&31)==5) {
+            text[textLength++]=0x301;
+        }
+    }
+    specialized.text=generic.text=text;
+    specialized.textLength=generic.textLength=textLength;
+
+    uprv_memset(&ext, 0, sizeof(ext));
+    ucnv_extOpenFromU(&ext, specialized.cx);
+    specialized.ext=&ext;
+    generic.ext=NULL;
+
+    comparePaths(benchmark, "chars",
+                 "generic", matchFromUSimple, &generic,
+                 "specialized", matchFromUSimple, &specialized);
+
+    free((void *)specialized.cx);
+}
+
+static void
+benchFromUMatchers() {
+    benchFromUMatchersForTable("fromUMatchers (roundtrip)", FALSE);
+    benchFromUMatchersForTable("fromUMatchers (fallbacks)", TRUE);
+}
+
+/* table sorting ------------------------------------------------------------ */
+
+typedef void SortFn(UCMTable *t);
+
+typedef struct SortData {
+    UCMTable *table;
+    const UCMapping *mappings;
+    SortFn *sort;
+} SortData;
+
+/* sort a fresh copy of the unsorted mappings */
+static double
+sortMappings(const void *context, uint32_t *pCheck, double *pSeconds) {
+    const SortData *data=(const SortData *)context;
+    UCMTable *t=data->table;
+    uint32_t check;
+    double start;
+    int32_t i;
+
+    uprv_memcpy(t->mappings, data->mappings, t->mappingsLength*sizeof(UCMapping));
+    start=getSeconds();
+    data->sort(t);
+    *pSeconds+=getSeconds()-start;
+
+    check=0;
+    for(i=0; i<t->mappingsLength; ++i) {
+        check=check*31+(uint32_t)t->mappings[i].u;
+        check=check*31+(uint32_t)t->reverseMap[i];
+    }
+    *pCheck=check;
+    return t->mappingsLength;
+}
+
+static void
+benchSortTable() {
+    UChar32 codePoints[UCNV_EXT_MAX_LENGTH];
+    uint8_t bytes[UCNV_EXT_MAX_LENGTH];
+    UCMapping m={ 0 };
+    UCMTable *table;
+    UCMapping *mappings, temp;
+    SortData radix, comparison;
+    uint32_t random;
+    int32_t i, j, length;
+
+    /*
+     * The i-th code point maps to the j-th four-byte code (GB18030-style)
+     * with j=i*7919 mod SORT_MAPPINGS, so that the two sort orders differ.
+     */
+    table=ucm_openTable();
+    for(i=0; i<SORT_MAPPINGS; ++i) {
+        j=(int32_t)(((int64_t)i*7919)%SORT_MAPPINGS);
+        codePoints[0]=m.u=0x20000+i;
+        bytes[0]=(uint8_t)(0x81+j/12600);
+        bytes[1]=(uint8_t)(0x30+(j/1260)%10);
+        bytes[2]=(uint8_t)(0x81+(j/10)%126);
+        bytes[3]=(uint8_t)(0x30+j%10);
+        m.uLen=1;
+        m.bLen=4;
+        m.f=(int8_t)(i%5==0 ? 1 : 0);
+        ucm_addMapping(table, &m, codePoints, bytes);
+    }
+
+    /* shuffle the mappings into a fixed random order */
+    length=table->mappingsLength;
+    random=1;
+    for(i=length-1; i>0; --i) {
+        random=random*1103515245+12345;
+        j=(int32_t)((random>>8)%(uint32_t)(i+1));
+        temp=table->mappings[i];
+        table->mappings[i]=table->mappings[j];
+        table->mappings[j]=temp;
+    }
+    mappings=(UCMapping *)malloc(length*sizeof(UCMapping));
+    if(mappings==NULL) {
+        fprintf(stderr, "cnvbench: unable to allocate %ld mappings\n", (long)length);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    uprv_memcpy(mappings, table->mappings, length*sizeof(UCMapping));
+
+    radix.table=comparison.table=table;
+    radix.mappings=comparison.mappings=mappings;
+    radix.sort=ucm_sortTable;
+    comparison.sort=ucm_sortTableByComparison;
+    comparePaths("sortTable", "mappings",
+                 "comparison", sortMappings, &comparison,
+                 "radix", sortMappings, &radix);
+
+    free(mappings);
+    ucm_closeTable(table);
+}
+
+/* state tables ------------------------------------------------------------- */
+
+/*
+ * Open a charset with the maximum number of states in a chain
+ * 0 -> 127 -> 126 -> ... -> 1, against the state order:
+ * each state has single bytes 00..7f and continues with 80..ff
+ * in the next state, and state 1 is final.
+ */
+static UCMFile *
+openStateChain() {
+    static const char *const header[]={
+        "<code_set_name> \"chain\"",
+        "<mb_cur_max> 4",
+        "<mb_cur_min> 1",
+        "<uconv_class> \"MBCS\""
+    };
+    char line[100];
+    char *key, *value;
+    UCMFile *ucm;
+    int32_t i;
+
+    ucm=ucm_open();
+    for(i=0; i<(int32_t)(sizeof(header)/sizeof(header[0])); ++i) {
+        strcpy(line, header[i]);
+        ucm_parseHeaderLine(ucm, line, &key, &value);
+    }
+    sprintf(line, "0-7f, 80-ff:%lx", (long)(MBCS_MAX_STATE_COUNT-1));
+    ucm_addState(&ucm->states, line);
+    ucm_addState(&ucm->states, "0-ff");
+    for(i=2; i<MBCS_MAX_STATE_COUNT; ++i) {
+        sprintf(line, "0-7f, 80-ff:%lx", (long)(i-1));
+        ucm_addState(&ucm->states, line);
+    }
+    return ucm;
+}
+
+/* process the states of a fresh copy of the chain */
+static double
+processStateChain(const void *context, uint32_t *pCheck, double *pSeconds) {
+    UCMFile *ucm;
+    double start;
+
+    ucm=openStateChain();
+    start=getSeconds();
+    ucm_processStates(&ucm->states);
+    *pSeconds+=getSeconds()-start;
+    *pCheck=(uint32_t)ucm->states.countToUCodeUnits;
+    ucm_close(ucm);
+    return MBCS_MAX_STATE_COUNT;
+}
+
+static void
+benchStateChain() {
+    uint32_t check;
+
+    printf("stateChain:\n");
+    timePath("states", "states", processStateChain, NULL, &check);
+}
+
+/* tool --------------------------------------------------------------------- */
+
+typedef struct Benchmark {
+    const char *name;
+    void (*bench)(void);
+} Benchmark;
+
+static const Benchmark benchmarks[]={
+    { "toUSections", benchToUSections },
+    { "fromUTrie", benchFromUTrie },
+    { "fromUSearch", benchFromUSearch },
+    { "fromUMatchers", benchFromUMatchers },
+    { "sortTable", benchSortTable },
+    { "stateChain", benchStateChain }
+};
+
+extern int
+main(int argc, const char *argv[]) {
+    int32_t i, j, count;
+
+    argc=u_parseArgs(argc, (char **)argv, sizeof(options)/sizeof(options[0]), options);
+    if(argc<0 || options[OPT_HELP_H].doesOccur || options[OPT_HELP_QUESTION_MARK].doesOccur) {
+        fprintf(stderr,
+            "usage: %s [-p passes] [benchmark...]\n"
+            "\ttimes alternative code paths of the conversion extension\n"
+            "\tfunctions on the same data; runs all benchmarks by default\n"
+            "options:\n"
+            "\t-h or -? or --help  this usage text\n"
+            "\t-p or --passes      number of passes per path (default: 5),\n"
+            "\t                    the best one is reported\n"
+            "benchmarks:\n",
+            argv[0]);
+        for(i=0; i<(int32_t)(sizeof(benchmarks)/sizeof(benchmarks[0])); ++i) {
+            fprintf(stderr, "\t%s\n", benchmarks[i].name);
+        }
+        return argc<0 ? U_ILLEGAL_ARGUMENT_ERROR : U_ZERO_ERROR;
+    }
+
+    if(options[OPT_PASSES].doesOccur) {
+        passes=atoi(options[OPT_PASSES].value);
+        if(passes<1) {
+            passes=1;
+        }
+    }
+
+    count=(int32_t)(sizeof(benchmarks)/sizeof(benchmarks[0]));
+    if(argc==1) {
+        for(i=0; i<count; ++i) {
+            benchmarks[i].bench();
+        }
+    } else {
+        for(j=1; j<argc; ++j) {
+            for(i=0; i<count && 0!=uprv_strcmp(argv[j], benchmarks[i].name); ++i) {}
+            if(i==count) {
+                fprintf(stderr, "cnvbench: unknown benchmark %s\n", argv[j]);
+                return U_ILLEGAL_ARGUMENT_ERROR;
+            }
+            benchmarks[i].bench();
+        }
+    }
+    return 0;
+}
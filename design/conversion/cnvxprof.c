@@ -0,0 +1,838 @@
+/*
+*******************************************************************************
+*
+*   Copyright (C) 2026, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+*
+*******************************************************************************
+*   file name:  cnvxprof.c
+*   encoding:   US-ASCII
+*   tab size:   8 (not used)
+*   indentation:4
+*
+*   created on: 2026oct16
+*   created by: agent
+*
+*   This tool loads conversion extension data files (.cnvx, see ucnv_ext.h
+*   and ucm_writeExtData()) and reports where their size and lookup time go:
+*   - the sizes of all arrays
+*   - a histogram of the toUTable and fromUTable section lengths
+*   - for every mapping entry, the number of section entries that the
+*     runtime search (ucnv_extFindToU(), ucnv_extFindFromU()) reads
+*     to find it, and the number of cache lines touched by that lookup,
+*     as an average and maximum
+*
+*   With --replay text.txt, it also converts the UTF-8 sample text
+*   to the charset and back with the extension data and reports
+*   the actual number of section lookups per character, the cache lines
+*   per lookup, and the time per character and per lookup of the runtime
+*   matchers.
+*
+*   The search models below mirror the runtime functions in ucnv_ext.c
+*   and must be kept in sync with them.
+*/
+
+#include "unicode/utypes.h"
+#include "unicode/utf16.h"
+#include "unicode/ustring.h"
+#include "unicode/udata.h"
+#include "cstring.h"
+#include "uoptions.h"
+#include "ucnv_ext.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum {
+    CACHE_LINE_SIZE=64,
+
+    /* at most this many cache lines per lookup are distinguished */
+    MAX_LINES=64,
+
+    /* histogram buckets for section lengths 1, 2, 3..4, 5..8, .. 32769..65536 */
+    HISTOGRAM_LENGTH=17,
+
+    MAX_PATH_LENGTH=1024,
+
+    /* number of matches per ucnv_extMatchFromURun() call in the replay */
+    MATCH_CAPACITY=1024
+};
+
+static UOption options[]={
+    UOPTION_HELP_H,
+    UOPTION_HELP_QUESTION_MARK,
+    UOPTION_DEF("replay", 'r', UOPT_REQUIRES_ARG)
+};
+
+enum {
+    OPT_HELP_H,
+    OPT_HELP_QUESTION_MARK,
+    OPT_REPLAY
+};
+
+/* lookup cost accounting --------------------------------------------------- */
+
+/* cache lines touched by one lookup */
+typedef struct Lines {
+    size_t lines[MAX_LINES];
+    int32_t count;
+} Lines;
+
+static void
+touch(Lines *lines, const void *p) {
+    size_t line;
+    int32_t i;
+
+    line=(size_t)p/CACHE_LINE_SIZE;
+    for(i=0; i<lines->count; ++i) {
+        if(lines->lines[i]==line) {
+            return;
+        }
+    }
+    if(lines->count<MAX_LINES) {
+        lines->lines[lines->count++]=line;
+    }
+}
+
+/* sums over lookups */
+typedef struct Cost {
+    double lookups, probes, lines;
+    int32_t maxProbes, maxLines;
+} Cost;
+
+static void
+addLookup(Cost *cost, int32_t probes, const Lines *lines) {
+    cost->lookups+=1.;
+    cost->probes+=probes;
+    cost->lines+=lines->count;
+    if(probes>cost->maxProbes) {
+        cost->maxProbes=probes;
+    }
+    if(lines->count>cost->maxLines) {
+        cost->maxLines=lines->count;
+    }
+}
+
+static void
+printCost(const char *what, const Cost *cost) {
+    if(cost->lookups==0.) {
+        return;
+    }
+    printf("    %s: %.0f lookups\n"
+           "        entries read per lookup: average %.2f, maximum %ld\n"
+           "        cache lines per lookup:  average %.2f, maximum %ld\n",
+           what, cost->lookups,
+           cost->probes/cost->lookups, (long)cost->maxProbes,
+           cost->lines/cost->lookups, (long)cost->maxLines);
+}
+
+/* section length histogram ------------------------------------------------- */
+
+static void
+addLength(int32_t histogram[HISTOGRAM_LENGTH], int32_t length) {
+    int32_t i;
+
+    /* bucket i has lengths 2^(i-1)+1..2^i */
+    for(i=0; i<HISTOGRAM_LENGTH-1 && (1<<i)<length; ++i) {}
+    ++histogram[i];
+}
+
+static void
+printHistogram(const int32_t histogram[HISTOGRAM_LENGTH]) {
+    int32_t i, low, high;
+
+    printf("    section lengths:\n");
+    for(i=0; i<HISTOGRAM_LENGTH; ++i) {
+        if(histogram[i]>0) {
+            low= i==0 ? 0 : (1<<(i-1))+1;
+            high=1<<i;
+            printf("        %5ld..%5ld: %ld\n", (long)low, (long)high, (long)histogram[i]);
+        }
+    }
+}
+
+/* search models ------------------------------------------------------------ */
+
+/* same search as ucnv_extFindToU(), counting the words read */
+static uint32_t
+findToU(const uint32_t *toUSection, int32_t length, uint8_t byte,
+        Lines *lines, int32_t *pProbes) {
+    uint32_t word0, word;
+    int32_t i, start, limit, probes;
+
+    touch(lines, toUSection);
+    touch(lines, toUSection+length-1);
+    probes=2;
+
+    start=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUSection[0]);
+    limit=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUSection[length-1]);
+    if(byte<start || limit<byte) {
+        *pProbes=probes;
+        return 0;
+    }
+
+    if(UCNV_EXT_TO_U_IS_DENSE(start, limit, length)) {
+        touch(lines, toUSection+(byte-start));
+        *pProbes=probes+1;
+        return UCNV_EXT_TO_U_GET_VALUE(toUSection[byte-start]);
+    }
+
+    word0=UCNV_EXT_TO_U_MAKE_WORD(byte, 0);
+    word=word0|UCNV_EXT_TO_U_VALUE_MASK;
+
+    start=0;
+    limit=length;
+    for(;;) {
+        i=limit-start;
+        if(i<=1) {
+            break;
+        }
+
+        if(i<=4) {
+            /* linear search, reads up to 3 words */
+            for(i=0; i<3; ++i) {
+                touch(lines, toUSection+start);
+                ++probes;
+                if(word0<=toUSection[start] || ++start>=limit) {
+                    break;
+                }
+            }
+            break;
+        }
+
+        i=(start+limit)/2;
+        touch(lines, toUSection+i);
+        ++probes;
+        if(word<toUSection[i]) {
+            limit=i;
+        } else {
+            start=i;
+        }
+    }
+
+    if(start<limit) {
+        touch(lines, toUSection+start);
+        ++probes;
+        if(byte==UCNV_EXT_TO_U_GET_BYTE(toUSection[start])) {
+            *pProbes=probes;
+            return UCNV_EXT_TO_U_GET_VALUE(toUSection[start]);
+        }
+    }
+    *pProbes=probes;
+    return 0;
+}
+
+/* same search as ucnv_extFindFromU() and ucnv_extFindFromUWide() */
+static int32_t
+findFromU(const UChar *fromUSection, int32_t length, UChar u,
+          Lines *lines, int32_t *pProbes) {
+    const UChar *base;
+    int32_t i, start, limit, half, probes;
+
+    probes=0;
+    if(length>=UCNV_EXT_FROM_U_WIDE_SECTION_LENGTH) {
+        base=fromUSection;
+        while(length>1) {
+            half=length>>1;
+            touch(lines, base+half);
+            ++probes;
+            base= base[half]<=u ? base+half : base;
+            length-=half;
+        }
+        touch(lines, base);
+        *pProbes=probes+1;
+        return u==*base ? (int32_t)(base-fromUSection) : -1;
+    }
+
+    start=0;
+    limit=length;
+    for(;;) {
+        i=limit-start;
+        if(i<=1) {
+            break;
+        }
+
+        if(i<=4) {
+            for(i=0; i<3; ++i) {
+                touch(lines, fromUSection+start);
+                ++probes;
+                if(u<=fromUSection[start] || ++start>=limit) {
+                    break;
+                }
+            }
+            break;
+        }
+
+        i=(start+limit)/2;
+        touch(lines, fromUSection+i);
+        ++probes;
+        if(u<fromUSection[i]) {
+            limit=i;
+        } else {
+            start=i;
+        }
+    }
+
+    *pProbes=probes;
+    if(start<limit) {
+        touch(lines, fromUSection+start);
+        *pProbes=probes+1;
+        if(u==fromUSection[start]) {
+            return start;
+        }
+    }
+    return -1;
+}
+
+/* trie lookup like UCNV_EXT_FROM_U(), for a code point below the stage 1 limit */
+static uint32_t
+findTrie(const int32_t *cx, UChar32 c, Lines *lines) {
+    const uint16_t *stage12;
+    const uint32_t *stage3;
+    int32_t i1, i2;
+
+    stage12=(const uint16_t *)cx+cx[UCNV_EXT_FROM_U_STAGE_12_INDEX];
+    stage3=(const uint32_t *)cx+cx[UCNV_EXT_FROM_U_STAGE_3_INDEX];
+
+    i1=c>>UCNV_EXT_FROM_U_STAGE_1_SHIFT;
+    touch(lines, stage12+i1);
+    i2=stage12[i1]+((c>>UCNV_EXT_FROM_U_STAGE_2_SHIFT)&UCNV_EXT_FROM_U_STAGE_2_MASK);
+    touch(lines, stage12+i2);
+    touch(lines, stage3+stage12[i2]+(c&UCNV_EXT_FROM_U_STAGE_3_MASK));
+    return stage3[stage12[i2]+(c&UCNV_EXT_FROM_U_STAGE_3_MASK)];
+}
+
+/* static analysis ---------------------------------------------------------- */
+
+/* histogram and cost of finding each entry of each toUTable section */
+static void
+profileToU(const int32_t *cx) {
+    const uint32_t *toUTable, *section;
+    int32_t histogram[HISTOGRAM_LENGTH];
+    Cost dense, sparse;
+    Lines lines;
+    int32_t i, j, length, probes, count, denseCount;
+    uint8_t first, last;
+
+    toUTable=(const uint32_t *)cx+cx[UCNV_EXT_TO_U_INDEX];
+    memset(histogram, 0, sizeof(histogram));
+    memset(&dense, 0, sizeof(dense));
+    memset(&sparse, 0, sizeof(sparse));
+    count=denseCount=0;
+
+    /* the sections are stored one after the other */
+    for(i=0; i<cx[UCNV_EXT_TO_U_LENGTH]; i+=1+length) {
+        length=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUTable[i]);
+        ++count;
+        addLength(histogram, length);
+        if(length==0) {
+            continue;
+        }
+
+        section=toUTable+i+1;
+        first=(uint8_t)UCNV_EXT_TO_U_GET_BYTE(section[0]);
+        last=(uint8_t)UCNV_EXT_TO_U_GET_BYTE(section[length-1]);
+        if(UCNV_EXT_TO_U_IS_DENSE(first, last, length)) {
+            ++denseCount;
+        }
+        for(j=0; j<length; ++j) {
+            if(UCNV_EXT_TO_U_GET_VALUE(section[j])==0) {
+                continue; /* gap in a dense section */
+            }
+            lines.count=0;
+            touch(&lines, toUTable+i); /* the section word */
+            findToU(section, length, (uint8_t)UCNV_EXT_TO_U_GET_BYTE(section[j]), &lines, &probes);
+            addLookup(UCNV_EXT_TO_U_IS_DENSE(first, last, length) ? &dense : &sparse, probes, &lines);
+        }
+    }
+
+    printf("  toUnicode: %ld sections (%ld dense), toUTable %ld bytes, toUUChars %ld bytes\n",
+           (long)count, (long)denseCount,
+           (long)cx[UCNV_EXT_TO_U_LENGTH]*4, (long)cx[UCNV_EXT_TO_U_UCHARS_LENGTH]*2);
+    if(count>0) {
+        printHistogram(histogram);
+        printCost("dense sections (direct access)", &dense);
+        printCost("sparse sections (binary search)", &sparse);
+    }
+}
+
+/* same for the fromUTable sections and the trie */
+static void
+profileFromU(const int32_t *cx) {
+    const UChar *uchars;
+    int32_t histogram[HISTOGRAM_LENGTH];
+    Cost wide, narrow, trie;
+    Lines lines;
+    UChar32 c, limit;
+    int32_t i, j, length, probes, count;
+
+    uchars=(const UChar *)cx+cx[UCNV_EXT_FROM_U_UCHARS_INDEX];
+    memset(histogram, 0, sizeof(histogram));
+    memset(&wide, 0, sizeof(wide));
+    memset(&narrow, 0, sizeof(narrow));
+    memset(&trie, 0, sizeof(trie));
+    count=0;
+
+    for(i=0; i<cx[UCNV_EXT_FROM_U_LENGTH]; i+=1+length) {
+        length=uchars[i];
+        if(length==0) {
+            continue; /* index 0 reserved for the trie */
+        }
+        ++count;
+        addLength(histogram, length);
+        for(j=0; j<length; ++j) {
+            lines.count=0;
+            touch(&lines, uchars+i); /* the section length */
+            touch(&lines, (const uint32_t *)cx+cx[UCNV_EXT_FROM_U_VALUES_INDEX]+i);
+            findFromU(uchars+i+1, length, uchars[i+1+j], &lines, &probes);
+            touch(&lines, (const uint32_t *)cx+cx[UCNV_EXT_FROM_U_VALUES_INDEX]+i+1+j);
+            addLookup(length>=UCNV_EXT_FROM_U_WIDE_SECTION_LENGTH ? &wide : &narrow, probes, &lines);
+        }
+    }
+
+    printf("  fromUnicode: %ld sections, fromUTable %ld bytes, fromUBytes %ld bytes\n",
+           (long)count, (long)cx[UCNV_EXT_FROM_U_LENGTH]*6, (long)cx[UCNV_EXT_FROM_U_BYTES_LENGTH]);
+    if(cx[UCNV_EXT_FROM_U_STAGE_12_LENGTH]>0) {
+        printf("    trie: stage 1 %ld, stage 1+2 %ld (%ld bytes), stage 3 %ld (%ld bytes)\n",
+               (long)cx[UCNV_EXT_FROM_U_STAGE_1_LENGTH],
+               (long)cx[UCNV_EXT_FROM_U_STAGE_12_LENGTH], (long)cx[UCNV_EXT_FROM_U_STAGE_12_LENGTH]*2,
+               (long)cx[UCNV_EXT_FROM_U_STAGE_3_LENGTH], (long)cx[UCNV_EXT_FROM_U_STAGE_3_LENGTH]*4);
+
+        limit=cx[UCNV_EXT_FROM_U_STAGE_1_LENGTH]<<UCNV_EXT_FROM_U_STAGE_1_SHIFT;
+        for(c=0; c<limit; ++c) {
+            lines.count=0;
+            if(findTrie(cx, c, &lines)!=0) {
+                addLookup(&trie, 3, &lines);
+            }
+        }
+    }
+    if(count>0) {
+        printHistogram(histogram);
+    }
+    printCost("initial code points in the trie", &trie);
+    printCost("wide sections (branch-free search)", &wide);
+    printCost("narrow sections (binary+linear search)", &narrow);
+}
+
+/* replay ------------------------------------------------------------------- */
+
+static double
+getSeconds() {
+    return (double)clock()/CLOCKS_PER_SEC;
+}
+
+/*
+ * Walk the fromU tables for the input at src[0] like ucnv_extMatchFromUTables()
+ * with useFallback=TRUE and flush=TRUE, adding each section lookup to the cost.
+ * @return number of UChars matched, or the length of the unmappable code point
+ */
+static int32_t
+replayFromU(const int32_t *cx, const UChar *src, int32_t srcLength, Cost *cost) {
+    const UChar *uchars;
+    const uint32_t *values;
+    Lines lines;
+    uint32_t value;
+    UChar32 c;
+    int32_t i, index, length, cpLength, matchLength, probes;
+
+    uchars=(const UChar *)cx+cx[UCNV_EXT_FROM_U_UCHARS_INDEX];
+    values=(const uint32_t *)cx+cx[UCNV_EXT_FROM_U_VALUES_INDEX];
+
+    cpLength=0;
+    U16_NEXT(src, cpLength, srcLength, c);
+    matchLength=0;
+
+    if(cx[UCNV_EXT_FROM_U_STAGE_12_LENGTH]>0) {
+        lines.count=0;
+        if((c>>UCNV_EXT_FROM_U_STAGE_1_SHIFT)<cx[UCNV_EXT_FROM_U_STAGE_1_LENGTH]) {
+            value=findTrie(cx, c, &lines);
+            addLookup(cost, 3, &lines);
+        } else {
+            value=0;
+            addLookup(cost, 0, &lines);
+        }
+        if(value==0 || !UCNV_EXT_FROM_U_IS_PARTIAL(value)) {
+            return cpLength;
+        }
+        index=(int32_t)UCNV_EXT_FROM_U_GET_PARTIAL_INDEX(value);
+        i=cpLength;
+    } else if(cx[UCNV_EXT_FROM_U_LENGTH]>0) {
+        index=0;
+        i=0;
+    } else {
+        return cpLength;
+    }
+
+    for(;;) {
+        if(values[index]!=0) {
+            matchLength=i;
+        }
+        if(i>=srcLength) {
+            break;
+        }
+
+        lines.count=0;
+        touch(&lines, uchars+index);
+        touch(&lines, values+index);
+        length=uchars[index];
+        probes=0;
+        if(length>0) {
+            length=findFromU(uchars+index+1, length, src[i], &lines, &probes);
+        } else {
+            length=-1;
+        }
+        if(length>=0) {
+            touch(&lines, values+index+1+length);
+        }
+        addLookup(cost, probes, &lines);
+        if(length<0) {
+            break;
+        }
+
+        ++i;
+        value=values[index+1+length];
+        if(UCNV_EXT_FROM_U_IS_PARTIAL(value)) {
+            index=(int32_t)UCNV_EXT_FROM_U_GET_PARTIAL_INDEX(value);
+        } else {
+            matchLength=i;
+            break;
+        }
+    }
+
+    return matchLength>=cpLength ? matchLength : cpLength;
+}
+
+/* same for toU, like ucnv_extMatchToU(); returns 1 for an unmappable byte */
+static int32_t
+replayToU(const int32_t *cx, const uint8_t *src, int32_t srcLength, Cost *cost) {
+    const uint32_t *toUTable;
+    Lines lines;
+    uint32_t value;
+    int32_t i, index, length, matchLength, probes;
+
+    toUTable=(const uint32_t *)cx+cx[UCNV_EXT_TO_U_INDEX];
+    index=i=matchLength=0;
+
+    for(;;) {
+        if(UCNV_EXT_TO_U_GET_VALUE(toUTable[index])!=0) {
+            matchLength=i;
+        }
+        if(i>=srcLength) {
+            break;
+        }
+
+        lines.count=0;
+        touch(&lines, toUTable+index);
+        length=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUTable[index]);
+        probes=0;
+        value= length>0 ? findToU(toUTable+index+1, length, src[i], &lines, &probes) : 0;
+        addLookup(cost, probes, &lines);
+        if(value==0) {
+            break;
+        }
+
+        ++i;
+        if(UCNV_EXT_TO_U_IS_PARTIAL(value)) {
+            index=(int32_t)UCNV_EXT_TO_U_GET_PARTIAL_INDEX(value);
+        } else {
+            matchLength=i;
+            break;
+        }
+    }
+
+    return matchLength>0 ? matchLength : 1;
+}
+
+/*
+ * Make room in the replay buffer for one more fromU result.
+ * The buffer grows as needed: the worst case of UCNV_EXT_FROM_U_MAX_LENGTH
+ * bytes per UChar would overflow for long texts and is rarely approached.
+ * @return the (possibly moved) buffer
+ */
+static uint8_t *
+ensureReplayCapacity(uint8_t *bytes, int32_t *pCapacity, int32_t length) {
+    int32_t capacity;
+
+    if(length<=*pCapacity-UCNV_EXT_FROM_U_MAX_LENGTH) {
+        return bytes;
+    }
+    if(*pCapacity>0x7fffffff/2) {
+        fprintf(stderr, "cnvxprof: the replay text converts to more than 1GB of bytes\n");
+        exit(U_BUFFER_OVERFLOW_ERROR);
+    }
+    capacity=2**pCapacity;
+    bytes=(uint8_t *)realloc(bytes, capacity);
+    if(bytes==NULL) {
+        fprintf(stderr, "cnvxprof: unable to allocate %ld bytes for the replay buffer\n", (long)capacity);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    *pCapacity=capacity;
+    return bytes;
+}
+
+/*
+ * Append the bytes of a fromU match result, see ucnv_extMatchFromU().
+ * There must be room for UCNV_EXT_FROM_U_MAX_LENGTH bytes.
+ */
+static int32_t
+appendResult(uint8_t *bytes, int32_t length, const UCNVExtMatch *match) {
+    uint32_t value;
+    int32_t i, resultLength;
+
+    if(match->resultLength>0) {
+        memcpy(bytes+length, match->result, match->resultLength);
+        return length+match->resultLength;
+    } else if(match->resultLength<0) {
+        /* up to 3 bytes stored in the value */
+        value=(uint32_t)-match->resultLength;
+        resultLength=(int32_t)UCNV_EXT_FROM_U_GET_LENGTH(value);
+        for(i=resultLength; i>0;) {
+            bytes[length++]=(uint8_t)(value>>(8*--i));
+        }
+    }
+    return length;
+}
+
+static void
+printReplay(const char *what, double chars, const Cost *cost, double seconds, int32_t rounds) {
+    if(chars==0.) {
+        return;
+    }
+    printf("    %s: %.0f characters, %.2f lookups per character, %.2f cache lines per lookup\n"
+           "        %.1f ns per character, %.1f ns per lookup\n",
+           what, chars, cost->lookups/chars,
+           cost->lookups>0. ? cost->lines/cost->lookups : 0.,
+           seconds*1e9/(rounds*chars),
+           cost->lookups>0. ? seconds*1e9/(rounds*cost->lookups) : 0.);
+}
+
+/*
+ * Convert the text to bytes and back with the extension data:
+ * Count the lookups with the models, and time the runtime matchers
+ * for enough rounds to get measurable times.
+ */
+static void
+replay(const int32_t *cx, const UChar *text, int32_t textLength) {
+    UConverterExt ext;
+    UCNVExtMatch matches[MATCH_CAPACITY];
+    UCNVExtToUState state;
+    Cost fromUCost, toUCost;
+    uint8_t *bytes;
+    double start, fromUSeconds, toUSeconds, chars, byteChars;
+    int32_t i, j, length, capacity, count, consumed, rounds;
+    int8_t match;
+
+    memset(&fromUCost, 0, sizeof(fromUCost));
+    memset(&toUCost, 0, sizeof(toUCost));
+    if(textLength==0) {
+        return;
+    }
+
+    /* count the lookups and the code points */
+    chars=0.;
+    for(i=0; i<textLength; i+=length) {
+        length=replayFromU(cx, text+i, textLength-i, &fromUCost);
+        ++chars;
+    }
+
+    /* the replay buffer grows with the converted bytes */
+    capacity=0x10000;
+    bytes=(uint8_t *)malloc(capacity);
+    if(bytes==NULL) {
+        fprintf(stderr, "cnvxprof: unable to allocate the replay buffer\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+
+    /* match with the specialized matchers, as a converter would */
+    ucnv_extOpenFromU(&ext, cx);
+
+    /* collect the bytes for the mappable characters */
+    length=0;
+    for(i=0; i<textLength; i+=consumed) {
+        count=ucnv_extMatchFromURun(&ext, cx, text+i, textLength-i,
+                                    matches, MATCH_CAPACITY, &consumed,
+                                    TRUE, TRUE);
+        for(j=0; j<count; ++j) {
+            bytes=ensureReplayCapacity(bytes, &capacity, length);
+            length=appendResult(bytes, length, matches+j);
+        }
+        if(consumed==0) {
+            break;
+        }
+    }
+
+    /* time fromU */
+    rounds=0;
+    start=getSeconds();
+    do {
+        for(i=0; i<textLength; i+=consumed) {
+            ucnv_extMatchFromURun(&ext, cx, text+i, textLength-i,
+                                  matches, MATCH_CAPACITY, &consumed,
+                                  TRUE, TRUE);
+            if(consumed==0) {
+                break;
+            }
+        }
+        ++rounds;
+    } while((fromUSeconds=getSeconds()-start)<0.2);
+    printReplay("fromUnicode", chars, &fromUCost, fromUSeconds, rounds);
+
+    /* count the toU lookups on the converted bytes */
+    byteChars=0.;
+    for(i=0; i<length; i+=count) {
+        count=replayToU(cx, bytes+i, length-i, &toUCost);
+        ++byteChars;
+    }
+
+    if(length==0) {
+        free(bytes);
+        return; /* nothing mappable */
+    }
+    rounds=0;
+    start=getSeconds();
+    do {
+        for(i=0; i<length; i+= match>0 ? match : 1) {
+            state.matchValue=0;
+            state.index=0;
+            state.length=state.matchLength=0;
+            state.firstLength=1;
+            match=ucnv_extMatchToU(cx, &state, NULL, 0,
+                                   (const char *)bytes+i, length-i,
+                                   TRUE, TRUE);
+        }
+        ++rounds;
+    } while((toUSeconds=getSeconds()-start)<0.2);
+    printReplay("toUnicode", byteChars, &toUCost, toUSeconds, rounds);
+
+    free(bytes);
+}
+
+/* read a UTF-8 text file into a malloc()ed UTF-16 string */
+static UChar *
+readText(const char *filename, int32_t *pLength) {
+    FILE *f;
+    char *utf8;
+    UChar *text;
+    UErrorCode errorCode;
+    int32_t length, textLength;
+
+    f=fopen(filename, "rb");
+    if(f==NULL) {
+        fprintf(stderr, "cnvxprof: unable to open %s\n", filename);
+        exit(U_FILE_ACCESS_ERROR);
+    }
+    fseek(f, 0, SEEK_END);
+    length=(int32_t)ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    utf8=(char *)malloc(length+1);
+    text=(UChar *)malloc((length+1)*U_SIZEOF_UCHAR);
+    if(utf8==NULL || text==NULL) {
+        fprintf(stderr, "cnvxprof: unable to allocate memory for %s\n", filename);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    length=(int32_t)fread(utf8, 1, length, f);
+    fclose(f);
+
+    errorCode=U_ZERO_ERROR;
+    u_strFromUTF8(text, length+1, &textLength, utf8, length, &errorCode);
+    free(utf8);
+    if(U_FAILURE(errorCode)) {
+        fprintf(stderr, "cnvxprof: %s is not valid UTF-8 - %s\n", filename, u_errorName(errorCode));
+        exit(errorCode);
+    }
+
+    *pLength=textLength;
+    return text;
+}
+
+/* tool --------------------------------------------------------------------- */
+
+/* profile one path/name.cnvx file; @return 0 if successful */
+static int
+profileFile(const char *filename, const UChar *text, int32_t textLength) {
+    char path[MAX_PATH_LENGTH+2], buffer[MAX_PATH_LENGTH];
+    char *name, *basename, *suffix;
+    UDataMemory *pData;
+    const int32_t *cx;
+    UErrorCode errorCode;
+
+    if(uprv_strlen(filename)>=MAX_PATH_LENGTH) {
+        fprintf(stderr, "cnvxprof: file name too long: %s\n", filename);
+        return 1;
+    }
+
+    /*
+     * split into the directory path and the name without the .cnvx suffix;
+     * udata_openChoice() finds a file by its directory path only if that
+     * ends with a separator, and if it is relative, only if it starts with
+     * "./", so make it "./dir/" for relative paths
+     */
+    if(filename[0]==U_FILE_SEP_CHAR || (filename[0]!=0 && filename[1]==':')) {
+        path[0]=0;
+    } else {
+        uprv_strcpy(path, "." U_FILE_SEP_STRING);
+    }
+    uprv_strcat(path, filename);
+    basename=uprv_strrchr(path, U_FILE_SEP_CHAR)+1;
+    uprv_strcpy(buffer, basename);
+    *basename=0;
+    name=buffer;
+    suffix=uprv_strrchr(name, '.');
+    if(suffix!=NULL && 0==uprv_strcmp(suffix+1, UCNV_EXT_DATA_TYPE)) {
+        *suffix=0;
+    }
+
+    errorCode=U_ZERO_ERROR;
+    cx=ucnv_extOpenData(path, name, &pData, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        fprintf(stderr, "cnvxprof: unable to open %s - %s\n", filename, u_errorName(errorCode));
+        return 1;
+    }
+
+    printf("%s: %ld bytes of extension data\n", filename, (long)cx[UCNV_EXT_SIZE]);
+    profileToU(cx);
+    profileFromU(cx);
+    if(text!=NULL) {
+        printf("  replay of %s:\n", options[OPT_REPLAY].value);
+        replay(cx, text, textLength);
+    }
+
+    udata_close(pData);
+    return 0;
+}
+
+extern int
+main(int argc, const char *argv[]) {
+    UChar *text;
+    int32_t textLength;
+    int i, failed;
+
+    argc=u_parseArgs(argc, (char **)argv, sizeof(options)/sizeof(options[0]), options);
+    if(argc<2 || options[OPT_HELP_H].doesOccur || options[OPT_HELP_QUESTION_MARK].doesOccur) {
+        fprintf(stderr,
+            "usage: %s [-r text.txt] path/name.cnvx ...\n"
+            "\treports the size and lookup cost of conversion extension data\n"
+            "options:\n"
+            "\t-h or -? or --help  this usage text\n"
+            "\t-r or --replay      UTF-8 sample text to convert with each file,\n"
+            "\t                    reports the lookups and the time per character\n",
+            argv[0]);
+        return argc<0 ? U_ILLEGAL_ARGUMENT_ERROR : U_ZERO_ERROR;
+    }
+
+    text=NULL;
+    textLength=0;
+    if(options[OPT_REPLAY].doesOccur) {
+        text=readText(options[OPT_REPLAY].value, &textLength);
+    }
+
+    failed=0;
+    for(i=1; i<argc; ++i) {
+        failed+=profileFile(argv[i], text, textLength);
+    }
+
+    free(text);
+    return failed>0 ? U_INVALID_FORMAT_ERROR : 0;
+}
@@ -0,0 +1,129 @@
+/*
+*******************************************************************************
+*
+*   Copyright (C) 2026, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+*
+*******************************************************************************
+*   file name:  makecnvx.c
+*   encoding:   US-ASCII
+*   tab size:   8 (not used)
+*   indentation:4
+*
+*   created on: 2026oct16
+*   created by: agent
+*
+*   This tool reads .ucm files and writes stand-alone conversion extension
+*   data (.cnvx, see ucnv_ext.h and ucm_writeExtData()) for each of them,
+*   for loading with ucnv_extOpenData() and for profiling with cnvxprof.
+*
+*   The data is built from the extension table of a .ucm file,
+*   or with --base from its base table, which makes extension data
+*   for all of the charset's mappings.
+*   The output file is destdir/name.cnvx where name is the .ucm file name
+*   without its path and suffix.
+*/
+
+#include "unicode/utypes.h"
+#include "unicode/putil.h"
+#include "cstring.h"
+#include "uoptions.h"
+#include "ucnv_ext.h"
+#include "ucm.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+    MAX_NAME_LENGTH=200
+};
+
+static UOption options[]={
+    UOPTION_HELP_H,
+    UOPTION_HELP_QUESTION_MARK,
+    UOPTION_DESTDIR,
+    UOPTION_DEF("base", 'b', UOPT_NO_ARG)
+};
+
+enum {
+    OPT_HELP_H,
+    OPT_HELP_QUESTION_MARK,
+    OPT_DESTDIR,
+    OPT_BASE
+};
+
+/* set name[] to the file name without its path and .ucm suffix */
+static void
+getCharsetName(char name[MAX_NAME_LENGTH], const char *filename) {
+    const char *basename, *suffix;
+    int32_t length;
+
+    basename=uprv_strrchr(filename, U_FILE_SEP_CHAR);
+#ifdef WIN32
+    {
+        const char *slash=uprv_strrchr(filename, '/');
+        if(slash!=NULL && (basename==NULL || slash>basename)) {
+            basename=slash;
+        }
+    }
+#endif
+    basename= basename==NULL ? filename : basename+1;
+
+    suffix=uprv_strrchr(basename, '.');
+    if(suffix!=NULL && 0==uprv_strcmp(suffix, ".ucm")) {
+        length=(int32_t)(suffix-basename);
+    } else {
+        length=(int32_t)uprv_strlen(basename);
+    }
+
+    if(length>=MAX_NAME_LENGTH) {
+        fprintf(stderr, "makecnvx: charset name too long: %s\n", filename);
+        exit(U_ILLEGAL_ARGUMENT_ERROR);
+    }
+    uprv_memcpy(name, basename, length);
+    name[length]=0;
+}
+
+extern int
+main(int argc, const char *argv[]) {
+    char name[MAX_NAME_LENGTH];
+    const char *destDir;
+    UCMFile *ucm;
+    UCMTable *table;
+    int32_t i;
+
+    argc=u_parseArgs(argc, (char **)argv, sizeof(options)/sizeof(options[0]), options);
+    if(argc<2 || options[OPT_HELP_H].doesOccur || options[OPT_HELP_QUESTION_MARK].doesOccur) {
+        fprintf(stderr,
+            "usage: %s [-d destdir] [-b] file.ucm ...\n"
+            "\twrites conversion extension data destdir/file.cnvx\n"
+            "\tfrom the extension table of each .ucm file\n"
+            "options:\n"
+            "\t-h or -? or --help  this usage text\n"
+            "\t-d or --destdir     destination directory, followed by the path\n"
+            "\t-b or --base        use the base table instead, for extension data\n"
+            "\t                    with all of the charset's mappings\n",
+            argv[0]);
+        return argc<0 ? U_ILLEGAL_ARGUMENT_ERROR : U_ZERO_ERROR;
+    }
+    destDir= options[OPT_DESTDIR].doesOccur ? options[OPT_DESTDIR].value : NULL;
+
+    for(i=1; i<argc; ++i) {
+        getCharsetName(name, argv[i]);
+
+        /* the ucm module exit()s in case of an error */
+        ucm=ucm_readFile(argv[i]);
+        table= options[OPT_BASE].doesOccur ? ucm->base : ucm->ext;
+        if(table->mappingsLength==0) {
+            fprintf(stderr, "makecnvx: %s has no %s table mappings\n",
+                    argv[i], options[OPT_BASE].doesOccur ? "base" : "extension");
+            ucm_close(ucm);
+            return U_INVALID_TABLE_FORMAT;
+        }
+
+        ucm_writeExtData(table, destDir, name);
+        printf("%s.%s: %ld mappings\n",
+               name, UCNV_EXT_DATA_TYPE, (long)table->mappingsLength);
+        ucm_close(ucm);
+    }
+    return 0;
+}
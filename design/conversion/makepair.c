@@ -0,0 +1,125 @@
+/*
+*******************************************************************************
+*
+*   Copyright (C) 2026, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+*
+*******************************************************************************
+*   file name:  makepair.c
+*   encoding:   US-ASCII
+*   tab size:   8 (not used)
+*   indentation:4
+*
+*   created on: 2026oct16
+*   created by: agent
+*
+*   This tool reads two .ucm files and writes converter pair data
+*   (.cnvp, see ucnv_ext.h and ucm_buildPairData()) for converting text
+*   directly from the first charset to the second one with
+*   ucnv_extConvertPair(), without going through UTF-16 for the
+*   characters that both charsets map in the same unique way.
+*
+*   The output file is destdir/from_to.cnvp where from and to are
+*   the .ucm file names without their paths and suffixes.
+*/
+
+#include "unicode/utypes.h"
+#include "unicode/putil.h"
+#include "cstring.h"
+#include "uoptions.h"
+#include "ucnv_ext.h"
+#include "ucm.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+enum {
+    MAX_NAME_LENGTH=200
+};
+
+static UOption options[]={
+    UOPTION_HELP_H,
+    UOPTION_HELP_QUESTION_MARK,
+    UOPTION_DESTDIR
+};
+
+enum {
+    OPT_HELP_H,
+    OPT_HELP_QUESTION_MARK,
+    OPT_DESTDIR
+};
+
+/* append the file name without its path and .ucm suffix to name[] */
+static void
+appendCharsetName(char name[MAX_NAME_LENGTH], const char *filename) {
+    const char *basename, *suffix;
+    int32_t length, nameLength;
+
+    basename=uprv_strrchr(filename, U_FILE_SEP_CHAR);
+#ifdef WIN32
+    {
+        const char *slash=uprv_strrchr(filename, '/');
+        if(slash!=NULL && (basename==NULL || slash>basename)) {
+            basename=slash;
+        }
+    }
+#endif
+    basename= basename==NULL ? filename : basename+1;
+
+    suffix=uprv_strrchr(basename, '.');
+    if(suffix!=NULL && 0==uprv_strcmp(suffix, ".ucm")) {
+        length=(int32_t)(suffix-basename);
+    } else {
+        length=(int32_t)uprv_strlen(basename);
+    }
+
+    nameLength=(int32_t)uprv_strlen(name);
+    if(nameLength+length+1>=MAX_NAME_LENGTH) { /* +1 for the "_" */
+        fprintf(stderr, "makepair: charset name too long: %s\n", filename);
+        exit(U_ILLEGAL_ARGUMENT_ERROR);
+    }
+    uprv_memcpy(name+nameLength, basename, length);
+    name[nameLength+length]=0;
+}
+
+extern int
+main(int argc, const char *argv[]) {
+    char name[MAX_NAME_LENGTH];
+    const char *destDir;
+    UCMFile *source, *target;
+    int32_t *indexes;
+    int32_t size, directCount, pivotCount;
+
+    argc=u_parseArgs(argc, (char **)argv, sizeof(options)/sizeof(options[0]), options);
+    if(argc!=3 || options[OPT_HELP_H].doesOccur || options[OPT_HELP_QUESTION_MARK].doesOccur) {
+        fprintf(stderr,
+            "usage: %s [-d destdir] from.ucm to.ucm\n"
+            "\twrites converter pair data destdir/from_to.cnvp\n"
+            "\tfor converting directly from one charset to the other\n"
+            "options:\n"
+            "\t-h or -? or --help  this usage text\n"
+            "\t-d or --destdir     destination directory, followed by the path\n",
+            argv[0]);
+        return argc<0 ? U_ILLEGAL_ARGUMENT_ERROR : U_ZERO_ERROR;
+    }
+    destDir= options[OPT_DESTDIR].doesOccur ? options[OPT_DESTDIR].value : NULL;
+
+    name[0]=0;
+    appendCharsetName(name, argv[1]);
+    uprv_strcat(name, "_");
+    appendCharsetName(name, argv[2]);
+
+    /* the ucm module exit()s in case of an error */
+    source=ucm_readFile(argv[1]);
+    target=ucm_readFile(argv[2]);
+
+    indexes=ucm_buildPairData(source, target, &size, &directCount, &pivotCount);
+    ucm_writePairData(indexes, destDir, name);
+
+    printf("%s.%s: %ld bytes, %ld direct mappings, %ld via Unicode\n",
+           name, UCNV_PAIR_DATA_TYPE, (long)size, (long)directCount, (long)pivotCount);
+
+    free(indexes);
+    ucm_close(source);
+    ucm_close(target);
+    return 0;
+}
@@ -169,8 +169,175 @@ compareMappingsBytesFirst(const void *context, const void *left, const void *rig
     return compareMappings(table, table->mappings+l, table->mappings+r, FALSE);
 }
 
+/* radix sort --------------------------------------------------------------- */
+
+/*
+ * Most tables contain only 1:1 mappings with up to 4 bytes.
+ * For those, all of the fields that compareMappings() looks at fit into
+ * a 64-bit sort key per mapping, and the keys compare as unsigned integers
+ * exactly like the mappings compare with compareMappings().
+ * An LSD radix sort of (key, index) pairs then replaces the
+ * comparator-based sorts with their callbacks and indirect accesses.
+ *
+ * Unicode first: u (21 bits), bLen (3), bytes left-justified (32), f+1 (8)
+ * Bytes first:   bytes left-justified and 00-padded (32), bLen (3), u (21), f+1 (8)
+ *
+ * In the bytes-first key, 00-padding followed by the length yields the
+ * lexical order: A shorter sequence sorts before any longer one that it
+ * is a prefix of, and 00 is the lowest byte value.
+ */
+typedef struct UCMSortItem {
+    uint64_t key;
+    int32_t index;
+} UCMSortItem;
+
+static UBool
+isRadixSortable(const UCMTable *t) {
+    const UCMapping *m, *limit;
+
+    for(m=t->mappings, limit=m+t->mappingsLength; m<limit; ++m) {
+        if(m->uLen!=1 || m->bLen>4) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* bytes of a mapping with bLen<=4, left-justified */
+static U_INLINE uint64_t
+getBytesKey(const UCMapping *m) {
+    uint32_t bytes;
+    int32_t i;
+
+    bytes=0;
+    for(i=0; i<4; ++i) {
+        bytes<<=8;
+        if(i<m->bLen) {
+            bytes|=m->b.bytes[i];
+        }
+    }
+    return bytes;
+}
+
+static U_INLINE uint64_t
+getUnicodeFirstKey(const UCMapping *m) {
+    return
+        ((uint64_t)m->u<<43)|
+        ((uint64_t)m->bLen<<40)|
+        (getBytesKey(m)<<8)|
+        (uint64_t)(m->f+1);
+}
+
+static U_INLINE uint64_t
+getBytesFirstKey(const UCMapping *m) {
+    return
+        (getBytesKey(m)<<32)|
+        ((uint64_t)m->bLen<<29)|
+        ((uint64_t)m->u<<8)|
+        (uint64_t)(m->f+1);
+}
+
+/*
+ * Stable LSD radix sort with 8-bit digits.
+ * Passes in which all keys have the same digit are skipped.
+ * @return items or temp, whichever contains the sorted items
+ */
+static UCMSortItem *
+radixSort(UCMSortItem *items, UCMSortItem *temp, int32_t length) {
+    int32_t counts[8][256];
+    UCMSortItem *swap;
+    uint64_t key;
+    int32_t i, pass, shift, sum, count;
+
+    /* count the digits for all passes at once */
+    memset(counts, 0, sizeof(counts));
+    for(i=0; i<length; ++i) {
+        key=items[i].key;
+        for(pass=0; pass<8; ++pass) {
+            ++counts[pass][(key>>(8*pass))&0xff];
+        }
+    }
+
+    for(pass=0; pass<8; ++pass) {
+        shift=8*pass;
+        if(counts[pass][(items[0].key>>shift)&0xff]==length) {
+            continue; /* all the same digit */
+        }
+
+        /* turn the counts into start indexes */
+        sum=0;
+        for(i=0; i<256; ++i) {
+            count=counts[pass][i];
+            counts[pass][i]=sum;
+            sum+=count;
+        }
+
+        for(i=0; i<length; ++i) {
+            temp[counts[pass][(items[i].key>>shift)&0xff]++]=items[i];
+        }
+        swap=items;
+        items=temp;
+        temp=swap;
+    }
+    return items;
+}
+
+static void
+allocReverseMap(UCMTable *t) {
+    if(t->reverseMap==NULL) {
+        t->reverseMap=(int32_t *)malloc(t->mappingsCapacity*sizeof(int32_t));
+        if(t->reverseMap==NULL) {
+            fprintf(stderr, "ucm error: unable to allocate reverseMap\n");
+            exit(U_MEMORY_ALLOCATION_ERROR);
+        }
+    }
+}
+
+/* same results as the comparator-based sorts in ucm_sortTable() */
+static void
+radixSortTable(UCMTable *t) {
+    UCMSortItem *items, *sorted;
+    UCMapping *mappings;
+    int32_t i, length;
+
+    length=t->mappingsLength;
+    items=(UCMSortItem *)malloc(2*length*sizeof(UCMSortItem));
+    mappings=(UCMapping *)malloc(t->mappingsCapacity*sizeof(UCMapping));
+    if(items==NULL || mappings==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate sort keys\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+
+    /* 1. sort by Unicode first, then move the mappings into that order */
+    for(i=0; i<length; ++i) {
+        items[i].key=getUnicodeFirstKey(t->mappings+i);
+        items[i].index=i;
+    }
+    sorted=radixSort(items, items+length, length);
+    for(i=0; i<length; ++i) {
+        mappings[i]=t->mappings[sorted[i].index];
+    }
+    free(t->mappings);
+    t->mappings=mappings;
+
+    /* 2. sort the reverseMap by bytes first */
+    for(i=0; i<length; ++i) {
+        items[i].key=getBytesFirstKey(mappings+i);
+        items[i].index=i;
+    }
+    sorted=radixSort(items, items+length, length);
+    allocReverseMap(t);
+    for(i=0; i<length; ++i) {
+        t->reverseMap[i]=sorted[i].index;
+    }
+
+    free(items);
+}
+
+/* sorting ------------------------------------------------------------------ */
+
 U_CAPI void U_EXPORT2
-ucm_sortTable(UCMTable *t) {
+ucm_sortTableByComparison(UCMTable *t) {
     UErrorCode errorCode;
     int32_t i;
 
@@ -182,13 +349,7 @@ ucm_sortTable(UCMTable *t) {
                    FALSE, &errorCode);
 
     /* build the reverseMap */
-    if(t->reverseMap==NULL) {
-        t->reverseMap=(int32_t *)malloc(t->mappingsLength*sizeof(int32_t));
-        if(t->reverseMap==NULL) {
-            fprintf(stderr, "ucm error: unable to allocate reverseMap\n");
-            exit(U_MEMORY_ALLOCATION_ERROR);
-        }
-    }
+    allocReverseMap(t);
     for(i=0; i<t->mappingsLength; ++i) {
         t->reverseMap[i]=i;
     }
@@ -205,15 +366,17 @@ ucm_sortTable(UCMTable *t) {
     }
 }
 
-/*
-
-TODO normalization function for a table
-sort table
-if there are mappings with the same code points and bytes but |1 and |3, merge them into one |0 (or make |2 where necessary)
-if mappings were merged, sort again
--> for rptp2ucm
-
-*/
+U_CAPI void U_EXPORT2
+ucm_sortTable(UCMTable *t) {
+    if(t->isReadOnly) {
+        return; /* cached tables are sorted */
+    }
+    if(t->mappingsLength>0 && isRadixSortable(t)) {
+        radixSortTable(t);
+    } else {
+        ucm_sortTableByComparison(t);
+    }
+}
 
 /* ucm parser --------------------------------------------------------------- */
 
@@ -233,10 +396,34 @@ option for automatically adding multi-char mappings into a secondary table
 
  */
 
-U_CAPI int8_t U_EXPORT2
-ucm_parseBytes(uint8_t bytes[UCNV_EXT_MAX_LENGTH], const char *line, const char **ps) {
+/* print a parse error with the line (number) where it occurred, and exit */
+static void
+parseError(const char *message, const char *line, int32_t lineNumber, UErrorCode errorCode) {
+    if(lineNumber>0) {
+        fprintf(stderr, "ucm error: %s on line %ld: \"%s\"\n", message, (long)lineNumber, line);
+    } else {
+        fprintf(stderr, "ucm error: %s - \"%s\"\n", message, line);
+    }
+    exit(errorCode);
+}
+
+/* value of a hexadecimal digit, or -1 */
+static U_INLINE int32_t
+hexDigitValue(char c) {
+    if((uint8_t)(c-'0')<=9) {
+        return c-'0';
+    }
+    c|=0x20; /* lowercase */
+    if((uint8_t)(c-'a')<=5) {
+        return c-'a'+10;
+    }
+    return -1;
+}
+
+static int8_t
+parseBytes(uint8_t bytes[UCNV_EXT_MAX_LENGTH], const char *line, int32_t lineNumber, const char **ps) {
     const char *s=*ps;
-    char *end;
+    int32_t hi, lo;
     int8_t bLen;
 
     bLen=0;
@@ -250,31 +437,30 @@ ucm_parseBytes(uint8_t bytes[UCNV_EXT_MAX_LENGTH], const char *line, const char
         }
 
         if(bLen==UCNV_EXT_MAX_LENGTH) {
-            fprintf(stderr, "ucm error: too many bytes on \"%s\"\n", line);
-            exit(U_INVALID_TABLE_FORMAT);
+            parseError("too many bytes", line, lineNumber, U_INVALID_TABLE_FORMAT);
         }
         if( s[1]!='x' ||
-            (bytes[bLen]=(uint8_t)strtoul(s+2, &end, 16), end)!=s+4
+            (hi=hexDigitValue(s[2]))<0 || (lo=hexDigitValue(s[3]))<0 ||
+            hexDigitValue(s[4])>=0
         ) {
-            fprintf(stderr, "ucm error: byte must be formatted as \\xXX (2 hex digits) - \"%s\"\n", line);
-            exit(U_INVALID_TABLE_FORMAT);
+            parseError("byte must be formatted as \\xXX (2 hex digits)", line, lineNumber, U_INVALID_TABLE_FORMAT);
         }
-        ++bLen;
-        s=end;
+        bytes[bLen++]=(uint8_t)((hi<<4)|lo);
+        s+=4;
     }
 
     *ps=s;
     return bLen;
 }
 
-/* parse a mapping line; must not be empty */
-U_CAPI void U_EXPORT2
-ucm_parseMappingLine(UCMapping *m,
-                     UChar32 codePoints[UCNV_EXT_MAX_LENGTH],
-                     uint8_t bytes[UCNV_EXT_MAX_LENGTH],
-                     const char *line) {
+static void
+parseMappingLine(UCMapping *m,
+                 UChar32 codePoints[UCNV_EXT_MAX_LENGTH],
+                 uint8_t bytes[UCNV_EXT_MAX_LENGTH],
+                 const char *line, int32_t lineNumber) {
     const char *s;
-    char *end;
+    UChar32 c;
+    int32_t digit, digitCount;
     int8_t uLen, bLen, f;
 
     s=line;
@@ -291,27 +477,33 @@ ucm_parseMappingLine(UCMapping *m,
         }
 
         if(uLen==UCNV_EXT_MAX_LENGTH) {
-            fprintf(stderr, "ucm error: too many code points on \"%s\"\n", line);
-            exit(U_MEMORY_ALLOCATION_ERROR);
+            parseError("too many code points", line, lineNumber, U_MEMORY_ALLOCATION_ERROR);
         }
-        if( s[1]!='U' ||
-            (codePoints[uLen]=(UChar32)strtoul(s+2, &end, 16), end)==s+2 ||
-            *end!='>'
-        ) {
-            fprintf(stderr, "ucm error: Unicode code point must be formatted as <UXXXX> (1..6 hex digits) - \"%s\"\n", line);
-            exit(U_INVALID_TABLE_FORMAT);
+        if(s[1]!='U') {
+            c=digitCount=0;
+        } else {
+            /* more than 6 digits are tolerated but the value must fit */
+            s+=2;
+            c=0;
+            for(digitCount=0; (digit=hexDigitValue(*s))>=0; ++digitCount) {
+                if(c<=0x10ffff) {
+                    c=(c<<4)|digit;
+                }
+                ++s;
+            }
         }
-        if((uint32_t)codePoints[uLen]>0x10ffff || U_IS_SURROGATE(codePoints[uLen])) {
-            fprintf(stderr, "ucm error: Unicode code point must be 0..d7ff or e000..10ffff - \"%s\"\n", line);
-            exit(U_INVALID_TABLE_FORMAT);
+        if(digitCount==0 || *s!='>') {
+            parseError("Unicode code point must be formatted as <UXXXX> (1..6 hex digits)", line, lineNumber, U_INVALID_TABLE_FORMAT);
         }
-        ++uLen;
-        s=end+1;
+        if(c>0x10ffff || U_IS_SURROGATE(c)) {
+            parseError("Unicode code point must be 0..d7ff or e000..10ffff", line, lineNumber, U_INVALID_TABLE_FORMAT);
+        }
+        codePoints[uLen++]=c;
+        ++s;
     }
 
     if(uLen==0) {
-        fprintf(stderr, "ucm error: no Unicode code points on \"%s\"\n", line);
-        exit(U_INVALID_TABLE_FORMAT);
+        parseError("no Unicode code points", line, lineNumber, U_INVALID_TABLE_FORMAT);
     } else if(uLen==1) {
         m->u=codePoints[0];
     }
@@ -319,11 +511,10 @@ ucm_parseMappingLine(UCMapping *m,
     s=u_skipWhitespace(s);
 
     /* parse bytes */
-    bLen=ucm_parseBytes(bytes, line, &s);
+    bLen=parseBytes(bytes, line, lineNumber, &s);
 
     if(bLen==0) {
-        fprintf(stderr, "ucm error: no bytes on \"%s\"\n", line);
-        exit(U_INVALID_TABLE_FORMAT);
+        parseError("no bytes", line, lineNumber, U_INVALID_TABLE_FORMAT);
     } else if(bLen<=4) {
         memcpy(m->b.bytes, bytes, bLen);
     }
@@ -336,8 +527,7 @@ ucm_parseMappingLine(UCMapping *m,
         } else if(*s=='|') {
             f=(int8_t)(s[1]-'0');
             if((uint8_t)f>3) {
-                fprintf(stderr, "ucm error: fallback indicator must be |0..|3 - \"%s\"\n", line);
-                exit(U_INVALID_TABLE_FORMAT);
+                parseError("fallback indicator must be |0..|3", line, lineNumber, U_INVALID_TABLE_FORMAT);
             }
             break;
         }
@@ -349,16 +539,538 @@ ucm_parseMappingLine(UCMapping *m,
     m->f=f;
 }
 
+U_CAPI int8_t U_EXPORT2
+ucm_parseBytes(uint8_t bytes[UCNV_EXT_MAX_LENGTH], const char *line, const char **ps) {
+    return parseBytes(bytes, line, 0, ps);
+}
+
+/* parse a mapping line; must not be empty */
+U_CAPI void U_EXPORT2
+ucm_parseMappingLine(UCMapping *m,
+                     UChar32 codePoints[UCNV_EXT_MAX_LENGTH],
+                     uint8_t bytes[UCNV_EXT_MAX_LENGTH],
+                     const char *line) {
+    parseMappingLine(m, codePoints, bytes, line, 0);
+}
+
+/* .ucm file reader --------------------------------------------------------- */
+
+U_CAPI void U_EXPORT2
+ucm_openReader(UCMReader *reader, FILE *f) {
+    int32_t capacity, count;
+
+    memset(reader, 0, sizeof(UCMReader));
+
+    /* read the whole file, with room for a terminating NUL */
+    capacity=0;
+    for(;;) {
+        if(reader->length+1>=capacity) {
+            capacity= capacity==0 ? 0x10000 : 2*capacity;
+            reader->buffer=(char *)realloc(reader->buffer, capacity);
+            if(reader->buffer==NULL) {
+                fprintf(stderr, "ucm error: unable to allocate %ld bytes for the input file\n", (long)capacity);
+                exit(U_MEMORY_ALLOCATION_ERROR);
+            }
+        }
+        count=(int32_t)fread(reader->buffer+reader->length, 1, capacity-1-reader->length, f);
+        if(count<=0) {
+            break;
+        }
+        reader->length+=count;
+    }
+    if(ferror(f)) {
+        fprintf(stderr, "ucm error: unable to read the input file\n");
+        exit(U_FILE_ACCESS_ERROR);
+    }
+    reader->buffer[reader->length]=0;
+}
+
+U_CAPI char * U_EXPORT2
+ucm_readLine(UCMReader *reader) {
+    char *line, *limit, *end;
+
+    if(reader->start>=reader->length) {
+        return NULL;
+    }
+    line=reader->buffer+reader->start;
+    limit=reader->buffer+reader->length;
+
+    end=(char *)memchr(line, '\n', limit-line);
+    if(end==NULL) {
+        end=limit; /* last line without a line ending */
+    }
+    reader->start=(int32_t)(end-reader->buffer)+1;
+
+    /* NUL-terminate the line in place, without CR and LF */
+    if(end>line && *(end-1)=='\r') {
+        --end;
+    }
+    *end=0;
+
+    ++reader->lineNumber;
+    return line;
+}
+
+U_CAPI void U_EXPORT2
+ucm_closeReader(UCMReader *reader) {
+    free(reader->buffer);
+    reader->buffer=NULL;
+    reader->length=reader->start=0;
+}
+
+/* read the next non-empty, non-comment line; NULL at the end of the file */
+static char *
+readMappingLine(UCMReader *reader, UCMFile *ucm) {
+    char *line;
+
+    while((line=ucm_readLine(reader))!=NULL) {
+        ucm->lineNumber=reader->lineNumber;
+        if(line[0]!=0 && line[0]!='#') {
+            break;
+        }
+    }
+    return line;
+}
+
+/* read the mapping lines of one charmap section up to END CHARMAP */
+static void
+readCharmap(UCMReader *reader, UCMFile *ucm, UBool forBase) {
+    char *line;
+
+    for(;;) {
+        if((line=readMappingLine(reader, ucm))==NULL) {
+            fprintf(stderr, "ucm error: incomplete charmap section\n");
+            exit(U_INVALID_TABLE_FORMAT);
+        }
+        if(0==strcmp(line, "END CHARMAP")) {
+            break;
+        }
+        ucm_addMappingFromLine(ucm, line, forBase);
+    }
+}
+
+U_CAPI UCMFile * U_EXPORT2
+ucm_readFile(const char *filename) {
+    UCMReader reader;
+    UCMFile *ucm;
+    FILE *f;
+    char *line, *key, *value;
+
+    f=fopen(filename, "rb");
+    if(f==NULL) {
+        fprintf(stderr, "ucm error: unable to open %s\n", filename);
+        exit(U_FILE_ACCESS_ERROR);
+    }
+    ucm_openReader(&reader, f);
+    fclose(f);
+
+    ucm=ucm_open();
+
+    /* header lines up to CHARMAP */
+    do {
+        if((line=ucm_readLine(&reader))==NULL) {
+            fprintf(stderr, "ucm error: no mapping section in %s\n", filename);
+            exit(U_INVALID_TABLE_FORMAT);
+        }
+        ucm->lineNumber=reader.lineNumber;
+    } while(ucm_parseHeaderLine(ucm, line, &key, &value) ||
+            0!=strcmp(line, "CHARMAP"));
+    ucm_processStates(&ucm->states);
+
+    /*
+     * Without a base table name, the first charmap section is the base table
+     * and an extension table section is optional.
+     * With a base table name, the one section is the extension table.
+     */
+    readCharmap(&reader, ucm, (UBool)(ucm->baseName[0]==0));
+    if(ucm->baseName[0]==0 && (line=readMappingLine(&reader, ucm))!=NULL) {
+        if(0!=strcmp(line, "CHARMAP")) {
+            fprintf(stderr, "ucm error: unexpected text after the base mapping table in %s\n", filename);
+            exit(U_INVALID_TABLE_FORMAT);
+        }
+        readCharmap(&reader, ucm, FALSE);
+    }
+
+    ucm->lineNumber=0;
+    ucm_closeReader(&reader);
+    return ucm;
+}
+
 /* lookups ------------------------------------------------------------------ */
 
 /*
+ * Hash index over the mappings of a table, see UCMIndex in ucm.h.
+ * Each slot array has a power-of-2 capacity of at least twice the number
+ * of its entries and uses linear probing.
+ * A slot contains an entry+1, 0 for an empty slot.
+ */
 
-binary search for first mapping with some code point or byte sequence
-check if a code point is the first of any mapping (RT or FB)
-check if a byte sequence is a prefix of any mapping (RT or RFB)
-check if there is a mapping with the same source units; return whether the target is same or different
+static uint32_t
+hashCodePoints(const UChar32 *s, int32_t length) {
+    uint32_t hash=0x811c9dc5;
 
-*/
+    while(length>0) {
+        hash=(hash^(uint32_t)*s++)*0x1000193;
+        --length;
+    }
+    return hash^(hash>>15);
+}
+
+static uint32_t
+hashBytes(const uint8_t *s, int32_t length) {
+    uint32_t hash=0x811c9dc5;
+
+    while(length>0) {
+        hash=(hash^*s++)*0x1000193;
+        --length;
+    }
+    return hash^(hash>>15);
+}
+
+static int32_t *
+allocSlots(int32_t count, int32_t *pMask) {
+    int32_t *slots;
+    int32_t capacity;
+
+    for(capacity=16; capacity<2*count; capacity<<=1) {}
+    slots=(int32_t *)calloc(capacity, 4);
+    if(slots==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate %ld hash index slots\n", (long)capacity);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    *pMask=capacity-1;
+    return slots;
+}
+
+static UBool
+isSameCodePoints(UCMTable *table, const UCMapping *m, const UChar32 *codePoints, int32_t length) {
+    return (UBool)(
+        m->uLen==length &&
+        0==memcmp(UCM_GET_CODE_POINTS(table, m), codePoints, length*4));
+}
+
+static UBool
+isSameBytes(UCMTable *table, const UCMapping *m, const uint8_t *bytes, int32_t length) {
+    return (UBool)(
+        m->bLen==length &&
+        0==memcmp(UCM_GET_BYTES(table, m), bytes, length));
+}
+
+/* the mapping is used from Unicode (roundtrip, fallback, subchar1) */
+#define IS_FROM_U(m) ((m)->f!=3)
+
+/* the mapping is used to Unicode (roundtrip, reverse fallback) */
+#define IS_TO_U(m) ((m)->f<=0 || (m)->f==3)
+
+/* prefix set entries are (mapping index<<5)|prefix length */
+#define PREFIX_ENTRY(index, length) (((index)<<5)|(length))
+
+U_CAPI UCMIndex * U_EXPORT2
+ucm_openIndex(UCMTable *table) {
+    UCMIndex *index;
+    UCMapping *m;
+    const UChar32 *codePoints;
+    const uint8_t *bytes, *other;
+    int32_t i, j, slot, entry, length, prefixCount;
+
+    index=(UCMIndex *)malloc(sizeof(UCMIndex));
+    if(index==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate a UCMIndex\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    index->table=table;
+
+    prefixCount=0;
+    for(i=0; i<table->mappingsLength; ++i) {
+        prefixCount+=table->mappings[i].bLen;
+    }
+
+    index->unicodeSlots=allocSlots(table->mappingsLength, &index->unicodeMask);
+    index->bytesSlots=allocSlots(table->mappingsLength, &index->bytesMask);
+    index->firstCodePointSlots=allocSlots(table->mappingsLength, &index->firstCodePointMask);
+    index->prefixSlots=allocSlots(prefixCount, &index->prefixMask);
+
+    for(i=0, m=table->mappings; i<table->mappingsLength; ++m, ++i) {
+        codePoints=UCM_GET_CODE_POINTS(table, m);
+        bytes=UCM_GET_BYTES(table, m);
+
+        /* all mappings by code points and by bytes */
+        slot=(int32_t)(hashCodePoints(codePoints, m->uLen)&index->unicodeMask);
+        while(index->unicodeSlots[slot]!=0) {
+            slot=(slot+1)&index->unicodeMask;
+        }
+        index->unicodeSlots[slot]=i+1;
+
+        slot=(int32_t)(hashBytes(bytes, m->bLen)&index->bytesMask);
+        while(index->bytesSlots[slot]!=0) {
+            slot=(slot+1)&index->bytesMask;
+        }
+        index->bytesSlots[slot]=i+1;
+
+        /* the set of first code points of fromUnicode mappings */
+        if(IS_FROM_U(m)) {
+            slot=(int32_t)(hashCodePoints(codePoints, 1)&index->firstCodePointMask);
+            while((entry=index->firstCodePointSlots[slot])!=0 && entry-1!=codePoints[0]) {
+                slot=(slot+1)&index->firstCodePointMask;
+            }
+            index->firstCodePointSlots[slot]=codePoints[0]+1;
+        }
+
+        /* the set of all prefixes of the byte sequences of toUnicode mappings */
+        if(IS_TO_U(m)) {
+            for(length=1; length<=m->bLen; ++length) {
+                slot=(int32_t)(hashBytes(bytes, length)&index->prefixMask);
+                while((entry=index->prefixSlots[slot])!=0) {
+                    j=(entry-1)>>5;
+                    other=UCM_GET_BYTES(table, table->mappings+j);
+                    if(((entry-1)&0x1f)==length && 0==memcmp(other, bytes, length)) {
+                        break;
+                    }
+                    slot=(slot+1)&index->prefixMask;
+                }
+                if(entry==0) {
+                    index->prefixSlots[slot]=PREFIX_ENTRY(i, length)+1;
+                }
+            }
+        }
+    }
+
+    return index;
+}
+
+U_CAPI void U_EXPORT2
+ucm_closeIndex(UCMIndex *index) {
+    if(index!=NULL) {
+        free(index->unicodeSlots);
+        free(index->bytesSlots);
+        free(index->firstCodePointSlots);
+        free(index->prefixSlots);
+        free(index);
+    }
+}
+
+U_CAPI UBool U_EXPORT2
+ucm_isFirstCodePoint(const UCMIndex *index, UChar32 c) {
+    int32_t slot, entry;
+
+    slot=(int32_t)(hashCodePoints(&c, 1)&index->firstCodePointMask);
+    while((entry=index->firstCodePointSlots[slot])!=0) {
+        if(entry-1==c) {
+            return TRUE;
+        }
+        slot=(slot+1)&index->firstCodePointMask;
+    }
+    return FALSE;
+}
+
+U_CAPI UBool U_EXPORT2
+ucm_isBytesPrefix(const UCMIndex *index, const uint8_t *bytes, int32_t length) {
+    UCMTable *table=index->table;
+    int32_t slot, entry;
+
+    if(length<=0 || length>UCNV_EXT_MAX_LENGTH) {
+        return FALSE;
+    }
+    slot=(int32_t)(hashBytes(bytes, length)&index->prefixMask);
+    while((entry=index->prefixSlots[slot])!=0) {
+        if( ((entry-1)&0x1f)==length &&
+            0==memcmp(UCM_GET_BYTES(table, table->mappings+((entry-1)>>5)), bytes, length)
+        ) {
+            return TRUE;
+        }
+        slot=(slot+1)&index->prefixMask;
+    }
+    return FALSE;
+}
+
+U_CAPI int32_t U_EXPORT2
+ucm_findUnicode(const UCMIndex *index,
+                const UChar32 *codePoints, int32_t length,
+                int32_t *pSlot) {
+    UCMTable *table=index->table;
+    int32_t slot, entry;
+
+    if(*pSlot<0) {
+        slot=(int32_t)(hashCodePoints(codePoints, length)&index->unicodeMask);
+    } else {
+        slot=(*pSlot+1)&index->unicodeMask;
+    }
+    while((entry=index->unicodeSlots[slot])!=0) {
+        if(isSameCodePoints(table, table->mappings+entry-1, codePoints, length)) {
+            *pSlot=slot;
+            return entry-1;
+        }
+        slot=(slot+1)&index->unicodeMask;
+    }
+    return -1;
+}
+
+U_CAPI int32_t U_EXPORT2
+ucm_findBytes(const UCMIndex *index,
+              const uint8_t *bytes, int32_t length,
+              int32_t *pSlot) {
+    UCMTable *table=index->table;
+    int32_t slot, entry;
+
+    if(*pSlot<0) {
+        slot=(int32_t)(hashBytes(bytes, length)&index->bytesMask);
+    } else {
+        slot=(*pSlot+1)&index->bytesMask;
+    }
+    while((entry=index->bytesSlots[slot])!=0) {
+        if(isSameBytes(table, table->mappings+entry-1, bytes, length)) {
+            *pSlot=slot;
+            return entry-1;
+        }
+        slot=(slot+1)&index->bytesMask;
+    }
+    return -1;
+}
+
+/* normalization ------------------------------------------------------------ */
+
+static void
+printMapping(UCMTable *table, const UCMapping *m, FILE *f) {
+    const UChar32 *codePoints;
+    const uint8_t *bytes;
+    int32_t j;
+
+    codePoints=UCM_GET_CODE_POINTS(table, m);
+    for(j=0; j<m->uLen; ++j) {
+        fprintf(f, "<U%04lX>", (long)codePoints[j]);
+    }
+    fputc(' ', f);
+    bytes=UCM_GET_BYTES(table, m);
+    for(j=0; j<m->bLen; ++j) {
+        fprintf(f, "\\x%02X", bytes[j]);
+    }
+    if(m->f>=0) {
+        fprintf(f, " |%d", m->f);
+    }
+}
+
+static void
+printConflict(UCMTable *table, const char *message, const UCMapping *m1, const UCMapping *m2) {
+    fprintf(stderr, "ucm error: %s:\n    ", message);
+    printMapping(table, m1, stderr);
+    fputs("\n    ", stderr);
+    printMapping(table, m2, stderr);
+    fputc('\n', stderr);
+}
+
+U_CAPI UBool U_EXPORT2
+ucm_normalizeTable(UCMTable *table) {
+    UCMIndex index;
+    UCMapping *m, *other;
+    const UChar32 *codePoints;
+    const uint8_t *bytes;
+    int32_t *newIndexes;
+    int32_t i, j, slot, entry, length;
+    UBool isOK, isRemoved;
+
+    if(table->isReadOnly) {
+        fprintf(stderr, "ucm error: unable to normalize a cached, read-only table\n");
+        exit(U_NO_WRITE_PERMISSION);
+    }
+
+    /* the unicode and bytes slots are filled while going through the mappings */
+    index.table=table;
+    index.unicodeSlots=allocSlots(table->mappingsLength, &index.unicodeMask);
+    index.bytesSlots=allocSlots(table->mappingsLength, &index.bytesMask);
+    newIndexes=(int32_t *)malloc((table->mappingsLength+1)*4);
+    if(newIndexes==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate memory for normalizing a table\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+
+    isOK=TRUE;
+    length=0; /* number of mappings kept so far */
+    for(i=0; i<table->mappingsLength; ++i) {
+        m=table->mappings+i;
+        codePoints=UCM_GET_CODE_POINTS(table, m);
+        bytes=UCM_GET_BYTES(table, m);
+        isRemoved=FALSE;
+
+        /* compare with earlier mappings for the same code points */
+        slot=-1;
+        while((j=ucm_findUnicode(&index, codePoints, m->uLen, &slot))>=0) {
+            other=table->mappings+j;
+            if(isSameBytes(table, other, bytes, m->bLen)) {
+                if(other->f==m->f) {
+                    isRemoved=TRUE; /* duplicate */
+                    break;
+                } else if((other->f==1 && m->f==3) || (other->f==3 && m->f==1)) {
+                    /* |1 and |3 for the same pair: one roundtrip mapping */
+                    other->f=0;
+                    isRemoved=TRUE;
+                    break;
+                } else {
+                    printConflict(table, "the same mapping with different flags", other, m);
+                    isOK=FALSE;
+                }
+            } else if(IS_FROM_U(other) && IS_FROM_U(m)) {
+                printConflict(table, "more than one fromUnicode mapping for the same code points", other, m);
+                isOK=FALSE;
+            }
+        }
+
+        if(!isRemoved) {
+            /* compare with earlier mappings for the same bytes */
+            slot=-1;
+            while((j=ucm_findBytes(&index, bytes, m->bLen, &slot))>=0) {
+                other=table->mappings+j;
+                if(IS_TO_U(other) && IS_TO_U(m)) {
+                    printConflict(table, "more than one toUnicode mapping for the same bytes", other, m);
+                    isOK=FALSE;
+                }
+            }
+
+            /* keep this mapping */
+            slot=(int32_t)(hashCodePoints(codePoints, m->uLen)&index.unicodeMask);
+            while(index.unicodeSlots[slot]!=0) {
+                slot=(slot+1)&index.unicodeMask;
+            }
+            index.unicodeSlots[slot]=i+1;
+
+            slot=(int32_t)(hashBytes(bytes, m->bLen)&index.bytesMask);
+            while(index.bytesSlots[slot]!=0) {
+                slot=(slot+1)&index.bytesMask;
+            }
+            index.bytesSlots[slot]=i+1;
+
+            newIndexes[i]=length++;
+        } else {
+            newIndexes[i]=-1;
+        }
+    }
+
+    /*
+     * Remove the merged and duplicate mappings, keeping the order.
+     * A sorted table stays sorted because only the flags of the remaining one
+     * of two equal mappings changed, and |0 sorts before the others.
+     */
+    if(length<table->mappingsLength) {
+        for(i=0; i<table->mappingsLength; ++i) {
+            if((j=newIndexes[i])>=0) {
+                table->mappings[j]=table->mappings[i];
+            }
+        }
+        if(table->reverseMap!=NULL) {
+            for(i=j=0; i<table->mappingsLength; ++i) {
+                entry=newIndexes[table->reverseMap[i]];
+                if(entry>=0) {
+                    table->reverseMap[j++]=entry;
+                }
+            }
+        }
+        table->mappingsLength=length;
+    }
+
+    free(index.unicodeSlots);
+    free(index.bytesSlots);
+    free(newIndexes);
+    return isOK;
+}
 
 /* general APIs ------------------------------------------------------------- */
 
@@ -374,17 +1086,101 @@ ucm_openTable() {
     return table;
 }
 
+/* arena of code points or bytes, see ucm.h */
+
+/* allocate length units, which will not cross a chunk boundary */
+static int32_t
+arenaAlloc(UCMArena *arena, int32_t length, int32_t unitSize) {
+    int32_t chunk, offset;
+
+    chunk=arena->top>>UCM_ARENA_CHUNK_SHIFT;
+    offset=arena->top&UCM_ARENA_CHUNK_MASK;
+    if(offset+length>UCM_ARENA_CHUNK_SIZE) {
+        /*
+         * start a new chunk;
+         * zero the rest of the current one so that the units [0..top[
+         * are all initialized, for a deterministic cache file (see ucmcache.c)
+         */
+        memset((char *)arena->chunks[chunk]+offset*unitSize, 0,
+               (UCM_ARENA_CHUNK_SIZE-offset)*unitSize);
+        ++chunk;
+        offset=0;
+    }
+
+    if(chunk>=arena->chunksCount) {
+        /* allocate another chunk; only the array of chunk pointers is reallocated */
+        if(chunk>=(0x7fffffff>>UCM_ARENA_CHUNK_SHIFT)) {
+            fprintf(stderr, "ucm error: too many code points or bytes in long mappings\n");
+            exit(U_INDEX_OUTOFBOUNDS_ERROR);
+        }
+        if(arena->chunksCount>=arena->chunksCapacity) {
+            if(arena->chunksCapacity==0) {
+                arena->chunksCapacity=16;
+            } else {
+                arena->chunksCapacity*=2;
+            }
+            arena->chunks=(void **)realloc(arena->chunks, arena->chunksCapacity*sizeof(void *));
+            if(arena->chunks==NULL) {
+                fprintf(stderr, "ucm error: unable to allocate %d arena chunk pointers\n",
+                                arena->chunksCapacity);
+                exit(U_MEMORY_ALLOCATION_ERROR);
+            }
+        }
+        arena->chunks[arena->chunksCount]=malloc(UCM_ARENA_CHUNK_SIZE*unitSize);
+        if(arena->chunks[arena->chunksCount]==NULL) {
+            fprintf(stderr, "ucm error: unable to allocate an arena chunk\n");
+            exit(U_MEMORY_ALLOCATION_ERROR);
+        }
+        ++arena->chunksCount;
+    }
+
+    arena->top=(chunk<<UCM_ARENA_CHUNK_SHIFT)+offset+length;
+    return (chunk<<UCM_ARENA_CHUNK_SHIFT)|offset;
+}
+
+static void
+arenaClose(UCMArena *arena) {
+    int32_t i;
+
+    for(i=0; i<arena->chunksCount; ++i) {
+        free(arena->chunks[i]);
+    }
+    free(arena->chunks);
+}
+
 U_CAPI void U_EXPORT2
 ucm_closeTable(UCMTable *table) {
     if(table!=NULL) {
-        free(table->mappings);
-        free(table->codePoints);
-        free(table->bytes);
-        free(table->reverseMap);
+        if(!table->isReadOnly) {
+            free(table->mappings);
+            arenaClose(&table->codePoints);
+            arenaClose(&table->bytes);
+            free(table->reverseMap);
+        } else {
+            /* only the arrays of chunk pointers are owned */
+            free(table->codePoints.chunks);
+            free(table->bytes.chunks);
+        }
         free(table);
     }
 }
 
+U_CAPI void U_EXPORT2
+ucm_resetTable(UCMTable *table) {
+    if(table!=NULL) {
+        if(table->isReadOnly) {
+            /* drop the references into the cache file */
+            free(table->codePoints.chunks);
+            free(table->bytes.chunks);
+            memset(table, 0, sizeof(UCMTable));
+        }
+        table->mappingsLength=0;
+        table->codePoints.top=0;
+        table->bytes.top=0;
+        table->flagsType=UCM_FLAGS_INITIAL;
+    }
+}
+
 U_CAPI void U_EXPORT2
 ucm_addMapping(UCMTable *table,
                UCMapping *m,
@@ -393,6 +1189,11 @@ ucm_addMapping(UCMTable *table,
     UCMapping *tm;
     int32_t index;
 
+    if(table->isReadOnly) {
+        fprintf(stderr, "ucm error: unable to add a mapping to a cached, read-only table\n");
+        exit(U_NO_WRITE_PERMISSION);
+    }
+
     if(table->mappingsLength>=table->mappingsCapacity) {
         /* make the mappings array larger */
         if(table->mappingsCapacity==0) {
@@ -415,47 +1216,15 @@ ucm_addMapping(UCMTable *table,
         }
     }
 
-    if(m->uLen>1 && table->codePointsCapacity==0) {
-        table->codePointsCapacity=10000;
-        table->codePoints=(UChar32 *)malloc(table->codePointsCapacity*4);
-        if(table->codePoints==NULL) {
-            fprintf(stderr, "ucm error: unable to allocate %d UChar32s\n",
-                            table->codePointsCapacity);
-            exit(U_MEMORY_ALLOCATION_ERROR);
-        }
-    }
-
-    if(m->bLen>4 && table->bytesCapacity==0) {
-        table->bytesCapacity=10000;
-        table->bytes=(uint8_t *)malloc(table->bytesCapacity);
-        if(table->bytes==NULL) {
-            fprintf(stderr, "ucm error: unable to allocate %d bytes\n",
-                            table->bytesCapacity);
-            exit(U_MEMORY_ALLOCATION_ERROR);
-        }
-    }
-
     if(m->uLen>1) {
-        index=table->codePointsLength;
-        table->codePointsLength+=m->uLen;
-        if(table->codePointsLength>table->codePointsCapacity) {
-            fprintf(stderr, "ucm error: too many code points in multiple-code point mappings\n");
-            exit(U_MEMORY_ALLOCATION_ERROR);
-        }
-
-        memcpy(table->codePoints+index, codePoints, m->uLen*4);
+        index=arenaAlloc(&table->codePoints, m->uLen, 4);
+        memcpy(UCM_ARENA_GET(table->codePoints, UChar32, index), codePoints, m->uLen*4);
         m->u=index;
     }
 
     if(m->bLen>4) {
-        index=table->bytesLength;
-        table->bytesLength+=m->bLen;
-        if(table->bytesLength>table->bytesCapacity) {
-            fprintf(stderr, "ucm error: too many bytes in mappings with >4 charset bytes\n");
-            exit(U_MEMORY_ALLOCATION_ERROR);
-        }
-
-        memcpy(table->bytes+index, bytes, m->bLen);
+        index=arenaAlloc(&table->bytes, m->bLen, 1);
+        memcpy(UCM_ARENA_GET(table->bytes, uint8_t, index), bytes, m->bLen);
         m->b.index=index;
     }
 
@@ -516,8 +1285,12 @@ ucm_open() {
 U_CAPI void U_EXPORT2
 ucm_close(UCMFile *ucm) {
     if(ucm!=NULL) {
-        free(ucm->base);
-        free(ucm->ext);
+        ucm_closeTable(ucm->base);
+        ucm_closeTable(ucm->ext);
+        ucm_closeStates(&ucm->states);
+        if(ucm->cache!=NULL) {
+            udata_close(ucm->cache);
+        }
         free(ucm);
     }
 }
@@ -528,7 +1301,7 @@ ucm_addMappingFromLine(UCMFile *ucm, const char *line, UBool forBase) {
     UChar32 codePoints[UCNV_EXT_MAX_LENGTH];
     uint8_t bytes[UCNV_EXT_MAX_LENGTH];
 
-    ucm_parseMappingLine(&m, codePoints, bytes, line);
+    parseMappingLine(&m, codePoints, bytes, line, ucm->lineNumber);
 
     /*
      * Add the mapping to the base table if this is requested
@@ -545,6 +1318,10 @@ ucm_addMappingFromLine(UCMFile *ucm, const char *line, UBool forBase) {
             for(count=0; count<m.bLen; ++count) {
                 fprintf(stderr, " %02X", bytes[count]);
             }
+            if(ucm->lineNumber>0) {
+                fprintf(stderr, " on line %ld", (long)ucm->lineNumber);
+            }
+            fputc('\n', stderr);
             exit(U_INVALID_TABLE_FORMAT);
         }
     }
@@ -20,6 +20,7 @@
 #define __UCM_H__
 
 #include "unicode/utypes.h"
+#include "unicode/udata.h"
 #include "ucnvmbcs.h"
 #include "ucnv_ext.h"
 #include <stdio.h>
@@ -35,9 +36,9 @@ enum {
  * Per-mapping data structure
  *
  * u if uLen==1: Unicode code point
- *   else index to uLen code points
+ *   else arena index to uLen code points
  * b if bLen<=4: up to 4 bytes
- *   else index to bLen bytes
+ *   else arena index to bLen bytes
  * uLen number of code points
  * bLen number of words containing left-justified bytes
  * bIsMultipleChars indicates that the bytes contain more than one sequence
@@ -60,20 +61,44 @@ enum {
     UCM_FLAGS_EXPLICIT  /* .ucm file has mappings with | fallback indicators */
 };
 
+/*
+ * Chunked arena for the code points and bytes of long mappings.
+ * Chunks are allocated as needed and never move or grow,
+ * and a sequence never crosses a chunk boundary.
+ * Adding a sequence therefore never copies existing data,
+ * and an arena index addresses it directly:
+ *   index=(chunk number<<UCM_ARENA_CHUNK_SHIFT)|(offset in the chunk)
+ */
+enum {
+    UCM_ARENA_CHUNK_SHIFT=12,
+    UCM_ARENA_CHUNK_SIZE=1<<UCM_ARENA_CHUNK_SHIFT,  /* units per chunk */
+    UCM_ARENA_CHUNK_MASK=UCM_ARENA_CHUNK_SIZE-1
+};
+
+typedef struct UCMArena {
+    void **chunks;
+    int32_t chunksCapacity, chunksCount; /* allocated chunks */
+    int32_t top; /* arena index of the next free unit */
+} UCMArena;
+
 typedef struct UCMTable {
     UCMapping *mappings;
     int32_t mappingsCapacity, mappingsLength;
 
-    UChar32 *codePoints;
-    int32_t codePointsCapacity, codePointsLength;
-
-    uint8_t *bytes;
-    int32_t bytesCapacity, bytesLength;
+    UCMArena codePoints; /* UChar32 units */
+    UCMArena bytes;      /* uint8_t units */
 
-    /* index map for mapping by bytes first */
+    /* index map for mapping by bytes first, mappingsCapacity entries */
     int32_t *reverseMap;
 
     int8_t flagsType; /* UCM_FLAGS_INITIAL etc. */
+
+    /*
+     * TRUE if the mappings, the reverseMap and the arena chunks are in
+     * a cache file (see ucm_openCachedFile()); such a table is sorted and
+     * cannot be modified except by ucm_resetTable()
+     */
+    UBool isReadOnly;
 } UCMTable;
 
 enum {
@@ -83,13 +108,52 @@ enum {
     MBCS_STATE_FLAG_READY=16
 };
 
+/*
+ * Compact form of a state table for walking byte sequences (validation, counting).
+ * Only the next state and the action are kept for each entry, not the offsets.
+ * Byte values that behave the same in all states share a byte class, and
+ * states with identical rows (by class) share a row.
+ * A table with few states and ranges typically takes well under 1kB
+ * instead of 1kB per state.
+ *
+ * Entry bits:
+ * 31     final
+ * 19..16 action (final entries only)
+ * 15..0  index of the next row's first entry (next row * countClasses)
+ */
+typedef struct UCMCompactStates {
+    uint8_t byteClasses[256];
+    int32_t countClasses, countRows;
+    uint32_t *entries;  /* [row*countClasses+byteClass] */
+    uint16_t stateRows[MBCS_MAX_STATE_COUNT]; /* index of each state's row in entries[] */
+    /*
+     * index of the initial row if bytes 00..7f are valid single-byte characters
+     * that stay in that row (ASCII fast path), otherwise -1
+     */
+    int32_t asciiRow;
+} UCMCompactStates;
+
+#define UCM_COMPACT_ENTRY_IS_FINAL(entry) ((entry)&0x80000000)
+#define UCM_COMPACT_ENTRY_ACTION(entry) (((entry)>>16)&0xf)
+#define UCM_COMPACT_ENTRY_NEXT_ROW(entry) ((entry)&0xffff)
+
+#define UCM_COMPACT_GET_ENTRY(compact, rowIndex, b) \
+    ((compact)->entries[(rowIndex)+(compact)->byteClasses[b]])
+
 typedef struct UCMStates {
-    int32_t stateTable[MBCS_MAX_STATE_COUNT][256];
+    /*
+     * stateTable[state][byte] for state<countStates;
+     * rows are allocated as states are added
+     */
+    int32_t (*stateTable)[256];
     uint32_t stateFlags[MBCS_MAX_STATE_COUNT],
              stateOffsetSum[MBCS_MAX_STATE_COUNT];
 
     int32_t countStates, minCharLength, maxCharLength, countToUCodeUnits;
     int8_t conversionType;
+
+    /* built on demand by ucm_compactStates(), discarded by ucm_addState() */
+    UCMCompactStates compact;
 } UCMStates;
 
 typedef struct UCMFile {
@@ -97,15 +161,50 @@ typedef struct UCMFile {
     UCMStates states;
 
     char baseName[UCNV_MAX_CONVERTER_NAME_LENGTH];
+
+    /* number of the line being parsed, for error messages; 0 if unknown */
+    int32_t lineNumber;
+
+    /* mapped cache file with the tables' data, or NULL */
+    UDataMemory *cache;
 } UCMFile;
 
+/*
+ * .ucm file reader.
+ * Reads the whole file into memory and returns one line at a time,
+ * without a line length limit.
+ */
+typedef struct UCMReader {
+    char *buffer;
+    int32_t length, start; /* start: offset of the next line */
+    int32_t lineNumber;    /* of the line returned last, starting with 1 */
+} UCMReader;
+
+/*
+ * Open-addressing hash index over the mappings of a UCMTable,
+ * by code point sequence and by byte sequence,
+ * with sets of the first code points of fromUnicode mappings (|0, |1, |2)
+ * and of all prefixes of the byte sequences of toUnicode mappings (|0, |3).
+ * The index is valid until the table is modified.
+ */
+typedef struct UCMIndex {
+    UCMTable *table;
+    int32_t *unicodeSlots, *bytesSlots;  /* mapping index+1 */
+    int32_t *firstCodePointSlots;        /* code point+1 */
+    int32_t *prefixSlots;                /* ((mapping index<<5)|prefix length)+1 */
+    int32_t unicodeMask, bytesMask, firstCodePointMask, prefixMask;
+} UCMIndex;
+
 /* simple accesses ---------------------------------------------------------- */
 
+#define UCM_ARENA_GET(arena, type, index) \
+    ((type *)(arena).chunks[(index)>>UCM_ARENA_CHUNK_SHIFT]+((index)&UCM_ARENA_CHUNK_MASK))
+
 #define UCM_GET_CODE_POINTS(t, m) \
-    (((m)->uLen==1) ? &(m)->u : (t)->codePoints+(m)->u)
+    (((m)->uLen==1) ? &(m)->u : UCM_ARENA_GET((t)->codePoints, UChar32, (m)->u))
 
 #define UCM_GET_BYTES(t, m) \
-    (((m)->bLen<=4) ? (m)->b.bytes : (t)->bytes+(m)->b.index)
+    (((m)->bLen<=4) ? (m)->b.bytes : UCM_ARENA_GET((t)->bytes, uint8_t, (m)->b.index))
 
 /* APIs --------------------------------------------------------------------- */
 
@@ -129,12 +228,145 @@ ucm_openTable(void);
 U_CAPI void U_EXPORT2
 ucm_closeTable(UCMTable *table);
 
+/*
+ * Remove all mappings but keep the allocated memory,
+ * so that the table can be reused for another set of mappings
+ * without new allocations.
+ */
+U_CAPI void U_EXPORT2
+ucm_resetTable(UCMTable *table);
+
 U_CAPI void U_EXPORT2
 ucm_sortTable(UCMTable *t);
 
+/*
+ * Same as ucm_sortTable() but always with the comparator-based sorts,
+ * also for tables that ucm_sortTable() radix-sorts; for benchmarks.
+ */
+U_CAPI void U_EXPORT2
+ucm_sortTableByComparison(UCMTable *t);
+
 U_CAPI void U_EXPORT2
 ucm_printTable(UCMTable *table, FILE *f);
 
+/*
+ * Merge each pair of |1 and |3 mappings with the same code points and bytes
+ * into one |0 mapping and remove duplicate mappings, in one pass
+ * with a hash index and without sorting; a sorted table stays sorted.
+ * Reports conflicting mappings: different fromUnicode mappings for the same
+ * code points, different toUnicode mappings for the same bytes,
+ * or the same mapping with otherwise different flags.
+ * @return TRUE if there are no conflicts
+ */
+U_CAPI UBool U_EXPORT2
+ucm_normalizeTable(UCMTable *table);
+
+
+U_CAPI UCMIndex * U_EXPORT2
+ucm_openIndex(UCMTable *table);
+
+U_CAPI void U_EXPORT2
+ucm_closeIndex(UCMIndex *index);
+
+/* is c the first code point of any fromUnicode mapping (|0, |1, |2)? */
+U_CAPI UBool U_EXPORT2
+ucm_isFirstCodePoint(const UCMIndex *index, UChar32 c);
+
+/* is the byte sequence a prefix of (or equal to) any toUnicode mapping's bytes (|0, |3)? */
+U_CAPI UBool U_EXPORT2
+ucm_isBytesPrefix(const UCMIndex *index, const uint8_t *bytes, int32_t length);
+
+/*
+ * Find the mappings with exactly these code points.
+ * Start with *pSlot=-1 and call again with the same pSlot for the next one.
+ * @return mapping index, or -1 if there are no more
+ */
+U_CAPI int32_t U_EXPORT2
+ucm_findUnicode(const UCMIndex *index,
+                const UChar32 *codePoints, int32_t length,
+                int32_t *pSlot);
+
+/* same as ucm_findUnicode() but for the mappings with exactly these bytes */
+U_CAPI int32_t U_EXPORT2
+ucm_findBytes(const UCMIndex *index,
+              const uint8_t *bytes, int32_t length,
+              int32_t *pSlot);
+
+
+/*
+ * Build conversion extension data (see ucnv_ext.h) from the table's mappings.
+ * Sorts the table.
+ * @return malloc()ed data, starting with indexes[]; *pSize=number of bytes
+ */
+U_CAPI int32_t * U_EXPORT2
+ucm_buildExtData(UCMTable *table, int32_t *pSize);
+
+/*
+ * Same as ucm_buildExtData() but never with the initial-code point trie:
+ * all initial UChars are in the root fromUTable section,
+ * as in data for which the builder rejects the trie.
+ */
+U_CAPI int32_t * U_EXPORT2
+ucm_buildExtDataWithoutTrie(UCMTable *table, int32_t *pSize);
+
+/*
+ * Print the size of extension data as built by ucm_buildExtData()
+ * and how its lookups work: how many toUnicode sections are dense
+ * and directly indexed, and whether initial code points go through the trie.
+ */
+U_CAPI void U_EXPORT2
+ucm_printExtStats(const int32_t *indexes, const char *name, FILE *f);
+
+/*
+ * Build the extension data and write it to destDir/name.cnvx
+ * for loading with ucnv_extOpenData().
+ */
+U_CAPI void U_EXPORT2
+ucm_writeExtData(UCMTable *table, const char *destDir, const char *name);
+
+/*
+ * Build converter pair data (see ucnv_ext.h) for converting directly
+ * from the source charset's bytes to the target charset's bytes.
+ * Source mappings whose single code point has exactly one roundtrip mapping
+ * in the target get their target bytes, all others are marked for pivoting
+ * through Unicode.
+ * @return malloc()ed data, starting with indexes[]; *pSize=number of bytes
+ */
+U_CAPI int32_t * U_EXPORT2
+ucm_buildPairData(UCMFile *source, UCMFile *target, int32_t *pSize,
+                  int32_t *pDirectCount, int32_t *pPivotCount);
+
+/*
+ * Write converter pair data to destDir/name.cnvp
+ * for loading with ucnv_extOpenPairData().
+ */
+U_CAPI void U_EXPORT2
+ucm_writePairData(const int32_t *indexes, const char *destDir, const char *name);
+
+
+/*
+ * Binary cache of parsed .ucm files, see ucmcache.c.
+ * A cache file is named after a hash of the .ucm source text and contains
+ * the header fields, the states and the sorted base and extension tables.
+ */
+U_CAPI uint64_t U_EXPORT2
+ucm_hashSource(const char *source, int32_t length);
+
+/*
+ * Load the cached UCMFile for the source with this hash and length.
+ * The mapping tables are used directly from the mapped file and are read-only.
+ * @return the UCMFile, or NULL if there is no matching, intact cache file
+ */
+U_CAPI UCMFile * U_EXPORT2
+ucm_openCachedFile(const char *cacheDir, uint64_t hash, int32_t length);
+
+/*
+ * Write a cache file for a completely parsed UCMFile with processed states.
+ * Sorts the tables.
+ */
+U_CAPI void U_EXPORT2
+ucm_writeCachedFile(UCMFile *ucm, const char *cacheDir, uint64_t hash, int32_t length);
+
 
 U_CAPI void U_EXPORT2
 ucm_addState(UCMStates *states, const char *s);
@@ -142,10 +374,59 @@ ucm_addState(UCMStates *states, const char *s);
 U_CAPI void U_EXPORT2
 ucm_processStates(UCMStates *states);
 
+/* build states->compact from the current state table */
+U_CAPI void U_EXPORT2
+ucm_compactStates(UCMStates *states);
+
+/* release the memory of the state table and its compact form */
+U_CAPI void U_EXPORT2
+ucm_closeStates(UCMStates *states);
+
 U_CAPI int32_t U_EXPORT2
 ucm_countChars(UCMStates *states,
                const uint8_t *bytes, int32_t length);
 
+/*
+ * Validate a whole byte stream against the state table, starting in state 0
+ * like a converter; state changes (SI/SO) are allowed and not counted.
+ * Does not print anything.
+ * Builds the compact state table if necessary.
+ *
+ * @param pErrorOffset receives -1 if the bytes form only complete, valid characters,
+ *        otherwise the offset of the first byte of the first illegal, unassigned
+ *        or truncated character
+ * @return number of valid characters before *pErrorOffset (or in total)
+ */
+U_CAPI int32_t U_EXPORT2
+ucm_validateBytes(UCMStates *states,
+                  const uint8_t *bytes, int32_t length,
+                  int32_t *pErrorOffset);
+
+
+U_CAPI void U_EXPORT2
+ucm_openReader(UCMReader *reader, FILE *f);
+
+/*
+ * Return the next line, NUL-terminated in place without CR/LF,
+ * or NULL at the end of the file.
+ * The line may be modified and stays valid until ucm_closeReader().
+ */
+U_CAPI char * U_EXPORT2
+ucm_readLine(UCMReader *reader);
+
+U_CAPI void U_EXPORT2
+ucm_closeReader(UCMReader *reader);
+
+/*
+ * Read a whole .ucm file: the header, the base table
+ * and the optional extension table, or only the extension table
+ * if the header names a base table (<icu:base>).
+ * Like the rest of the ucm module, exit()s in case of an error.
+ * @return the new UCMFile, to be closed with ucm_close()
+ */
+U_CAPI UCMFile * U_EXPORT2
+ucm_readFile(const char *filename);
+
 
 U_CAPI int8_t U_EXPORT2
 ucm_parseBytes(uint8_t bytes[UCNV_EXT_MAX_LENGTH], const char *line, const char **ps);
@@ -0,0 +1,462 @@
+/*
+*******************************************************************************
+*
+*   Copyright (C) 2026, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+*
+*******************************************************************************
+*   file name:  ucmcache.c
+*   encoding:   US-ASCII
+*   tab size:   8 (not used)
+*   indentation:4
+*
+*   created on: 2026oct16
+*   created by: agent
+*
+*   This file writes and loads a binary cache of parsed .ucm files
+*   as part of the ucm module.
+*
+*   A cache file contains a fully parsed UCMFile: the header fields,
+*   the processed states and the sorted base and extension tables.
+*   It is named after a 64-bit hash of the .ucm source text,
+*   in a cache directory, so that an unchanged .ucm file need not be parsed
+*   and sorted again.
+*   The mappings, the reverseMap and the arena units of the tables are used
+*   directly from the mapped file; only the small state table is copied.
+*
+*   The data is written as is, in the platform's struct layout, after a
+*   standard ICU data header; the data header check rejects files from
+*   platforms with different endianness or charset family.
+*   The loader checks the offsets and lengths against the size of the file
+*   and treats a damaged or truncated file like a missing one.
+*/
+
+#include "unicode/utypes.h"
+#include "unicode/udata.h"
+#include "unicode/putil.h"
+#include "cstring.h"
+#include "udatamem.h"
+#include "unewdata.h"
+#include "ucnvmbcs.h"
+#include "ucnv_ext.h"
+#include "ucm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#   include <process.h>
+#   define getpid _getpid
+#else
+#   include <unistd.h>
+#endif
+
+#define UCM_CACHE_DATA_TYPE "ucmc"
+
+/* UDataInfo cf. udata.h */
+static const UDataInfo dataInfo={
+    sizeof(UDataInfo),
+    0,
+
+    U_IS_BIG_ENDIAN,
+    U_CHARSET_FAMILY,
+    sizeof(UChar),
+    0,
+
+    { 0x55, 0x63, 0x6d, 0x43 },     /* dataFormat="UcmC" */
+    { 1, 0, 0, 0 },                 /* formatVersion */
+    { 0, 0, 0, 0 }                  /* dataVersion */
+};
+
+/*
+ * Cache file format, after the data header:
+ *
+ * int32_t indexes[UCM_CACHE_INDEX_COUNT] with byte offsets from the start of indexes[]
+ * CachedStates states, followed by countStates rows of 256 int32_t
+ * for the base table and the extension table:
+ *   CachedTable table
+ *   UCMapping mappings[mappingsLength]
+ *   int32_t reverseMap[mappingsLength] (if mappingsLength>0)
+ *   UChar32 codePoints[codePointsTop] (arena units, chunk by chunk)
+ *   uint8_t bytes[bytesTop], padded to a multiple of 4
+ */
+enum {
+    UCM_CACHE_INDEXES_LENGTH,
+    UCM_CACHE_SOURCE_LENGTH,
+    UCM_CACHE_HASH_LOW,
+    UCM_CACHE_HASH_HIGH,
+
+    UCM_CACHE_STATES_OFFSET,
+    UCM_CACHE_BASE_OFFSET,
+    UCM_CACHE_EXT_OFFSET,
+    UCM_CACHE_SIZE,
+
+    UCM_CACHE_INDEX_COUNT=8
+};
+
+typedef struct CachedStates {
+    uint32_t stateFlags[MBCS_MAX_STATE_COUNT],
+             stateOffsetSum[MBCS_MAX_STATE_COUNT];
+    int32_t countStates, minCharLength, maxCharLength, countToUCodeUnits;
+    int32_t conversionType;
+    char baseName[UCNV_MAX_CONVERTER_NAME_LENGTH];
+} CachedStates;
+
+typedef struct CachedTable {
+    int32_t mappingsLength, codePointsTop, bytesTop, flagsType;
+} CachedTable;
+
+#define PAD4(length) (((length)+3)&~3)
+
+/* FNV-1a */
+U_CAPI uint64_t U_EXPORT2
+ucm_hashSource(const char *source, int32_t length) {
+    uint64_t hash=((uint64_t)0xcbf29ce4<<32)|0x84222325;
+    const uint8_t *s=(const uint8_t *)source, *limit=s+length;
+
+    while(s<limit) {
+        hash=(hash^*s++)*(((uint64_t)0x100<<32)|0x1b3);
+    }
+    return hash;
+}
+
+static void
+getCacheName(char name[20], uint64_t hash) {
+    sprintf(name, "%08lx%08lx", (unsigned long)(hash>>32), (unsigned long)(hash&0xffffffff));
+}
+
+/* writer ------------------------------------------------------------------- */
+
+static int32_t
+getTableSize(const UCMTable *table) {
+    int32_t size;
+
+    size=sizeof(CachedTable)+table->mappingsLength*(sizeof(UCMapping)+4);
+    size+=table->codePoints.top*4;
+    size+=PAD4(table->bytes.top);
+    return size;
+}
+
+/* write the units [0..top[ of an arena chunk by chunk */
+static void
+writeArena(UNewDataMemory *pData, const UCMArena *arena, int32_t unitSize) {
+    int32_t i, length;
+
+    for(i=0; i<arena->top; i+=UCM_ARENA_CHUNK_SIZE) {
+        length=arena->top-i;
+        if(length>UCM_ARENA_CHUNK_SIZE) {
+            length=UCM_ARENA_CHUNK_SIZE;
+        }
+        udata_writeBlock(pData, arena->chunks[i>>UCM_ARENA_CHUNK_SHIFT], length*unitSize);
+    }
+}
+
+static void
+writeTable(UNewDataMemory *pData, const UCMTable *table) {
+    CachedTable cached;
+
+    cached.mappingsLength=table->mappingsLength;
+    cached.codePointsTop=table->codePoints.top;
+    cached.bytesTop=table->bytes.top;
+    cached.flagsType=table->flagsType;
+    udata_writeBlock(pData, &cached, sizeof(cached));
+
+    if(table->mappingsLength>0) {
+        udata_writeBlock(pData, table->mappings, table->mappingsLength*sizeof(UCMapping));
+        udata_writeBlock(pData, table->reverseMap, table->mappingsLength*4);
+    }
+    writeArena(pData, &table->codePoints, 4);
+    writeArena(pData, &table->bytes, 1);
+    udata_writePadding(pData, PAD4(table->bytes.top)-table->bytes.top);
+}
+
+U_CAPI void U_EXPORT2
+ucm_writeCachedFile(UCMFile *ucm, const char *cacheDir, uint64_t hash, int32_t length) {
+    char name[20], tmpName[40];
+    char path[1024], tmpPath[1024];
+    int32_t indexes[UCM_CACHE_INDEX_COUNT];
+    CachedStates states;
+    UNewDataMemory *pData;
+    UErrorCode errorCode;
+    int32_t statesSize;
+
+    ucm_sortTable(ucm->base);
+    ucm_sortTable(ucm->ext);
+
+    /* the header fields and states */
+    memset(&states, 0, sizeof(states));
+    memcpy(states.stateFlags, ucm->states.stateFlags, sizeof(states.stateFlags));
+    memcpy(states.stateOffsetSum, ucm->states.stateOffsetSum, sizeof(states.stateOffsetSum));
+    states.countStates=ucm->states.countStates;
+    states.minCharLength=ucm->states.minCharLength;
+    states.maxCharLength=ucm->states.maxCharLength;
+    states.countToUCodeUnits=ucm->states.countToUCodeUnits;
+    states.conversionType=ucm->states.conversionType;
+    uprv_strcpy(states.baseName, ucm->baseName);
+    statesSize=sizeof(states)+states.countStates*256*4;
+
+    indexes[UCM_CACHE_INDEXES_LENGTH]=UCM_CACHE_INDEX_COUNT;
+    indexes[UCM_CACHE_SOURCE_LENGTH]=length;
+    indexes[UCM_CACHE_HASH_LOW]=(int32_t)hash;
+    indexes[UCM_CACHE_HASH_HIGH]=(int32_t)(hash>>32);
+    indexes[UCM_CACHE_STATES_OFFSET]=sizeof(indexes);
+    indexes[UCM_CACHE_BASE_OFFSET]=indexes[UCM_CACHE_STATES_OFFSET]+statesSize;
+    indexes[UCM_CACHE_EXT_OFFSET]=indexes[UCM_CACHE_BASE_OFFSET]+getTableSize(ucm->base);
+    indexes[UCM_CACHE_SIZE]=indexes[UCM_CACHE_EXT_OFFSET]+getTableSize(ucm->ext);
+
+    /*
+     * write a temporary file and rename it when it is complete
+     * so that another process never maps a partial file;
+     * the process ID keeps parallel writers of the same file apart
+     */
+    getCacheName(name, hash);
+    sprintf(tmpName, "%s_%ld_tmp", name, (long)getpid());
+
+    errorCode=U_ZERO_ERROR;
+    pData=udata_create(cacheDir, UCM_CACHE_DATA_TYPE, tmpName, &dataInfo, NULL, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        fprintf(stderr, "ucm error: unable to create the cache file %s.%s - %s\n",
+                tmpName, UCM_CACHE_DATA_TYPE, u_errorName(errorCode));
+        exit(errorCode);
+    }
+
+    udata_writeBlock(pData, indexes, sizeof(indexes));
+    udata_writeBlock(pData, &states, sizeof(states));
+    if(states.countStates>0) {
+        udata_writeBlock(pData, ucm->states.stateTable, states.countStates*256*4);
+    }
+    writeTable(pData, ucm->base);
+    writeTable(pData, ucm->ext);
+
+    udata_finish(pData, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        fprintf(stderr, "ucm error: failure writing the cache file %s.%s - %s\n",
+                tmpName, UCM_CACHE_DATA_TYPE, u_errorName(errorCode));
+        exit(errorCode);
+    }
+
+    if(uprv_strlen(cacheDir)+uprv_strlen(tmpName)+uprv_strlen(UCM_CACHE_DATA_TYPE)+3>(int32_t)sizeof(path)) {
+        fprintf(stderr, "ucm error: cache directory path too long\n");
+        exit(U_BUFFER_OVERFLOW_ERROR);
+    }
+    uprv_strcpy(path, cacheDir);
+    if(*cacheDir!=0 && path[uprv_strlen(path)-1]!=U_FILE_SEP_CHAR) {
+        uprv_strcat(path, U_FILE_SEP_STRING);
+    }
+    uprv_strcpy(tmpPath, path);
+    uprv_strcat(tmpPath, tmpName);
+    uprv_strcat(tmpPath, "." UCM_CACHE_DATA_TYPE);
+    uprv_strcat(path, name);
+    uprv_strcat(path, "." UCM_CACHE_DATA_TYPE);
+
+    remove(path); /* rename() does not replace files on Windows */
+    if(rename(tmpPath, path)!=0) {
+        fprintf(stderr, "ucm error: unable to rename %s to %s\n", tmpPath, path);
+        remove(tmpPath);
+        exit(U_FILE_ACCESS_ERROR);
+    }
+}
+
+/* loader ------------------------------------------------------------------- */
+
+static UBool U_CALLCONV
+isCacheAcceptable(void *context,
+                  const char *type, const char *name,
+                  const UDataInfo *pInfo) {
+    return (UBool)(
+        pInfo->size>=20 &&
+        pInfo->isBigEndian==U_IS_BIG_ENDIAN &&
+        pInfo->charsetFamily==U_CHARSET_FAMILY &&
+        pInfo->sizeofUChar==U_SIZEOF_UCHAR &&
+        pInfo->dataFormat[0]==0x55 &&   /* dataFormat="UcmC" */
+        pInfo->dataFormat[1]==0x63 &&
+        pInfo->dataFormat[2]==0x6d &&
+        pInfo->dataFormat[3]==0x43 &&
+        pInfo->formatVersion[0]==1);
+}
+
+/* point an arena's chunks to consecutive chunks of units in the cache file */
+static const uint8_t *
+mapArena(UCMArena *arena, int32_t top, const uint8_t *p, int32_t unitSize) {
+    int32_t i;
+
+    arena->top=top;
+    arena->chunksCount=arena->chunksCapacity=(top+UCM_ARENA_CHUNK_MASK)>>UCM_ARENA_CHUNK_SHIFT;
+    if(arena->chunksCount>0) {
+        arena->chunks=(void **)malloc(arena->chunksCount*sizeof(void *));
+        if(arena->chunks==NULL) {
+            fprintf(stderr, "ucm error: unable to allocate %d arena chunk pointers\n",
+                            arena->chunksCount);
+            exit(U_MEMORY_ALLOCATION_ERROR);
+        }
+        for(i=0; i<arena->chunksCount; ++i) {
+            arena->chunks[i]=(void *)(p+i*UCM_ARENA_CHUNK_SIZE*unitSize);
+        }
+    }
+    return p+top*unitSize;
+}
+
+/*
+ * Does the table at offset fit completely before limit,
+ * and do its mappings and reverseMap only point into the table?
+ */
+static UBool
+isValidTable(const uint8_t *p, int32_t offset, int32_t limit) {
+    const CachedTable *cached;
+    const UCMapping *m;
+    const int32_t *reverseMap;
+    int32_t available, i;
+
+    available=limit-offset-(int32_t)sizeof(CachedTable);
+    if((offset&3)!=0 || available<0) {
+        return FALSE;
+    }
+    cached=(const CachedTable *)(p+offset);
+
+    if( cached->mappingsLength<0 ||
+        cached->mappingsLength>available/(int32_t)(sizeof(UCMapping)+4)
+    ) {
+        return FALSE;
+    }
+    available-=cached->mappingsLength*(int32_t)(sizeof(UCMapping)+4);
+    if(cached->codePointsTop<0 || cached->codePointsTop>available/4) {
+        return FALSE;
+    }
+    available-=cached->codePointsTop*4;
+    if(cached->bytesTop<0 || cached->bytesTop>available) {
+        return FALSE;
+    }
+
+    m=(const UCMapping *)(cached+1);
+    reverseMap=(const int32_t *)(m+cached->mappingsLength);
+    for(i=0; i<cached->mappingsLength; ++m, ++i) {
+        if( m->uLen<1 || m->bLen<1 ||
+            (m->uLen>1 && (m->u<0 || m->u>cached->codePointsTop-m->uLen)) ||
+            (m->bLen>4 && (m->bLen>cached->bytesTop ||
+                           m->b.index>(uint32_t)(cached->bytesTop-m->bLen))) ||
+            (uint32_t)reverseMap[i]>=(uint32_t)cached->mappingsLength
+        ) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/*
+ * Check the indexes, the states and the table lengths against
+ * the length of the mapped data, so that a damaged file is never read
+ * beyond its end.
+ */
+static UBool
+isValidCache(const uint8_t *p, int32_t length) {
+    const int32_t *indexes;
+    const CachedStates *states;
+    int32_t statesOffset, baseOffset, extOffset, size;
+
+    indexes=(const int32_t *)p;
+    if( length<UCM_CACHE_INDEX_COUNT*4 ||
+        indexes[UCM_CACHE_INDEXES_LENGTH]<UCM_CACHE_INDEX_COUNT ||
+        indexes[UCM_CACHE_INDEXES_LENGTH]>length/4
+    ) {
+        return FALSE;
+    }
+
+    statesOffset=indexes[UCM_CACHE_STATES_OFFSET];
+    baseOffset=indexes[UCM_CACHE_BASE_OFFSET];
+    extOffset=indexes[UCM_CACHE_EXT_OFFSET];
+    size=indexes[UCM_CACHE_SIZE];
+    if( (statesOffset&3)!=0 || statesOffset<indexes[UCM_CACHE_INDEXES_LENGTH]*4 ||
+        statesOffset>baseOffset || baseOffset-statesOffset<(int32_t)sizeof(CachedStates) ||
+        baseOffset>extOffset || extOffset>size || size>length
+    ) {
+        return FALSE;
+    }
+
+    states=(const CachedStates *)(p+statesOffset);
+    if( states->countStates<0 || states->countStates>MBCS_MAX_STATE_COUNT ||
+        (int32_t)sizeof(CachedStates)+states->countStates*256*4>baseOffset-statesOffset ||
+        memchr(states->baseName, 0, sizeof(states->baseName))==NULL
+    ) {
+        return FALSE;
+    }
+
+    return (UBool)(
+        isValidTable(p, baseOffset, extOffset) &&
+        isValidTable(p, extOffset, size));
+}
+
+static void
+mapTable(UCMTable *table, const uint8_t *p) {
+    const CachedTable *cached=(const CachedTable *)p;
+
+    table->isReadOnly=TRUE;
+    table->flagsType=(int8_t)cached->flagsType;
+    table->mappingsLength=table->mappingsCapacity=cached->mappingsLength;
+    p+=sizeof(CachedTable);
+
+    if(cached->mappingsLength>0) {
+        table->mappings=(UCMapping *)p;
+        p+=cached->mappingsLength*sizeof(UCMapping);
+        table->reverseMap=(int32_t *)p;
+        p+=cached->mappingsLength*4;
+    }
+    p=mapArena(&table->codePoints, cached->codePointsTop, p, 4);
+    mapArena(&table->bytes, cached->bytesTop, p, 1);
+}
+
+U_CAPI UCMFile * U_EXPORT2
+ucm_openCachedFile(const char *cacheDir, uint64_t hash, int32_t length) {
+    char name[20];
+    UDataMemory *pData;
+    const uint8_t *p;
+    const int32_t *indexes;
+    const CachedStates *states;
+    UCMFile *ucm;
+    UErrorCode errorCode;
+
+    getCacheName(name, hash);
+    errorCode=U_ZERO_ERROR;
+    pData=udata_openChoice(cacheDir, UCM_CACHE_DATA_TYPE, name, isCacheAcceptable, NULL, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        return NULL;
+    }
+
+    p=(const uint8_t *)udata_getMemory(pData);
+    indexes=(const int32_t *)p;
+    if( !isValidCache(p, udata_getLength(pData)) ||
+        indexes[UCM_CACHE_SOURCE_LENGTH]!=length ||
+        indexes[UCM_CACHE_HASH_LOW]!=(int32_t)hash ||
+        indexes[UCM_CACHE_HASH_HIGH]!=(int32_t)(hash>>32)
+    ) {
+        udata_close(pData);
+        return NULL;
+    }
+
+    ucm=ucm_open();
+    ucm->cache=pData;
+
+    /* copy the header fields and states; ucm_addState() etc. may modify them */
+    states=(const CachedStates *)(p+indexes[UCM_CACHE_STATES_OFFSET]);
+    memcpy(ucm->states.stateFlags, states->stateFlags, sizeof(states->stateFlags));
+    memcpy(ucm->states.stateOffsetSum, states->stateOffsetSum, sizeof(states->stateOffsetSum));
+    ucm->states.countStates=states->countStates;
+    ucm->states.minCharLength=states->minCharLength;
+    ucm->states.maxCharLength=states->maxCharLength;
+    ucm->states.countToUCodeUnits=states->countToUCodeUnits;
+    ucm->states.conversionType=(int8_t)states->conversionType;
+    uprv_strcpy(ucm->baseName, states->baseName);
+
+    if(states->countStates>0) {
+        ucm->states.stateTable=(int32_t (*)[256])malloc(states->countStates*256*4);
+        if(ucm->states.stateTable==NULL) {
+            fprintf(stderr, "ucm error: unable to allocate state table rows\n");
+            exit(U_MEMORY_ALLOCATION_ERROR);
+        }
+        memcpy(ucm->states.stateTable, states+1, states->countStates*256*4);
+        ucm_compactStates(&ucm->states);
+    }
+
+    mapTable(ucm->base, p+indexes[UCM_CACHE_BASE_OFFSET]);
+    mapTable(ucm->ext, p+indexes[UCM_CACHE_EXT_OFFSET]);
+    return ucm;
+}
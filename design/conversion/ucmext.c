@@ -0,0 +1,1201 @@
+/*
+*******************************************************************************
+*
+*   Copyright (C) 2026, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+*
+*******************************************************************************
+*   file name:  ucmext.c
+*   encoding:   US-ASCII
+*   tab size:   8 (not used)
+*   indentation:4
+*
+*   created on: 2026oct16
+*   created by: agent
+*
+*   This file builds conversion extension data (see ucnv_ext.h)
+*   from the mappings in a UCMTable and writes it as a binary data file
+*   as part of the ucm module.
+*
+*   The data is one flat block of int32_t indexes[] followed by the arrays
+*   they point to, with offsets relative to indexes[]. It is written as is,
+*   after a standard ICU data header, so that the runtime can map the file
+*   and use the data without copying it; see ucnv_extOpenData().
+*/
+
+#include "unicode/utypes.h"
+#include "unicode/udata.h"
+#include "uarrsort.h"
+#include "unewdata.h"
+#include "ucnvmbcs.h"
+#include "ucnv_ext.h"
+#include "ucm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* UDataInfo cf. udata.h */
+static const UDataInfo dataInfo={
+    sizeof(UDataInfo),
+    0,
+
+    U_IS_BIG_ENDIAN,
+    U_CHARSET_FAMILY,
+    sizeof(UChar),
+    0,
+
+    { 0x43, 0x76, 0x45, 0x78 },     /* dataFormat="CvEx" */
+    { 1, 0, 0, 0 },                 /* formatVersion */
+    { 0, 0, 0, 0 }                  /* dataVersion (from .ucm file) */
+};
+
+/* builder data ------------------------------------------------------------- */
+
+/* one fromUnicode mapping with its input as UTF-16 */
+typedef struct ExtFromU {
+    UCMapping *m;
+    int32_t unitsIndex, unitsLength;
+} ExtFromU;
+
+typedef struct ExtData ExtData;
+
+/* toUTable value for a complete mapping */
+typedef uint32_t
+GetToUValueFn(ExtData *extData, UCMapping *m);
+
+struct ExtData {
+    UCMTable *table;
+    GetToUValueFn *getToUValue;
+
+    /* toUnicode: indexes of the toU mappings, in reverseMap (bytes) order */
+    int32_t *toUMap;
+    int32_t toUMapLength;
+
+    uint32_t *toUTable;
+    int32_t toUTableCapacity, toUTableLength;
+
+    UChar *toUUChars;
+    int32_t toUUCharsCapacity, toUUCharsLength;
+
+    /* fromUnicode: the fromU mappings, sorted by their UTF-16 input */
+    ExtFromU *fromU;
+    int32_t fromULength;
+
+    UChar *units;
+    int32_t unitsCapacity, unitsLength;
+
+    UChar *fromUTableUChars;
+    uint32_t *fromUTableValues;
+    int32_t fromUTableCapacity, fromUTableLength;
+
+    uint8_t *fromUBytes;
+    int32_t fromUBytesCapacity, fromUBytesLength;
+
+    /* initial-code point trie, stage12Length==0 if there is none */
+    UBool withoutTrie;
+    uint16_t *stage12;
+    int32_t stage12Capacity, stage12Length, stage1Length;
+
+    uint32_t *stage3;
+    int32_t stage3Capacity, stage3Length;
+
+    /*
+     * converter pairs: the target charset's tables and indexes,
+     * the sorted first code points of its multiple-code point mappings,
+     * and the results[] for the source mappings
+     */
+    UCMTable *targetTables[2];
+    UCMIndex *targetIndexes[2];
+    UChar32 *targetStarts;
+    int32_t targetStartsLength;
+
+    uint32_t *results;
+    int32_t resultsCapacity, resultsLength;
+    int32_t directCount, pivotCount;
+};
+
+/*
+ * Make sure that an array has room for length more units.
+ * @return the (possibly moved) array
+ */
+static void *
+ensureCapacity(void *array, int32_t *pCapacity, int32_t oldLength, int32_t length,
+               int32_t unitSize, const char *name) {
+    int32_t capacity;
+
+    length+=oldLength;
+    if(length<=*pCapacity) {
+        return array;
+    }
+
+    capacity=*pCapacity;
+    if(capacity==0) {
+        capacity=256;
+    }
+    while(capacity<length) {
+        capacity*=2;
+    }
+
+    array=realloc(array, capacity*unitSize);
+    if(array==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate %ld units for the extension %s\n",
+                        (long)capacity, name);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    *pCapacity=capacity;
+    return array;
+}
+
+/* roundtrip (|0) or no fallback indicator at all */
+#define IS_ROUNDTRIP(m) ((m)->f<=0)
+
+/* toUnicode ---------------------------------------------------------------- */
+
+/* write the result of a toUnicode mapping into a toUTable value */
+static uint32_t
+getToUValue(ExtData *extData, UCMapping *m) {
+    UChar32 *codePoints;
+    uint32_t value;
+    int32_t i, length;
+
+    codePoints=UCM_GET_CODE_POINTS(extData->table, m);
+    if(m->uLen==1) {
+        value=UCNV_EXT_TO_U_MIN_CODE_POINT+codePoints[0];
+    } else {
+        /* store the code points as UTF-16 in toUUChars[] */
+        extData->toUUChars=(UChar *)ensureCapacity(
+            extData->toUUChars, &extData->toUUCharsCapacity,
+            extData->toUUCharsLength, 2*m->uLen,
+            sizeof(UChar), "toUUChars");
+
+        length=0;
+        for(i=0; i<m->uLen; ++i) {
+            U16_APPEND_UNSAFE(extData->toUUChars+extData->toUUCharsLength, length, codePoints[i]);
+        }
+        if(length>UCNV_EXT_TO_U_MAX_LENGTH) {
+            fprintf(stderr, "ucm error: toUnicode result too long (%ld UChars, max %ld)\n",
+                            (long)length, (long)UCNV_EXT_TO_U_MAX_LENGTH);
+            exit(U_INVALID_TABLE_FORMAT);
+        }
+        if(extData->toUUCharsLength>UCNV_EXT_TO_U_INDEX_MASK) {
+            fprintf(stderr, "ucm error: too many toUnicode result UChars\n");
+            exit(U_INDEX_OUTOFBOUNDS_ERROR);
+        }
+
+        value=
+            ((uint32_t)(length+UCNV_EXT_TO_U_LENGTH_OFFSET)<<UCNV_EXT_TO_U_LENGTH_SHIFT)|
+            (uint32_t)extData->toUUCharsLength;
+        extData->toUUCharsLength+=length;
+    }
+
+    if(IS_ROUNDTRIP(m)) {
+        value|=UCNV_EXT_TO_U_ROUNDTRIP_FLAG;
+    }
+    return value;
+}
+
+/*
+ * Write the toUTable section for the toU mappings toUMap[start..limit[
+ * which all share the same first unitIndex bytes,
+ * and recursively the sections for their longer byte sequences.
+ * The mapping for exactly these unitIndex bytes, if any, sorts first
+ * and provides the section's default value.
+ *
+ * @return index of the section in toUTable[]
+ */
+static int32_t
+writeToUSection(ExtData *extData, int32_t start, int32_t limit, int32_t unitIndex) {
+    UCMTable *table;
+    UCMapping *m;
+    uint32_t defaultValue, value;
+    int32_t sectionIndex, count, length, i, j;
+    uint8_t b, prev=0, first=0;
+    UBool isDense;
+
+    table=extData->table;
+
+    /* the mapping for the prefix itself */
+    defaultValue=0;
+    m=table->mappings+extData->toUMap[start];
+    if(m->bLen==unitIndex) {
+        defaultValue=extData->getToUValue(extData, m);
+        if(++start<limit && table->mappings[extData->toUMap[start]].bLen==unitIndex) {
+            fprintf(stderr, "ucm error: more than one toUnicode mapping for the same bytes\n");
+            exit(U_INVALID_TABLE_FORMAT);
+        }
+    }
+
+    /* count the distinct bytes at unitIndex */
+    count=0;
+    for(i=start; i<limit; ++i) {
+        b=UCM_GET_BYTES(table, table->mappings+extData->toUMap[i])[unitIndex];
+        if(count==0) {
+            first=b;
+        }
+        if(count==0 || b!=prev) {
+            ++count;
+            prev=b;
+        }
+    }
+
+    /*
+     * Write a dense section for a well-filled byte range (and always for the
+     * initial section), with 0 values for the bytes that have no mapping,
+     * see UCNV_EXT_TO_U_USE_DENSE().
+     * The section word has only 8 bits for the length, so a full 00..ff range
+     * cannot be dense.
+     */
+    length=(int32_t)prev-first+1;
+    isDense= count>0 && length<=0xff && (unitIndex==0 || UCNV_EXT_TO_U_USE_DENSE(count, first, prev));
+    if(!isDense) {
+        length=count;
+    }
+    if(length>0xff) {
+        /* the initial section word has only 8 bits for the count */
+        fprintf(stderr, "ucm error: too many (%ld) toUnicode section entries\n", (long)count);
+        exit(U_INVALID_TABLE_FORMAT);
+    }
+
+    /* reserve the section, then fill it; recursion appends after it */
+    extData->toUTable=(uint32_t *)ensureCapacity(
+        extData->toUTable, &extData->toUTableCapacity,
+        extData->toUTableLength, 1+length,
+        sizeof(uint32_t), "toUTable");
+    sectionIndex=extData->toUTableLength;
+    extData->toUTableLength+=1+length;
+    extData->toUTable[sectionIndex]=UCNV_EXT_TO_U_MAKE_WORD(length, defaultValue);
+    if(isDense) {
+        for(i=0; i<length; ++i) {
+            extData->toUTable[sectionIndex+1+i]=UCNV_EXT_TO_U_MAKE_WORD(first+i, 0);
+        }
+    }
+
+    for(i=start, count=0; i<limit; i=j) {
+        /* find the range of mappings with the same byte at unitIndex */
+        b=UCM_GET_BYTES(table, table->mappings+extData->toUMap[i])[unitIndex];
+        for(j=i+1;
+            j<limit && b==UCM_GET_BYTES(table, table->mappings+extData->toUMap[j])[unitIndex];
+            ++j) {}
+
+        m=table->mappings+extData->toUMap[i];
+        if((j-i)==1 && m->bLen==(unitIndex+1)) {
+            /* complete mapping */
+            value=extData->getToUValue(extData, m);
+        } else {
+            /* partial match, continue in a new section */
+            value=(uint32_t)writeToUSection(extData, i, j, unitIndex+1);
+            if(value>=UCNV_EXT_TO_U_MIN_CODE_POINT) {
+                fprintf(stderr, "ucm error: toUTable too long for partial-match indexes\n");
+                exit(U_INDEX_OUTOFBOUNDS_ERROR);
+            }
+        }
+        if(isDense) {
+            count=b-first;
+        }
+        extData->toUTable[sectionIndex+1+count++]=UCNV_EXT_TO_U_MAKE_WORD(b, value);
+    }
+
+    return sectionIndex;
+}
+
+static void
+buildToU(ExtData *extData) {
+    UCMTable *table;
+    UCMapping *m;
+    int32_t i, index;
+
+    table=extData->table;
+
+    /* collect the toUnicode mappings (all but fallbacks |1 and sub mappings |2) in bytes order */
+    extData->toUMap=(int32_t *)malloc(table->mappingsLength*sizeof(int32_t)+1);
+    if(extData->toUMap==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate the toUMap\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    for(i=0; i<table->mappingsLength; ++i) {
+        index=table->reverseMap[i];
+        m=table->mappings+index;
+        if(m->f!=1 && m->f!=2) {
+            extData->toUMap[extData->toUMapLength++]=index;
+        }
+    }
+
+    if(extData->toUMapLength>0) {
+        writeToUSection(extData, 0, extData->toUMapLength, 0);
+    }
+}
+
+/* fromUnicode -------------------------------------------------------------- */
+
+static int32_t
+compareFromU(const void *context, const void *left, const void *right) {
+    const UChar *units=(const UChar *)context;
+    const ExtFromU *l=(const ExtFromU *)left, *r=(const ExtFromU *)right;
+    const UChar *lu, *ru;
+    int32_t i, length;
+
+    lu=units+l->unitsIndex;
+    ru=units+r->unitsIndex;
+    length= l->unitsLength<=r->unitsLength ? l->unitsLength : r->unitsLength;
+    for(i=0; i<length; ++i) {
+        if(lu[i]!=ru[i]) {
+            return (int32_t)lu[i]-(int32_t)ru[i];
+        }
+    }
+    return l->unitsLength-r->unitsLength;
+}
+
+/*
+ * write the result of a fromUnicode mapping into a fromUTable value;
+ * m is one of the table's mappings
+ */
+static uint32_t
+getFromUValue(ExtData *extData, UCMTable *table, UCMapping *m) {
+    const uint8_t *bytes;
+    uint32_t value;
+    int32_t i;
+
+    bytes=UCM_GET_BYTES(table, m);
+    if(m->bLen<=UCNV_EXT_FROM_U_MAX_DIRECT_LENGTH) {
+        /* store 1..3 bytes directly in the value, right-justified */
+        value=0;
+        for(i=0; i<m->bLen; ++i) {
+            value=(value<<8)|bytes[i];
+        }
+    } else {
+        /* store the bytes in fromUBytes[] */
+        if(extData->fromUBytesLength>UCNV_EXT_FROM_U_DATA_MASK) {
+            fprintf(stderr, "ucm error: too many fromUnicode result bytes\n");
+            exit(U_INDEX_OUTOFBOUNDS_ERROR);
+        }
+        extData->fromUBytes=(uint8_t *)ensureCapacity(
+            extData->fromUBytes, &extData->fromUBytesCapacity,
+            extData->fromUBytesLength, m->bLen,
+            1, "fromUBytes");
+        value=(uint32_t)extData->fromUBytesLength;
+        memcpy(extData->fromUBytes+extData->fromUBytesLength, bytes, m->bLen);
+        extData->fromUBytesLength+=m->bLen;
+    }
+
+    value|=(uint32_t)m->bLen<<UCNV_EXT_FROM_U_LENGTH_SHIFT;
+    if(IS_ROUNDTRIP(m)) {
+        value|=UCNV_EXT_FROM_U_ROUNDTRIP_FLAG;
+    }
+    return value;
+}
+
+/*
+ * Write the fromUTable section for the fromU mappings fromU[start..limit[
+ * which all share the same first unitIndex UChars,
+ * like writeToUSection().
+ *
+ * @return index of the section in fromUTableUChars[] and fromUTableValues[]
+ */
+static int32_t
+writeFromUSection(ExtData *extData, int32_t start, int32_t limit, int32_t unitIndex) {
+    ExtFromU *fromU;
+    uint32_t defaultValue, value;
+    int32_t sectionIndex, count, capacity, i, j;
+    UChar u, prev=0;
+
+    fromU=extData->fromU;
+
+    /* the mapping for the prefix itself */
+    defaultValue=0;
+    if(fromU[start].unitsLength==unitIndex) {
+        defaultValue=getFromUValue(extData, extData->table, fromU[start].m);
+        if(++start<limit && fromU[start].unitsLength==unitIndex) {
+            fprintf(stderr, "ucm error: more than one fromUnicode mapping for the same code points\n");
+            exit(U_INVALID_TABLE_FORMAT);
+        }
+    }
+
+    /* count the distinct UChars at unitIndex */
+    count=0;
+    for(i=start; i<limit; ++i) {
+        u=extData->units[fromU[i].unitsIndex+unitIndex];
+        if(count==0 || u!=prev) {
+            ++count;
+            prev=u;
+        }
+    }
+    if(count>0xffff) {
+        fprintf(stderr, "ucm error: too many (%ld) fromUnicode section entries\n", (long)count);
+        exit(U_INVALID_TABLE_FORMAT);
+    }
+
+    /* reserve the section, then fill it; recursion appends after it */
+    capacity=extData->fromUTableCapacity; /* the two arrays grow in parallel */
+    extData->fromUTableUChars=(UChar *)ensureCapacity(
+        extData->fromUTableUChars, &capacity,
+        extData->fromUTableLength, 1+count,
+        sizeof(UChar), "fromUTableUChars");
+    extData->fromUTableValues=(uint32_t *)ensureCapacity(
+        extData->fromUTableValues, &extData->fromUTableCapacity,
+        extData->fromUTableLength, 1+count,
+        sizeof(uint32_t), "fromUTableValues");
+    sectionIndex=extData->fromUTableLength;
+    extData->fromUTableLength+=1+count;
+    extData->fromUTableUChars[sectionIndex]=(UChar)count;
+    extData->fromUTableValues[sectionIndex]=defaultValue;
+
+    for(i=start, count=0; i<limit; i=j) {
+        /* find the range of mappings with the same UChar at unitIndex */
+        u=extData->units[fromU[i].unitsIndex+unitIndex];
+        for(j=i+1; j<limit && u==extData->units[fromU[j].unitsIndex+unitIndex]; ++j) {}
+
+        if((j-i)==1 && fromU[i].unitsLength==(unitIndex+1)) {
+            /* complete mapping */
+            value=getFromUValue(extData, extData->table, fromU[i].m);
+        } else {
+            /* partial match, continue in a new section */
+            value=(uint32_t)writeFromUSection(extData, i, j, unitIndex+1);
+            if(value>UCNV_EXT_FROM_U_DATA_MASK) {
+                fprintf(stderr, "ucm error: fromUTable too long for partial-match indexes\n");
+                exit(U_INDEX_OUTOFBOUNDS_ERROR);
+            }
+        }
+        ++count;
+        extData->fromUTableUChars[sectionIndex+count]=u;
+        extData->fromUTableValues[sectionIndex+count]=value;
+    }
+
+    return sectionIndex;
+}
+
+/* number of bytes for the fromU tables, the trie and the result bytes */
+static int32_t
+getFromUSize(const ExtData *extData) {
+    return
+        ((extData->fromUTableLength*2+3)&~3)+
+        extData->fromUTableLength*4+
+        ((extData->fromUBytesLength+3)&~3)+
+        ((extData->stage12Length*2+3)&~3)+
+        extData->stage3Length*4;
+}
+
+/* discard the fromU tables, the trie and the result bytes but keep their memory */
+static void
+resetFromU(ExtData *extData) {
+    extData->fromUTableLength=0;
+    extData->fromUBytesLength=0;
+    extData->stage12Length=extData->stage1Length=0;
+    extData->stage3Length=0;
+}
+
+/*
+ * Append a stage 3 block of the trie, or return the all-zero null block
+ * which comes first.
+ * Other blocks are not shared: Their values contain the mapping bytes
+ * or section indexes, which hardly ever repeat.
+ * @return index of the block in stage3[],
+ *         or -1 if the block does not fit into the 16-bit stage 2 values
+ */
+static int32_t
+getStage3Block(ExtData *extData, const uint32_t *block) {
+    int32_t i;
+
+    i=extData->stage3Length;
+    if(i>0 && 0==memcmp(extData->stage3, block, (UCNV_EXT_FROM_U_STAGE_3_MASK+1)*4)) {
+        return 0;
+    }
+
+    if(i>0xffff) {
+        return -1;
+    }
+    extData->stage3=(uint32_t *)ensureCapacity(
+        extData->stage3, &extData->stage3Capacity,
+        extData->stage3Length, UCNV_EXT_FROM_U_STAGE_3_MASK+1,
+        sizeof(uint32_t), "fromUStage3");
+    memcpy(extData->stage3+i, block, (UCNV_EXT_FROM_U_STAGE_3_MASK+1)*4);
+    extData->stage3Length+=UCNV_EXT_FROM_U_STAGE_3_MASK+1;
+    return i;
+}
+
+/*
+ * Same as getStage3Block() for a stage 2 block in stage12[],
+ * with the null block right after stage 1.
+ */
+static int32_t
+getStage2Block(ExtData *extData, const uint16_t *block) {
+    int32_t i;
+
+    i=extData->stage12Length;
+    if( i>extData->stage1Length &&
+        0==memcmp(extData->stage12+extData->stage1Length, block, (UCNV_EXT_FROM_U_STAGE_2_MASK+1)*2)
+    ) {
+        return extData->stage1Length;
+    }
+
+    if(i>0xffff) {
+        return -1;
+    }
+    extData->stage12=(uint16_t *)ensureCapacity(
+        extData->stage12, &extData->stage12Capacity,
+        extData->stage12Length, UCNV_EXT_FROM_U_STAGE_2_MASK+1,
+        sizeof(uint16_t), "fromUStage12");
+    memcpy(extData->stage12+i, block, (UCNV_EXT_FROM_U_STAGE_2_MASK+1)*2);
+    extData->stage12Length+=UCNV_EXT_FROM_U_STAGE_2_MASK+1;
+    return i;
+}
+
+/*
+ * Build the initial-code point trie and the fromUTable sections
+ * for the units that follow each initial code point.
+ * The trie value for a code point is its complete mapping if it has only
+ * a single-code point one, or else the index of its section.
+ * Index 0 of the fromUTable is reserved because trie values of 0 mean
+ * "no mapping".
+ *
+ * @return FALSE if the trie blocks do not fit into the 16-bit trie indexes
+ *         (the caller then writes the fromUTable sections without a trie)
+ */
+static UBool
+buildFromUTrie(ExtData *extData) {
+    ExtFromU *fromU;
+    uint32_t *values;
+    uint32_t value;
+    UChar32 c, maxC;
+    int32_t i, j, k, length, capacity, i1, i2, block;
+    uint32_t block3[UCNV_EXT_FROM_U_STAGE_3_MASK+1];
+    uint16_t block2[UCNV_EXT_FROM_U_STAGE_2_MASK+1];
+    UBool isNull;
+
+    fromU=extData->fromU;
+
+    /* reserve index 0 of the fromUTable */
+    capacity=extData->fromUTableCapacity;
+    extData->fromUTableUChars=(UChar *)ensureCapacity(
+        extData->fromUTableUChars, &capacity,
+        extData->fromUTableLength, 1,
+        sizeof(UChar), "fromUTableUChars");
+    extData->fromUTableValues=(uint32_t *)ensureCapacity(
+        extData->fromUTableValues, &extData->fromUTableCapacity,
+        extData->fromUTableLength, 1,
+        sizeof(uint32_t), "fromUTableValues");
+    extData->fromUTableUChars[0]=0;
+    extData->fromUTableValues[0]=0;
+    extData->fromUTableLength=1;
+
+    /* the mappings are in UTF-16 order, not in code point order */
+    maxC=0;
+    for(i=0; i<extData->fromULength; ++i) {
+        k=0;
+        U16_NEXT(extData->units+fromU[i].unitsIndex, k, fromU[i].unitsLength, c);
+        if(c>maxC) {
+            maxC=c;
+        }
+    }
+    extData->stage1Length=(maxC>>UCNV_EXT_FROM_U_STAGE_1_SHIFT)+1;
+
+    /* collect the trie values for all code points up to the highest one */
+    length=extData->stage1Length<<UCNV_EXT_FROM_U_STAGE_1_SHIFT;
+    values=(uint32_t *)calloc(length, 4);
+    if(values==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate %ld fromUnicode trie values\n", (long)length);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+
+    for(i=0; i<extData->fromULength; i=j) {
+        /* find the range of mappings with the same initial code point */
+        length=0;
+        U16_NEXT(extData->units+fromU[i].unitsIndex, length, fromU[i].unitsLength, c);
+        for(j=i+1; j<extData->fromULength; ++j) {
+            UChar32 c2;
+
+            k=0;
+            U16_NEXT(extData->units+fromU[j].unitsIndex, k, fromU[j].unitsLength, c2);
+            if(c2!=c || k!=length) {
+                break;
+            }
+        }
+
+        if((j-i)==1 && fromU[i].unitsLength==length) {
+            /* complete mapping */
+            value=getFromUValue(extData, extData->table, fromU[i].m);
+        } else {
+            /* partial match, continue in a new section */
+            value=(uint32_t)writeFromUSection(extData, i, j, length);
+            if(value>UCNV_EXT_FROM_U_DATA_MASK) {
+                fprintf(stderr, "ucm error: fromUTable too long for partial-match indexes\n");
+                exit(U_INDEX_OUTOFBOUNDS_ERROR);
+            }
+        }
+        values[c]=value;
+    }
+
+    /* compact the values into stage 3 blocks, and those into stage 2 blocks */
+    extData->stage12=(uint16_t *)ensureCapacity(
+        extData->stage12, &extData->stage12Capacity,
+        0, extData->stage1Length,
+        sizeof(uint16_t), "fromUStage12");
+    extData->stage12Length=extData->stage1Length;
+    extData->stage3Length=0;
+
+    /* the null blocks come first */
+    memset(block3, 0, sizeof(block3));
+    getStage3Block(extData, block3);
+    memset(block2, 0, sizeof(block2));
+    getStage2Block(extData, block2);
+
+    for(i1=0; i1<extData->stage1Length; ++i1) {
+        isNull=TRUE;
+        for(i2=0; i2<=UCNV_EXT_FROM_U_STAGE_2_MASK; ++i2) {
+            block=getStage3Block(
+                extData,
+                values+
+                    (i1<<UCNV_EXT_FROM_U_STAGE_1_SHIFT)+
+                    (i2<<UCNV_EXT_FROM_U_STAGE_2_SHIFT));
+            if(block<0) {
+                free(values);
+                return FALSE;
+            }
+            block2[i2]=(uint16_t)block;
+            if(block!=0) {
+                isNull=FALSE;
+            }
+        }
+        /* stage 1 indexes are relative to stage12[], the null stage 2 block follows stage 1 */
+        block= isNull ? extData->stage1Length : getStage2Block(extData, block2);
+        if(block<0) {
+            free(values);
+            return FALSE;
+        }
+        extData->stage12[i1]=(uint16_t)block;
+    }
+
+    free(values);
+    return TRUE;
+}
+
+static void
+buildFromU(ExtData *extData) {
+    UCMTable *table;
+    UCMapping *m;
+    UChar32 *codePoints;
+    UErrorCode errorCode;
+    int32_t i, j, length, sectionSize, trieSize;
+
+    table=extData->table;
+
+    /*
+     * collect the fromUnicode mappings (all but reverse fallbacks |3) with UTF-16 input;
+     * there is no special value for sub mappings |2 yet,
+     * so they are stored like fallbacks to their bytes
+     */
+    extData->fromU=(ExtFromU *)malloc(table->mappingsLength*sizeof(ExtFromU)+1);
+    if(extData->fromU==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate the fromU mappings\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    m=table->mappings;
+    for(i=0; i<table->mappingsLength; ++m, ++i) {
+        if(m->f==3) {
+            continue;
+        }
+
+        extData->units=(UChar *)ensureCapacity(
+            extData->units, &extData->unitsCapacity,
+            extData->unitsLength, 2*m->uLen,
+            sizeof(UChar), "fromU input");
+        codePoints=UCM_GET_CODE_POINTS(table, m);
+        length=0;
+        for(j=0; j<m->uLen; ++j) {
+            U16_APPEND_UNSAFE(extData->units+extData->unitsLength, length, codePoints[j]);
+        }
+
+        extData->fromU[extData->fromULength].m=m;
+        extData->fromU[extData->fromULength].unitsIndex=extData->unitsLength;
+        extData->fromU[extData->fromULength].unitsLength=length;
+        ++extData->fromULength;
+        extData->unitsLength+=length;
+    }
+
+    /*
+     * Sort by UTF-16 code units, which is not the code point order of the
+     * UCMTable when supplementary code points are mixed with U+e000..U+ffff.
+     */
+    errorCode=U_ZERO_ERROR;
+    uprv_sortArray(extData->fromU, extData->fromULength, sizeof(ExtFromU),
+                   compareFromU, extData->units,
+                   FALSE, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        fprintf(stderr, "ucm error: sorting the fromU mappings fails - %s\n",
+                u_errorName(errorCode));
+        exit(errorCode);
+    }
+
+    if(extData->fromULength==0) {
+        return;
+    }
+
+    /*
+     * Build the fromU data both ways and keep the trie unless
+     * it makes the data much larger, see UCNV_EXT_FROM_U_USE_TRIE(),
+     * or it has too many blocks for its 16-bit indexes.
+     */
+    writeFromUSection(extData, 0, extData->fromULength, 0);
+    if(extData->withoutTrie) {
+        return;
+    }
+    sectionSize=getFromUSize(extData);
+
+    resetFromU(extData);
+    if(!buildFromUTrie(extData)) {
+        trieSize=-1;
+    } else {
+        trieSize=getFromUSize(extData);
+    }
+
+    if(trieSize<0 || !UCNV_EXT_FROM_U_USE_TRIE(trieSize, sectionSize)) {
+        resetFromU(extData);
+        writeFromUSection(extData, 0, extData->fromULength, 0);
+    }
+}
+
+/* serialization ------------------------------------------------------------ */
+
+/* append length units of an array to the data, padded to a multiple of 4 bytes */
+static int32_t
+appendArray(uint8_t *data, int32_t *pOffset, const void *array, int32_t length, int32_t unitSize) {
+    int32_t offset, size;
+
+    offset=*pOffset;
+    size=length*unitSize;
+    if(size>0) {
+        memcpy(data+offset, array, size);
+    }
+    size=(size+3)&~3;
+    *pOffset=offset+size;
+
+    /* index in units of the array type, relative to indexes[] */
+    return offset/unitSize;
+}
+
+static int32_t *
+buildExtData(UCMTable *table, UBool withoutTrie, int32_t *pSize) {
+    ExtData extData;
+    int32_t *indexes;
+    uint8_t *data;
+    int32_t size, offset;
+
+    /* sort the mappings and build the reverseMap */
+    ucm_sortTable(table);
+
+    memset(&extData, 0, sizeof(extData));
+    extData.table=table;
+    extData.getToUValue=getToUValue;
+    extData.withoutTrie=withoutTrie;
+
+    buildToU(&extData);
+    buildFromU(&extData);
+
+    size=
+        UCNV_EXT_INDEXES_MIN_LENGTH*4+
+        extData.toUTableLength*4+
+        ((extData.toUUCharsLength*2+3)&~3)+
+        getFromUSize(&extData);
+
+    data=(uint8_t *)malloc(size);
+    if(data==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate %ld bytes of extension data\n", (long)size);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    memset(data, 0, size);
+    indexes=(int32_t *)data;
+    offset=UCNV_EXT_INDEXES_MIN_LENGTH*4;
+
+    indexes[UCNV_EXT_INDEXES_LENGTH]=UCNV_EXT_INDEXES_MIN_LENGTH;
+
+    indexes[UCNV_EXT_TO_U_INDEX]=
+        appendArray(data, &offset, extData.toUTable, extData.toUTableLength, 4);
+    indexes[UCNV_EXT_TO_U_LENGTH]=extData.toUTableLength;
+    indexes[UCNV_EXT_TO_U_UCHARS_INDEX]=
+        appendArray(data, &offset, extData.toUUChars, extData.toUUCharsLength, 2);
+    indexes[UCNV_EXT_TO_U_UCHARS_LENGTH]=extData.toUUCharsLength;
+
+    indexes[UCNV_EXT_FROM_U_UCHARS_INDEX]=
+        appendArray(data, &offset, extData.fromUTableUChars, extData.fromUTableLength, 2);
+    indexes[UCNV_EXT_FROM_U_VALUES_INDEX]=
+        appendArray(data, &offset, extData.fromUTableValues, extData.fromUTableLength, 4);
+    indexes[UCNV_EXT_FROM_U_LENGTH]=extData.fromUTableLength;
+    indexes[UCNV_EXT_FROM_U_BYTES_INDEX]=
+        appendArray(data, &offset, extData.fromUBytes, extData.fromUBytesLength, 1);
+    indexes[UCNV_EXT_FROM_U_BYTES_LENGTH]=extData.fromUBytesLength;
+
+    if(extData.stage12Length>0) {
+        indexes[UCNV_EXT_FROM_U_STAGE_12_INDEX]=
+            appendArray(data, &offset, extData.stage12, extData.stage12Length, 2);
+        indexes[UCNV_EXT_FROM_U_STAGE_1_LENGTH]=extData.stage1Length;
+        indexes[UCNV_EXT_FROM_U_STAGE_12_LENGTH]=extData.stage12Length;
+        indexes[UCNV_EXT_FROM_U_STAGE_3_INDEX]=
+            appendArray(data, &offset, extData.stage3, extData.stage3Length, 4);
+        indexes[UCNV_EXT_FROM_U_STAGE_3_LENGTH]=extData.stage3Length;
+    }
+
+    indexes[UCNV_EXT_SIZE]=size;
+
+    free(extData.toUMap);
+    free(extData.toUTable);
+    free(extData.toUUChars);
+    free(extData.fromU);
+    free(extData.units);
+    free(extData.fromUTableUChars);
+    free(extData.fromUTableValues);
+    free(extData.fromUBytes);
+    free(extData.stage12);
+    free(extData.stage3);
+
+    *pSize=size;
+    return indexes;
+}
+
+U_CAPI int32_t * U_EXPORT2
+ucm_buildExtData(UCMTable *table, int32_t *pSize) {
+    return buildExtData(table, FALSE, pSize);
+}
+
+U_CAPI int32_t * U_EXPORT2
+ucm_buildExtDataWithoutTrie(UCMTable *table, int32_t *pSize) {
+    return buildExtData(table, TRUE, pSize);
+}
+
+U_CAPI void U_EXPORT2
+ucm_printExtStats(const int32_t *indexes, const char *name, FILE *f) {
+    const uint32_t *toUTable;
+    const UChar *fromUTableUChars;
+    int32_t i, length, first, last;
+    int32_t sections, denseSections, sparseEntries, maxSparse, wideSections;
+
+    fprintf(f, "%s: %ld bytes of extension data\n", name, (long)indexes[UCNV_EXT_SIZE]);
+
+    /* the sections are stored one after the other */
+    toUTable=(const uint32_t *)indexes+indexes[UCNV_EXT_TO_U_INDEX];
+    sections=denseSections=sparseEntries=maxSparse=0;
+    for(i=0; i<indexes[UCNV_EXT_TO_U_LENGTH]; i+=1+length) {
+        length=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUTable[i]);
+        ++sections;
+        if(length>0) {
+            first=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUTable[i+1]);
+            last=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUTable[i+length]);
+            if(UCNV_EXT_TO_U_IS_DENSE(first, last, length)) {
+                ++denseSections;
+                continue;
+            }
+        }
+        sparseEntries+=length;
+        if(length>maxSparse) {
+            maxSparse=length;
+        }
+    }
+    fprintf(f, "  toUnicode:   %6ld bytes, %ld sections: %ld dense (direct access), "
+               "%ld sparse (binary search, %ld entries, at most %ld per section)\n",
+               (long)(indexes[UCNV_EXT_TO_U_LENGTH]*4+indexes[UCNV_EXT_TO_U_UCHARS_LENGTH]*2),
+               (long)sections, (long)denseSections,
+               (long)(sections-denseSections), (long)sparseEntries, (long)maxSparse);
+
+    fromUTableUChars=(const UChar *)indexes+indexes[UCNV_EXT_FROM_U_UCHARS_INDEX];
+    sections=wideSections=0;
+    for(i=0; i<indexes[UCNV_EXT_FROM_U_LENGTH]; i+=1+length) {
+        length=fromUTableUChars[i];
+        if(length>0) {
+            ++sections;
+            if(length>=UCNV_EXT_FROM_U_WIDE_SECTION_LENGTH) {
+                ++wideSections;
+            }
+        }
+    }
+    fprintf(f, "  fromUnicode: %6ld bytes, %ld sections: %ld wide (kernel search), "
+               "%ld narrow (binary+linear search)\n",
+               (long)(indexes[UCNV_EXT_FROM_U_LENGTH]*6+indexes[UCNV_EXT_FROM_U_BYTES_LENGTH]+
+                      indexes[UCNV_EXT_FROM_U_STAGE_12_LENGTH]*2+indexes[UCNV_EXT_FROM_U_STAGE_3_LENGTH]*4),
+               (long)sections, (long)wideSections, (long)(sections-wideSections));
+    if(indexes[UCNV_EXT_FROM_U_STAGE_12_LENGTH]>0) {
+        fprintf(f, "               initial code points via the trie: "
+                   "stage 1 %ld, stage 1+2 %ld, stage 3 %ld units\n",
+                   (long)indexes[UCNV_EXT_FROM_U_STAGE_1_LENGTH],
+                   (long)indexes[UCNV_EXT_FROM_U_STAGE_12_LENGTH],
+                   (long)indexes[UCNV_EXT_FROM_U_STAGE_3_LENGTH]);
+    } else {
+        fputs("               initial code points via the initial section, no trie\n", f);
+    }
+}
+
+/* write one data block with a standard ICU data header */
+static void
+writeDataFile(const char *destDir, const char *type, const char *name,
+              const UDataInfo *pInfo, const int32_t *indexes, int32_t size) {
+    UNewDataMemory *pData;
+    UErrorCode errorCode;
+    uint32_t dataLength;
+
+    errorCode=U_ZERO_ERROR;
+    pData=udata_create(destDir, type, name, pInfo, U_COPYRIGHT_STRING, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        fprintf(stderr, "ucm error: unable to create the data file for %s.%s - %s\n",
+                name, type, u_errorName(errorCode));
+        exit(errorCode);
+    }
+
+    udata_writeBlock(pData, indexes, size);
+
+    dataLength=udata_finish(pData, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        fprintf(stderr, "ucm error: failure writing %s.%s - %s\n",
+                name, type, u_errorName(errorCode));
+        exit(errorCode);
+    }
+    if(dataLength!=(uint32_t)size) {
+        fprintf(stderr, "ucm error: %s.%s has %lu data bytes instead of %ld\n",
+                name, type, (unsigned long)dataLength, (long)size);
+        exit(U_INTERNAL_PROGRAM_ERROR);
+    }
+}
+
+U_CAPI void U_EXPORT2
+ucm_writeExtData(UCMTable *table, const char *destDir, const char *name) {
+    int32_t *indexes;
+    int32_t size;
+
+    indexes=ucm_buildExtData(table, &size);
+    writeDataFile(destDir, UCNV_EXT_DATA_TYPE, name, &dataInfo, indexes, size);
+    free(indexes);
+}
+
+/* converter pairs ---------------------------------------------------------- */
+
+/* UDataInfo cf. udata.h */
+static const UDataInfo pairDataInfo={
+    sizeof(UDataInfo),
+    0,
+
+    U_IS_BIG_ENDIAN,
+    U_CHARSET_FAMILY,
+    sizeof(UChar),
+    0,
+
+    { 0x43, 0x76, 0x50, 0x72 },     /* dataFormat="CvPr" */
+    { 1, 0, 0, 0 },                 /* formatVersion */
+    { 0, 0, 0, 0 }                  /* dataVersion */
+};
+
+static int32_t
+compareCodePoints(const void *context, const void *left, const void *right) {
+    (void)context; /* unused */
+    return *(const UChar32 *)left-*(const UChar32 *)right;
+}
+
+/* does c start a target mapping of more than one code point? */
+static UBool
+isTargetStart(const ExtData *extData, UChar32 c) {
+    int32_t start, limit, i;
+
+    start=0;
+    limit=extData->targetStartsLength;
+    while(start<limit) {
+        i=(start+limit)/2;
+        if(c<extData->targetStarts[i]) {
+            limit=i;
+        } else if(c>extData->targetStarts[i]) {
+            start=i+1;
+        } else {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Find the target's roundtrip mapping for c, in the base or the extension table.
+ * @return the mapping, or NULL if there is none or if there are different ones
+ */
+static UCMapping *
+findTargetMapping(const ExtData *extData, UChar32 c, UCMTable **pTable) {
+    UCMapping *m, *found;
+    UCMTable *table;
+    int32_t i, index, slot;
+
+    found=NULL;
+    for(i=0; i<2; ++i) {
+        table=extData->targetTables[i];
+        slot=-1;
+        while((index=ucm_findUnicode(extData->targetIndexes[i], &c, 1, &slot))>=0) {
+            m=table->mappings+index;
+            if(m->f>0) {
+                continue; /* fallback or sub mapping */
+            }
+            if( found!=NULL &&
+                (found->bLen!=m->bLen ||
+                 0!=memcmp(UCM_GET_BYTES(*pTable, found), UCM_GET_BYTES(table, m), m->bLen))
+            ) {
+                return NULL;
+            }
+            found=m;
+            *pTable=table;
+        }
+    }
+    return found;
+}
+
+/*
+ * toUTable value for a source mapping: an index into results[] for its
+ * direct target bytes, or UCNV_PAIR_PIVOT_INDEX
+ */
+static uint32_t
+getPairValue(ExtData *extData, UCMapping *m) {
+    UCMapping *tm;
+    UCMTable *targetTable;
+    uint32_t result;
+    UChar32 c;
+    int32_t index;
+
+    result=0;
+    if(m->uLen==1) {
+        c=m->u;
+        if(!isTargetStart(extData, c) && (tm=findTargetMapping(extData, c, &targetTable))!=NULL) {
+            result=getFromUValue(extData, targetTable, tm);
+        }
+    }
+
+    if(result==0) {
+        ++extData->pivotCount;
+        index=UCNV_PAIR_PIVOT_INDEX;
+    } else {
+        ++extData->directCount;
+        index=extData->resultsLength;
+        if(index>UCNV_EXT_TO_U_VALUE_MASK-UCNV_EXT_TO_U_MIN_CODE_POINT) {
+            fprintf(stderr, "ucm error: too many converter pair results\n");
+            exit(U_INDEX_OUTOFBOUNDS_ERROR);
+        }
+        extData->results=(uint32_t *)ensureCapacity(
+            extData->results, &extData->resultsCapacity,
+            extData->resultsLength, 1,
+            sizeof(uint32_t), "pair results");
+        extData->results[extData->resultsLength++]=result;
+    }
+    return UCNV_EXT_TO_U_MIN_CODE_POINT+(uint32_t)index;
+}
+
+/* add a table's toUnicode mappings (|0 and |3) to the pair's source table */
+static void
+addSourceMappings(UCMTable *pairTable, UCMTable *table) {
+    UCMapping m;
+    int32_t i;
+
+    for(i=0; i<table->mappingsLength; ++i) {
+        m=table->mappings[i];
+        if(m.f!=1 && m.f!=2) {
+            ucm_addMapping(pairTable, &m,
+                           UCM_GET_CODE_POINTS(table, table->mappings+i),
+                           UCM_GET_BYTES(table, table->mappings+i));
+        }
+    }
+}
+
+U_CAPI int32_t * U_EXPORT2
+ucm_buildPairData(UCMFile *source, UCMFile *target, int32_t *pSize,
+                  int32_t *pDirectCount, int32_t *pPivotCount) {
+    ExtData extData;
+    UCMTable *pairTable, *table;
+    UCMapping *m;
+    int32_t *indexes;
+    uint8_t *data;
+    UErrorCode errorCode;
+    int32_t size, offset, i, j;
+
+    /* ucm_processStates() turns EBCDIC_STATEFUL into MBCS with SI/SO */
+    if( source->states.conversionType==MBCS_OUTPUT_2_SISO ||
+        target->states.conversionType==MBCS_OUTPUT_2_SISO
+    ) {
+        fprintf(stderr, "ucm error: converter pairs do not support stateful charsets\n");
+        exit(U_INVALID_TABLE_FORMAT);
+    }
+
+    memset(&extData, 0, sizeof(extData));
+
+    /* the target's mappings by code points */
+    extData.targetTables[0]=target->base;
+    extData.targetTables[1]=target->ext;
+    size=0;
+    extData.targetStarts=(UChar32 *)ensureCapacity(
+        NULL, &size,
+        0, target->base->mappingsLength+target->ext->mappingsLength+1,
+        sizeof(UChar32), "pair target code points");
+    for(i=0; i<2; ++i) {
+        table=extData.targetTables[i];
+        extData.targetIndexes[i]=ucm_openIndex(table);
+        for(j=0, m=table->mappings; j<table->mappingsLength; ++m, ++j) {
+            if(m->uLen>1 && m->f!=3) {
+                extData.targetStarts[extData.targetStartsLength++]=UCM_GET_CODE_POINTS(table, m)[0];
+            }
+        }
+    }
+    errorCode=U_ZERO_ERROR;
+    uprv_sortArray(extData.targetStarts, extData.targetStartsLength, sizeof(UChar32),
+                   compareCodePoints, NULL, FALSE, &errorCode);
+
+    /* one table with all of the source's toUnicode mappings */
+    pairTable=ucm_openTable();
+    addSourceMappings(pairTable, source->base);
+    addSourceMappings(pairTable, source->ext);
+    ucm_sortTable(pairTable);
+
+    /* results[0] is for the pivot */
+    extData.results=(uint32_t *)ensureCapacity(
+        NULL, &extData.resultsCapacity, 0, 1,
+        sizeof(uint32_t), "pair results");
+    extData.results[UCNV_PAIR_PIVOT_INDEX]=0;
+    extData.resultsLength=1;
+
+    extData.table=pairTable;
+    extData.getToUValue=getPairValue;
+    buildToU(&extData);
+
+    size=
+        UCNV_PAIR_INDEXES_MIN_LENGTH*4+
+        extData.toUTableLength*4+
+        extData.resultsLength*4+
+        ((extData.fromUBytesLength+3)&~3);
+
+    data=(uint8_t *)malloc(size);
+    if(data==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate %ld bytes of converter pair data\n", (long)size);
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+    memset(data, 0, size);
+    indexes=(int32_t *)data;
+    offset=UCNV_PAIR_INDEXES_MIN_LENGTH*4;
+
+    indexes[UCNV_PAIR_INDEXES_LENGTH]=UCNV_PAIR_INDEXES_MIN_LENGTH;
+    indexes[UCNV_PAIR_TABLE_INDEX]=
+        appendArray(data, &offset, extData.toUTable, extData.toUTableLength, 4);
+    indexes[UCNV_PAIR_TABLE_LENGTH]=extData.toUTableLength;
+    indexes[UCNV_PAIR_RESULTS_INDEX]=
+        appendArray(data, &offset, extData.results, extData.resultsLength, 4);
+    indexes[UCNV_PAIR_RESULTS_LENGTH]=extData.resultsLength;
+    indexes[UCNV_PAIR_BYTES_INDEX]=
+        appendArray(data, &offset, extData.fromUBytes, extData.fromUBytesLength, 1);
+    indexes[UCNV_PAIR_BYTES_LENGTH]=extData.fromUBytesLength;
+    indexes[UCNV_PAIR_SIZE]=size;
+
+    ucm_closeIndex(extData.targetIndexes[0]);
+    ucm_closeIndex(extData.targetIndexes[1]);
+    ucm_closeTable(pairTable);
+    free(extData.targetStarts);
+    free(extData.toUMap);
+    free(extData.toUTable);
+    free(extData.toUUChars);
+    free(extData.results);
+    free(extData.fromUBytes);
+
+    *pSize=size;
+    *pDirectCount=extData.directCount;
+    *pPivotCount=extData.pivotCount;
+    return indexes;
+}
+
+U_CAPI void U_EXPORT2
+ucm_writePairData(const int32_t *indexes, const char *destDir, const char *name) {
+    writeDataFile(destDir, UCNV_PAIR_DATA_TYPE, name, &pairDataInfo,
+                  indexes, indexes[UCNV_PAIR_SIZE]);
+}
@@ -0,0 +1,2002 @@
+/*
+*******************************************************************************
+*
+*   Copyright (C) 2026, International Business Machines
+*   Corporation and others.  All Rights Reserved.
+*
+*******************************************************************************
+*   file name:  ucmfuzz.c
+*   encoding:   US-ASCII
+*   tab size:   8 (not used)
+*   indentation:4
+*
+*   created on: 2026oct16
+*   created by: agent
+*
+*   This tool tests the ucm module and the conversion extension matchers
+*   with random input, and measures their throughput.
+*
+*   By default, it generates random state tables and mapping tables and checks
+*   - that each generated mapping line is parsed by ucm_parseMappingLine()
+*     into exactly the code points, bytes and fallback indicator it was
+*     generated from, in all of the allowed spellings
+*   - that ucm_countChars() and ucm_validateBytes() agree with a simple
+*     model of the state table, for valid and for damaged byte sequences
+*   - that ucm_sortTable() leaves the mappings in Unicode-first order and
+*     the reverseMap as a permutation in bytes-first order,
+*     for tables that take the radix sort and for those that do not
+*   - that ucnv_extMatchToU() and ucnv_extMatchFromURun() find the longest
+*     mapping for each input in the data built by ucm_buildExtData()
+*   - that ucm_writeExtData() writes a .cnvx file which ucnv_extOpenData()
+*     loads with the same data as ucm_buildExtData() returns
+*   - that ucm_buildExtData() falls back to fromUTable sections without
+*     the trie when the trie has too many blocks for its 16-bit indexes
+*   - that ucnv_extConvertPair() with data from ucm_buildPairData() for two
+*     random charsets, whole and in small source and target chunks, together
+*     with the pivot for what it leaves out, gives the same bytes as
+*     ucnv_extMatchToU() followed by ucnv_extMatchFromURun() on all of the input
+*   - that all fromUTable section searches, the binary+linear one and
+*     the branch-free one for wide sections with its SSE2 and AVX2 variants
+*     (those that the build and the CPU support), find the same UChars
+*     as a linear search
+*
+*   With .ucm file arguments, it checks the fromUTable section searches
+*   instead on every section of the extension data built from the files,
+*   with and without the initial-code point trie.
+*
+*   With --crash, it feeds mutated header, state and mapping lines to the
+*   parser in child processes and reports any that crash instead of
+*   being rejected. (The ucm module exit()s on invalid input.)
+*   It also checks that ucm_buildPairData() rejects EBCDIC_STATEFUL charsets,
+*   and that ucm_processStates() rejects state tables with loops.
+*
+*   With --time, it runs each phase (parse, count, validate, sort, build,
+*   match) on a fixed, CJK-sized table several times and reports its best
+*   throughput, which is less noisy than a single run.
+*   --write saves the results, and --baseline compares them with saved
+*   results and fails if any phase is slower by more than --tolerance percent,
+*   for use as a performance regression check.
+*/
+
+#include "unicode/utypes.h"
+#include "unicode/putil.h"
+#include "unicode/utf16.h"
+#include "cstring.h"
+#include "uoptions.h"
+#include "ucnv_ext.h"
+#include "ucm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef WIN32
+#   include <process.h>
+#   define getpid _getpid
+#else
+#   include <sys/types.h>
+#   include <sys/wait.h>
+#   include <unistd.h>
+#endif
+
+enum {
+    /* generated state tables */
+    MAX_STATES=4,
+    MAX_RANGES=3,
+
+    /* generated mapping tables */
+    FUZZ_MAPPINGS=2500,
+    MAX_CODE_POINTS=3,
+    MAX_CHARS=2,    /* characters per byte sequence */
+    MAX_BYTES=MAX_CHARS*4,
+
+    MAX_LINE_LENGTH=400,
+    MAX_HEADER_LINES=MAX_STATES+4,
+
+    MATCH_CAPACITY=256,
+
+    /* timed mode: 1:1 mappings for about half of the double-byte codes */
+    TIME_MAPPINGS=12000,
+    TIME_MN_MAPPINGS=2000,
+    TIME_LINE_LENGTH=128,
+    MAX_PHASES=16,
+    TIME_PASSES=5,
+
+    MAX_MAPPINGS=TIME_MAPPINGS+TIME_MN_MAPPINGS,
+
+    /* converter pairs: one source byte can become 3 code points of 8 target bytes each */
+    PAIR_INPUT_LENGTH=400,
+    PAIR_OUTPUT_CAPACITY=PAIR_INPUT_LENGTH*MAX_CODE_POINTS*MAX_BYTES,
+
+    /* hash sets for unique byte and code point sequences, at most half full */
+    SET_SIZE=32768
+};
+
+static UOption options[]={
+    UOPTION_HELP_H,
+    UOPTION_HELP_QUESTION_MARK,
+    UOPTION_DEF("seed", 's', UOPT_REQUIRES_ARG),
+    UOPTION_DEF("iterations", 'i', UOPT_REQUIRES_ARG),
+    UOPTION_DEF("crash", 'c', UOPT_NO_ARG),
+    UOPTION_DEF("time", 't', UOPT_NO_ARG),
+    UOPTION_DEF("write", 'w', UOPT_REQUIRES_ARG),
+    UOPTION_DEF("baseline", 'b', UOPT_REQUIRES_ARG),
+    UOPTION_DEF("tolerance", 0, UOPT_REQUIRES_ARG)
+};
+
+enum {
+    OPT_HELP_H,
+    OPT_HELP_QUESTION_MARK,
+    OPT_SEED,
+    OPT_ITERATIONS,
+    OPT_CRASH,
+    OPT_TIME,
+    OPT_WRITE,
+    OPT_BASELINE,
+    OPT_TOLERANCE
+};
+
+static int32_t errors=0;
+
+static void
+reportError(int32_t iteration, const char *message) {
+    fprintf(stderr, "ucmfuzz: iteration %ld: %s\n", (long)iteration, message);
+    ++errors;
+}
+
+/* random numbers, the same on all platforms for the same seed */
+
+static uint32_t randomState;
+
+static int32_t
+getRandom(int32_t limit) {
+    randomState=randomState*1103515245+12345;
+    return (int32_t)((randomState>>8)%(uint32_t)limit);
+}
+
+/* random state tables ------------------------------------------------------ */
+
+/*
+ * A byte range in a state: the next state, or -1 for a valid
+ * single-byte or final byte.
+ * The generated tables have a single-byte state 0 and one trail state
+ * per additional byte, so every path ends in a valid character.
+ */
+typedef struct Range {
+    int32_t start, end, next;
+} Range;
+
+typedef struct Charset {
+    Range ranges[MAX_STATES][MAX_RANGES];
+    int32_t countRanges[MAX_STATES];
+    int32_t countStates;
+
+    char header[MAX_HEADER_LINES][MAX_LINE_LENGTH];
+    int32_t countHeaderLines;
+} Charset;
+
+static void
+addRange(Charset *cs, int32_t state, int32_t start, int32_t end, int32_t next) {
+    Range *range=cs->ranges[state]+cs->countRanges[state]++;
+    range->start=start;
+    range->end=end;
+    range->next=next;
+}
+
+static void
+makeCharset(Charset *cs, int32_t maxCharLength) {
+    char *line;
+    int32_t state, i, start, end;
+
+    memset(cs, 0, sizeof(Charset));
+    cs->countStates=maxCharLength;
+
+    /* state 0: single bytes (often all of ASCII) and lead bytes */
+    end= getRandom(2) ? 0x7f : 0x3f+getRandom(0x41);
+    addRange(cs, 0, 0, end, -1);
+    if(maxCharLength==1) {
+        addRange(cs, 0, 0x80, 0x80+getRandom(0x80), -1);
+    } else {
+        start=0x81+getRandom(0x20);
+        end=start+getRandom(0xff-start);
+        addRange(cs, 0, start, end, 1);
+        if(end<0xfe && getRandom(2)) {
+            addRange(cs, 0, end+1, end+1+getRandom(0xff-end-1), -1);
+        }
+    }
+
+    /* trail states: final bytes, and 30..39-like bytes that continue */
+    for(state=1; state<maxCharLength; ++state) {
+        if(state<maxCharLength-1) {
+            addRange(cs, state, 0x30, 0x30+getRandom(10), state+1);
+        }
+        start=0x40+getRandom(0x40);
+        addRange(cs, state, start, start+getRandom(0xff-start), -1);
+    }
+
+    /* the header lines */
+    sprintf(cs->header[0], "<code_set_name>   \"fuzz-%ld\"", (long)maxCharLength);
+    sprintf(cs->header[1], "<mb_cur_max>\t%ld", (long)maxCharLength);
+    strcpy(cs->header[2], "<mb_cur_min> 1");
+    strcpy(cs->header[3], "<uconv_class> \"MBCS\"   # comment");
+    for(state=0; state<cs->countStates; ++state) {
+        line=cs->header[4+state];
+        strcpy(line, "<icu:state> ");
+        for(i=0; i<cs->countRanges[state]; ++i) {
+            const Range *range=cs->ranges[state]+i;
+            line+=uprv_strlen(line);
+            if(i>0) {
+                strcpy(line, getRandom(2) ? ", " : ",");
+                line+=uprv_strlen(line);
+            }
+            if(range->start==range->end && getRandom(2)) {
+                sprintf(line, "%lx", (long)range->start);
+            } else {
+                sprintf(line, getRandom(2) ? "%lx-%lx" : "%lX-%lX", (long)range->start, (long)range->end);
+            }
+            if(range->next>=0) {
+                line+=uprv_strlen(line);
+                sprintf(line, ":%lx", (long)range->next);
+            }
+        }
+    }
+    cs->countHeaderLines=4+cs->countStates;
+}
+
+/* parse the header like a .ucm file; exit()s if the ucm module rejects it */
+static UCMFile *
+openCharset(const Charset *cs) {
+    char line[MAX_LINE_LENGTH];
+    char *key, *value;
+    UCMFile *ucm;
+    int32_t i;
+
+    ucm=ucm_open();
+    for(i=0; i<cs->countHeaderLines; ++i) {
+        strcpy(line, cs->header[i]);
+        ucm->lineNumber=i+1;
+        ucm_parseHeaderLine(ucm, line, &key, &value);
+    }
+    ucm_processStates(&ucm->states);
+    return ucm;
+}
+
+/*
+ * Open a charset with the maximum number of states in a chain:
+ * each state has single bytes 00..7f and continues with 80..ff
+ * in the next state.
+ * The last state is final if lastNext==0, else it continues in state lastNext,
+ * which makes a loop.
+ */
+static UCMFile *
+openStateChain(int32_t lastNext) {
+    static const char *const header[]={
+        "<code_set_name> \"chain\"",
+        "<mb_cur_max> 4",
+        "<mb_cur_min> 1",
+        "<uconv_class> \"MBCS\""
+    };
+    char line[MAX_LINE_LENGTH];
+    char *key, *value;
+    UCMFile *ucm;
+    int32_t i;
+
+    ucm=ucm_open();
+    for(i=0; i<(int32_t)(sizeof(header)/sizeof(header[0])); ++i) {
+        strcpy(line, header[i]);
+        ucm_parseHeaderLine(ucm, line, &key, &value);
+    }
+    for(i=0; i<MBCS_MAX_STATE_COUNT-1; ++i) {
+        sprintf(line, "0-7f, 80-ff:%lx", (long)(i+1));
+        ucm_addState(&ucm->states, line);
+    }
+    if(lastNext==0) {
+        ucm_addState(&ucm->states, "0-ff");
+    } else {
+        sprintf(line, "0-7f, 80-ff:%lx", (long)lastNext);
+        ucm_addState(&ucm->states, line);
+    }
+    return ucm;
+}
+
+/* append one random valid character */
+static int32_t
+appendChar(const Charset *cs, uint8_t *bytes, int32_t length) {
+    const Range *range;
+    int32_t state;
+
+    state=0;
+    do {
+        range=cs->ranges[state]+getRandom(cs->countRanges[state]);
+        bytes[length++]=(uint8_t)(range->start+getRandom(range->end-range->start+1));
+        state=range->next;
+    } while(state>=0);
+    return length;
+}
+
+/* a byte value at or next to the boundary of one of the ranges */
+static uint8_t
+getBoundaryByte(const Charset *cs) {
+    const Range *range;
+    int32_t state, b;
+
+    state=getRandom(cs->countStates);
+    range=cs->ranges[state]+getRandom(cs->countRanges[state]);
+    b= getRandom(2) ? range->start : range->end;
+    b+=getRandom(3)-1;
+    return (uint8_t)(b&0xff);
+}
+
+/* model of ucm_validateBytes() for the generated state table */
+static int32_t
+validateModel(const Charset *cs, const uint8_t *bytes, int32_t length, int32_t *pErrorOffset) {
+    int32_t i, j, start, state, count;
+
+    i=start=count=state=0;
+    while(i<length) {
+        for(j=0; j<cs->countRanges[state]; ++j) {
+            if(cs->ranges[state][j].start<=bytes[i] && bytes[i]<=cs->ranges[state][j].end) {
+                break;
+            }
+        }
+        if(j==cs->countRanges[state]) {
+            break; /* illegal */
+        }
+        ++i;
+        state=cs->ranges[state][j].next;
+        if(state<0) {
+            ++count;
+            start=i;
+            state=0;
+        }
+    }
+    *pErrorOffset= start<length ? start : -1;
+    return count;
+}
+
+/* random mapping tables ---------------------------------------------------- */
+
+typedef struct Mapping {
+    UChar32 codePoints[MAX_CODE_POINTS];
+    uint8_t bytes[MAX_BYTES];
+    int8_t uLen, bLen, f, charCount;
+} Mapping;
+
+static Mapping mappings[MAX_MAPPINGS];
+static int32_t mappingsLength;
+
+/* code points from a small per-table pool make for shared prefixes */
+static UChar32 pool[8];
+
+/*
+ * the large timed tables keep their supplementary code points in CJK Ext. B
+ * like real charsets do; scattering thousands of them overflows the fromU trie
+ */
+static UChar32 supplementaryStart=0x10000, supplementaryLength=0x100000;
+
+static UChar32
+getCodePoint() {
+    switch(getRandom(8)) {
+    case 0:
+        return 0x20+getRandom(0x5f);
+    case 1:
+        return 0xe000+getRandom(0x1900);
+    case 2:
+        return supplementaryStart+getRandom(supplementaryLength);
+    case 3:
+        return 0xffff-getRandom(2);
+    case 4:
+        return 0x4e00+getRandom(0x5200);
+    default:
+        return pool[getRandom(8)];
+    }
+}
+
+/*
+ * simple open-addressing hash set of sequence hashes (never 0);
+ * @return the slot with the hash, or the empty slot for it
+ */
+static int32_t
+findSlot(const uint32_t *set, uint32_t hash) {
+    int32_t i;
+
+    for(i=(int32_t)(hash%SET_SIZE); set[i]!=0 && set[i]!=hash; i=(i+1)%SET_SIZE) {}
+    return i;
+}
+
+static uint32_t
+hashSequence(const void *p, int32_t length) {
+    const uint8_t *s=(const uint8_t *)p;
+    uint32_t hash=2166136261u;
+    while(length-->0) {
+        hash=(hash^*s++)*16777619u;
+    }
+    return hash|1; /* 0 marks empty slots */
+}
+
+/*
+ * Generate count mappings with unique byte sequences and unique code point
+ * sequences, so that ucm_buildExtData() sees no conflicts.
+ * The last mnCount of them may be m:n mappings.
+ */
+static void
+makeMappings(const Charset *cs, int32_t count, int32_t mnCount) {
+    static uint32_t bytesSet[SET_SIZE], unicodeSet[SET_SIZE];
+    static const int8_t flags[5]={ -1, 0, 0, 1, 3 };
+    Mapping *m;
+    uint32_t bytesHash, unicodeHash;
+    int32_t i, j, tries;
+    UBool mn;
+
+    memset(bytesSet, 0, sizeof(bytesSet));
+    memset(unicodeSet, 0, sizeof(unicodeSet));
+    for(i=0; i<8; ++i) {
+        pool[i]=getCodePoint();
+    }
+
+    mappingsLength=0;
+    for(tries=0; mappingsLength<count && tries<16*count; ++tries) {
+        m=mappings+mappingsLength;
+        mn=(UBool)(mappingsLength>=count-mnCount);
+        m->uLen= (int8_t)(mn ? 1+getRandom(MAX_CODE_POINTS) : 1);
+        for(j=0; j<m->uLen; ++j) {
+            m->codePoints[j]=getCodePoint();
+        }
+        if(mn) {
+            m->charCount=(int8_t)(1+getRandom(MAX_CHARS));
+        } else {
+            /* some 1:1 mappings have two characters, for byte sequence prefixes */
+            m->charCount=(int8_t)(getRandom(8)==0 ? 2 : 1);
+        }
+        m->bLen=0;
+        for(j=0; j<m->charCount; ++j) {
+            m->bLen=(int8_t)appendChar(cs, m->bytes, m->bLen);
+        }
+        m->f=flags[getRandom(5)];
+
+        bytesHash=hashSequence(m->bytes, m->bLen);
+        unicodeHash=hashSequence(m->codePoints, m->uLen*4);
+        i=findSlot(bytesSet, bytesHash);
+        j=findSlot(unicodeSet, unicodeHash);
+        if(bytesSet[i]==0 && unicodeSet[j]==0) {
+            bytesSet[i]=bytesHash;
+            unicodeSet[j]=unicodeHash;
+            ++mappingsLength;
+        }
+    }
+}
+
+/* write a mapping line in one of the spellings that .ucm files use */
+static void
+formatMapping(const Mapping *m, char *line) {
+    static const char *const hexFormats[4]={ "<U%04lX>", "<U%lX>", "<U%06lX>", "<U%04lx>" };
+    int32_t i, format;
+
+    format=getRandom(4);
+    for(i=0; i<m->uLen; ++i) {
+        if(i>0 && getRandom(4)==0) {
+            *line++='+';
+        }
+        line+=sprintf(line, hexFormats[format], (long)m->codePoints[i]);
+    }
+    line+=sprintf(line, getRandom(4)==0 ? " \t " : " ");
+    for(i=0; i<m->bLen; ++i) {
+        if(i>0 && getRandom(4)==0) {
+            *line++='+';
+        }
+        line+=sprintf(line, getRandom(4)==0 ? "\\x%02x" : "\\x%02X", m->bytes[i]);
+    }
+    if(m->f>=0) {
+        line+=sprintf(line, " |%d", m->f);
+    }
+    if(getRandom(4)==0) {
+        line+=sprintf(line, " # comment <U0041> \\x41");
+    }
+    *line=0;
+}
+
+/* did ucm_parseMappingLine() return exactly the generated mapping? */
+static UBool
+isSameMapping(const Mapping *m,
+              const UCMapping *parsed, const UChar32 *codePoints, const uint8_t *bytes) {
+    return (UBool)(
+        parsed->uLen==m->uLen && parsed->bLen==m->bLen && parsed->f==m->f &&
+        0==memcmp(codePoints, m->codePoints, m->uLen*4) &&
+        0==memcmp(bytes, m->bytes, m->bLen) &&
+        (m->uLen!=1 || parsed->u==m->codePoints[0]) &&
+        (m->bLen>4 || 0==memcmp(parsed->b.bytes, m->bytes, m->bLen)));
+}
+
+/* sort order model --------------------------------------------------------- */
+
+static int32_t
+compareUnicodeModel(UCMTable *t, const UCMapping *l, const UCMapping *r) {
+    const UChar32 *lu=UCM_GET_CODE_POINTS(t, l), *ru=UCM_GET_CODE_POINTS(t, r);
+    int32_t i;
+
+    for(i=0; i<l->uLen && i<r->uLen; ++i) {
+        if(lu[i]!=ru[i]) {
+            return lu[i]<ru[i] ? -1 : 1;
+        }
+    }
+    return l->uLen-r->uLen;
+}
+
+/* lexical: a prefix sorts before the longer sequence */
+static int32_t
+compareBytesModel(UCMTable *t, const UCMapping *l, const UCMapping *r) {
+    const uint8_t *lb=UCM_GET_BYTES(t, l), *rb=UCM_GET_BYTES(t, r);
+    int32_t i;
+
+    for(i=0; i<l->bLen && i<r->bLen; ++i) {
+        if(lb[i]!=rb[i]) {
+            return (int32_t)lb[i]-(int32_t)rb[i];
+        }
+    }
+    return l->bLen-r->bLen;
+}
+
+static UBool
+isSortedTable(UCMTable *t, int32_t length) {
+    static uint8_t seen[MAX_MAPPINGS];
+    int32_t i, index;
+
+    if(t->mappingsLength!=length) {
+        return FALSE;
+    }
+    for(i=1; i<length; ++i) {
+        if(compareUnicodeModel(t, t->mappings+i-1, t->mappings+i)>0) {
+            return FALSE;
+        }
+    }
+
+    memset(seen, 0, length);
+    for(i=0; i<length; ++i) {
+        index=t->reverseMap[i];
+        if(index<0 || index>=length || seen[index]) {
+            return FALSE;
+        }
+        seen[index]=1;
+        if(i>0 && compareBytesModel(t, t->mappings+t->reverseMap[i-1], t->mappings+index)>0) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* matcher models ----------------------------------------------------------- */
+
+#define IS_TO_U(m) ((m)->f!=1)
+#define IS_FROM_U(m) ((m)->f!=3)
+
+/* @return the index of the longest toUnicode mapping for a prefix of the bytes, or -1 */
+static int32_t
+findToUModel(const uint8_t *bytes, int32_t length) {
+    const Mapping *m;
+    int32_t i, best, bestLength;
+
+    best=-1;
+    bestLength=0;
+    for(i=0, m=mappings; i<mappingsLength; ++m, ++i) {
+        if( IS_TO_U(m) && bestLength<m->bLen && m->bLen<=length &&
+            0==memcmp(m->bytes, bytes, m->bLen)
+        ) {
+            best=i;
+            bestLength=m->bLen;
+        }
+    }
+    return best;
+}
+
+/* @return the index of the longest fromUnicode mapping for a prefix of the code points, or -1 */
+static int32_t
+findFromUModel(const UChar32 *codePoints, int32_t length) {
+    const Mapping *m;
+    int32_t i, best, bestLength;
+
+    best=-1;
+    bestLength=0;
+    for(i=0, m=mappings; i<mappingsLength; ++m, ++i) {
+        if( IS_FROM_U(m) && bestLength<m->uLen && m->uLen<=length &&
+            0==memcmp(m->codePoints, codePoints, m->uLen*4)
+        ) {
+            best=i;
+            bestLength=m->uLen;
+        }
+    }
+    return best;
+}
+
+/* is the toUTable value the result of the mapping? */
+static UBool
+isToUResult(const int32_t *cx, uint32_t value, const Mapping *m) {
+    UChar expected[2*MAX_CODE_POINTS];
+    const UChar *uchars;
+    int32_t i, length;
+
+    if((UBool)UCNV_EXT_TO_U_IS_ROUNDTRIP(value)!=(UBool)(m->f<=0)) {
+        return FALSE;
+    }
+    value=UCNV_EXT_TO_U_MASK_ROUNDTRIP(value);
+    if(UCNV_EXT_TO_U_IS_CODE_POINT(value)) {
+        return (UBool)(m->uLen==1 && (UChar32)UCNV_EXT_TO_U_GET_CODE_POINT(value)==m->codePoints[0]);
+    }
+
+    length=0;
+    for(i=0; i<m->uLen; ++i) {
+        U16_APPEND_UNSAFE(expected, length, m->codePoints[i]);
+    }
+    uchars=(const UChar *)cx+cx[UCNV_EXT_TO_U_UCHARS_INDEX]+UCNV_EXT_TO_U_GET_INDEX(value);
+    return (UBool)(
+        (int32_t)UCNV_EXT_TO_U_GET_LENGTH(value)==length &&
+        0==memcmp(uchars, expected, length*U_SIZEOF_UCHAR));
+}
+
+/* are the ucnv_extMatchFromURun() result bytes those of the mapping? */
+static UBool
+isFromUResult(const UCNVExtMatch *match, const Mapping *m) {
+    uint8_t bytes[4];
+    uint32_t value;
+    int32_t i, length;
+
+    if(match->resultLength<0) {
+        /* 1..3 bytes in the value */
+        value=(uint32_t)-match->resultLength;
+        length=(int32_t)UCNV_EXT_FROM_U_GET_LENGTH(value);
+        for(i=0; i<length; ++i) {
+            bytes[i]=(uint8_t)(value>>(8*(length-1-i)));
+        }
+        return (UBool)(length==m->bLen && 0==memcmp(bytes, m->bytes, length));
+    } else {
+        return (UBool)(match->resultLength==m->bLen && 0==memcmp(match->result, m->bytes, m->bLen));
+    }
+}
+
+static void
+checkToU(const int32_t *cx, const uint8_t *bytes, int32_t length, int32_t iteration) {
+    UCNVExtToUState state;
+    int32_t best;
+    int8_t match;
+
+    best=findToUModel(bytes, length);
+
+    state.matchValue=0;
+    state.index=0;
+    state.length=state.matchLength=0;
+    state.firstLength=1;
+    match=ucnv_extMatchToU(cx, &state, NULL, 0, (const char *)bytes, length, TRUE, TRUE);
+
+    if(best<0) {
+        if(match!=0) {
+            reportError(iteration, "ucnv_extMatchToU() matches an unmapped sequence");
+        }
+    } else if(match!=mappings[best].bLen) {
+        reportError(iteration, "ucnv_extMatchToU() returns the wrong match length");
+    } else if(!isToUResult(cx, state.matchValue, mappings+best)) {
+        reportError(iteration, "ucnv_extMatchToU() returns the wrong result");
+    }
+}
+
+/* ext: specialized matchers, or NULL for the generic one */
+static void
+checkFromU(const UConverterExt *ext, const int32_t *cx,
+           const UChar32 *codePoints, int32_t length, int32_t iteration) {
+    UCNVExtMatch matches[MATCH_CAPACITY];
+    UChar s[2*(MAX_CODE_POINTS+1)];
+    int32_t i, best, sLength, bestLength, count, consumed;
+
+    best=findFromUModel(codePoints, length);
+
+    sLength=bestLength=0;
+    for(i=0; i<length; ++i) {
+        U16_APPEND_UNSAFE(s, sLength, codePoints[i]);
+        if(best>=0 && i+1==mappings[best].uLen) {
+            bestLength=sLength;
+        }
+    }
+    /* without flush, a lead surrogate at the end must be left for the next run */
+    if(U_IS_SUPPLEMENTARY(codePoints[length-1])) {
+        ucnv_extMatchFromURun(ext, cx, s, sLength-1, matches, MATCH_CAPACITY, &consumed, TRUE, FALSE);
+        if(consumed>sLength-2) {
+            reportError(iteration, "ucnv_extMatchFromURun() consumes a lead surrogate at the end without flush");
+        }
+    }
+
+    count=ucnv_extMatchFromURun(ext, cx, s, sLength, matches, MATCH_CAPACITY, &consumed, TRUE, TRUE);
+
+    if(count<1 || consumed!=sLength) {
+        reportError(iteration, "ucnv_extMatchFromURun() does not consume all input with flush==TRUE");
+    } else if(best<0) {
+        if(matches[0].resultLength!=0 || matches[0].length!=U16_LENGTH(codePoints[0])) {
+            reportError(iteration, "ucnv_extMatchFromURun() matches an unmapped sequence");
+        }
+    } else if(matches[0].length!=bestLength) {
+        reportError(iteration, "ucnv_extMatchFromURun() returns the wrong match length");
+    } else if(!isFromUResult(matches, mappings+best)) {
+        reportError(iteration, "ucnv_extMatchFromURun() returns the wrong result");
+    }
+}
+
+static const char *const searchNames[UCNV_EXT_FROM_U_SEARCH_COUNT]={
+    "binary+linear", "wide", "SSE2", "AVX2", "default"
+};
+
+/* search u in the section with each available search function, compare with a linear search */
+static void
+checkSearchFor(const UChar *section, int32_t length, UChar u, int32_t iteration) {
+    int32_t expected, i, search;
+
+    for(expected=-1, i=0; i<length; ++i) {
+        if(section[i]==u) {
+            expected=i;
+            break;
+        }
+    }
+    for(search=0; search<UCNV_EXT_FROM_U_SEARCH_COUNT; ++search) {
+        if( ucnv_extHasFromUSearch(search) &&
+            ucnv_extSearchFromU(section, length, u, search)!=expected
+        ) {
+            reportError(iteration, "a fromU section search differs from a linear search");
+            fprintf(stderr, "    %s search: U+%04lx in a section of %ld\n",
+                            searchNames[search], (long)u, (long)length);
+        }
+    }
+}
+
+/* probe a section at, between and around its UChars, and at both ends */
+static void
+checkSearchInSection(const UChar *section, int32_t length, int32_t iteration) {
+    int32_t i;
+
+    checkSearchFor(section, length, 0, iteration);
+    checkSearchFor(section, length, 0xffff, iteration);
+    for(i=0; i<length; ++i) {
+        checkSearchFor(section, length, section[i], iteration);
+        checkSearchFor(section, length, (UChar)(section[i]-1), iteration);
+        checkSearchFor(section, length, (UChar)(section[i]+1), iteration);
+    }
+}
+
+/*
+ * Every position in short sections, where the binary+linear search
+ * is all or mostly linear, then random sections of up to about four times
+ * the wide-section length, probed at, between and around their UChars.
+ */
+static void
+checkSearch(int32_t iteration) {
+    UChar section[4*UCNV_EXT_FROM_U_WIDE_SECTION_LENGTH+8];
+    int32_t i, length;
+    UChar u;
+
+    if(iteration==0) {
+        for(length=1; length<=8; ++length) {
+            for(i=0; i<length; ++i) {
+                section[i]=(UChar)(2+2*i);
+            }
+            for(u=0; u<=2*length+2; ++u) {
+                checkSearchFor(section, length, u, iteration);
+            }
+        }
+    }
+
+    /* sorted, unique UChars, often adjacent */
+    length=1+getRandom(sizeof(section)/U_SIZEOF_UCHAR);
+    u=(UChar)getRandom(0x100);
+    for(i=0; i<length; ++i) {
+        section[i]=u;
+        u+=(UChar)(1+getRandom(getRandom(2) ? 3 : 0x200));
+    }
+    checkSearchInSection(section, length, iteration);
+}
+
+/*
+ * Build the extension data for a table of a .ucm file,
+ * with the trie if the builder chooses it or without,
+ * and check every one of its fromUTable sections.
+ * @return the number of sections
+ */
+static int32_t
+checkSearchInTable(UCMTable *table, UBool withoutTrie) {
+    const UChar *uchars;
+    int32_t *cx;
+    int32_t i, length, count, size, sections;
+
+    if(table->mappingsLength==0) {
+        return 0;
+    }
+    if(withoutTrie) {
+        cx=ucm_buildExtDataWithoutTrie(table, &size);
+    } else {
+        cx=ucm_buildExtData(table, &size);
+    }
+
+    /* the sections are stored one after the other, each after its length unit */
+    uchars=(const UChar *)cx+cx[UCNV_EXT_FROM_U_UCHARS_INDEX];
+    length=cx[UCNV_EXT_FROM_U_LENGTH];
+    sections=0;
+    for(i=0; i<length; i+=1+count) {
+        count=uchars[i];
+        if(count>0) {
+            checkSearchInSection(uchars+i+1, count, i);
+            ++sections;
+        }
+    }
+
+    free(cx);
+    return sections;
+}
+
+/*
+ * Check the fromUTable section searches on real data:
+ * every section of the extension data for the base table
+ * and for the extension table of each .ucm file, in both forms.
+ * Without the trie, the root section has all initial UChars of the table.
+ */
+static void
+checkSearchInFiles(const char *filenames[], int32_t count) {
+    UCMFile *ucm;
+    int32_t i, sections, previousErrors;
+
+    printf("searches:");
+    for(i=0; i<UCNV_EXT_FROM_U_SEARCH_COUNT; ++i) {
+        if(ucnv_extHasFromUSearch(i)) {
+            printf(" %s", searchNames[i]);
+        }
+    }
+    puts("");
+
+    for(i=0; i<count; ++i) {
+        previousErrors=errors;
+        ucm=ucm_readFile(filenames[i]);
+        sections=checkSearchInTable(ucm->base, FALSE);
+        sections+=checkSearchInTable(ucm->base, TRUE);
+        sections+=checkSearchInTable(ucm->ext, FALSE);
+        sections+=checkSearchInTable(ucm->ext, TRUE);
+        ucm_close(ucm);
+        printf("%s: %ld fromUTable sections: %ld errors\n",
+               filenames[i], (long)sections, (long)(errors-previousErrors));
+    }
+}
+
+/* fuzz mode ---------------------------------------------------------------- */
+
+/* parse, count and add the generated mappings, checking each one */
+static void
+parseMappings(UCMFile *ucm, UCMTable *table, int32_t iteration) {
+    char line[MAX_LINE_LENGTH];
+    UCMapping parsed;
+    UChar32 codePoints[UCNV_EXT_MAX_LENGTH];
+    uint8_t bytes[UCNV_EXT_MAX_LENGTH];
+    const Mapping *m;
+    int32_t i;
+
+    for(i=0, m=mappings; i<mappingsLength; ++m, ++i) {
+        formatMapping(m, line);
+        memset(&parsed, 0, sizeof(parsed));
+        ucm_parseMappingLine(&parsed, codePoints, bytes, line);
+        if(!isSameMapping(m, &parsed, codePoints, bytes)) {
+            reportError(iteration, "ucm_parseMappingLine() returns a different mapping");
+            fprintf(stderr, "    line: %s\n", line);
+        }
+        if(ucm_countChars(&ucm->states, m->bytes, m->bLen)!=m->charCount) {
+            reportError(iteration, "ucm_countChars() returns the wrong number of characters");
+        }
+        ucm_addMapping(table, &parsed, codePoints, bytes);
+    }
+}
+
+/* validate the concatenated byte sequences, intact and damaged */
+static void
+checkValidation(const Charset *cs, UCMFile *ucm, int32_t iteration) {
+    static uint8_t stream[MAX_MAPPINGS*MAX_BYTES];
+    int32_t i, length, chars, count, errorOffset, modelCount, modelErrorOffset;
+
+    length=chars=0;
+    for(i=0; i<mappingsLength; ++i) {
+        uprv_memcpy(stream+length, mappings[i].bytes, mappings[i].bLen);
+        length+=mappings[i].bLen;
+        chars+=mappings[i].charCount;
+    }
+
+    count=ucm_validateBytes(&ucm->states, stream, length, &errorOffset);
+    if(count!=chars || errorOffset!=-1) {
+        reportError(iteration, "ucm_validateBytes() rejects valid characters");
+    }
+
+    for(i=0; i<8 && length>0; ++i) {
+        /* damage one byte, or cut the stream in the middle of a character */
+        if(i&1) {
+            stream[getRandom(length)]= getRandom(2) ? (uint8_t)getRandom(0x100) : getBoundaryByte(cs);
+        } else {
+            length=getRandom(length);
+        }
+        count=ucm_validateBytes(&ucm->states, stream, length, &errorOffset);
+        modelCount=validateModel(cs, stream, length, &modelErrorOffset);
+        if(count!=modelCount || errorOffset!=modelErrorOffset) {
+            reportError(iteration, "ucm_validateBytes() differs from the state table model");
+        }
+    }
+}
+
+static void
+checkMatchers(const UConverterExt *ext, const int32_t *cx, int32_t iteration) {
+    uint8_t bytes[2*MAX_BYTES];
+    UChar32 codePoints[MAX_CODE_POINTS+1];
+    const Mapping *m;
+    int32_t i, j, length;
+
+    for(i=0, m=mappings; i<mappingsLength; ++m, ++i) {
+        /* each mapping, sometimes followed by more input */
+        uprv_memcpy(bytes, m->bytes, m->bLen);
+        length=m->bLen;
+        if(getRandom(2)) {
+            j=getRandom(mappingsLength);
+            uprv_memcpy(bytes+length, mappings[j].bytes, mappings[j].bLen);
+            length+=mappings[j].bLen;
+        }
+        checkToU(cx, bytes, length, iteration);
+
+        uprv_memcpy(codePoints, m->codePoints, m->uLen*4);
+        length=m->uLen;
+        if(getRandom(2)) {
+            codePoints[length++]=getCodePoint();
+        }
+        checkFromU(getRandom(2) ? ext : NULL, cx, codePoints, length, iteration);
+    }
+
+    /* random input that mostly misses or matches partially */
+    for(i=0; i<mappingsLength; ++i) {
+        length=1+getRandom(MAX_BYTES);
+        for(j=0; j<length; ++j) {
+            bytes[j]= getRandom(2) ? mappings[i].bytes[0] : (uint8_t)getRandom(0x100);
+        }
+        checkToU(cx, bytes, length, iteration);
+
+        length=1+getRandom(MAX_CODE_POINTS);
+        for(j=0; j<length; ++j) {
+            codePoints[j]=getCodePoint();
+        }
+        checkFromU(getRandom(2) ? ext : NULL, cx, codePoints, length, iteration);
+    }
+}
+
+/* fill the table with mappings[start..limit[ */
+static void
+fillTable(UCMTable *table, int32_t start, int32_t limit) {
+    UCMapping m;
+    UChar32 codePoints[UCNV_EXT_MAX_LENGTH];
+    uint8_t bytes[UCNV_EXT_MAX_LENGTH];
+    int32_t i;
+
+    ucm_resetTable(table);
+    for(i=start; i<limit; ++i) {
+        memset(&m, 0, sizeof(m));
+        m.uLen=mappings[i].uLen;
+        m.bLen=mappings[i].bLen;
+        m.f=mappings[i].f;
+        m.u=mappings[i].codePoints[0];
+        if(m.bLen<=4) {
+            uprv_memcpy(m.b.bytes, mappings[i].bytes, m.bLen);
+        }
+        uprv_memcpy(codePoints, mappings[i].codePoints, m.uLen*4);
+        uprv_memcpy(bytes, mappings[i].bytes, m.bLen);
+        ucm_addMapping(table, &m, codePoints, bytes);
+    }
+}
+
+/*
+ * Build extension data for count double-byte mappings of
+ * U+10000, U+10010, U+10020, ...: each of them needs its own
+ * fromUnicode trie stage 3 block, and with 4096 of them the blocks no longer
+ * fit into the 16-bit stage 2 values.
+ * ucm_buildExtData() must then write the fromUTable sections without a trie.
+ */
+static void
+checkTrieOverflow(int32_t count) {
+    UConverterExt ext;
+    UCMTable *table;
+    Mapping *m;
+    int32_t *cx;
+    int32_t i, size;
+
+    for(i=0, m=mappings; i<count; ++m, ++i) {
+        memset(m, 0, sizeof(Mapping));
+        m->codePoints[0]=0x10000+0x10*i;
+        m->uLen=1;
+        m->bytes[0]=(uint8_t)(0x81+(i>>7));
+        m->bytes[1]=(uint8_t)(0x80+(i&0x7f));
+        m->bLen=2;
+        m->charCount=1;
+    }
+    mappingsLength=count;
+
+    table=ucm_openTable();
+    fillTable(table, 0, count);
+    cx=ucm_buildExtData(table, &size);
+    if(cx[UCNV_EXT_SIZE]!=size) {
+        reportError(count, "ucm_buildExtData() returns an inconsistent size");
+    }
+    ucnv_extOpenFromU(&ext, cx);
+    for(i=0, m=mappings; i<count; ++m, ++i) {
+        checkToU(cx, m->bytes, m->bLen, count);
+        checkFromU((i&1) ? &ext : NULL, cx, m->codePoints, m->uLen, count);
+    }
+
+    free(cx);
+    ucm_closeTable(table);
+}
+
+/*
+ * Write the table's extension data to a .cnvx file in the current directory,
+ * load it with ucnv_extOpenData(), and compare it with cx.
+ * The process ID keeps the files of parallel runs apart.
+ */
+static void
+checkExtDataFile(UCMTable *table, const int32_t *cx, int32_t iteration) {
+    char name[32], filename[48];
+    UDataMemory *pData;
+    const int32_t *loaded;
+    UErrorCode errorCode;
+
+    sprintf(name, "ucmfuzz_%ld", (long)getpid());
+    ucm_writeExtData(table, "." U_FILE_SEP_STRING, name);
+
+    errorCode=U_ZERO_ERROR;
+    loaded=ucnv_extOpenData("." U_FILE_SEP_STRING, name, &pData, &errorCode);
+    if(U_FAILURE(errorCode)) {
+        reportError(iteration, "ucnv_extOpenData() fails to load the file from ucm_writeExtData()");
+        fprintf(stderr, "    %s\n", u_errorName(errorCode));
+    } else {
+        if( loaded[UCNV_EXT_SIZE]!=cx[UCNV_EXT_SIZE] ||
+            0!=memcmp(loaded, cx, cx[UCNV_EXT_SIZE])
+        ) {
+            reportError(iteration, "the .cnvx file differs from the ucm_buildExtData() data");
+        }
+        udata_close(pData);
+    }
+
+    sprintf(filename, "%s.%s", name, UCNV_EXT_DATA_TYPE);
+    remove(filename);
+}
+
+/* converter pairs ---------------------------------------------------------- */
+
+/*
+ * Add target mappings after the source mappings[0..sourceLength[,
+ * mostly for the same code points so that ucm_buildPairData() finds
+ * direct results.
+ * Some of them append the first code point of another source mapping,
+ * which makes the source code point start a longer target mapping.
+ */
+static void
+makeTargetMappings(const Charset *cs, int32_t sourceLength) {
+    static uint32_t bytesSet[SET_SIZE], unicodeSet[SET_SIZE];
+    static const int8_t flags[5]={ -1, 0, 0, 1, 3 };
+    const Mapping *s;
+    Mapping *m;
+    uint32_t bytesHash, unicodeHash;
+    int32_t i, j, tries;
+
+    memset(bytesSet, 0, sizeof(bytesSet));
+    memset(unicodeSet, 0, sizeof(unicodeSet));
+
+    for(tries=0; tries<2*sourceLength && mappingsLength<MAX_MAPPINGS; ++tries) {
+        m=mappings+mappingsLength;
+        s=mappings+getRandom(sourceLength);
+        uprv_memcpy(m->codePoints, s->codePoints, s->uLen*4);
+        m->uLen=s->uLen;
+        switch(getRandom(8)) {
+        case 0:
+            m->codePoints[0]=getCodePoint();
+            break;
+        case 1:
+        case 2:
+            if(m->uLen<MAX_CODE_POINTS) {
+                m->codePoints[m->uLen++]=mappings[getRandom(sourceLength)].codePoints[0];
+            }
+            break;
+        default:
+            break;
+        }
+        m->charCount=(int8_t)(getRandom(8)==0 ? 2 : 1);
+        m->bLen=0;
+        for(j=0; j<m->charCount; ++j) {
+            m->bLen=(int8_t)appendChar(cs, m->bytes, m->bLen);
+        }
+        m->f=flags[getRandom(5)];
+
+        bytesHash=hashSequence(m->bytes, m->bLen);
+        unicodeHash=hashSequence(m->codePoints, m->uLen*4);
+        i=findSlot(bytesSet, bytesHash);
+        j=findSlot(unicodeSet, unicodeHash);
+        if(bytesSet[i]==0 && unicodeSet[j]==0) {
+            bytesSet[i]=bytesHash;
+            unicodeSet[j]=unicodeHash;
+            ++mappingsLength;
+        }
+    }
+}
+
+/* source bytes: mostly whole mappings, some single lead bytes and random bytes */
+static int32_t
+makePairInput(int32_t sourceLength, uint8_t *input) {
+    const Mapping *m;
+    int32_t length;
+
+    length=0;
+    while(length<=PAIR_INPUT_LENGTH-MAX_BYTES) {
+        m=mappings+getRandom(sourceLength);
+        switch(getRandom(8)) {
+        case 0:
+            input[length++]=(uint8_t)getRandom(0x100);
+            break;
+        case 1:
+            input[length++]=m->bytes[0];
+            break;
+        default:
+            uprv_memcpy(input+length, m->bytes, m->bLen);
+            length+=m->bLen;
+            break;
+        }
+    }
+    return length;
+}
+
+/*
+ * Convert the source character at input[start] to UChars with
+ * ucnv_extMatchToU(), or an unmappable byte to U+FFFD.
+ * @return the index after the character
+ */
+static int32_t
+toUPivot(const int32_t *cx, const uint8_t *input, int32_t length, int32_t start,
+         UChar *u, int32_t *pULength) {
+    UCNVExtToUState state;
+    uint32_t value;
+    int8_t match;
+
+    state.matchValue=0;
+    state.index=0;
+    state.length=state.matchLength=0;
+    state.firstLength=1;
+    match=ucnv_extMatchToU(cx, &state, NULL, 0, (const char *)input+start, length-start, TRUE, TRUE);
+    if(match<=0) {
+        u[(*pULength)++]=0xfffd;
+        return start+1;
+    }
+
+    value=UCNV_EXT_TO_U_MASK_ROUNDTRIP(state.matchValue);
+    if(UCNV_EXT_TO_U_IS_CODE_POINT(value)) {
+        U16_APPEND_UNSAFE(u, *pULength, (UChar32)UCNV_EXT_TO_U_GET_CODE_POINT(value));
+    } else {
+        uprv_memcpy(u+*pULength,
+                    (const UChar *)cx+cx[UCNV_EXT_TO_U_UCHARS_INDEX]+UCNV_EXT_TO_U_GET_INDEX(value),
+                    UCNV_EXT_TO_U_GET_LENGTH(value)*U_SIZEOF_UCHAR);
+        *pULength+=UCNV_EXT_TO_U_GET_LENGTH(value);
+    }
+    return start+match;
+}
+
+/*
+ * Convert UChars to target bytes with ucnv_extMatchFromURun(),
+ * an unmappable code point to 1a.
+ * @return the number of UChars consumed; less than uLength if
+ *         flush==FALSE and there is a partial match at the end
+ */
+static int32_t
+fromUPivot(const int32_t *cx, const UChar *u, int32_t uLength, UBool flush,
+           uint8_t *output, int32_t *pOutputLength) {
+    UCNVExtMatch matches[MATCH_CAPACITY];
+    const UCNVExtMatch *match;
+    uint32_t value;
+    int32_t i, j, count, consumed, length;
+
+    i=0;
+    do {
+        count=ucnv_extMatchFromURun(NULL, cx, u+i, uLength-i, matches, MATCH_CAPACITY,
+                                    &consumed, FALSE, flush);
+        for(j=0, match=matches; j<count; ++match, ++j) {
+            if(match->resultLength<0) {
+                /* 1..3 bytes in the value */
+                value=(uint32_t)-match->resultLength;
+                length=(int32_t)UCNV_EXT_FROM_U_GET_LENGTH(value);
+                while(length>0) {
+                    output[(*pOutputLength)++]=(uint8_t)(value>>(8*--length));
+                }
+            } else if(match->resultLength>0) {
+                uprv_memcpy(output+*pOutputLength, match->result, match->resultLength);
+                *pOutputLength+=match->resultLength;
+            } else {
+                output[(*pOutputLength)++]=0x1a;
+            }
+        }
+        i+=consumed;
+    } while(count==MATCH_CAPACITY && i<uLength);
+    return i;
+}
+
+/*
+ * Convert through the UTF-16 pivot from input[start] like a caller of
+ * ucnv_extConvertPair() with its regular converters:
+ * at least up to minLimit, and then until the target side has no
+ * partial match that the following text could continue.
+ * With minLimit==length, this is the reference conversion of the whole input.
+ * @return the index where the pair conversion continues
+ */
+static int32_t
+convertPivot(const int32_t *sourceCx, const int32_t *targetCx,
+             const uint8_t *input, int32_t length, int32_t start, int32_t minLimit,
+             uint8_t *output, int32_t *pOutputLength) {
+    static UChar u[PAIR_INPUT_LENGTH*2*MAX_CODE_POINTS];
+    int32_t uLength, outputLength;
+
+    uLength=0;
+    for(;;) {
+        start=toUPivot(sourceCx, input, length, start, u, &uLength);
+        if(start>=minLimit) {
+            outputLength=*pOutputLength;
+            if(fromUPivot(targetCx, u, uLength, (UBool)(start==length), output, &outputLength)==uLength) {
+                *pOutputLength=outputLength;
+                return start;
+            }
+        }
+    }
+}
+
+/*
+ * Convert the input with ucnv_extConvertPair() and convertPivot()
+ * for what it leaves to the pivot,
+ * with the whole input and a large target, or in small chunks
+ * into small target buffers.
+ * @return the output length
+ */
+static int32_t
+convertPair(const int32_t *px, const int32_t *sourceCx, const int32_t *targetCx,
+            const uint8_t *input, int32_t length, UBool chunked,
+            uint8_t *output, int32_t iteration) {
+    const char *source, *sourceLimit, *inputLimit;
+    char *target, *targetLimit;
+    int32_t pivotLength, start, outputLength, calls;
+    UErrorCode errorCode;
+
+    source=(const char *)input;
+    inputLimit=source+length;
+    target=(char *)output;
+    for(calls=0; source<inputLimit; ++calls) {
+        if(calls>100*PAIR_INPUT_LENGTH) {
+            reportError(iteration, "ucnv_extConvertPair() makes no progress");
+            break;
+        }
+        if(chunked) {
+            sourceLimit=source+1+getRandom(8);
+            if(sourceLimit>inputLimit) {
+                sourceLimit=inputLimit;
+            }
+            targetLimit=target+1+getRandom(MAX_BYTES);
+        } else {
+            sourceLimit=inputLimit;
+            targetLimit=(char *)output+PAIR_OUTPUT_CAPACITY;
+        }
+
+        errorCode=U_ZERO_ERROR;
+        ucnv_extConvertPair(px, &source, sourceLimit, &target, targetLimit,
+                            &pivotLength, (UBool)(sourceLimit==inputLimit), &errorCode);
+        if(errorCode==U_BUFFER_OVERFLOW_ERROR && chunked && pivotLength==0) {
+            continue; /* the next call has a new target buffer */
+        } else if(U_FAILURE(errorCode)) {
+            reportError(iteration, "ucnv_extConvertPair() fails");
+            fprintf(stderr, "    %s\n", u_errorName(errorCode));
+            break;
+        }
+
+        if(pivotLength>0) {
+            start=(int32_t)(source-(const char *)input);
+            outputLength=(int32_t)(target-(char *)output);
+            start=convertPivot(sourceCx, targetCx, input, length,
+                               start, start+pivotLength, output, &outputLength);
+            source=(const char *)input+start;
+            target=(char *)output+outputLength;
+        }
+    }
+    return (int32_t)(target-(char *)output);
+}
+
+/*
+ * Build converter pair data for two random charsets and check that
+ * ucnv_extConvertPair() together with the pivot for what it leaves out
+ * gives the same bytes as converting all of the input to Unicode with
+ * the source's extension data and then to the target charset with the
+ * target's extension data.
+ */
+static void
+checkPair(int32_t iteration) {
+    static uint8_t input[PAIR_INPUT_LENGTH];
+    static uint8_t expected[PAIR_OUTPUT_CAPACITY], actual[PAIR_OUTPUT_CAPACITY];
+    Charset cs;
+    UCMFile *source, *target;
+    int32_t *px, *sourceCx, *targetCx;
+    int32_t count, sourceLength, size, directCount, pivotCount;
+    int32_t length, expectedLength, actualLength, pass;
+
+    makeCharset(&cs, 1+getRandom(4));
+    source=openCharset(&cs);
+    count=1+getRandom(200);
+    makeMappings(&cs, count, getRandom(count/4+1));
+    sourceLength=mappingsLength;
+    fillTable(source->base, 0, sourceLength);
+    length=makePairInput(sourceLength, input);
+
+    makeCharset(&cs, 1+getRandom(4));
+    target=openCharset(&cs);
+    makeTargetMappings(&cs, sourceLength);
+    fillTable(target->base, sourceLength, mappingsLength);
+
+    px=ucm_buildPairData(source, target, &size, &directCount, &pivotCount);
+    if(px[UCNV_PAIR_SIZE]!=size) {
+        reportError(iteration, "ucm_buildPairData() returns an inconsistent size");
+    }
+    sourceCx=ucm_buildExtData(source->base, &size);
+    targetCx=ucm_buildExtData(target->base, &size);
+
+    expectedLength=0;
+    convertPivot(sourceCx, targetCx, input, length, 0, length, expected, &expectedLength);
+    for(pass=0; pass<2; ++pass) {
+        actualLength=convertPair(px, sourceCx, targetCx, input, length, (UBool)pass, actual, iteration);
+        if(actualLength!=expectedLength || 0!=memcmp(actual, expected, expectedLength)) {
+            reportError(iteration, pass==0 ?
+                "ucnv_extConvertPair() differs from the conversion through the pivot" :
+                "ucnv_extConvertPair() in chunks differs from the conversion through the pivot");
+            break;
+        }
+    }
+
+    free(px);
+    free(sourceCx);
+    free(targetCx);
+    ucm_close(source);
+    ucm_close(target);
+}
+
+static void
+fuzz(int32_t iterations) {
+    UConverterExt ext;
+    Charset cs;
+    UCMFile *ucm;
+    UCMTable *table;
+    int32_t *cx;
+    int32_t iteration, size;
+    int32_t count;
+
+    checkTrieOverflow(4095);
+    checkTrieOverflow(4096);
+    for(iteration=0; iteration<iterations; ++iteration) {
+        makeCharset(&cs, 1+getRandom(4));
+        ucm=openCharset(&cs);
+        table=ucm_openTable();
+
+        /* alternate between 1:1 tables for the radix sort and m:n tables */
+        count=1+getRandom(iteration%4==0 ? FUZZ_MAPPINGS : 100);
+        makeMappings(&cs, count, (iteration&1) ? count : 0);
+
+        parseMappings(ucm, table, iteration);
+        checkValidation(&cs, ucm, iteration);
+
+        ucm_sortTable(table);
+        if(!isSortedTable(table, mappingsLength)) {
+            reportError(iteration, "ucm_sortTable() leaves the table out of order");
+        }
+
+        cx=ucm_buildExtData(table, &size);
+        if(cx[UCNV_EXT_SIZE]!=size) {
+            reportError(iteration, "ucm_buildExtData() returns an inconsistent size");
+        }
+        ucnv_extOpenFromU(&ext, cx);
+        checkMatchers(&ext, cx, iteration);
+        checkSearch(iteration);
+        if((iteration&15)==0) {
+            checkExtDataFile(table, cx, iteration);
+        }
+        checkPair(iteration);
+
+        free(cx);
+        ucm_closeTable(table);
+        ucm_close(ucm);
+    }
+}
+
+/* crash mode --------------------------------------------------------------- */
+
+/* damage a line: replace, insert or delete characters, or repeat a part */
+static void
+mutateLine(char *line) {
+    static const char special[]="<>U\\x+|#:-,.0123456789abcdefABCDEF \t\"";
+    int32_t i, j, n, length, pos, segment;
+
+    n=1+getRandom(4);
+    for(i=0; i<n; ++i) {
+        length=(int32_t)uprv_strlen(line);
+        pos=getRandom(length+1);
+        switch(getRandom(6)) {
+        case 0:
+            if(pos<length) {
+                line[pos]=special[getRandom(sizeof(special)-1)];
+            }
+            break;
+        case 1:
+            if(length<MAX_LINE_LENGTH-2) {
+                memmove(line+pos+1, line+pos, length-pos+1);
+                line[pos]=special[getRandom(sizeof(special)-1)];
+            }
+            break;
+        case 2:
+            if(pos<length) {
+                memmove(line+pos, line+pos+1, length-pos);
+            }
+            break;
+        case 3:
+            line[pos]=0;
+            break;
+        case 4:
+            /* repeat a part of the line in place */
+            if(pos<length) {
+                segment=1+getRandom(length-pos);
+                for(j=1+getRandom(4); j>0 && length+segment<MAX_LINE_LENGTH; --j) {
+                    memmove(line+pos+segment, line+pos, length-pos+1);
+                    length+=segment;
+                }
+            }
+            break;
+        default:
+            /* repeat a <Uxxxx> or \xXX token, to exceed the sequence length limits */
+            while(pos>0 && line[pos]!='<' && line[pos]!='\\') {
+                --pos;
+            }
+            if(line[pos]=='<' || line[pos]=='\\') {
+                for(segment=1; uprv_strchr("<\\ +|", line[pos+segment])==NULL; ++segment) {}
+                for(j=1+getRandom(20); j>0 && length+segment<MAX_LINE_LENGTH; --j) {
+                    memmove(line+pos+segment, line+pos, length-pos+1);
+                    length+=segment;
+                }
+            }
+            break;
+        }
+    }
+}
+
+#ifndef WIN32
+
+/*
+ * Parse the charset header and the mapping line in a child process.
+ * @return TRUE if the child exited (accepting or rejecting the input),
+ *         FALSE if it crashed
+ */
+static UBool
+parseInChild(const Charset *cs, const char *line) {
+    UCMFile *ucm;
+    UCMapping m;
+    UChar32 codePoints[UCNV_EXT_MAX_LENGTH];
+    uint8_t bytes[UCNV_EXT_MAX_LENGTH];
+    char copy[MAX_LINE_LENGTH];
+    int32_t errorOffset;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid=fork();
+    if(pid<0) {
+        fprintf(stderr, "ucmfuzz: unable to start a child process\n");
+        exit(U_INTERNAL_PROGRAM_ERROR);
+    } else if(pid==0) {
+        /* child: the ucm module reports invalid input on stderr and exit()s */
+        freopen("/dev/null", "w", stderr);
+        ucm=openCharset(cs);
+        if(*line!=0) {
+            strcpy(copy, line);
+            memset(&m, 0, sizeof(m));
+            ucm_parseMappingLine(&m, codePoints, bytes, copy);
+            if(m.bLen>0) {
+                ucm_countChars(&ucm->states, bytes, m.bLen);
+                ucm_validateBytes(&ucm->states, bytes, m.bLen, &errorOffset);
+            }
+        }
+        ucm_close(ucm);
+        exit(0);
+    }
+
+    while(waitpid(pid, &status, 0)<0) {}
+    return (UBool)WIFEXITED(status);
+}
+
+/*
+ * Build converter pair data in a child process.
+ * @return the child's exit code, or -1 if it crashed
+ */
+static int
+buildPairInChild(const Charset *source, const Charset *target) {
+    UCMFile *sourceUCM, *targetUCM;
+    int32_t size, directCount, pivotCount;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid=fork();
+    if(pid<0) {
+        fprintf(stderr, "ucmfuzz: unable to start a child process\n");
+        exit(U_INTERNAL_PROGRAM_ERROR);
+    } else if(pid==0) {
+        freopen("/dev/null", "w", stderr);
+        sourceUCM=openCharset(source);
+        targetUCM=openCharset(target);
+        free(ucm_buildPairData(sourceUCM, targetUCM, &size, &directCount, &pivotCount));
+        exit(0);
+    }
+
+    while(waitpid(pid, &status, 0)<0) {}
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+ * ucm_buildPairData() must reject EBCDIC_STATEFUL charsets on either side,
+ * as makepair does with such a .ucm file;
+ * ucm_processStates() turns them into MBCS with SI/SO state tables.
+ */
+static void
+checkStatefulPair() {
+    Charset stateful, cs;
+
+    memset(&stateful, 0, sizeof(Charset));
+    strcpy(stateful.header[0], "<code_set_name> \"fuzz-stateful\"");
+    strcpy(stateful.header[1], "<mb_cur_max> 2");
+    strcpy(stateful.header[2], "<mb_cur_min> 1");
+    strcpy(stateful.header[3], "<uconv_class> \"EBCDIC_STATEFUL\"");
+    stateful.countHeaderLines=4;
+    makeCharset(&cs, 1);
+
+    if( buildPairInChild(&stateful, &cs)!=U_INVALID_TABLE_FORMAT ||
+        buildPairInChild(&cs, &stateful)!=U_INVALID_TABLE_FORMAT
+    ) {
+        reportError(0, "ucm_buildPairData() accepts an EBCDIC_STATEFUL charset");
+    }
+}
+
+/*
+ * Process the states of openStateChain(lastNext) in a child process.
+ * @return the child's exit code, or -1 if it crashed
+ */
+static int
+processStateChainInChild(int32_t lastNext) {
+    UCMFile *ucm;
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    fflush(stderr);
+    pid=fork();
+    if(pid<0) {
+        fprintf(stderr, "ucmfuzz: unable to start a child process\n");
+        exit(U_INTERNAL_PROGRAM_ERROR);
+    } else if(pid==0) {
+        freopen("/dev/null", "w", stderr);
+        ucm=openStateChain(lastNext);
+        ucm_processStates(&ucm->states);
+        ucm_close(ucm);
+        exit(0);
+    }
+
+    while(waitpid(pid, &status, 0)<0) {}
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/*
+ * ucm_processStates() must accept the longest state chain and
+ * reject one that loops back, from the last state to the first trail state
+ * or to the last state itself, instead of recursing without end.
+ */
+static void
+checkStateLoops() {
+    if(processStateChainInChild(0)!=0) {
+        reportError(0, "ucm_processStates() rejects a chain of the maximum number of states");
+    }
+    if( processStateChainInChild(1)!=U_INVALID_TABLE_FORMAT ||
+        processStateChainInChild(MBCS_MAX_STATE_COUNT-1)!=U_INVALID_TABLE_FORMAT
+    ) {
+        reportError(0, "ucm_processStates() accepts a state table with a loop");
+    }
+}
+
+static void
+printLine(const char *line) {
+    fputs("    \"", stderr);
+    for(; *line!=0; ++line) {
+        if(*line=='\t') {
+            fputs("\\t", stderr);
+        } else {
+            fputc(*line, stderr);
+        }
+    }
+    fputs("\"\n", stderr);
+}
+
+static void
+crash(int32_t iterations) {
+    char line[MAX_LINE_LENGTH];
+    Charset cs;
+    int32_t iteration, i;
+
+    checkStatefulPair();
+    checkStateLoops();
+    for(iteration=0; iteration<iterations; ++iteration) {
+        makeCharset(&cs, 1+getRandom(4));
+        makeMappings(&cs, 1, getRandom(2));
+        formatMapping(mappings, line);
+
+        if(getRandom(2)) {
+            /* damage the mapping line */
+            mutateLine(line);
+        } else {
+            /* damage a header or state line, and parse a valid mapping line */
+            i=getRandom(cs.countHeaderLines);
+            mutateLine(cs.header[i]);
+        }
+
+        if(!parseInChild(&cs, line)) {
+            reportError(iteration, "crash while parsing");
+            for(i=0; i<cs.countHeaderLines; ++i) {
+                printLine(cs.header[i]);
+            }
+            printLine(line);
+        }
+    }
+}
+
+#endif
+
+/* timed mode --------------------------------------------------------------- */
+
+typedef struct Phase {
+    char name[32];
+    const char *items;
+    double count, seconds;  /* of the fastest pass */
+    double rate;            /* million items per second */
+} Phase;
+
+static Phase phases[MAX_PHASES];
+static int32_t phasesLength;
+
+static double
+getSeconds() {
+    return (double)clock()/CLOCKS_PER_SEC;
+}
+
+/* record a phase result, keeping the fastest one of several passes */
+static void
+addPhase(const char *name, const char *items, double count, double seconds) {
+    Phase *phase;
+    double rate;
+    int32_t i;
+
+    for(i=0; i<phasesLength && 0!=strcmp(name, phases[i].name); ++i) {}
+    phase=phases+i;
+    rate=count/seconds/1e6;
+    if(i==phasesLength) {
+        ++phasesLength;
+        strcpy(phase->name, name);
+        phase->items=items;
+    } else if(rate<=phase->rate) {
+        return;
+    }
+    phase->count=count;
+    phase->seconds=seconds;
+    phase->rate=rate;
+}
+
+static void
+printPhases() {
+    const Phase *phase;
+    int32_t i;
+
+    for(i=0; i<phasesLength; ++i) {
+        phase=phases+i;
+        printf("%-10s %10.0f %-12s %8.1f ms  %8.3f M/s\n",
+               phase->name, phase->count, phase->items, phase->seconds*1e3, phase->rate);
+    }
+}
+
+/* run ucm_sortTable() on fresh copies of mappings[start..limit[ for a while */
+static void
+timeSort(const char *name, UCMTable *table, int32_t start, int32_t limit) {
+    double seconds, t;
+    int32_t rounds;
+
+    rounds=0;
+    seconds=0.;
+    do {
+        fillTable(table, start, limit);
+        t=getSeconds();
+        ucm_sortTable(table);
+        seconds+=getSeconds()-t;
+        ++rounds;
+    } while(seconds<0.2);
+    addPhase(name, "mappings", (double)rounds*(limit-start), seconds);
+}
+
+static void
+timePhases(void) {
+    static char lines[TIME_MAPPINGS+TIME_MN_MAPPINGS][TIME_LINE_LENGTH];
+    static uint8_t stream[(TIME_MAPPINGS+TIME_MN_MAPPINGS)*MAX_BYTES];
+    static UChar text[(TIME_MAPPINGS+TIME_MN_MAPPINGS)*2*MAX_CODE_POINTS];
+    UConverterExt ext;
+    UCNVExtMatch matches[MATCH_CAPACITY];
+    UCNVExtToUState state;
+    UCMapping m;
+    UChar32 codePoints[UCNV_EXT_MAX_LENGTH];
+    uint8_t bytes[UCNV_EXT_MAX_LENGTH];
+    Charset cs;
+    UCMFile *ucm;
+    UCMTable *table;
+    int32_t *cx;
+    double start, seconds, chars;
+    int32_t i, j, count, rounds, total, streamLength, textLength, size, consumed, errorOffset;
+
+    /* a double-byte charset like Shift-JIS or GBK, with fixed contents */
+    randomState=1;
+    memset(&cs, 0, sizeof(Charset));
+    cs.countStates=2;
+    addRange(&cs, 0, 0, 0x7f, -1);
+    addRange(&cs, 0, 0x81, 0xfe, 1);
+    addRange(&cs, 1, 0x40, 0x7e, -1);
+    addRange(&cs, 1, 0x80, 0xfe, -1);
+    strcpy(cs.header[0], "<code_set_name> \"timed\"");
+    strcpy(cs.header[1], "<mb_cur_max> 2");
+    strcpy(cs.header[2], "<mb_cur_min> 1");
+    strcpy(cs.header[3], "<uconv_class> \"MBCS\"");
+    strcpy(cs.header[4], "<icu:state> 0-7f, 81-fe:1");
+    strcpy(cs.header[5], "<icu:state> 40-7e, 80-fe");
+    cs.countHeaderLines=6;
+    ucm=openCharset(&cs);
+
+    /* 1:1 mappings then m:n mappings */
+    total=TIME_MAPPINGS+TIME_MN_MAPPINGS;
+    supplementaryStart=0x20000;
+    supplementaryLength=0xa6e0;
+    makeMappings(&cs, total, TIME_MN_MAPPINGS);
+    if(mappingsLength!=total) {
+        fprintf(stderr, "ucmfuzz: unable to generate %ld unique mappings\n", (long)total);
+        exit(U_INTERNAL_PROGRAM_ERROR);
+    }
+
+    streamLength=textLength=0;
+    for(i=0; i<total; ++i) {
+        formatMapping(mappings+i, lines[i]);
+        uprv_memcpy(stream+streamLength, mappings[i].bytes, mappings[i].bLen);
+        streamLength+=mappings[i].bLen;
+        for(j=0; j<mappings[i].uLen; ++j) {
+            U16_APPEND_UNSAFE(text, textLength, mappings[i].codePoints[j]);
+        }
+    }
+
+    if(phasesLength==0) {
+        printf("%ld mappings (%ld m:n) in a double-byte charset, best of %ld passes\n",
+               (long)total, (long)TIME_MN_MAPPINGS, (long)TIME_PASSES);
+    }
+
+    /* parse */
+    rounds=0;
+    start=getSeconds();
+    do {
+        for(i=0; i<total; ++i) {
+            ucm_parseMappingLine(&m, codePoints, bytes, lines[i]);
+        }
+        ++rounds;
+    } while((seconds=getSeconds()-start)<0.2);
+    addPhase("parse", "lines", (double)rounds*total, seconds);
+
+    /* count */
+    rounds=0;
+    start=getSeconds();
+    do {
+        for(i=0; i<total; ++i) {
+            ucm_countChars(&ucm->states, mappings[i].bytes, mappings[i].bLen);
+        }
+        ++rounds;
+    } while((seconds=getSeconds()-start)<0.2);
+    addPhase("count", "sequences", (double)rounds*total, seconds);
+
+    /* validate */
+    rounds=0;
+    start=getSeconds();
+    do {
+        count=ucm_validateBytes(&ucm->states, stream, streamLength, &errorOffset);
+        ++rounds;
+    } while((seconds=getSeconds()-start)<0.2);
+    addPhase("validate", "characters", (double)rounds*count, seconds);
+
+    /* sort: radix sort for 1:1 mappings, comparator sort with m:n mappings */
+    table=ucm_openTable();
+    timeSort("sort", table, 0, TIME_MAPPINGS);
+    timeSort("sortmn", table, 0, total);
+
+    /* build */
+    rounds=0;
+    seconds=0.;
+    do {
+        fillTable(table, 0, total);
+        start=getSeconds();
+        cx=ucm_buildExtData(table, &size);
+        seconds+=getSeconds()-start;
+        free(cx);
+        ++rounds;
+    } while(seconds<0.2);
+    addPhase("build", "mappings", (double)rounds*total, seconds);
+
+    /* match, with the data for all mappings */
+    fillTable(table, 0, total);
+    cx=ucm_buildExtData(table, &size);
+    ucnv_extOpenFromU(&ext, cx);
+
+    rounds=0;
+    start=getSeconds();
+    do {
+        for(i=0; i<streamLength; i+= count>0 ? count : 1) {
+            state.matchValue=0;
+            state.index=0;
+            state.length=state.matchLength=0;
+            state.firstLength=1;
+            count=ucnv_extMatchToU(cx, &state, NULL, 0,
+                                   (const char *)stream+i, streamLength-i,
+                                   TRUE, TRUE);
+        }
+        ++rounds;
+    } while((seconds=getSeconds()-start)<0.2);
+    addPhase("matchToU", "bytes", (double)rounds*streamLength, seconds);
+
+    chars=0.;
+    rounds=0;
+    start=getSeconds();
+    do {
+        for(i=0; i<textLength; i+=consumed) {
+            count=ucnv_extMatchFromURun(&ext, cx, text+i, textLength-i,
+                                        matches, MATCH_CAPACITY, &consumed,
+                                        TRUE, TRUE);
+            if(rounds==0) {
+                chars+=count;
+            }
+            if(consumed==0) {
+                break;
+            }
+        }
+        ++rounds;
+    } while((seconds=getSeconds()-start)<0.2);
+    addPhase("matchFromU", "matches", rounds*chars, seconds);
+
+    free(cx);
+    ucm_closeTable(table);
+    ucm_close(ucm);
+}
+
+static void
+writePhases(const char *filename) {
+    FILE *f;
+    int32_t i;
+
+    f=fopen(filename, "w");
+    if(f==NULL) {
+        fprintf(stderr, "ucmfuzz: unable to create %s\n", filename);
+        exit(U_FILE_ACCESS_ERROR);
+    }
+    for(i=0; i<phasesLength; ++i) {
+        fprintf(f, "%s %.3f\n", phases[i].name, phases[i].rate);
+    }
+    fclose(f);
+}
+
+/*
+ * Compare the phase rates with those in the baseline file.
+ * @return number of phases that are slower by more than tolerance percent
+ */
+static int32_t
+compareWithBaseline(const char *filename, double tolerance) {
+    char name[32];
+    FILE *f;
+    double rate, change;
+    int32_t i, slower;
+
+    f=fopen(filename, "r");
+    if(f==NULL) {
+        fprintf(stderr, "ucmfuzz: unable to open %s\n", filename);
+        exit(U_FILE_ACCESS_ERROR);
+    }
+
+    printf("compared with %s (tolerance %.0f%%):\n", filename, tolerance);
+    slower=0;
+    while(fscanf(f, "%31s %lf", name, &rate)==2) {
+        for(i=0; i<phasesLength && 0!=strcmp(name, phases[i].name); ++i) {}
+        if(i==phasesLength || rate<=0.) {
+            continue;
+        }
+        change=(phases[i].rate-rate)*100./rate;
+        printf("%-10s %8.3f -> %8.3f M/s  %+6.1f%%%s\n",
+               name, rate, phases[i].rate, change,
+               change<-tolerance ? "  SLOWER" : "");
+        if(change<-tolerance) {
+            ++slower;
+        }
+    }
+    fclose(f);
+    return slower;
+}
+
+/* tool --------------------------------------------------------------------- */
+
+extern int
+main(int argc, const char *argv[]) {
+    int32_t seed, iterations, i;
+    double tolerance;
+
+    argc=u_parseArgs(argc, (char **)argv, sizeof(options)/sizeof(options[0]), options);
+    if(argc<0 || options[OPT_HELP_H].doesOccur || options[OPT_HELP_QUESTION_MARK].doesOccur) {
+        fprintf(stderr,
+            "usage: %s [-s seed] [-i iterations] [-c]\n"
+            "       %s file.ucm ...\n"
+            "       %s -t [-w results.txt] [-b baseline.txt [--tolerance percent]]\n"
+            "\ttests the ucm parser, state table, sorting and extension data\n"
+            "\tfunctions with random input, or measures their throughput;\n"
+            "\twith .ucm files, checks the fromUTable section searches\n"
+            "\ton every section of the files' extension data\n"
+            "options:\n"
+            "\t-h or -? or --help  this usage text\n"
+            "\t-s or --seed        random seed (default: 1)\n"
+            "\t-i or --iterations  number of random tables (default: 200)\n"
+            "\t-c or --crash       parse damaged input in child processes\n"
+            "\t                    and report crashes\n"
+            "\t-t or --time        report the throughput of each phase\n"
+            "\t-w or --write       write the throughput results to a file\n"
+            "\t-b or --baseline    compare with results written before and fail\n"
+            "\t                    if a phase is slower than the tolerance\n"
+            "\t--tolerance         percent (default: 10)\n",
+            argv[0], argv[0], argv[0]);
+        return argc<0 ? U_ILLEGAL_ARGUMENT_ERROR : U_ZERO_ERROR;
+    }
+
+    seed= options[OPT_SEED].doesOccur ? atoi(options[OPT_SEED].value) : 1;
+    iterations= options[OPT_ITERATIONS].doesOccur ? atoi(options[OPT_ITERATIONS].value) : 200;
+    tolerance= options[OPT_TOLERANCE].doesOccur ? atof(options[OPT_TOLERANCE].value) : 10.;
+    randomState=(uint32_t)seed;
+
+    if(argc>1) {
+        checkSearchInFiles(argv+1, argc-1);
+        return errors>0 ? U_INTERNAL_PROGRAM_ERROR : 0;
+    }
+
+    if(options[OPT_TIME].doesOccur) {
+        for(i=0; i<TIME_PASSES; ++i) {
+            timePhases();
+        }
+        printPhases();
+        if(options[OPT_WRITE].doesOccur) {
+            writePhases(options[OPT_WRITE].value);
+        }
+        if(options[OPT_BASELINE].doesOccur &&
+           compareWithBaseline(options[OPT_BASELINE].value, tolerance)>0
+        ) {
+            return U_INTERNAL_PROGRAM_ERROR;
+        }
+        return 0;
+    }
+
+    if(options[OPT_CRASH].doesOccur) {
+#ifndef WIN32
+        crash(iterations);
+#else
+        fprintf(stderr, "ucmfuzz: --crash is not supported on Windows\n");
+        return U_UNSUPPORTED_ERROR;
+#endif
+    } else {
+        fuzz(iterations);
+    }
+
+    printf("%ld iterations with seed %ld: %ld errors\n",
+           (long)iterations, (long)seed, (long)errors);
+    return errors>0 ? U_INTERNAL_PROGRAM_ERROR : 0;
+}
@@ -23,6 +23,7 @@
 #include "ucnv_ext.h"
 #include "ucm.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* MBCS state handling ------------------------------------------------------ */
@@ -187,6 +188,18 @@ ucm_addState(UCMStates *states, const char *s) {
         exit(U_INVALID_TABLE_FORMAT);
     }
 
+    /* allocate one more row; most tables have only a handful of states */
+    states->stateTable=(int32_t (*)[256])realloc(states->stateTable,
+                                                 (states->countStates+1)*sizeof(states->stateTable[0]));
+    if(states->stateTable==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate state table rows\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+
+    /* the compact form is out of date */
+    free(states->compact.entries);
+    states->compact.entries=NULL;
+
     error=parseState(s, states->stateTable[states->countStates],
                        &states->stateFlags[states->countStates]);
     if(error!=NULL) {
@@ -197,73 +210,86 @@ ucm_addState(UCMStates *states, const char *s) {
     ++states->countStates;
 }
 
-static void
-sumUpStates(UCMStates *states) {
-    int32_t entry, sum, state, cell, count;
-    UBool allStatesReady;
+/*
+ * Sum up the offsets for one state after doing so for all of the states
+ * that it transitions to (depth-first, in topological order),
+ * so that each state table row is processed only once.
+ * In each final state (where there are only final entries),
+ * the offsets add up directly.
+ * In all other state table rows, for each transition entry to another state,
+ * the offsets sum of that state needs to be added.
+ *
+ * @param inProgress flags for the states on the current path, for loop detection
+ * @return FALSE if the state table contains a loop through this state
+ */
+static UBool
+sumUpState(UCMStates *states, int32_t state, UBool inProgress[]) {
+    int32_t entry, sum, cell, next;
 
-    /*
-     * Sum up the offsets for all states.
-     * In each final state (where there are only final entries),
-     * the offsets add up directly.
-     * In all other state table rows, for each transition entry to another state,
-     * the offsets sum of that state needs to be added.
-     * This is achieved in at most countStates iterations.
-     */
-    allStatesReady=FALSE;
-    for(count=states->countStates; !allStatesReady && count>=0; --count) {
-        allStatesReady=TRUE;
-        for(state=states->countStates-1; state>=0; --state) {
-            if(!(states->stateFlags[state]&MBCS_STATE_FLAG_READY)) {
-                allStatesReady=FALSE;
-                sum=0;
-
-                /* at first, add up only the final delta offsets to keep them <512 */
-                for(cell=0; cell<256; ++cell) {
-                    entry=states->stateTable[state][cell];
-                    if(MBCS_ENTRY_IS_FINAL(entry)) {
-                        switch(MBCS_ENTRY_FINAL_ACTION(entry)) {
-                        case MBCS_STATE_VALID_16:
-                            states->stateTable[state][cell]=MBCS_ENTRY_FINAL_SET_VALUE(entry, sum);
-                            sum+=1;
-                            break;
-                        case MBCS_STATE_VALID_16_PAIR:
-                            states->stateTable[state][cell]=MBCS_ENTRY_FINAL_SET_VALUE(entry, sum);
-                            sum+=2;
-                            break;
-                        default:
-                            /* no addition */
-                            break;
-                        }
-                    }
-                }
+    inProgress[state]=TRUE;
 
-                /* now, add up the delta offsets for the transitional entries */
-                for(cell=0; cell<256; ++cell) {
-                    entry=states->stateTable[state][cell];
-                    if(MBCS_ENTRY_IS_TRANSITION(entry)) {
-                        if(states->stateFlags[MBCS_ENTRY_TRANSITION_STATE(entry)]&MBCS_STATE_FLAG_READY) {
-                            states->stateTable[state][cell]=MBCS_ENTRY_TRANSITION_SET_OFFSET(entry, sum);
-                            sum+=states->stateOffsetSum[MBCS_ENTRY_TRANSITION_STATE(entry)];
-                        } else {
-                            /* that next state does not have a sum yet, we cannot finish the one for this state */
-                            sum=-1;
-                            break;
-                        }
-                    }
+    /* first make sure that all next states of transitions have their sums */
+    for(cell=0; cell<256; ++cell) {
+        entry=states->stateTable[state][cell];
+        if(MBCS_ENTRY_IS_TRANSITION(entry)) {
+            next=MBCS_ENTRY_TRANSITION_STATE(entry);
+            if(!(states->stateFlags[next]&MBCS_STATE_FLAG_READY)) {
+                if(inProgress[next] || !sumUpState(states, next, inProgress)) {
+                    return FALSE;
                 }
+            }
+        }
+    }
 
-                if(sum!=-1) {
-                    states->stateOffsetSum[state]=sum;
-                    states->stateFlags[state]|=MBCS_STATE_FLAG_READY;
-                }
+    /* at first, add up only the final delta offsets to keep them <512 */
+    sum=0;
+    for(cell=0; cell<256; ++cell) {
+        entry=states->stateTable[state][cell];
+        if(MBCS_ENTRY_IS_FINAL(entry)) {
+            switch(MBCS_ENTRY_FINAL_ACTION(entry)) {
+            case MBCS_STATE_VALID_16:
+                states->stateTable[state][cell]=MBCS_ENTRY_FINAL_SET_VALUE(entry, sum);
+                sum+=1;
+                break;
+            case MBCS_STATE_VALID_16_PAIR:
+                states->stateTable[state][cell]=MBCS_ENTRY_FINAL_SET_VALUE(entry, sum);
+                sum+=2;
+                break;
+            default:
+                /* no addition */
+                break;
             }
         }
     }
 
-    if(!allStatesReady) {
-        fprintf(stderr, "ucm error: the state table contains loops\n");
-        exit(U_INVALID_TABLE_FORMAT);
+    /* now, add up the delta offsets for the transitional entries */
+    for(cell=0; cell<256; ++cell) {
+        entry=states->stateTable[state][cell];
+        if(MBCS_ENTRY_IS_TRANSITION(entry)) {
+            states->stateTable[state][cell]=MBCS_ENTRY_TRANSITION_SET_OFFSET(entry, sum);
+            sum+=states->stateOffsetSum[MBCS_ENTRY_TRANSITION_STATE(entry)];
+        }
+    }
+
+    states->stateOffsetSum[state]=sum;
+    states->stateFlags[state]|=MBCS_STATE_FLAG_READY;
+    inProgress[state]=FALSE;
+    return TRUE;
+}
+
+static void
+sumUpStates(UCMStates *states) {
+    UBool inProgress[MBCS_MAX_STATE_COUNT];
+    int32_t entry, sum, state, cell;
+
+    memset(inProgress, 0, sizeof(inProgress));
+    for(state=states->countStates-1; state>=0; --state) {
+        if( !(states->stateFlags[state]&MBCS_STATE_FLAG_READY) &&
+            !sumUpState(states, state, inProgress)
+        ) {
+            fprintf(stderr, "ucm error: the state table contains loops\n");
+            exit(U_INVALID_TABLE_FORMAT);
+        }
     }
 
     /*
@@ -370,7 +396,7 @@ ucm_processStates(UCMStates *states) {
     /* count non-direct states and compare with max B/char */
     count=0;
     for(state=0; state<states->countStates; ++state) {
-        if((states->stateFlags[1]&0xf)!=MBCS_STATE_FLAG_DIRECT) {
+        if((states->stateFlags[state]&0xf)!=MBCS_STATE_FLAG_DIRECT) {
             ++count;
         }
     }
@@ -463,29 +489,148 @@ ucm_processStates(UCMStates *states) {
     }
 
     sumUpStates(states);
+    ucm_compactStates(states);
 
     /* ### TODO in genmbcs.c/MBCSProcessStates() keep the following allocation code */
 }
 
+/* compact state table --------------------------------------------------- */
+
+/* bit set of the actions that complete a valid character */
+#define UCM_VALID_ACTIONS \
+    ((1<<MBCS_STATE_VALID_DIRECT_16)|(1<<MBCS_STATE_VALID_DIRECT_20)| \
+     (1<<MBCS_STATE_FALLBACK_DIRECT_16)|(1<<MBCS_STATE_FALLBACK_DIRECT_20)| \
+     (1<<MBCS_STATE_VALID_16)|(1<<MBCS_STATE_VALID_16_PAIR))
+
+/* state table entry without the offset or value, with the next state in bits 15..0 */
+static uint32_t
+getCompactEntry(int32_t entry) {
+    if(MBCS_ENTRY_IS_FINAL(entry)) {
+        return 0x80000000|((uint32_t)MBCS_ENTRY_FINAL_ACTION(entry)<<16)|MBCS_ENTRY_FINAL_STATE(entry);
+    } else {
+        return (uint32_t)MBCS_ENTRY_TRANSITION_STATE(entry);
+    }
+}
+
+U_CAPI void U_EXPORT2
+ucm_compactStates(UCMStates *states) {
+    UCMCompactStates *compact;
+    uint32_t *rows, *row;
+    uint8_t classBytes[256]; /* one representative byte value per class */
+    int32_t countStates, countClasses, countRows, state, b, c, r, i;
+
+    compact=&states->compact;
+    countStates=states->countStates;
+
+    /* a byte value shares a class with an earlier one if it behaves the same in all states */
+    countClasses=0;
+    for(b=0; b<256; ++b) {
+        for(c=0; c<countClasses; ++c) {
+            for(state=0; state<countStates; ++state) {
+                if( getCompactEntry(states->stateTable[state][b])!=
+                    getCompactEntry(states->stateTable[state][classBytes[c]])
+                ) {
+                    break;
+                }
+            }
+            if(state==countStates) {
+                break;
+            }
+        }
+        if(c==countClasses) {
+            classBytes[countClasses++]=(uint8_t)b;
+        }
+        compact->byteClasses[b]=(uint8_t)c;
+    }
+
+    rows=(uint32_t *)malloc((countStates>0 ? countStates : 1)*countClasses*4);
+    if(rows==NULL) {
+        fprintf(stderr, "ucm error: unable to allocate the compact state table\n");
+        exit(U_MEMORY_ALLOCATION_ERROR);
+    }
+
+    /* deduplicate rows, with next-state numbers in the entries */
+    countRows=0;
+    for(state=0; state<countStates; ++state) {
+        row=rows+countRows*countClasses;
+        for(c=0; c<countClasses; ++c) {
+            row[c]=getCompactEntry(states->stateTable[state][classBytes[c]]);
+        }
+        for(r=0; r<countRows; ++r) {
+            if(0==memcmp(rows+r*countClasses, row, countClasses*4)) {
+                break;
+            }
+        }
+        if(r==countRows) {
+            ++countRows;
+        }
+        compact->stateRows[state]=(uint16_t)(r*countClasses);
+    }
+
+    /* turn next states into the indexes of the next rows */
+    for(i=countRows*countClasses; i>0;) {
+        --i;
+        rows[i]=(rows[i]&0xffff0000)|compact->stateRows[rows[i]&0x7f];
+    }
+
+    free(compact->entries);
+    compact->entries=rows;
+    compact->countClasses=countClasses;
+    compact->countRows=countRows;
+
+    /* can ASCII runs in state 0 be skipped? */
+    compact->asciiRow=-1;
+    if(countStates>0) {
+        uint32_t entry, row=compact->stateRows[0];
+        for(b=0; b<0x80; ++b) {
+            entry=UCM_COMPACT_GET_ENTRY(compact, row, b);
+            if( !UCM_COMPACT_ENTRY_IS_FINAL(entry) ||
+                !(UCM_VALID_ACTIONS&(1<<UCM_COMPACT_ENTRY_ACTION(entry))) ||
+                UCM_COMPACT_ENTRY_NEXT_ROW(entry)!=row
+            ) {
+                break;
+            }
+        }
+        if(b==0x80) {
+            compact->asciiRow=(int32_t)row;
+        }
+    }
+}
+
+U_CAPI void U_EXPORT2
+ucm_closeStates(UCMStates *states) {
+    free(states->stateTable);
+    states->stateTable=NULL;
+    free(states->compact.entries);
+    states->compact.entries=NULL;
+}
+
 U_CAPI int32_t U_EXPORT2
 ucm_countChars(UCMStates *states,
                const uint8_t *bytes, int32_t length) {
-    uint32_t offset;
-    int32_t i, entry, count;
-    uint8_t state;
+    const UCMCompactStates *compact;
+    int32_t i, count;
+    uint32_t entry, row;
+    UBool inChar;
 
-    offset=0;
+    inChar=FALSE;
     i=count=0;
-    state=0;
 
     if(states->countStates==0) {
         fprintf(stderr, "ucm error: there is no state information!\n");
         return -1;
     }
 
+    if(states->compact.entries==NULL) {
+        ucm_compactStates(states);
+    }
+    compact=&states->compact;
+
     /* for SI/SO (like EBCDIC-stateful), double-byte sequences start in state 1 */
     if(length==2 && states->conversionType==MBCS_OUTPUT_2_SISO) {
-        state=1;
+        row=compact->stateRows[1];
+    } else {
+        row=compact->stateRows[0];
     }
 
     /*
@@ -494,12 +639,12 @@ ucm_countChars(UCMStates *states,
      * We assume that c<=0x10ffff.
      */
     for(i=0; i<length; ++i) {
-        entry=states->stateTable[state][bytes[i]];
-        if(MBCS_ENTRY_IS_TRANSITION(entry)) {
-            state=(uint8_t)MBCS_ENTRY_TRANSITION_STATE(entry);
-            offset+=MBCS_ENTRY_TRANSITION_OFFSET(entry);
+        entry=UCM_COMPACT_GET_ENTRY(compact, row, bytes[i]);
+        row=UCM_COMPACT_ENTRY_NEXT_ROW(entry);
+        if(!UCM_COMPACT_ENTRY_IS_FINAL(entry)) {
+            inChar=TRUE;
         } else {
-            switch(MBCS_ENTRY_FINAL_ACTION(entry)) {
+            switch(UCM_COMPACT_ENTRY_ACTION(entry)) {
             case MBCS_STATE_ILLEGAL:
                 fprintf(stderr, "ucm error: byte sequence ends in illegal state\n");
                 return -1;
@@ -517,19 +662,19 @@ ucm_countChars(UCMStates *states,
             case MBCS_STATE_VALID_16_PAIR:
                 /* count a complete character and prepare for a new one */
                 ++count;
-                state=(uint8_t)MBCS_ENTRY_FINAL_STATE(entry);
-                offset=0;
+                inChar=FALSE;
                 break;
             default:
                 /* reserved, must never occur */
-                fprintf(stderr, "ucm error: byte sequence reached reserved action code, entry: 0x%02lx\n", entry);
+                fprintf(stderr, "ucm error: byte sequence reached reserved action code 0x%x\n",
+                        UCM_COMPACT_ENTRY_ACTION(entry));
                 return -1;
             }
         }
     }
 
-    if(offset!=0) {
-        fprintf(stderr, "ucm error: byte sequence too short, ends in non-final state %hu: 0x%02lx\n", state);
+    if(inChar) {
+        fprintf(stderr, "ucm error: byte sequence too short, ends in the middle of a character\n");
         return -1;
     }
 
@@ -537,7 +682,7 @@ ucm_countChars(UCMStates *states,
      * for SI/SO (like EBCDIC-stateful), multiple-character results
      * must consist of only double-byte sequences
      */
-    if(states->conversionType==MBCS_OUTPUT_2_SISO && length!=2*count) {
+    if(count>1 && states->conversionType==MBCS_OUTPUT_2_SISO && length!=2*count) {
         fprintf(stderr, "ucm error: SI/SO (like EBCDIC-stateful) result with %d characters does not contain all DBCS\n", count);
         return -1;
     }
@@ -545,6 +690,78 @@ ucm_countChars(UCMStates *states,
     return count;
 }
 
+/* are all of these 8 bytes ASCII? */
+#define UCM_ALL_ASCII_8(s) \
+    ((((s)[0]|(s)[1]|(s)[2]|(s)[3]|(s)[4]|(s)[5]|(s)[6]|(s)[7])&0x80)==0)
+
+U_CAPI int32_t U_EXPORT2
+ucm_validateBytes(UCMStates *states,
+                  const uint8_t *bytes, int32_t length,
+                  int32_t *pErrorOffset) {
+    const UCMCompactStates *compact;
+    const uint32_t *entries;
+    const uint8_t *byteClasses;
+    int32_t i, start, count, asciiRow;
+    uint32_t entry, row;
+
+    *pErrorOffset=-1;
+    if(states->countStates==0 || length<=0) {
+        if(length>0) {
+            *pErrorOffset=0;
+        }
+        return 0;
+    }
+
+    if(states->compact.entries==NULL) {
+        ucm_compactStates(states);
+    }
+    compact=&states->compact;
+    entries=compact->entries;
+    byteClasses=compact->byteClasses;
+    asciiRow=compact->asciiRow;
+
+    row=compact->stateRows[0];
+    i=start=count=0;
+
+    while(i<length) {
+        if((int32_t)row==asciiRow) {
+            /* ASCII fast path: each byte<0x80 is one character, the row does not change */
+            while(i<=length-8 && UCM_ALL_ASCII_8(bytes+i)) {
+                i+=8;
+            }
+            while(i<length && bytes[i]<0x80) {
+                ++i;
+            }
+            count+=i-start;
+            start=i;
+            if(i==length) {
+                break;
+            }
+        }
+
+        /* table-driven loop until the end of the next character */
+        do {
+            entry=entries[row+byteClasses[bytes[i++]]];
+            row=UCM_COMPACT_ENTRY_NEXT_ROW(entry);
+        } while(!UCM_COMPACT_ENTRY_IS_FINAL(entry) && i<length);
+
+        if(!UCM_COMPACT_ENTRY_IS_FINAL(entry)) {
+            break; /* truncated at the end of the input */
+        }
+        if(UCM_VALID_ACTIONS&(1<<UCM_COMPACT_ENTRY_ACTION(entry))) {
+            ++count;
+        } else if(UCM_COMPACT_ENTRY_ACTION(entry)!=MBCS_STATE_CHANGE_ONLY) {
+            break; /* illegal or unassigned */
+        }
+        start=i;
+    }
+
+    if(start<length) {
+        *pErrorOffset=start;
+    }
+    return count;
+}
+
 U_CAPI UBool U_EXPORT2
 ucm_parseHeaderLine(UCMFile *ucm,
                     char *line, char **pKey, char **pValue) {
@@ -578,13 +795,13 @@ ucm_parseHeaderLine(UCMFile *ucm,
 
     /* get the key name, bracketed in <> */
     if(*s!='<') {
-        fprintf(stderr, "ucm error: no header field <key> in line \"%s\"\n", line);
+        fprintf(stderr, "ucm error: no header field <key> on line %ld: \"%s\"\n", (long)ucm->lineNumber, line);
         exit(U_INVALID_TABLE_FORMAT);
     }
     *pKey=++s;
     while(*s!='>') {
         if(*s==0) {
-            fprintf(stderr, "ucm error: incomplete header field <key> in line \"%s\"\n", line);
+            fprintf(stderr, "ucm error: incomplete header field <key> on line %ld: \"%s\"\n", (long)ucm->lineNumber, line);
             exit(U_INVALID_TABLE_FORMAT);
         }
         ++s;
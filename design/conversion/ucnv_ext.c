@@ -16,6 +16,11 @@
 *   Conversion extensions
 */
 
+#include "unicode/utypes.h"
+#include "unicode/ucnv.h"
+#include "unicode/udata.h"
+#include "cmemory.h"
+#include "ucnv_bld.h"
 #include "ucnv_ext.h"
 
 /*
@@ -35,32 +40,74 @@
  *   the file.
  */
 
-/* TODO UConverter */
-{
-    ...;
-
-    /* fields for conversion extension */
-    /*
-     * TODO: probably need pointer to baseTableSharedData
-     * and also copy the base table's pointers for the base table arrays etc.
-     * into this sharedData
-     */
-    const int32_t *cx; /* extension data */
+/*
+ * Same as in ucnv_cnv.h:
+ * toUnicode fallbacks are always used,
+ * fromUnicode fallbacks always for private use code points.
+ */
+#ifndef FROM_U_USE_FALLBACK
+#   define UCNV_EXT_IS_PRIVATE_USE(c) \
+        ((uint32_t)((c)-0xe000)<0x1900 || (uint32_t)((c)-0xf0000)<0x20000)
+#   define FROM_U_USE_FALLBACK(useFallback, c) ((useFallback) || UCNV_EXT_IS_PRIVATE_USE(c))
+#endif
+#ifndef TO_U_USE_FALLBACK
+#   define TO_U_USE_FALLBACK(useFallback) TRUE
+#endif
 
-    /* store previous UChars/chars to continue partial matches */
-    UChar preFromU[_CNV_EXT_MAX_LENGTH];
-    char preToU[_CNV_EXT_MAX_LENGTH;
-    int8_t preFromULength, preToULength; /* negative: replay */
-};
+/*
+ * Use SSE2 for the last step of the search in wide fromUTable sections,
+ * and AVX2 if the CPU has it.
+ * SSE2 is always available on x86-64, and on 32-bit x86 only if the
+ * compiler is told to use it; define UCNV_EXT_USE_SSE2 as 0 to disable it.
+ * The AVX2 kernel is compiled for AVX2 by itself and selected at runtime;
+ * define UCNV_EXT_USE_AVX2 as 0 to disable only that one.
+ */
+#ifndef UCNV_EXT_USE_SSE2
+#   if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP>=2)
+#       define UCNV_EXT_USE_SSE2 1
+#   else
+#       define UCNV_EXT_USE_SSE2 0
+#   endif
+#endif
+
+#ifndef UCNV_EXT_USE_AVX2
+#   if UCNV_EXT_USE_SSE2 && (defined(_MSC_VER) || defined(__clang__) || (defined(__GNUC__) && __GNUC__>=5))
+#       define UCNV_EXT_USE_AVX2 1
+#   else
+#       define UCNV_EXT_USE_AVX2 0
+#   endif
+#endif
+
+#if UCNV_EXT_USE_SSE2
+#   include <emmintrin.h>
+#endif
+#if UCNV_EXT_USE_AVX2
+#   include <immintrin.h>
+#endif
+#if UCNV_EXT_USE_SSE2 && defined(_MSC_VER)
+#   include <intrin.h>
+#endif
 
 /*
  * @return lookup value for the byte, if found; else 0
  */
 static U_INLINE uint32_t
 ucnv_extFindToU(const uint32_t *toUSection, int32_t length, uint8_t byte) {
-    uint32_t word;
+    uint32_t word0, word;
     int32_t i, start, limit;
 
+    /* check the input byte against the lowest and highest section bytes */
+    start=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUSection[0]);
+    limit=(int32_t)UCNV_EXT_TO_U_GET_BYTE(toUSection[length-1]);
+    if(byte<start || limit<byte) {
+        return 0; /* the byte is outside the section range */
+    }
+
+    if(UCNV_EXT_TO_U_IS_DENSE(start, limit, length)) {
+        /* dense section: direct access, gaps in the range have 0 values */
+        return UCNV_EXT_TO_U_GET_VALUE(toUSection[byte-start]);
+    }
+
     /*
      * Shift byte once instead of each section word and add 0xffffff.
      * We will compare the shifted/added byte (bbffffff) against
@@ -68,8 +115,12 @@ ucnv_extFindToU(const uint32_t *toUSection, int32_t length, uint8_t byte) {
      * If and only if byte bb < section byte ss then bbffffff<ssvvvvvv
      * for all v=0..f
      * so we need not mask off the lower 24 bits of each section word.
+     *
+     * For the linear search, compare against the byte with 0 lower bits
+     * (bb000000) instead: bb000000<=ssvvvvvv if and only if bb<=ss.
      */
-    word=_CNV_EXT_TO_U_MAKE_WORD(byte, _CNV_EXT_TO_U_VALUE_MASK);
+    word0=UCNV_EXT_TO_U_MAKE_WORD(byte, 0);
+    word=word0|UCNV_EXT_TO_U_VALUE_MASK;
 
     /* binary search */
     start=0;
@@ -83,13 +134,13 @@ ucnv_extFindToU(const uint32_t *toUSection, int32_t length, uint8_t byte) {
 
         if(i<=4) {
             /* linear search for the last part */
-            if(word>=toUSection[start]) {
+            if(word0<=toUSection[start]) {
                 break;
             }
-            if(++start<limit && word>=toUSection[start]) {
+            if(++start<limit && word0<=toUSection[start]) {
                 break;
             }
-            if(++start<limit && word>=toUSection[start]) {
+            if(++start<limit && word0<=toUSection[start]) {
                 break;
             }
             /* always break at start==limit-1 */
@@ -106,18 +157,180 @@ ucnv_extFindToU(const uint32_t *toUSection, int32_t length, uint8_t byte) {
     }
 
     /* did we really find it? */
-    if(start<limit && byte==_CNV_EXT_TO_U_GET_BYTE(word=toUSection[start])) {
-        return _CNV_EXT_TO_U_GET_VALUE(word); /* never 0 */
+    if(start<limit && byte==UCNV_EXT_TO_U_GET_BYTE(word=toUSection[start])) {
+        return UCNV_EXT_TO_U_GET_VALUE(word); /* never 0 */
     } else {
         return 0; /* not found */
     }
 }
 
+U_CFUNC uint32_t
+ucnv_extSearchToU(const uint32_t *toUSection, int32_t length, uint8_t byte) {
+    return ucnv_extFindToU(toUSection, length, byte);
+}
+
 /*
+ * Search kernel for wide fromUTable sections, like the initial section
+ * of a large extension table.
+ * Finds the last entry <=u without data-dependent branches:
+ * The conditional assignment in the loop compiles to a conditional move,
+ * and the number of iterations depends only on the section length.
+ *
  * @return index of the UChar, if found; else <0
  */
 static U_INLINE int32_t
-ucnv_extFindFromU(const UChar *fromUSection, int32_t length, UChar u) {
+ucnv_extFindFromUWide(const UChar *fromUSection, int32_t length, UChar u) {
+    const UChar *base;
+    int32_t half;
+
+    base=fromUSection;
+    while(length>1) {
+        half=length>>1;
+        base= base[half]<=u ? base+half : base;
+        length-=half;
+    }
+
+    /* did we really find it? */
+    if(u==*base) {
+        return (int32_t)(base-fromUSection);
+    } else {
+        return -1; /* not found */
+    }
+}
+
+#if UCNV_EXT_USE_SSE2
+
+/* index of the lowest set bit in a movemask result, mask!=0 */
+static U_INLINE int32_t
+ucnv_extGetLowestBit(uint32_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int32_t)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+/*
+ * Same as ucnv_extFindFromUWide() but only narrows the section down to
+ * 8 UChars, then compares them all with u at once.
+ * The 8 UChars are moved back from the end of the section if necessary,
+ * so that they never extend beyond it; sections shorter than that are
+ * searched by the scalar kernel.
+ * The UChars in a section are unique, so at most one of them matches.
+ */
+static U_INLINE int32_t
+ucnv_extFindFromUSSE2(const UChar *fromUSection, int32_t length, UChar u) {
+    const UChar *base, *limit;
+    int32_t half;
+    uint32_t mask;
+
+    if(length<8) {
+        return ucnv_extFindFromUWide(fromUSection, length, u);
+    }
+
+    limit=fromUSection+length-8;
+    base=fromUSection;
+    while(length>8) {
+        half=length>>1;
+        base= base[half]<=u ? base+half : base;
+        length-=half;
+    }
+    if(base>limit) {
+        base=limit;
+    }
+
+    mask=(uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)base), _mm_set1_epi16((short)u)));
+    if(mask!=0) {
+        return (int32_t)(base-fromUSection)+(ucnv_extGetLowestBit(mask)>>1);
+    } else {
+        return -1; /* not found */
+    }
+}
+
+#endif
+
+#if UCNV_EXT_USE_AVX2
+
+/*
+ * Same as ucnv_extFindFromUSSE2() with 16 UChars at a time,
+ * for CPUs with AVX2, see ucnv_extHasAVX2().
+ */
+#if !defined(_MSC_VER)
+__attribute__((target("avx2")))
+#endif
+static int32_t
+ucnv_extFindFromUAVX2(const UChar *fromUSection, int32_t length, UChar u) {
+    const UChar *base, *limit;
+    int32_t half;
+    uint32_t mask;
+
+    if(length<16) {
+        return ucnv_extFindFromUSSE2(fromUSection, length, u);
+    }
+
+    limit=fromUSection+length-16;
+    base=fromUSection;
+    while(length>16) {
+        half=length>>1;
+        base= base[half]<=u ? base+half : base;
+        length-=half;
+    }
+    if(base>limit) {
+        base=limit;
+    }
+
+    mask=(uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)base), _mm256_set1_epi16((short)u)));
+    if(mask!=0) {
+        return (int32_t)(base-fromUSection)+(ucnv_extGetLowestBit(mask)>>1);
+    } else {
+        return -1; /* not found */
+    }
+}
+
+/*
+ * Does the CPU (and the operating system) support AVX2?
+ * The answer is cached; concurrent first calls only store the same value.
+ */
+static UBool
+ucnv_extHasAVX2() {
+    static int8_t hasAVX2=-1;
+
+    if(hasAVX2<0) {
+#if defined(_MSC_VER)
+        int info[4];
+        UBool result=FALSE;
+
+        __cpuid(info, 0);
+        if(info[0]>=7) {
+            __cpuid(info, 1);
+            /* OSXSAVE and AVX, and the OS saves the YMM registers */
+            if((info[2]&0x18000000)==0x18000000 && (_xgetbv(0)&6)==6) {
+                __cpuidex(info, 7, 0);
+                result=(UBool)((info[1]&0x20)!=0);
+            }
+        }
+        hasAVX2=(int8_t)result;
+#else
+        hasAVX2=(int8_t)(__builtin_cpu_supports("avx2")!=0);
+#endif
+    }
+    return (UBool)hasAVX2;
+}
+
+#endif
+
+/*
+ * Binary search with a linear search for the last part,
+ * for short fromUTable sections.
+ *
+ * @return index of the UChar, if found; else <0
+ */
+static U_INLINE int32_t
+ucnv_extFindFromUNarrow(const UChar *fromUSection, int32_t length, UChar u) {
     int32_t i, start, limit;
 
     /* binary search */
@@ -132,13 +345,13 @@ ucnv_extFindFromU(const UChar *fromUSection, int32_t length, UChar u) {
 
         if(i<=4) {
             /* linear search for the last part */
-            if(u>=fromUSection[start]) {
+            if(u<=fromUSection[start]) {
                 break;
             }
-            if(++start<limit && u>=fromUSection[start]) {
+            if(++start<limit && u<=fromUSection[start]) {
                 break;
             }
-            if(++start<limit && u>=fromUSection[start]) {
+            if(++start<limit && u<=fromUSection[start]) {
                 break;
             }
             /* always break at start==limit-1 */
@@ -162,6 +375,71 @@ ucnv_extFindFromU(const UChar *fromUSection, int32_t length, UChar u) {
     }
 }
 
+/*
+ * @return index of the UChar, if found; else <0
+ */
+static U_INLINE int32_t
+ucnv_extFindFromU(const UChar *fromUSection, int32_t length, UChar u) {
+    if(length>=UCNV_EXT_FROM_U_WIDE_SECTION_LENGTH) {
+#if UCNV_EXT_USE_AVX2
+        if(ucnv_extHasAVX2()) {
+            return ucnv_extFindFromUAVX2(fromUSection, length, u);
+        }
+#endif
+#if UCNV_EXT_USE_SSE2
+        return ucnv_extFindFromUSSE2(fromUSection, length, u);
+#else
+        return ucnv_extFindFromUWide(fromUSection, length, u);
+#endif
+    } else {
+        return ucnv_extFindFromUNarrow(fromUSection, length, u);
+    }
+}
+
+U_CFUNC UBool
+ucnv_extHasFromUSearch(int32_t search) {
+    switch(search) {
+    case UCNV_EXT_FROM_U_SEARCH_NARROW:
+    case UCNV_EXT_FROM_U_SEARCH_WIDE:
+    case UCNV_EXT_FROM_U_SEARCH_DEFAULT:
+        return TRUE;
+#if UCNV_EXT_USE_SSE2
+    case UCNV_EXT_FROM_U_SEARCH_SSE2:
+        return TRUE;
+#endif
+#if UCNV_EXT_USE_AVX2
+    case UCNV_EXT_FROM_U_SEARCH_AVX2:
+        return ucnv_extHasAVX2();
+#endif
+    default:
+        return FALSE;
+    }
+}
+
+U_CFUNC int32_t
+ucnv_extSearchFromU(const UChar *fromUSection, int32_t length, UChar u, int32_t search) {
+    switch(search) {
+    case UCNV_EXT_FROM_U_SEARCH_NARROW:
+        return ucnv_extFindFromUNarrow(fromUSection, length, u);
+#if UCNV_EXT_USE_SSE2
+    case UCNV_EXT_FROM_U_SEARCH_SSE2:
+        return ucnv_extFindFromUSSE2(fromUSection, length, u);
+#endif
+#if UCNV_EXT_USE_AVX2
+    case UCNV_EXT_FROM_U_SEARCH_AVX2:
+        if(ucnv_extHasAVX2()) {
+            return ucnv_extFindFromUAVX2(fromUSection, length, u);
+        }
+        break;
+#endif
+    case UCNV_EXT_FROM_U_SEARCH_DEFAULT:
+        return ucnv_extFindFromU(fromUSection, length, u);
+    default:
+        break;
+    }
+    return ucnv_extFindFromUWide(fromUSection, length, u);
+}
+
 static U_INLINE UBool
 ucnv_extFromUUseFallback(UBool useFallback,
                          const UChar *pre, int32_t preLength) {
@@ -178,32 +456,40 @@ ucnv_extFromUUseFallback(UBool useFallback,
     return FROM_U_USE_FALLBACK(useFallback, c);
 }
 
+/* TRUE if there are any fromUnicode mappings, in sections or in the trie */
+#define UCNV_EXT_HAS_FROM_U(cx) \
+    ((cx)[UCNV_EXT_FROM_U_LENGTH]>0 || (cx)[UCNV_EXT_FROM_U_STAGE_12_LENGTH]>0)
+
+static U_INLINE void
+ucnv_extGetFromUTables(const int32_t *cx, UCNVExtFromUTables *tables) {
+    tables->tableUChars=(const UChar *)cx+cx[UCNV_EXT_FROM_U_UCHARS_INDEX];
+    tables->tableValues=(const uint32_t *)cx+cx[UCNV_EXT_FROM_U_VALUES_INDEX];
+    tables->bytes=(const char *)cx+cx[UCNV_EXT_FROM_U_BYTES_INDEX];
+
+    if(cx[UCNV_EXT_FROM_U_STAGE_12_LENGTH]>0) {
+        tables->stage12=(const uint16_t *)cx+cx[UCNV_EXT_FROM_U_STAGE_12_INDEX];
+        tables->stage3=(const uint32_t *)cx+cx[UCNV_EXT_FROM_U_STAGE_3_INDEX];
+        tables->stage1Length=cx[UCNV_EXT_FROM_U_STAGE_1_LENGTH];
+    } else {
+        tables->stage12=NULL;
+        tables->stage3=NULL;
+        tables->stage1Length=0;
+    }
+}
+
 /*
- * @param cx pointer to extension data; if NULL, returns 0
- * @param pre UChars that must match; !initialMatch: partial match with them
- * @param preLength length of pre, >=1
- * @param src UChars that can be used to complete a match
- * @param srcLength length of src, >=0
- * @param pResult [out] address of pointer to result bytes
- *                      set only in case of a match
- * @param pResultLength [out] address of result length variable;
- *                            gets a negative value if the length variable
- *                            itself contains the length and bytes, encoded in
- *                            the format of fromUTableValues[] and then inverted
- * @param useFallback "use fallback" flag, usually from cnv->useFallback
- * @param flush TRUE if the end of the input stream is reached
- * @return >0: matched, return value=total match length (number of input units matched)
- *          0: no match
- *         <0: partial match, return value=negative total match length
- *             (partial matches are never returned for flush==TRUE)
- *             (partial matches are never returned as being longer than _CNV_EXT_MAX_LENGTH)
+ * Same as ucnv_extMatchFromU() but with the table pointers already
+ * derived from cx, so that bulk matching can hoist the setup out of its loop.
+ *
+ * @param hasFallbacks FALSE if the table contains only roundtrip mappings;
+ *                     then all fallback checks are skipped
  */
-static int8_t
-ucnv_extMatchFromU(const int32_t *cx,
-                   const UChar *pre, int32_t preLength,
-                   const UChar *src, int32_t srcLength,
-                   const char **pResult, int32_t *pResultLength,
-                   UBool useFallback, UBool flush) {
+static U_INLINE int8_t
+ucnv_extMatchFromUTables(const UCNVExtFromUTables *tables,
+                         const UChar *pre, int32_t preLength,
+                         const UChar *src, int32_t srcLength,
+                         const char **pResult, int32_t *pResultLength,
+                         UBool hasFallbacks, UBool useFallback, UBool flush) {
     const UChar *fromUTableUChars, *fromUSectionUChars;
     const uint32_t *fromUTableValues, *fromUSectionValues;
 
@@ -211,21 +497,48 @@ ucnv_extMatchFromU(const int32_t *cx,
     int32_t i, j, index, length, matchLength;
     UChar c;
 
-    if(cx==NULL) {
-        return 0; /* no extension data, no match */
-    }
-
-    /* initialize */
-    fromUTableUChars=(const UChar *)cx+cx[_CNV_EXT_FROM_U_UCHARS_INDEX];
-    fromUTableValues=(const uint32_t *)cx+cx[_CNV_EXT_FROM_U_VALUES_INDEX];
+    fromUTableUChars=tables->tableUChars;
+    fromUTableValues=tables->tableValues;
 
     matchValue=0;
     i=j=index=matchLength=0;
 
     /* we must not remember fallback matches when not using fallbacks */
 
-    /* match input units until there is a full match or the input is consumed */
-    for(;;) {
+    if(tables->stage12!=NULL) {
+        /*
+         * Look up the initial code point in the trie.
+         * Most code points only have single-code point mappings
+         * and get their result right here, without any section search.
+         * Only those that start multi-unit mappings continue with
+         * the section that the trie value points to.
+         */
+        UChar32 cp;
+
+        U16_NEXT(pre, i, preLength, cp);
+        value=UCNV_EXT_FROM_U(tables->stage12, tables->stage3, tables->stage1Length, cp);
+        if(value==0) {
+            return 0; /* the code point does not start any mapping */
+        } else if(UCNV_EXT_FROM_U_IS_PARTIAL(value)) {
+            /* continue with the next unit in the indicated section */
+            index=(int32_t)UCNV_EXT_FROM_U_GET_PARTIAL_INDEX(value);
+        } else if(!hasFallbacks || UCNV_EXT_FROM_U_IS_ROUNDTRIP(value) ||
+                  FROM_U_USE_FALLBACK(useFallback, cp)
+        ) {
+            /* single-code point mapping, no section search */
+            matchValue=value;
+            matchLength=i;
+            index=-1;
+        } else {
+            return 0; /* fallback mapping, but fallbacks are not used */
+        }
+    }
+
+    /*
+     * match input units until there is a full match or the input is consumed
+     * (index<0 only after a complete trie result)
+     */
+    while(index>=0) {
         /* go to the next section */
         fromUSectionUChars=fromUTableUChars+index;
         fromUSectionValues=fromUTableValues+index;
@@ -234,8 +547,8 @@ ucnv_extMatchFromU(const int32_t *cx,
         length=*fromUSectionUChars++;
         value=*fromUSectionValues++;
         if( value!=0 &&
-            (_CNV_EXT_FROM_U_IS_ROUNDTRIP(value) ||
-             ucnv_extFromUUseFallback(useFallback, pre, preLength)
+            (!hasFallbacks || UCNV_EXT_FROM_U_IS_ROUNDTRIP(value) ||
+             ucnv_extFromUUseFallback(useFallback, pre, preLength))
         ) {
             /* remember longest match so far */
             matchValue=value;
@@ -249,10 +562,10 @@ ucnv_extMatchFromU(const int32_t *cx,
             c=src[j++];
         } else {
             /* all input consumed, partial match */
-            if(flush || (length=(i+j))>_CNV_EXT_MAX_LENGTH) {
+            if(flush || (length=(i+j))>UCNV_EXT_MAX_LENGTH) {
                 /*
                  * end of the entire input stream, stop with the longest match so far
-                 * or: partial match must not be longer than _CNV_EXT_MAX_LENGTH
+                 * or: partial match must not be longer than UCNV_EXT_MAX_LENGTH
                  * because it must fit into state buffers
                  */
                 break;
@@ -269,16 +582,19 @@ ucnv_extMatchFromU(const int32_t *cx,
             break;
         } else {
             value=fromUSectionValues[index];
-            if(_CNV_EXT_FROM_U_IS_PARTIAL(value)) {
+            if(UCNV_EXT_FROM_U_IS_PARTIAL(value)) {
                 /* partial match, continue */
-                index=(int32_t)_CNV_EXT_FROM_U_GET_PARTIAL_INDEX(value);
-            } else if(_CNV_EXT_FROM_U_IS_ROUNDTRIP(value) ||
+                index=(int32_t)UCNV_EXT_FROM_U_GET_PARTIAL_INDEX(value);
+            } else if(!hasFallbacks || UCNV_EXT_FROM_U_IS_ROUNDTRIP(value) ||
                       ucnv_extFromUUseFallback(useFallback, pre, preLength)
             ) {
                 /* full match, stop with result */
                 matchValue=value;
                 matchLength=i+j;
                 break;
+            } else {
+                /* fallback mapping but not using fallbacks, stop with the longest match so far */
+                break;
             }
         }
     }
@@ -289,24 +605,153 @@ ucnv_extMatchFromU(const int32_t *cx,
     }
 
     /* return result */
-    matchValue=_CNV_EXT_FROM_U_MASK_ROUNDTRIP(matchValue);
-    length=(int32_t)_CNV_EXT_FROM_U_GET_LENGTH(matchValue);
-    if(length<=_CNV_EXT_FROM_U_MAX_DIRECT_LENGTH) {
+    matchValue=UCNV_EXT_FROM_U_MASK_ROUNDTRIP(matchValue);
+    length=(int32_t)UCNV_EXT_FROM_U_GET_LENGTH(matchValue);
+    if(length<=UCNV_EXT_FROM_U_MAX_DIRECT_LENGTH) {
         *pResultLength=-(int32_t)matchValue;
     } else {
         *pResultLength=length;
-        *pResult=(const char *)cx+cx[_CNV_EXT_FROM_U_BYTES_INDEX]+_CNV_EXT_FROM_U_GET_DATA(matchValue);
+        *pResult=tables->bytes+UCNV_EXT_FROM_U_GET_DATA(matchValue);
     }
 
     return matchLength;
 }
 
+/*
+ * @param cx pointer to extension data; if NULL, returns 0
+ * @param pre UChars that must match; !initialMatch: partial match with them
+ * @param preLength length of pre, >=1
+ * @param src UChars that can be used to complete a match
+ * @param srcLength length of src, >=0
+ * @param pResult [out] address of pointer to result bytes
+ *                      set only in case of a match
+ * @param pResultLength [out] address of result length variable;
+ *                            gets a negative value if the length variable
+ *                            itself contains the length and bytes, encoded in
+ *                            the format of fromUTableValues[] and then inverted
+ * @param useFallback "use fallback" flag, usually from cnv->useFallback
+ * @param flush TRUE if the end of the input stream is reached
+ * @return >0: matched, return value=total match length (number of input units matched)
+ *          0: no match
+ *         <0: partial match, return value=negative total match length
+ *             (partial matches are never returned for flush==TRUE)
+ *             (partial matches are never returned as being longer than UCNV_EXT_MAX_LENGTH)
+ */
+static int8_t
+ucnv_extMatchFromU(const int32_t *cx,
+                   const UChar *pre, int32_t preLength,
+                   const UChar *src, int32_t srcLength,
+                   const char **pResult, int32_t *pResultLength,
+                   UBool useFallback, UBool flush) {
+    UCNVExtFromUTables tables;
+
+    if(cx==NULL || !UCNV_EXT_HAS_FROM_U(cx)) {
+        return 0; /* no extension data, no match */
+    }
+
+    ucnv_extGetFromUTables(cx, &tables);
+    return ucnv_extMatchFromUTables(
+                &tables,
+                pre, preLength,
+                src, srcLength,
+                pResult, pResultLength,
+                TRUE, useFallback, flush);
+}
+
+/*
+ * Specialized matchers.
+ * Each one inlines ucnv_extMatchFromUTables() with constant
+ * hasFallbacks, useFallback and flush arguments, so that the compiler
+ * removes the invariant branches on them from the matching loop.
+ * ucnv_extOpenFromU() chooses the variants once per converter,
+ * and the matching functions only index them with the useFallback and
+ * flush flags, so that a changed useFallback setting takes effect
+ * with the next call.
+ */
+#define UCNV_EXT_MATCH_FROM_U_VARIANT(name, hasFallbacks, useFallback, flush) \
+static int8_t U_CALLCONV \
+name(const UCNVExtFromUTables *tables, \
+     const UChar *pre, int32_t preLength, \
+     const UChar *src, int32_t srcLength, \
+     const char **pResult, int32_t *pResultLength) { \
+    return ucnv_extMatchFromUTables(tables, \
+                                    pre, preLength, \
+                                    src, srcLength, \
+                                    pResult, pResultLength, \
+                                    hasFallbacks, useFallback, flush); \
+}
+
+UCNV_EXT_MATCH_FROM_U_VARIANT(ucnv_extMatchFromU_RT, FALSE, FALSE, FALSE)
+UCNV_EXT_MATCH_FROM_U_VARIANT(ucnv_extMatchFromU_RTFlush, FALSE, FALSE, TRUE)
+UCNV_EXT_MATCH_FROM_U_VARIANT(ucnv_extMatchFromU_NoUseFB, TRUE, FALSE, FALSE)
+UCNV_EXT_MATCH_FROM_U_VARIANT(ucnv_extMatchFromU_NoUseFBFlush, TRUE, FALSE, TRUE)
+UCNV_EXT_MATCH_FROM_U_VARIANT(ucnv_extMatchFromU_UseFB, TRUE, TRUE, FALSE)
+UCNV_EXT_MATCH_FROM_U_VARIANT(ucnv_extMatchFromU_UseFBFlush, TRUE, TRUE, TRUE)
+
+/*
+ * @return TRUE if any fromUnicode table value or trie value is a fallback
+ */
+static UBool
+ucnv_extHasFromUFallbacks(const UCNVExtFromUTables *tables, const int32_t *cx) {
+    const uint32_t *values;
+    uint32_t value;
+    int32_t i, length;
+
+    values=tables->tableValues;
+    length=cx[UCNV_EXT_FROM_U_LENGTH];
+    for(i=0; i<length; ++i) {
+        value=values[i];
+        if(!UCNV_EXT_FROM_U_IS_PARTIAL(value) && !UCNV_EXT_FROM_U_IS_ROUNDTRIP(value)) {
+            return TRUE;
+        }
+    }
+
+    if(tables->stage3!=NULL) {
+        values=tables->stage3;
+        length=cx[UCNV_EXT_FROM_U_STAGE_3_LENGTH];
+        for(i=0; i<length; ++i) {
+            value=values[i];
+            if(!UCNV_EXT_FROM_U_IS_PARTIAL(value) && !UCNV_EXT_FROM_U_IS_ROUNDTRIP(value)) {
+                return TRUE;
+            }
+        }
+    }
+    return FALSE;
+}
+
+/*
+ * Set up the converter for fromUnicode extension matching:
+ * Derive the table pointers and choose the matcher variants,
+ * indexed by the useFallback and flush flags of each call.
+ * Must be called when the converter is opened.
+ */
+U_CFUNC void
+ucnv_extOpenFromU(UConverterExt *ext, const int32_t *cx) {
+    if(cx==NULL || !UCNV_EXT_HAS_FROM_U(cx)) {
+        /* use ucnv_extMatchFromU() which returns "no match" */
+        ext->extMatchFromU[0][0]=ext->extMatchFromU[0][1]=NULL;
+        ext->extMatchFromU[1][0]=ext->extMatchFromU[1][1]=NULL;
+        return;
+    }
+
+    ucnv_extGetFromUTables(cx, &ext->extFromUTables);
+    if(!ucnv_extHasFromUFallbacks(&ext->extFromUTables, cx)) {
+        /* without fallbacks in the table, useFallback makes no difference */
+        ext->extMatchFromU[0][0]=ext->extMatchFromU[1][0]=ucnv_extMatchFromU_RT;
+        ext->extMatchFromU[0][1]=ext->extMatchFromU[1][1]=ucnv_extMatchFromU_RTFlush;
+    } else {
+        ext->extMatchFromU[0][0]=ucnv_extMatchFromU_NoUseFB;
+        ext->extMatchFromU[0][1]=ucnv_extMatchFromU_NoUseFBFlush;
+        ext->extMatchFromU[1][0]=ucnv_extMatchFromU_UseFB;
+        ext->extMatchFromU[1][1]=ucnv_extMatchFromU_UseFBFlush;
+    }
+}
+
 static void
 ucnv_extWriteFromU(UConverter *cnv,
                    const char *result, int32_t resultLength,
                    char **target, const char *targetLimit,
                    int32_t **offsets, int32_t srcIndex,
-                   UBool flush,
                    UErrorCode *pErrorCode) {
     char buffer[4];
 
@@ -325,20 +770,24 @@ ucnv_extWriteFromU(UConverter *cnv,
          * Offset and overflow handling are only done once this way.
          */
         uint32_t value;
+        char *p;
 
         resultLength=-resultLength;
-        value=(uint32_t)_CNV_EXT_FROM_U_GET_DATA(resultLength);
-        resultLength=_CNV_EXT_FROM_U_GET_LENGTH(resultLength);
-        /* resultLength<=_CNV_EXT_FROM_U_MAX_DIRECT_LENGTH==3 */
+        value=(uint32_t)UCNV_EXT_FROM_U_GET_DATA(resultLength);
+        resultLength=UCNV_EXT_FROM_U_GET_LENGTH(resultLength);
+        /* resultLength<=UCNV_EXT_FROM_U_MAX_DIRECT_LENGTH==3 */
 
-        result=buffer;
+        p=buffer;
         switch(resultLength) {
         case 3:
-            *result++=(char)(value>>16);
+            *p++=(char)(value>>16);
+            /* fall through */
         case 2:
-            *result++=(char)(value>>8);
+            *p++=(char)(value>>8);
+            /* fall through */
         case 1:
-            *result++=(char)value;
+            *p++=(char)value;
+            /* fall through */
         default:
             break; /* will never occur */
         }
@@ -354,7 +803,7 @@ ucnv_extWriteFromU(UConverter *cnv,
     do {
         *t++=*result++;
         if(o!=NULL) {
-            *o=srcIndex;
+            *o++=srcIndex;
         }
     } while(--resultLength>0 && t!=targetLimit);
 
@@ -369,7 +818,7 @@ ucnv_extWriteFromU(UConverter *cnv,
             uint8_t *overflow=(uint8_t *)cnv->charErrorBuffer;
 
             cnv->charErrorBufferLength=(int8_t)resultLength;
-            while(resultLength>0 && t!=targetLimit) {
+            while(resultLength>0) {
                 *overflow++=*result++;
                 --resultLength;
             }
@@ -392,7 +841,7 @@ ucnv_extWriteFromU(UConverter *cnv,
  *   flush==TRUE
  */
 U_CFUNC void U_CALLCONV
-ucnv_extInitialMatchFromU(UConverter *cnv,
+ucnv_extInitialMatchFromU(UConverter *cnv, UConverterExt *ext,
                           const int32_t *cx,
                           UChar32 cp,
                           const UChar **src, const UChar *srcLimit,
@@ -412,12 +861,20 @@ ucnv_extInitialMatchFromU(UConverter *cnv,
     preLength=0;
     U16_APPEND_UNSAFE(pre, preLength, cp);
 
-    /* try to match */
-    match=ucnv_extMatchFromU(cx,
-                             pre, preLength,
-                             *src, (int32_t)(srcLimit-*src),
-                             &result, &resultLength,
-                             useFallback, flush);
+    /* try to match, with the converter's specialized matcher if there is one */
+    if(ext!=NULL && ext->extMatchFromU[0][0]!=NULL) {
+        match=ext->extMatchFromU[useFallback!=0][flush!=0](
+                    &ext->extFromUTables,
+                    pre, preLength,
+                    *src, (int32_t)(srcLimit-*src),
+                    &result, &resultLength);
+    } else {
+        match=ucnv_extMatchFromU(cx,
+                                 pre, preLength,
+                                 *src, (int32_t)(srcLimit-*src),
+                                 &result, &resultLength,
+                                 useFallback, flush);
+    }
     if(match>0) {
         /* advance src pointer for the consumed input */
         *src+=match-preLength;
@@ -434,8 +891,8 @@ ucnv_extInitialMatchFromU(UConverter *cnv,
             /* write result for simple, single-character conversion */
             if(resultLength<0) {
                 resultLength=-resultLength;
-                *pSimpleValue=(uint32_t)_CNV_EXT_FROM_U_GET_DATA(resultLength);
-                *pSimpleLength=_CNV_EXT_FROM_U_GET_LENGTH(resultLength);
+                *pSimpleValue=(uint32_t)UCNV_EXT_FROM_U_GET_DATA(resultLength);
+                *pSimpleLength=UCNV_EXT_FROM_U_GET_LENGTH(resultLength);
             } else if(resultLength==4) {
                 /* de-serialize a 4-byte result */
                 *pSimpleValue=
@@ -460,22 +917,22 @@ ucnv_extInitialMatchFromU(UConverter *cnv,
         /* copy pre[] and the newly consumed input to preFromU[] */
         /* pre[] first */
         for(j=0; j<preLength; ++j) {
-            cnv->preFromU[j]=pre[j];
+            ext->preFromU[j]=pre[j];
         }
 
         /* now append the newly consumed input */
         s=*src;
         match=-match;
         for(; j<match; ++j) {
-            cnv->preFromU[j]=*s++;
+            ext->preFromU[j]=*s++;
         }
         *src=s; /* same as *src=srcLimit; because we reached the end of input */
-        cnv->preFromULength=match;
+        ext->preFromULength=match;
     } else /* match==0 or simple conversion */ {
         /* no match, prepare for normal unassigned callback for cp */
         if(cnv!=NULL) {
             /* cnv==NULL for simple, single-character conversion */
-            for(match==0; match<preLength; ++match) {
+            for(match=0; match<preLength; ++match) {
                 cnv->invalidUCharBuffer[match]=pre[match];
             }
             cnv->invalidUCharLength=match;
@@ -488,27 +945,27 @@ ucnv_extInitialMatchFromU(UConverter *cnv,
 
 /* never called for simple, single-character conversion */
 U_CFUNC void U_CALLCONV
-ucnv_extContinueMatchFromU(UConverter *cnv,
+ucnv_extContinueMatchFromU(UConverter *cnv, UConverterExt *ext,
                            const int32_t *cx,
                            const UChar **src, const UChar *srcLimit,
                            char **target, const char *targetLimit,
                            int32_t **offsets, int32_t srcIndex,
                            UBool useFallback, UBool flush,
                            UErrorCode *pErrorCode) {
-    if(cnv->preFromULength>0) {
+    if(ext->preFromULength>0) {
         /* continue partial match with new input */
         const char *result;
         int32_t resultLength;
         int8_t match;
 
-        match=ucnv_extMatchFromU(cx,
-                                 cnv->preFromU, cnv->preFromULength,
-                                 *src, (int32_t)(srcLimit-*src),
-                                 &result, &resultLength,
-                                 useFallback, flush);
+        match=ext->extMatchFromU[useFallback!=0][flush!=0](
+                    &ext->extFromUTables,
+                    ext->preFromU, ext->preFromULength,
+                    *src, (int32_t)(srcLimit-*src),
+                    &result, &resultLength);
         if(match>0) {
             /* advance src pointer for the consumed input */
-            *src+=match-cnv->preFromULength;
+            *src+=match-ext->preFromULength;
 
             /* write result */
             ucnv_extWriteFromU(cnv,
@@ -518,7 +975,7 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
                                pErrorCode);
 
             /* reset the preFromU buffer in the converter */
-            cnv->preFromULength=0;
+            ext->preFromULength=0;
         } else if(match<0) {
             /* save state for partial match */
             const UChar *s;
@@ -527,11 +984,11 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
             /* just _append_ the newly consumed input to preFromU[] */
             s=*src;
             match=-match;
-            for(j=cnv->preFromULength; j<match; ++j) {
-                cnv->preFromU[j]=*s++;
+            for(j=ext->preFromULength; j<match; ++j) {
+                ext->preFromU[j]=*s++;
             }
             *src=s; /* same as *src=srcLimit; because we reached the end of input */
-            cnv->preFromULength=match;
+            ext->preFromULength=match;
         } else /* match==0 */ {
             /*
              * no match
@@ -555,9 +1012,9 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
 
             /* move the first code point to the error buffer */
             i=0;
-            U16_FWD_1(cnv->preFromU, i, cnv->preFromULength);
+            U16_FWD_1(ext->preFromU, i, ext->preFromULength);
             for(j=0; j<i; j++) {
-                cnv->invalidUCharBuffer[j]=cnv->preFromU[j];
+                cnv->invalidUCharBuffer[j]=ext->preFromU[j];
             }
             cnv->invalidUCharLength=i;
 
@@ -565,16 +1022,16 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
             *pErrorCode=U_INVALID_CHAR_FOUND;
 
             /* move the rest of the previous input up to the beginning */
-            for(j=0; i<cnv->preFromULength; ++i, ++j) {
-                cnv->preFromU[j]=cnv->preFromU[i];
+            for(j=0; i<ext->preFromULength; ++i, ++j) {
+                ext->preFromU[j]=ext->preFromU[i];
             }
 
             /* mark it for replay */
-            cnv->preFromULength=-j;
+            ext->preFromULength=-j;
         }
-    } else if(cnv->preFromULength<0) {
+    } else if(ext->preFromULength<0) {
         /* replay previous input after partial match could not be completed */
-        UChar pre[_CNV_EXT_MAX_LENGTH];
+        UChar pre[UCNV_EXT_MAX_LENGTH];
         int32_t preLength;
 
         const UChar *preSrc;
@@ -582,15 +1039,15 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
         int32_t *o;
 
         /* move the previous input into a local buffer to prevent it from being overridden */
-        preLength=-cnv->preFromULength;
-        uprv_memcpy(pre, cnv->preFromU, preLength*U_SIZEOF_UCHAR);
+        preLength=-ext->preFromULength;
+        uprv_memcpy(pre, ext->preFromU, preLength*U_SIZEOF_UCHAR);
 
         /* reset the preFromU buffer in the converter */
-        cnv->preFromULength=0;
+        ext->preFromULength=0;
 
         /* convert the previous input */
         preSrc=pre;
-        oldTarget=target;
+        oldTarget=*target;
         ucnv_fromUnicode(cnv,
                          target, targetLimit,
                          &preSrc, pre+preLength,
@@ -598,8 +1055,9 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
                          pErrorCode);
         if(offsets!=NULL && (o=*offsets)!=NULL) {
             /* set offsets */
-            while(oldTarget!=target) {
+            while(oldTarget!=*target) {
                 *o++=-1; /* no source index for previous input */
+                ++oldTarget;
             }
             *offsets=o;
         }
@@ -634,15 +1092,746 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
             int8_t i, j;
 
             for(i=(int8_t)(preSrc-pre), j=0; i<preLength; ++i, ++j) {
-                cnv->preFromU[j]=pre[i];
+                ext->preFromU[j]=pre[i];
             }
-            cnv->preFromULength=-j; /* continue to replay */
+            ext->preFromULength=-j; /* continue to replay */
         }
     }
-    /* do nothing if cnv->preFromULength==0 */
+    /* do nothing if ext->preFromULength==0 */
 }
 
 
+/*
+ * Match a whole run of UChars that missed in the base table,
+ * for callers that convert many short records and would otherwise
+ * pay for the setup in ucnv_extInitialMatchFromU() once per code point.
+ *
+ * The table pointers are derived once, and each code point is matched
+ * directly in src[] without copying it into a pre[] buffer.
+ *
+ * @param ext if not NULL, set up with ucnv_extOpenFromU() for cx;
+ *            then its specialized matchers are used
+ * @param cx pointer to extension data; if NULL, returns 0
+ * @param src UChars to be matched, must not start with a trail surrogate
+ * @param srcLength length of src, >=0
+ * @param matches [out] array of match results, one per match or unmappable
+ *                      code point, see UCNVExtMatch
+ * @param capacity number of elements in matches[]
+ * @param pConsumed [out] number of UChars consumed by the returned matches;
+ *                        less than srcLength if matches[] is full or
+ *                        if there is a partial match or a lead surrogate
+ *                        at the end of src[] (never for flush==TRUE)
+ *                        which the caller must keep for the next call
+ * @param useFallback "use fallback" flag, usually from cnv->useFallback
+ * @param flush TRUE if the end of the input stream is reached
+ * @return number of matches[] written
+ */
+U_CFUNC int32_t
+ucnv_extMatchFromURun(const UConverterExt *ext, const int32_t *cx,
+                      const UChar *src, int32_t srcLength,
+                      UCNVExtMatch *matches, int32_t capacity,
+                      int32_t *pConsumed,
+                      UBool useFallback, UBool flush) {
+    UCNVExtFromUTables tables;
+    UCNVExtMatchFromUFn *matchFromU;
+
+    const char *result;
+    int32_t i, count, cpLength, resultLength;
+    int8_t match;
+    UBool hasFromU;
+
+    if(cx==NULL || srcLength<=0 || capacity<=0) {
+        *pConsumed=0;
+        return 0;
+    }
+
+    /* initialize once for the whole run */
+    hasFromU=(UBool)UCNV_EXT_HAS_FROM_U(cx);
+    if(ext!=NULL && ext->extMatchFromU[0][0]!=NULL) {
+        tables=ext->extFromUTables;
+        matchFromU=ext->extMatchFromU[useFallback!=0][flush!=0];
+    } else {
+        ucnv_extGetFromUTables(cx, &tables);
+        matchFromU=NULL;
+    }
+
+    i=count=0;
+    while(i<srcLength && count<capacity) {
+        /* the code point at src[i] is the pre[] part of the match */
+        cpLength=1;
+        if(U16_IS_LEAD(src[i])) {
+            if((i+1)<srcLength) {
+                if(U16_IS_TRAIL(src[i+1])) {
+                    cpLength=2;
+                }
+            } else if(!flush) {
+                /* the trail surrogate may be in the next run, leave it to the caller */
+                break;
+            }
+        }
+
+        /* direct results (resultLength<0) do not set result */
+        result=NULL;
+        if(!hasFromU) {
+            match=0; /* no fromUnicode mappings at all */
+        } else if(matchFromU!=NULL) {
+            match=matchFromU(&tables,
+                             src+i, cpLength,
+                             src+i+cpLength, srcLength-i-cpLength,
+                             &result, &resultLength);
+        } else {
+            match=ucnv_extMatchFromUTables(&tables,
+                                           src+i, cpLength,
+                                           src+i+cpLength, srcLength-i-cpLength,
+                                           &result, &resultLength,
+                                           TRUE, useFallback, flush);
+        }
+        if(match>0) {
+            matches[count].result=result;
+            matches[count].length=match;
+            matches[count].resultLength=resultLength;
+        } else if(match==0) {
+            /* unmappable code point */
+            matches[count].result=NULL;
+            matches[count].length=cpLength;
+            matches[count].resultLength=0;
+        } else /* match<0 */ {
+            /* partial match at the end of the run, leave it to the caller */
+            break;
+        }
+        i+=matches[count++].length;
+    }
+
+    *pConsumed=i;
+    return count;
+}
+
+/* toUnicode ---------------------------------------------------------------- */
+
+/*
+ * Resumable toUnicode matcher.
+ * Continues the match described by *pState with pre[] then src[],
+ * looking at each byte only once:
+ * When all input is consumed with a partial match, *pState is updated
+ * so that the next call continues with the section for the next byte.
+ *
+ * @param cx pointer to extension data
+ * @param pState [in/out] match state;
+ *               {0, 0, 0, 0, firstLength} to start in the root section
+ * @param pre bytes that must match, usually cnv->toUBytes[] for
+ *            an initial match; can be NULL if preLength==0
+ * @param preLength length of pre, >=0
+ * @param src bytes that can be used to complete a match
+ * @param srcLength length of src, >=0
+ * @param useFallback "use fallback" flag, usually from cnv->useFallback
+ * @param flush TRUE if the end of the input stream is reached
+ * @return >0: matched, return value=total match length (number of bytes
+ *             matched in this and previous calls), pState->matchValue is the result
+ *          0: no match
+ *         <0: partial match, return value=negative total match length;
+ *             all of pre[] and src[] was consumed
+ *             (partial matches are never returned for flush==TRUE)
+ */
+U_CFUNC int8_t
+ucnv_extMatchToU(const int32_t *cx,
+                 UCNVExtToUState *pState,
+                 const char *pre, int32_t preLength,
+                 const char *src, int32_t srcLength,
+                 UBool useFallback, UBool flush) {
+    const uint32_t *toUTable, *toUSection;
+
+    uint32_t value, matchValue;
+    int32_t i, j, index, length, sectionLength, matchLength;
+    uint8_t b;
+
+    if(cx[UCNV_EXT_TO_U_LENGTH]<=0) {
+        return 0; /* no toUnicode mappings */
+    }
+    toUTable=(const uint32_t *)cx+cx[UCNV_EXT_TO_U_INDEX];
+
+    /* resume */
+    matchValue=pState->matchValue;
+    index=pState->index;
+    length=pState->length;
+    matchLength=pState->matchLength;
+    i=j=0;
+
+    /* match input units until there is a full match or the input is consumed */
+    for(;;) {
+        /* go to the next section */
+        toUSection=toUTable+index;
+
+        /* read the initial word of the section */
+        value=*toUSection++;
+        sectionLength=(int32_t)UCNV_EXT_TO_U_GET_BYTE(value);
+        value=UCNV_EXT_TO_U_GET_VALUE(value);
+        if( value!=0 &&
+            (UCNV_EXT_TO_U_IS_ROUNDTRIP(value) || TO_U_USE_FALLBACK(useFallback))
+        ) {
+            /* remember longest match so far */
+            matchValue=value;
+            matchLength=length;
+        }
+
+        /* match pre[] then src[] */
+        if(i<preLength) {
+            b=(uint8_t)pre[i++];
+        } else if(j<srcLength) {
+            b=(uint8_t)src[j++];
+        } else {
+            /* all input consumed, partial match */
+            if(flush || length>=UCNV_EXT_MAX_LENGTH) {
+                /*
+                 * end of the entire input stream, stop with the longest match so far
+                 * or: partial match must not be longer than UCNV_EXT_MAX_LENGTH
+                 * because it must fit into state buffers
+                 */
+                break;
+            } else {
+                /* continue with more input next time, in this section */
+                pState->matchValue=matchValue;
+                pState->index=index;
+                pState->length=(int8_t)length;
+                pState->matchLength=(int8_t)matchLength;
+                return (int8_t)-length;
+            }
+        }
+        ++length;
+
+        /* search for the current byte */
+        value=ucnv_extFindToU(toUSection, sectionLength, b);
+        if(value==0) {
+            /* no match here, stop with the longest match so far */
+            break;
+        } else if(UCNV_EXT_TO_U_IS_PARTIAL(value)) {
+            /* partial match, continue */
+            index=(int32_t)UCNV_EXT_TO_U_GET_PARTIAL_INDEX(value);
+        } else {
+            if(UCNV_EXT_TO_U_IS_ROUNDTRIP(value) || TO_U_USE_FALLBACK(useFallback)) {
+                /* full match, stop with result */
+                matchValue=value;
+                matchLength=length;
+            }
+            break;
+        }
+    }
+
+    if(matchLength==0) {
+        /* no match at all */
+        return 0;
+    }
+
+    /* return result */
+    pState->matchValue=matchValue;
+    return (int8_t)matchLength;
+}
+
+static void
+ucnv_extWriteToU(UConverter *cnv, const int32_t *cx,
+                 uint32_t value,
+                 UChar **target, const UChar *targetLimit,
+                 int32_t **offsets, int32_t srcIndex,
+                 UErrorCode *pErrorCode) {
+    UChar buffer[U16_MAX_LENGTH];
+
+    const UChar *result;
+    int32_t resultLength;
+
+    int32_t *o;
+    UChar *t;
+
+    o=offsets!=NULL ? *offsets : NULL;
+    t=*target;
+
+    /* get the result UChars */
+    value=UCNV_EXT_TO_U_MASK_ROUNDTRIP(value);
+    if(UCNV_EXT_TO_U_IS_CODE_POINT(value)) {
+        resultLength=0;
+        U16_APPEND_UNSAFE(buffer, resultLength, UCNV_EXT_TO_U_GET_CODE_POINT(value));
+        result=buffer;
+    } else {
+        resultLength=UCNV_EXT_TO_U_GET_LENGTH(value);
+        result=(const UChar *)cx+cx[UCNV_EXT_TO_U_UCHARS_INDEX]+UCNV_EXT_TO_U_GET_INDEX(value);
+    }
+
+    /* with correct data we have resultLength>0 */
+    if(resultLength<=0) {
+        return;
+    }
+
+    /* write result to target */
+    do {
+        *t++=*result++;
+        if(o!=NULL) {
+            *o++=srcIndex;
+        }
+    } while(--resultLength>0 && t!=targetLimit);
+
+    if(o!=NULL) {
+        *offsets=o;
+    }
+    *target=t;
+
+    if(resultLength>0) {
+        /* write overflow result to overflow buffer */
+        UChar *overflow=cnv->UCharErrorBuffer;
+
+        cnv->UCharErrorBufferLength=(int8_t)resultLength;
+        do {
+            *overflow++=*result++;
+        } while(--resultLength>0);
+
+        *pErrorCode=U_BUFFER_OVERFLOW_ERROR;
+    }
+}
+
+/*
+ * Called for the bytes in cnv->toUBytes[] that the base table does not map;
+ * they form one complete character according to the state table.
+ * target<targetLimit; set error code for unmappable & overflow
+ */
+U_CFUNC void U_CALLCONV
+ucnv_extInitialMatchToU(UConverter *cnv, UConverterExt *ext,
+                        const int32_t *cx,
+                        const char **src, const char *srcLimit,
+                        UChar **target, const UChar *targetLimit,
+                        int32_t **offsets, int32_t srcIndex,
+                        UBool flush,
+                        UErrorCode *pErrorCode) {
+    UCNVExtToUState state;
+    int32_t preLength;
+    int8_t match;
+
+    preLength=cnv->toULength;
+
+    /* start in the root section */
+    state.matchValue=0;
+    state.index=0;
+    state.length=state.matchLength=0;
+    state.firstLength=(int8_t)preLength;
+
+    /* try to match */
+    match=ucnv_extMatchToU(cx, &state,
+                           (const char *)cnv->toUBytes, preLength,
+                           *src, (int32_t)(srcLimit-*src),
+                           cnv->useFallback, flush);
+    if(match>0) {
+        /*
+         * Advance src pointer for the consumed input.
+         * Mappings consist of complete characters, so a match is never
+         * shorter than the initial character in toUBytes[].
+         */
+        *src+=match-preLength;
+        cnv->toULength=0;
+
+        /* write result to target */
+        ucnv_extWriteToU(cnv, cx,
+                         state.matchValue,
+                         target, targetLimit,
+                         offsets, srcIndex,
+                         pErrorCode);
+    } else if(match<0) {
+        /* save state for partial match */
+        const char *s;
+        int8_t j;
+
+        /* copy the initial bytes and the newly consumed input to preToU[] */
+        for(j=0; j<preLength; ++j) {
+            ext->preToU[j]=(char)cnv->toUBytes[j];
+        }
+        s=*src;
+        match=-match;
+        for(; j<match; ++j) {
+            ext->preToU[j]=*s++;
+        }
+        *src=s; /* same as *src=srcLimit; because we reached the end of input */
+        ext->preToULength=match;
+        ext->preToUState=state;
+        cnv->toULength=0;
+    } else /* match==0 */ {
+        /* no match, leave the bytes in toUBytes[] for the unassigned callback */
+        *pErrorCode=U_INVALID_CHAR_FOUND;
+    }
+}
+
+/* never called for simple, single-character conversion */
+U_CFUNC void U_CALLCONV
+ucnv_extContinueMatchToU(UConverter *cnv, UConverterExt *ext,
+                         const int32_t *cx,
+                         const char **src, const char *srcLimit,
+                         UChar **target, const UChar *targetLimit,
+                         int32_t **offsets, int32_t srcIndex,
+                         UBool flush,
+                         UErrorCode *pErrorCode) {
+    if(ext->preToULength>0) {
+        /*
+         * continue partial match with new input,
+         * starting from the saved state, without looking at preToU[] again
+         */
+        int32_t preLength;
+        int8_t match, i, j;
+
+        preLength=ext->preToULength;
+        match=ucnv_extMatchToU(cx, &ext->preToUState,
+                               NULL, 0,
+                               *src, (int32_t)(srcLimit-*src),
+                               cnv->useFallback, flush);
+        if(match>0) {
+            if(match>=preLength) {
+                /* advance src pointer for the consumed input */
+                *src+=match-preLength;
+                ext->preToULength=0;
+            } else {
+                /*
+                 * The longest match ends inside the previous input.
+                 * The new input is not consumed, and the rest of the
+                 * previous input must be converted again (replay).
+                 */
+                for(i=match, j=0; i<preLength; ++i, ++j) {
+                    ext->preToU[j]=ext->preToU[i];
+                }
+                ext->preToULength=-j;
+            }
+
+            /* write result */
+            ucnv_extWriteToU(cnv, cx,
+                             ext->preToUState.matchValue,
+                             target, targetLimit,
+                             offsets, srcIndex,
+                             pErrorCode);
+        } else if(match<0) {
+            /* just _append_ the newly consumed input to preToU[] */
+            const char *s;
+
+            s=*src;
+            match=-match;
+            for(j=(int8_t)preLength; j<match; ++j) {
+                ext->preToU[j]=*s++;
+            }
+            *src=s; /* same as *src=srcLimit; because we reached the end of input */
+            ext->preToULength=match;
+        } else /* match==0 */ {
+            /*
+             * no match
+             *
+             * Same as for fromUnicode:
+             * The initial character is unmappable and goes into the error buffer,
+             * and the rest of the previous input must be replayed
+             * after the callback.
+             */
+            i=ext->preToUState.firstLength;
+            for(j=0; j<i; ++j) {
+                cnv->invalidCharBuffer[j]=ext->preToU[j];
+            }
+            cnv->invalidCharLength=i;
+
+            /* set the error code for unassigned */
+            *pErrorCode=U_INVALID_CHAR_FOUND;
+
+            /* move the rest of the previous input up to the beginning */
+            for(j=0; i<preLength; ++i, ++j) {
+                ext->preToU[j]=ext->preToU[i];
+            }
+
+            /* mark it for replay */
+            ext->preToULength=-j;
+        }
+    } else if(ext->preToULength<0) {
+        /* replay previous input after partial match could not be completed */
+        char pre[UCNV_EXT_MAX_LENGTH];
+        int32_t preLength;
+
+        const char *preSrc;
+        const UChar *oldTarget;
+        int32_t *o;
+
+        /* move the previous input into a local buffer to prevent it from being overridden */
+        preLength=-ext->preToULength;
+        uprv_memcpy(pre, ext->preToU, preLength);
+
+        /* reset the preToU buffer in the converter */
+        ext->preToULength=0;
+
+        /* convert the previous input */
+        preSrc=pre;
+        oldTarget=*target;
+        ucnv_toUnicode(cnv,
+                       target, targetLimit,
+                       &preSrc, pre+preLength,
+                       NULL, flush,
+                       pErrorCode);
+        if(offsets!=NULL && (o=*offsets)!=NULL) {
+            /* set offsets */
+            while(oldTarget!=*target) {
+                *o++=-1; /* no source index for previous input */
+                ++oldTarget;
+            }
+            *offsets=o;
+        }
+
+        if(preSrc!=(pre+preLength)) {
+            /*
+             * Put leftover previous input back into preToU for another replay,
+             * see the same case in ucnv_extContinueMatchFromU().
+             */
+            int8_t i, j;
+
+            for(i=(int8_t)(preSrc-pre), j=0; i<preLength; ++i, ++j) {
+                ext->preToU[j]=pre[i];
+            }
+            ext->preToULength=-j; /* continue to replay */
+        }
+    }
+    /* do nothing if ext->preToULength==0 */
+}
+
+/* extension data files ----------------------------------------------------- */
+
+static UBool U_CALLCONV
+isExtDataAcceptable(void *context,
+                    const char *type, const char *name,
+                    const UDataInfo *pInfo) {
+    return (UBool)(
+        pInfo->size>=20 &&
+        pInfo->isBigEndian==U_IS_BIG_ENDIAN &&
+        pInfo->charsetFamily==U_CHARSET_FAMILY &&
+        pInfo->sizeofUChar==U_SIZEOF_UCHAR &&
+        pInfo->dataFormat[0]==0x43 &&   /* dataFormat="CvEx" */
+        pInfo->dataFormat[1]==0x76 &&
+        pInfo->dataFormat[2]==0x45 &&
+        pInfo->dataFormat[3]==0x78 &&
+        pInfo->formatVersion[0]==1);
+}
+
+/*
+ * Open a stand-alone extension data file, see ucm_writeExtData().
+ *
+ * udata_openChoice() maps the file read-only (mmap() on POSIX systems)
+ * and the returned cx points directly into the mapping:
+ * The data is not copied, and all processes that load the same file
+ * share one copy of it in the page cache.
+ * cx can be passed to the matching functions and to ucnv_extOpenFromU()
+ * as is, and it remains valid until udata_close(*ppData).
+ *
+ * @param path directory or package path as for udata_openChoice()
+ * @param name data file name without the .cnvx type suffix
+ * @param ppData [out] receives the UDataMemory to be closed with udata_close()
+ * @return extension data (indexes[]), or NULL in case of failure
+ */
+U_CFUNC const int32_t *
+ucnv_extOpenData(const char *path, const char *name,
+                 UDataMemory **ppData, UErrorCode *pErrorCode) {
+    UDataMemory *pData;
+    const int32_t *cx;
+
+    *ppData=NULL;
+    if(U_FAILURE(*pErrorCode)) {
+        return NULL;
+    }
+
+    pData=udata_openChoice(path, UCNV_EXT_DATA_TYPE, name, isExtDataAcceptable, NULL, pErrorCode);
+    if(U_FAILURE(*pErrorCode)) {
+        return NULL;
+    }
+
+    cx=(const int32_t *)udata_getMemory(pData);
+    if( cx[UCNV_EXT_INDEXES_LENGTH]<UCNV_EXT_INDEXES_MIN_LENGTH ||
+        cx[UCNV_EXT_SIZE]<cx[UCNV_EXT_INDEXES_LENGTH]*4
+    ) {
+        udata_close(pData);
+        *pErrorCode=U_INVALID_FORMAT_ERROR;
+        return NULL;
+    }
+
+    *ppData=pData;
+    return cx;
+}
+
+/* converter pairs ---------------------------------------------------------- */
+
+static UBool U_CALLCONV
+isPairDataAcceptable(void *context,
+                     const char *type, const char *name,
+                     const UDataInfo *pInfo) {
+    return (UBool)(
+        pInfo->size>=20 &&
+        pInfo->isBigEndian==U_IS_BIG_ENDIAN &&
+        pInfo->charsetFamily==U_CHARSET_FAMILY &&
+        pInfo->sizeofUChar==U_SIZEOF_UCHAR &&
+        pInfo->dataFormat[0]==0x43 &&   /* dataFormat="CvPr" */
+        pInfo->dataFormat[1]==0x76 &&
+        pInfo->dataFormat[2]==0x50 &&
+        pInfo->dataFormat[3]==0x72 &&
+        pInfo->formatVersion[0]==1);
+}
+
+/*
+ * Open a converter pair data file, see ucm_writePairData().
+ * Same as ucnv_extOpenData() otherwise.
+ */
+U_CFUNC const int32_t *
+ucnv_extOpenPairData(const char *path, const char *name,
+                     UDataMemory **ppData, UErrorCode *pErrorCode) {
+    UDataMemory *pData;
+    const int32_t *px;
+
+    *ppData=NULL;
+    if(U_FAILURE(*pErrorCode)) {
+        return NULL;
+    }
+
+    pData=udata_openChoice(path, UCNV_PAIR_DATA_TYPE, name, isPairDataAcceptable, NULL, pErrorCode);
+    if(U_FAILURE(*pErrorCode)) {
+        return NULL;
+    }
+
+    px=(const int32_t *)udata_getMemory(pData);
+    if( px[UCNV_PAIR_INDEXES_LENGTH]<UCNV_PAIR_INDEXES_MIN_LENGTH ||
+        px[UCNV_PAIR_SIZE]<px[UCNV_PAIR_INDEXES_LENGTH]*4 ||
+        px[UCNV_PAIR_RESULTS_LENGTH]<1
+    ) {
+        udata_close(pData);
+        *pErrorCode=U_INVALID_FORMAT_ERROR;
+        return NULL;
+    }
+
+    *ppData=pData;
+    return px;
+}
+
+/*
+ * Convert directly from the source charset to the target charset
+ * with converter pair data, one table walk per character.
+ *
+ * Stops at the end of the source, when the target is full,
+ * and before a sequence that must be converted through the UTF-16 pivot.
+ * The caller converts *pPivotLength bytes through the pivot with its
+ * regular converters (which also handle unassigned and illegal sequences)
+ * and then calls this function again for the rest of the source.
+ *
+ * @param px pointer to converter pair data, from ucnv_extOpenPairData()
+ * @param pSource [in/out] source bytes; advanced past the converted input
+ * @param sourceLimit end of the source bytes
+ * @param pTarget [in/out] target bytes; advanced past the output
+ * @param targetLimit end of the target buffer
+ * @param pPivotLength [out] >0: the number of bytes at *pSource that must go
+ *                     through the pivot: a sequence without a direct mapping,
+ *                     or the bytes up to and including the first one that
+ *                     does not continue any source mapping;
+ *                     0: the source is consumed, or the target is full,
+ *                     or (flush==FALSE) the source ends with a partial
+ *                     sequence that the caller must keep for the next call
+ * @param flush TRUE if the end of the input stream is reached
+ * @param pErrorCode U_BUFFER_OVERFLOW_ERROR if the target is full
+ */
+U_CFUNC void
+ucnv_extConvertPair(const int32_t *px,
+                    const char **pSource, const char *sourceLimit,
+                    char **pTarget, const char *targetLimit,
+                    int32_t *pPivotLength,
+                    UBool flush, UErrorCode *pErrorCode) {
+    const uint32_t *table, *results, *section;
+    const char *bytes;
+    const uint8_t *source;
+    uint8_t *target;
+
+    uint32_t value, matchValue;
+    int32_t i, index, length, matchLength, srcLength;
+
+    *pPivotLength=0;
+    if(U_FAILURE(*pErrorCode)) {
+        return;
+    }
+
+    table=(const uint32_t *)px+px[UCNV_PAIR_TABLE_INDEX];
+    results=(const uint32_t *)px+px[UCNV_PAIR_RESULTS_INDEX];
+    bytes=(const char *)px+px[UCNV_PAIR_BYTES_INDEX];
+
+    source=(const uint8_t *)*pSource;
+    target=(uint8_t *)*pTarget;
+
+    while((srcLength=(int32_t)((const uint8_t *)sourceLimit-source))>0) {
+        /* walk the sections for the longest match, like ucnv_extMatchToU() */
+        matchValue=0;
+        index=i=matchLength=0;
+        if(px[UCNV_PAIR_TABLE_LENGTH]>0) {
+            for(;;) {
+                section=table+index;
+                length=(int32_t)UCNV_EXT_TO_U_GET_BYTE(*section);
+                value=UCNV_EXT_TO_U_GET_VALUE(*section);
+                if(value!=0) {
+                    matchValue=value;
+                    matchLength=i;
+                }
+
+                if(i==srcLength) {
+                    if(!flush) {
+                        /* the sequence may continue in the next buffer */
+                        *pSource=(const char *)source;
+                        *pTarget=(char *)target;
+                        return;
+                    }
+                    break;
+                }
+                value= length>0 ? ucnv_extFindToU(section+1, length, source[i]) : 0;
+                ++i;
+                if(value==0) {
+                    break;
+                } else if(UCNV_EXT_TO_U_IS_PARTIAL(value)) {
+                    index=(int32_t)UCNV_EXT_TO_U_GET_PARTIAL_INDEX(value);
+                } else {
+                    matchValue=value;
+                    matchLength=i;
+                    break;
+                }
+            }
+        } else {
+            i=1;
+        }
+
+        if(matchLength==0) {
+            /* no source mapping */
+            *pPivotLength=i;
+            break;
+        }
+        value=results[UCNV_PAIR_GET_RESULT_INDEX(matchValue)];
+        if(value==0) {
+            /* no direct mapping */
+            *pPivotLength=matchLength;
+            break;
+        }
+
+        /* write the target bytes */
+        length=(int32_t)UCNV_EXT_FROM_U_GET_LENGTH(UCNV_EXT_FROM_U_MASK_ROUNDTRIP(value));
+        if(length>(int32_t)((uint8_t *)targetLimit-target)) {
+            *pErrorCode=U_BUFFER_OVERFLOW_ERROR;
+            break;
+        }
+        if(length<=UCNV_EXT_FROM_U_MAX_DIRECT_LENGTH) {
+            switch(length) {
+            case 3:
+                *target++=(uint8_t)(value>>16);
+                /* fall through */
+            case 2:
+                *target++=(uint8_t)(value>>8);
+                /* fall through */
+            case 1:
+                *target++=(uint8_t)value;
+                /* fall through */
+            default:
+                break;
+            }
+        } else {
+            uprv_memcpy(target, bytes+UCNV_EXT_FROM_U_GET_DATA(value), length);
+            target+=length;
+        }
+        source+=matchLength;
+    }
+
+    *pSource=(const char *)source;
+    *pTarget=(char *)target;
+}
+
 /*
  * TODO
  *
@@ -650,9 +1839,6 @@ ucnv_extContinueMatchFromU(UConverter *cnv,
  * - callbacks are allowed to use following input;
  *   if there is a replay buffer, then the callback must be given that
  *   instead of the current source pointer
- * - functions for toU()
- *   + test fromU() functions first before writing toU()
- *   + use cnv->toUBytes[] for initial input
  * - EBCDIC_STATEFUL: support extensions, but the charset string must be
  *   either one single-byte character or a sequence of double-byte ones,
  *   to avoid state transitions inside the mapping and to avoid having to
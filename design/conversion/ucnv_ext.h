@@ -19,6 +19,10 @@
 #ifndef __UCNV_EXT_H__
 #define __UCNV_EXT_H__
 
+#include "unicode/utypes.h"
+#include "unicode/ucnv.h"
+#include "unicode/udata.h"
+
 /*
  * See icuhtml/design/conversion/conversion_extensions.html
  *
@@ -118,6 +122,16 @@
  *   which then allows for direct array access.
  *   The builder should always do this for the initial table section.
  *
+ *   Such a "dense" section is marked by its own shape; there is no spare bit
+ *   in the initial word for an explicit flag:
+ *     (last byte - first byte + 1) == count
+ *   Byte values in the range that do not have a mapping are stored with
+ *   a 0 value (no match).
+ *   The builder should write a dense section whenever that does not make it
+ *   much larger than the sparse one, see UCNV_EXT_TO_U_USE_DENSE().
+ *   The lookup (ucnv_extFindToU()) then indexes the section directly
+ *   instead of searching it.
+ *
  *   Entries may have 0 values, see below.
  *   No two entries in a section have the same byte values.
  *
@@ -273,7 +287,7 @@ enum {
 /* maximum number of indexed UChars */
 #define UCNV_EXT_TO_U_MAX_LENGTH 19
 
-#define UCNV_EXT_TO_U_MAKE_WORD(byte, value) ((uint32_t)(byte)<<UCNV_EXT_TO_U_BYTE_SHIFT)|(value))
+#define UCNV_EXT_TO_U_MAKE_WORD(byte, value) (((uint32_t)(byte)<<UCNV_EXT_TO_U_BYTE_SHIFT)|(value))
 
 #define UCNV_EXT_TO_U_GET_BYTE(word) ((word)>>UCNV_EXT_TO_U_BYTE_SHIFT)
 #define UCNV_EXT_TO_U_GET_VALUE(word) ((word)&UCNV_EXT_TO_U_VALUE_MASK)
@@ -291,6 +305,32 @@ enum {
 #define UCNV_EXT_TO_U_GET_INDEX(value) ((value)&UCNV_EXT_TO_U_INDEX_MASK)
 #define UCNV_EXT_TO_U_GET_LENGTH(value) (((value)>>UCNV_EXT_TO_U_LENGTH_SHIFT)-UCNV_EXT_TO_U_LENGTH_OFFSET)
 
+/*
+ * dense section: the section words (after the initial one) store
+ * a contiguous range of byte values, see the toUTable description
+ */
+#define UCNV_EXT_TO_U_IS_DENSE(firstByte, lastByte, length) \
+    ((int32_t)((lastByte)-(firstByte))+1==(length))
+
+/*
+ * builder heuristic: write a dense section if the byte range
+ * is at least half filled with mappings;
+ * the initial section is always written dense
+ */
+#define UCNV_EXT_TO_U_USE_DENSE(count, firstByte, lastByte) \
+    ((int32_t)((lastByte)-(firstByte))+1<=2*(count))
+
+/*
+ * Search a toUTable section (without its initial word) for byte
+ * like the toUnicode matcher does, for tests and benchmarks:
+ * dense sections with direct access, others with a binary search.
+ *
+ * @param length number of words in the section, >=1
+ * @return lookup value for the byte, if found; else 0
+ */
+U_CFUNC uint32_t
+ucnv_extSearchToU(const uint32_t *toUSection, int32_t length, uint8_t byte);
+
 /* fromUnicode helpers ------------------------------------------------------ */
 
 #define UCNV_EXT_FROM_U_LENGTH_SHIFT 24
@@ -303,6 +343,13 @@ enum {
 /* maximum number of indexed bytes */
 #define UCNV_EXT_FROM_U_MAX_LENGTH 0x7f
 
+/*
+ * sections with at least this many UChars are searched with
+ * a branch-free kernel which compares the last 8 or 16 UChars at once
+ * with SSE2 or AVX2 where available; shorter ones with a binary+linear search
+ */
+#define UCNV_EXT_FROM_U_WIDE_SECTION_LENGTH 16
+
 #define UCNV_EXT_FROM_U_IS_PARTIAL(value) (((value)>>UCNV_EXT_FROM_U_LENGTH_SHIFT)==0)
 #define UCNV_EXT_FROM_U_GET_PARTIAL_INDEX(value) (value)
 
@@ -315,4 +362,273 @@ enum {
 /* get bytes or bytes index */
 #define UCNV_EXT_FROM_U_GET_DATA(value) ((value)&UCNV_EXT_FROM_U_DATA_MASK)
 
+/* initial-code point trie, stage 3 granularity 1 */
+#define UCNV_EXT_FROM_U_STAGE_1_SHIFT 10
+#define UCNV_EXT_FROM_U_STAGE_2_SHIFT 4
+#define UCNV_EXT_FROM_U_STAGE_2_MASK 0x3f
+#define UCNV_EXT_FROM_U_STAGE_3_MASK 0xf
+
+/*
+ * trie lookup of the initial code point c;
+ * returns a value like in fromUTableValues[], 0 if c does not start any mapping
+ */
+#define UCNV_EXT_FROM_U(stage12, stage3, stage1Length, c) \
+    (((c)>>UCNV_EXT_FROM_U_STAGE_1_SHIFT)>=(stage1Length) ? 0 : \
+     (stage3)[ \
+        (stage12)[ \
+            (stage12)[(c)>>UCNV_EXT_FROM_U_STAGE_1_SHIFT]+ \
+            (((c)>>UCNV_EXT_FROM_U_STAGE_2_SHIFT)&UCNV_EXT_FROM_U_STAGE_2_MASK) \
+        ]+ \
+        ((c)&UCNV_EXT_FROM_U_STAGE_3_MASK) \
+     ])
+
+/*
+ * builder heuristic: build the trie if the fromUnicode data
+ * (tables, trie and result bytes) is at most twice as large with it
+ * as with only the initial fromUTable section
+ */
+#define UCNV_EXT_FROM_U_USE_TRIE(trieSize, sectionSize) \
+    ((trieSize)<=2*(sectionSize))
+
+/* extension data files ----------------------------------------------------- */
+
+/*
+ * Stand-alone extension data, as written by ucm_writeExtData():
+ * a standard ICU data header with dataFormat "CvEx" and formatVersion 1,
+ * followed by the extension data starting with indexes[]
+ */
+#define UCNV_EXT_DATA_TYPE "cnvx"
+
+U_CFUNC const int32_t *
+ucnv_extOpenData(const char *path, const char *name,
+                 UDataMemory **ppData, UErrorCode *pErrorCode);
+
+/* fromUnicode matching ----------------------------------------------------- */
+
+/* fromUnicode table pointers, derived from cx */
+typedef struct UCNVExtFromUTables {
+    const UChar *tableUChars;
+    const uint32_t *tableValues;
+    const char *bytes;
+
+    /* initial-code point trie; stage12==NULL if there is none */
+    const uint16_t *stage12;
+    const uint32_t *stage3;
+    int32_t stage1Length;
+} UCNVExtFromUTables;
+
+/*
+ * fromUnicode matcher specialized for constant useFallback and flush values
+ * and for tables with or without fallbacks, see ucnv_extOpenFromU()
+ */
+typedef int8_t U_CALLCONV
+UCNVExtMatchFromUFn(const UCNVExtFromUTables *tables,
+                    const UChar *pre, int32_t preLength,
+                    const UChar *src, int32_t srcLength,
+                    const char **pResult, int32_t *pResultLength);
+
+/*
+ * fromUTable section searches, for testing them against each other:
+ * the binary+linear search for short sections, the scalar branch-free kernel
+ * for wide sections and its SSE2 and AVX2 variants, and the default
+ * which chooses by section length and CPU like the matchers do
+ */
+enum {
+    UCNV_EXT_FROM_U_SEARCH_NARROW,
+    UCNV_EXT_FROM_U_SEARCH_WIDE,
+    UCNV_EXT_FROM_U_SEARCH_SSE2,
+    UCNV_EXT_FROM_U_SEARCH_AVX2,
+    UCNV_EXT_FROM_U_SEARCH_DEFAULT,
+    UCNV_EXT_FROM_U_SEARCH_COUNT
+};
+
+/*
+ * Is the search compiled in and supported by the CPU?
+ */
+U_CFUNC UBool
+ucnv_extHasFromUSearch(int32_t search);
+
+/*
+ * Search a fromUTable section (without its length unit) for u
+ * with one of the UCNV_EXT_FROM_U_SEARCH_ functions,
+ * regardless of the section length.
+ * An unavailable search falls back to the scalar wide kernel.
+ *
+ * @param length number of UChars in the section, >=1
+ * @return index of u in the section, if found; else <0
+ */
+U_CFUNC int32_t
+ucnv_extSearchFromU(const UChar *fromUSection, int32_t length, UChar u, int32_t search);
+
+/* bulk fromUnicode matching ------------------------------------------------ */
+
+/*
+ * One result of ucnv_extMatchFromURun().
+ * length: number of input UChars consumed (>0);
+ *         the first code point only, if resultLength==0 (unmappable)
+ * result, resultLength: as returned by ucnv_extMatchFromU();
+ *         resultLength==0 if there is no match for the code point at this
+ *         position, in which case the caller does the unassigned handling
+ */
+typedef struct UCNVExtMatch {
+    const char *result;
+    int32_t length, resultLength;
+} UCNVExtMatch;
+
+/* resumable toUnicode matching --------------------------------------------- */
+
+/*
+ * State of a partial toUnicode match, kept in the converter between
+ * input buffers so that the match continues with the next byte
+ * instead of being restarted from the first one.
+ *
+ * matchValue: toUTable value of the longest match so far, 0 if none
+ * index: toUTable section in which to look up the next byte
+ * length: number of bytes matched so far (stored in preToU[])
+ * matchLength: number of bytes in the longest match so far
+ * firstLength: number of bytes of the initial character,
+ *              which is unmappable if there is no match at all
+ */
+typedef struct UCNVExtToUState {
+    uint32_t matchValue;
+    int32_t index;
+    int8_t length, matchLength, firstLength;
+} UCNVExtToUState;
+
+U_CFUNC int8_t
+ucnv_extMatchToU(const int32_t *cx,
+                 UCNVExtToUState *pState,
+                 const char *pre, int32_t preLength,
+                 const char *src, int32_t srcLength,
+                 UBool useFallback, UBool flush);
+
+/* converter state ---------------------------------------------------------- */
+
+/*
+ * Conversion extension fields of a converter.
+ * The converter functions in ucnv_ext.c take them together with
+ * the UConverter (ucnv_bld.h) whose buffers they share.
+ */
+typedef struct UConverterExt {
+    /* store previous UChars/chars to continue partial matches */
+    UChar preFromU[UCNV_EXT_MAX_LENGTH];
+    char preToU[UCNV_EXT_MAX_LENGTH];
+    int8_t preFromULength, preToULength; /* negative: replay */
+
+    /* where to continue a partial toUnicode match, valid if preToULength>0 */
+    UCNVExtToUState preToUState;
+
+    /* fromUnicode table pointers and matchers[useFallback][flush], see ucnv_extOpenFromU() */
+    UCNVExtFromUTables extFromUTables;
+    UCNVExtMatchFromUFn *extMatchFromU[2][2];
+} UConverterExt;
+
+U_CFUNC void
+ucnv_extOpenFromU(UConverterExt *ext, const int32_t *cx);
+
+/*
+ * Match the code point cp and following input for full or simple
+ * (cnv==NULL, pSimpleValue!=NULL) fromUnicode conversion;
+ * uses the converter's specialized matchers if ext!=NULL.
+ */
+U_CFUNC void U_CALLCONV
+ucnv_extInitialMatchFromU(UConverter *cnv, UConverterExt *ext,
+                          const int32_t *cx,
+                          UChar32 cp,
+                          const UChar **src, const UChar *srcLimit,
+                          char **target, const char *targetLimit,
+                          int32_t **offsets, int32_t srcIndex,
+                          uint32_t *pSimpleValue, int32_t *pSimpleLength,
+                          UBool useFallback, UBool flush,
+                          UErrorCode *pErrorCode);
+
+U_CFUNC int32_t
+ucnv_extMatchFromURun(const UConverterExt *ext, const int32_t *cx,
+                      const UChar *src, int32_t srcLength,
+                      UCNVExtMatch *matches, int32_t capacity,
+                      int32_t *pConsumed,
+                      UBool useFallback, UBool flush);
+
+/* converter pairs ---------------------------------------------------------- */
+
+/*
+ * Direct byte-to-byte conversion between two charsets, without
+ * converting each character to UTF-16 and back, for callers that transcode
+ * between a fixed pair of charsets.
+ *
+ * The data is built by ucm_buildPairData() from the .ucm files of
+ * the two charsets and written with dataFormat "CvPr" and formatVersion 1
+ * as a .cnvp file. It starts with
+ *
+ * int32_t indexes[>=16];
+ *
+ *   [0] length of indexes[]
+ *   [1] index of table[] (int32_t units, relative to indexes[])
+ *   [2] length of table[]
+ *   [3] index of results[]
+ *   [4] length of results[]
+ *   [5] index of bytes[] (byte units)
+ *   [6] length of bytes[]
+ *   [7]..[14] reserved
+ *   [15] number of bytes for the entire pair structure
+ *
+ * uint32_t table[];
+ *
+ *   Sections for the source charset's byte sequences, in the same format
+ *   and searched the same way as the toUTable (including dense sections),
+ *   with the longest match winning.
+ *   A complete-match value v (>=UCNV_EXT_TO_U_MIN_CODE_POINT) is not
+ *   a code point but an index into results[]:
+ *     results[v-UCNV_EXT_TO_U_MIN_CODE_POINT]
+ *
+ * uint32_t results[];
+ *
+ *   Target charset bytes in the format of fromUTableValues[]:
+ *   1..3 bytes in the value itself, longer results in bytes[].
+ *   results[0]==0 is shared by all source sequences that must be
+ *   converted through the UTF-16 pivot instead:
+ *   - m:n mappings, on either side
+ *   - characters that the target charset maps only with a fallback
+ *     or not at all, so that the caller's callback or fallback
+ *     handling applies
+ *   - characters that start a longer mapping in the target charset,
+ *     which could combine with the following text
+ *
+ * char bytes[];
+ *
+ *   Target charset results with more than 3 bytes.
+ *
+ * Stateful charsets (EBCDIC_STATEFUL) are not supported.
+ */
+enum {
+    UCNV_PAIR_INDEXES_LENGTH,           /* 0 */
+    UCNV_PAIR_TABLE_INDEX,
+    UCNV_PAIR_TABLE_LENGTH,
+    UCNV_PAIR_RESULTS_INDEX,
+    UCNV_PAIR_RESULTS_LENGTH,
+    UCNV_PAIR_BYTES_INDEX,              /* 5 */
+    UCNV_PAIR_BYTES_LENGTH,
+
+    UCNV_PAIR_SIZE=15,
+    UCNV_PAIR_INDEXES_MIN_LENGTH=16
+};
+
+#define UCNV_PAIR_DATA_TYPE "cnvp"
+
+#define UCNV_PAIR_GET_RESULT_INDEX(value) ((value)-UCNV_EXT_TO_U_MIN_CODE_POINT)
+
+/* the results[] index for sequences that need the pivot */
+#define UCNV_PAIR_PIVOT_INDEX 0
+
+U_CFUNC const int32_t *
+ucnv_extOpenPairData(const char *path, const char *name,
+                     UDataMemory **ppData, UErrorCode *pErrorCode);
+
+U_CFUNC void
+ucnv_extConvertPair(const int32_t *px,
+                    const char **pSource, const char *sourceLimit,
+                    char **pTarget, const char *targetLimit,
+                    int32_t *pPivotLength,
+                    UBool flush, UErrorCode *pErrorCode);
+
 #endif
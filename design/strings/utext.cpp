@@ -21,6 +21,7 @@
 #include "cmemory.h"
 #include "cstring.h"
 #include "utext.h"
+#include "bocu1.h"
 
 #define I32_FLAG(bitIndex) ((int32_t)1<<(bitIndex))
 
@@ -592,6 +593,483 @@ utext_resetSBCS(UText *t, const char *s, int32_t length, UErrorCode *pErrorCode)
     }
 }
 
+/* UText implementation for BOCU-1 strings (read-only) ---------------------- */
+
+/*
+ * Use of UText data members:
+ *   context    pointer to BOCU-1 string
+ *
+ * BOCU-1 encodes differences between code points, so decoding from a byte index
+ * requires the decoder state ("prev") at that index. It is known
+ * - at the start of the text,
+ * - after the reset bytes written by bocu1_encodeCheckpoints()
+ *   if the caller passes their byte offsets,
+ * - at code point boundaries that were decoded before; the provider records
+ *   about one per BOCU1_TEXT_STATE_SPACING bytes in a table that grows with
+ *   the decoded part of the text, and the state at the current chunk limit.
+ * Each access decodes forward from the nearest known state before the index,
+ * so backward iteration does not decode from the start for each chunk.
+ *
+ * Native indexes are byte offsets. The reset bytes after a code point
+ * belong to that code point, so that code points start at their first
+ * difference byte or at a direct-encoded C0/space byte.
+ * Illegal and truncated sequences are returned as U+FFFD.
+ */
+
+enum {
+    BOCU1_TEXT_CHUNK_SIZE=64,
+    BOCU1_TEXT_STATE_SPACING=128,
+    /* a backward chunk has at most this many code points, for at most BOCU1_TEXT_CHUNK_SIZE UChars */
+    BOCU1_TEXT_BACKWARD_CODE_POINTS=BOCU1_TEXT_CHUNK_SIZE/2
+};
+
+/* decoder state at a code point boundary */
+struct BOCU1TextState {
+    /* native index */
+    int32_t index;
+    /* Bocu1Rx.prev at the index */
+    int32_t prev;
+};
+
+struct BOCU1Text : public UText {
+    /* length of BOCU-1 string (in bytes) */
+    int32_t length;
+    /* byte offsets after reset bytes, in ascending order; optional */
+    const int32_t *checkpoints;
+    int32_t checkpointsLength;
+    /* recorded states in ascending order of their indexes */
+    BOCU1TextState *states;
+    int32_t statesLength, statesCapacity;
+    /* state at the limit of the last chunk, for sequential forward access */
+    BOCU1TextState limitState;
+    /*
+     * Chunk UChars.
+     * +1 to simplify filling with surrogate pair at the end.
+     */
+    UChar s[BOCU1_TEXT_CHUNK_SIZE+1];
+    /*
+     * Index map, from UTF-16 indexes into s back to native indexes.
+     * +2: length of s[] + one more for chunk limit index.
+     */
+    int32_t map[BOCU1_TEXT_CHUNK_SIZE+2];
+};
+
+/*
+ * Decode the code point at *pIndex and move *pIndex to the start of the next one,
+ * past the reset bytes that follow.
+ * @return the code point, U+FFFD for an illegal or truncated sequence,
+ *         or U_SENTINEL if no code point starts before length
+ */
+static UChar32
+bocu1TextNext(const uint8_t *s8, int32_t *pIndex, int32_t length, Bocu1Rx *pRx) {
+    int32_t i=*pIndex;
+    UChar32 c=U_SENTINEL;
+
+    while(i<length) {
+        c=decodeBocu1(pRx, s8[i++]);
+        if(c>=0) {
+            break;
+        } else if(c<-1) {
+            // decodeBocu1() resets the state after an illegal sequence
+            c=0xfffd;
+            break;
+        }
+    }
+    if(c<0) {
+        if(pRx->count>0) {
+            // truncated sequence at the end of the text
+            pRx->prev=BOCU1_ASCII_PREV;
+            pRx->count=0;
+            c=0xfffd;
+        } else {
+            // no code point, at most reset bytes
+            *pIndex=i;
+            return U_SENTINEL;
+        }
+    }
+    while(i<length && s8[i]==BOCU1_RESET) {
+        pRx->prev=BOCU1_ASCII_PREV;
+        ++i;
+    }
+    *pIndex=i;
+    return c;
+}
+
+/*
+ * Record the state at a code point boundary if it is at least
+ * BOCU1_TEXT_STATE_SPACING bytes beyond the last recorded one.
+ * Boundaries before that are skipped, so the table stays sorted.
+ */
+static void
+bocu1TextAddState(BOCU1Text *tb, int32_t index, int32_t prev) {
+    int32_t last= tb->statesLength>0 ? tb->states[tb->statesLength-1].index : 0;
+    if(index<last+BOCU1_TEXT_STATE_SPACING) {
+        return;
+    }
+    if(tb->statesLength==tb->statesCapacity) {
+        int32_t capacity= tb->statesCapacity>0 ? 2*tb->statesCapacity : 64;
+        BOCU1TextState *states=(BOCU1TextState *)uprv_realloc(tb->states, capacity*sizeof(BOCU1TextState));
+        if(states==NULL) {
+            // not fatal, access only gets slower
+            return;
+        }
+        tb->states=states;
+        tb->statesCapacity=capacity;
+    }
+    tb->states[tb->statesLength].index=index;
+    tb->states[tb->statesLength].prev=prev;
+    ++tb->statesLength;
+}
+
+/*
+ * Find the known state with the largest index<=maxIndex
+ * and set the decoder to it.
+ * @return the index of the state, a code point boundary
+ */
+static int32_t
+bocu1TextFindState(BOCU1Text *tb, int32_t maxIndex, Bocu1Rx *pRx) {
+    int32_t start, limit, mid;
+    int32_t index=0, prev=BOCU1_ASCII_PREV;
+
+    // checkpoints: reset state
+    start=0;
+    limit=tb->checkpointsLength;
+    while(start<limit) {
+        mid=(start+limit)/2;
+        if(tb->checkpoints[mid]<=maxIndex) {
+            start=mid+1;
+        } else {
+            limit=mid;
+        }
+    }
+    if(start>0) {
+        index=tb->checkpoints[start-1];
+    }
+
+    // recorded states
+    start=0;
+    limit=tb->statesLength;
+    while(start<limit) {
+        mid=(start+limit)/2;
+        if(tb->states[mid].index<=maxIndex) {
+            start=mid+1;
+        } else {
+            limit=mid;
+        }
+    }
+    if(start>0 && tb->states[start-1].index>index) {
+        index=tb->states[start-1].index;
+        prev=tb->states[start-1].prev;
+    }
+
+    if(index<tb->limitState.index && tb->limitState.index<=maxIndex) {
+        index=tb->limitState.index;
+        prev=tb->limitState.prev;
+    }
+
+    pRx->prev=prev;
+    pRx->count=0;
+    pRx->diff=0;
+    return index;
+}
+
+/*
+ * Move from a known state at a code point boundary to the boundary
+ * of the code point that contains index.
+ * @return the boundary, with *pRx set to the state there;
+ *         or -1 if there is no code point at or after the boundary
+ */
+static int32_t
+bocu1TextSetCodePointStart(BOCU1Text *tb, int32_t start, int32_t index, Bocu1Rx *pRx) {
+    const uint8_t *s8=(const uint8_t *)tb->context;
+    Bocu1Rx saved;
+    int32_t i;
+
+    for(;;) {
+        saved=*pRx;
+        i=start;
+        if(bocu1TextNext(s8, &i, tb->length, pRx)<0) {
+            return -1;
+        }
+        bocu1TextAddState(tb, start, saved.prev);
+        if(i>index) {
+            *pRx=saved;
+            return start;
+        }
+        start=i;
+    }
+}
+
+static int32_t U_CALLCONV
+bocu1TextExchangeProperties(UText * /*t*/, int32_t /* callerProperties */) {
+    // ignore callerProperties for now
+    return
+        I32_FLAG(UTEXT_PROVIDER_NON_UTF16_INDEXES)|
+        I32_FLAG(UTEXT_PROVIDER_LENGTH_IS_INEXPENSIVE);
+        // not UTEXT_PROVIDER_STABLE_CHUNKS because chunk-related data is kept
+        // in BOCU1Text, so only one at a time can be active
+}
+
+static int32_t U_CALLCONV
+bocu1TextLength(UText *t) {
+    return ((BOCU1Text *)t)->length;
+}
+
+static int32_t U_CALLCONV
+bocu1TextAccess(UText *t, int32_t index, UBool forward, UTextChunk *chunk) {
+    BOCU1Text *tb=(BOCU1Text *)t;
+    const uint8_t *s8=(const uint8_t *)tb->context;
+    Bocu1Rx rx;
+    UChar32 c;
+    int32_t i, start, prev, length=tb->length;
+
+    if(forward) {
+        if(index<0 || length<=index) {
+            return -1;
+        }
+
+        start=bocu1TextFindState(tb, index, &rx);
+        start=bocu1TextSetCodePointStart(tb, start, index, &rx);
+        if(start<0) {
+            return -1;
+        }
+
+        // decode a chunk of characters starting with the one that contains index
+        chunk->start=i=start;
+        for(start=0; start<BOCU1_TEXT_CHUNK_SIZE && i<length;) {
+            tb->map[start]=i;
+            tb->map[start+1]=i; // in case there is a trail surrogate
+            prev=rx.prev;
+            c=bocu1TextNext(s8, &i, length, &rx);
+            if(c<0) {
+                break;
+            }
+            bocu1TextAddState(tb, tb->map[start], prev);
+            U16_APPEND_UNSAFE(tb->s, start, c);
+        }
+        tb->map[start]=i;
+        tb->limitState.index=i;
+        tb->limitState.prev=rx.prev;
+        chunk->contents=tb->s;
+        chunk->length=start;
+        chunk->limit=i;
+        chunk->nonUTF16Indexes=TRUE;
+        return 0; // chunkOffset corresponding to index
+    } else {
+        if(index<=0) {
+            return -1;
+        }
+        if(index>length) {
+            index=length;
+        }
+
+        /*
+         * Find the code point boundary at or before index (the chunk limit)
+         * while remembering the preceding boundaries,
+         * starting from a known state before index.
+         * If index is inside the code point that starts at the known state,
+         * then start from an earlier one.
+         */
+        BOCU1TextState ring[BOCU1_TEXT_BACKWARD_CODE_POINTS+1];
+        int32_t ringCount, limit, maxIndex=index-1;
+        for(;;) {
+            start=bocu1TextFindState(tb, maxIndex, &rx);
+            i=start;
+            ringCount=0;
+            for(;;) {
+                ring[ringCount%(BOCU1_TEXT_BACKWARD_CODE_POINTS+1)].index=i;
+                ring[ringCount%(BOCU1_TEXT_BACKWARD_CODE_POINTS+1)].prev=rx.prev;
+                ++ringCount;
+                limit=i;
+                prev=rx.prev;
+                if(bocu1TextNext(s8, &i, length, &rx)<0 || i>index) {
+                    break;
+                }
+                bocu1TextAddState(tb, limit, prev);
+            }
+            if(limit>start) {
+                break;
+            } else if(start==0) {
+                return -1;
+            }
+            maxIndex=start-1;
+        }
+
+        tb->limitState.index=limit;
+        tb->limitState.prev=prev;
+
+        // decode the up to BOCU1_TEXT_BACKWARD_CODE_POINTS code points before the limit
+        if(ringCount>BOCU1_TEXT_BACKWARD_CODE_POINTS+1) {
+            start=ringCount%(BOCU1_TEXT_BACKWARD_CODE_POINTS+1);
+        } else {
+            start=0;
+        }
+        chunk->start=i=ring[start].index;
+        rx.prev=ring[start].prev;
+        rx.count=0;
+        for(start=0; i<limit;) {
+            tb->map[start]=i;
+            tb->map[start+1]=i; // in case there is a trail surrogate
+            c=bocu1TextNext(s8, &i, length, &rx);
+            U16_APPEND_UNSAFE(tb->s, start, c);
+        }
+        tb->map[start]=limit;
+        chunk->contents=tb->s;
+        chunk->length=start;
+        chunk->limit=limit;
+        chunk->nonUTF16Indexes=TRUE;
+        return start; // chunkOffset corresponding to index
+    }
+}
+
+static int32_t U_CALLCONV
+bocu1TextExtract(UText *t,
+                 int32_t start, int32_t limit,
+                 UChar *dest, int32_t destCapacity,
+                 UErrorCode *pErrorCode) {
+    BOCU1Text *tb=(BOCU1Text *)t;
+    if(U_FAILURE(*pErrorCode)) {
+        return 0;
+    }
+    if(destCapacity<0 || (dest==NULL && destCapacity>0)) {
+        *pErrorCode=U_ILLEGAL_ARGUMENT_ERROR;
+        return 0;
+    }
+    if(start<0 || start>limit || tb->length<limit) {
+        *pErrorCode=U_INDEX_OUTOFBOUNDS_ERROR;
+        return 0;
+    }
+    int32_t destLength=0;
+    if(start<limit) {
+        // extract the code points that start in [start..limit[
+        // after adjusting start to its code point boundary
+        const uint8_t *s8=(const uint8_t *)tb->context;
+        Bocu1Rx rx;
+        UChar32 c;
+        int32_t i=bocu1TextFindState(tb, start, &rx);
+        i=bocu1TextSetCodePointStart(tb, i, start, &rx);
+        if(i>=0) {
+            while(i<limit && (c=bocu1TextNext(s8, &i, tb->length, &rx))>=0) {
+                if(c<=0xffff) {
+                    if(destLength<destCapacity) {
+                        dest[destLength]=(UChar)c;
+                    }
+                    ++destLength;
+                } else {
+                    if((destLength+2)<=destCapacity) {
+                        dest[destLength]=U16_LEAD(c);
+                        dest[destLength+1]=U16_TRAIL(c);
+                    }
+                    destLength+=2;
+                }
+            }
+        }
+    }
+    return u_terminateUChars(dest, destCapacity, destLength, pErrorCode);
+}
+
+// Assume 0<=offset<=chunk->length
+static int32_t U_CALLCONV
+bocu1TextMapOffsetToNative(UText *t, UTextChunk *chunk, int32_t offset) {
+    BOCU1Text *tb=(BOCU1Text *)t;
+    return tb->map[offset];
+}
+
+// Assume chunk->start<=index<=chunk->limit
+static int32_t U_CALLCONV
+bocu1TextMapIndexToUTF16(UText *t, UTextChunk *chunk, int32_t index) {
+    BOCU1Text *tb=(BOCU1Text *)t;
+    int32_t *map=tb->map;
+    int32_t offset=0;
+
+    while(index>map[offset]) {
+        ++offset;
+    }
+    return offset;
+}
+
+static const UText bocu1Text={
+    NULL, NULL, NULL, NULL,
+    (int32_t)sizeof(UText), 0, 0, 0,
+    noopTextClone,
+    bocu1TextExchangeProperties,
+    bocu1TextLength,
+    bocu1TextAccess,
+    bocu1TextExtract,
+    NULL, // replace
+    NULL, // copy
+    bocu1TextMapOffsetToNative,
+    bocu1TextMapIndexToUTF16
+};
+
+static void
+bocu1TextSetString(BOCU1Text *tb,
+                   const uint8_t *s, int32_t length,
+                   const int32_t *checkpoints, int32_t checkpointsLength) {
+    tb->context=s;
+    if(length>=0) {
+        tb->length=length;
+    } else {
+        tb->length=(int32_t)uprv_strlen((const char *)s);
+    }
+    tb->checkpoints=checkpoints;
+    tb->checkpointsLength=checkpointsLength;
+    // the recorded states are for the old string
+    tb->statesLength=0;
+    tb->limitState.index=0;
+    tb->limitState.prev=BOCU1_ASCII_PREV;
+}
+
+U_DRAFT UText * U_EXPORT2
+utext_openBOCU1(const uint8_t *s, int32_t length,
+                const int32_t *checkpoints, int32_t checkpointsLength,
+                UErrorCode *pErrorCode) {
+    if(U_FAILURE(*pErrorCode)) {
+        return NULL;
+    }
+    if( s==NULL || length<-1 ||
+        checkpointsLength<0 || (checkpoints==NULL && checkpointsLength>0)
+    ) {
+        *pErrorCode=U_ILLEGAL_ARGUMENT_ERROR;
+        return NULL;
+    }
+    BOCU1Text *tb=(BOCU1Text *)uprv_malloc(sizeof(BOCU1Text));
+    if(tb==NULL) {
+        *pErrorCode=U_MEMORY_ALLOCATION_ERROR;
+        return NULL;
+    }
+    *((UText *)tb)=bocu1Text;
+    tb->states=NULL;
+    tb->statesCapacity=0;
+    bocu1TextSetString(tb, s, length, checkpoints, checkpointsLength);
+    return tb;
+}
+
+U_DRAFT void U_EXPORT2
+utext_closeBOCU1(UText *t) {
+    if(t!=NULL) {
+        uprv_free(((BOCU1Text *)t)->states);
+        uprv_free((BOCU1Text *)t);
+    }
+}
+
+U_DRAFT void U_EXPORT2
+utext_resetBOCU1(UText *t,
+                 const uint8_t *s, int32_t length,
+                 const int32_t *checkpoints, int32_t checkpointsLength,
+                 UErrorCode *pErrorCode) {
+    if(U_FAILURE(*pErrorCode)) {
+        return;
+    }
+    if( s==NULL || length<-1 ||
+        checkpointsLength<0 || (checkpoints==NULL && checkpointsLength>0)
+    ) {
+        *pErrorCode=U_ILLEGAL_ARGUMENT_ERROR;
+        return;
+    }
+    bocu1TextSetString((BOCU1Text *)t, s, length, checkpoints, checkpointsLength);
+}
+
 /* UText implementation wrapper for Replaceable (read/write) ---------------- */
 
 #if 0 // initially commented out to reduce testing
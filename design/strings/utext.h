@@ -466,6 +466,35 @@ utext_closeSBCS(UText *t);
 U_DRAFT void U_EXPORT2
 utext_resetSBCS(UText *t, const char *s, int32_t length, UErrorCode *pErrorCode);
 
+/**
+ * Open a read-only UText implementation for BOCU-1 strings.
+ * Native indexes are byte offsets. Chunks are decoded on demand,
+ * so the text is never converted to UTF-16 as a whole.
+ *
+ * Decoding needs the BOCU-1 state at the starting offset; the implementation
+ * records states as it decodes, so that backward access does not
+ * decode from the start of the text.
+ *
+ * @param checkpoints Optional byte offsets, in ascending order, immediately
+ *            after BOCU-1 reset bytes, as written by bocu1_encodeCheckpoints().
+ *            They speed up random access into text that was not decoded yet.
+ *            The array must be available during the lifetime of the
+ *            UText object. Can be NULL if checkpointsLength==0.
+ */
+U_DRAFT UText * U_EXPORT2
+utext_openBOCU1(const uint8_t *s, int32_t length,
+                const int32_t *checkpoints, int32_t checkpointsLength,
+                UErrorCode *pErrorCode);
+
+U_DRAFT void U_EXPORT2
+utext_closeBOCU1(UText *t);
+
+U_DRAFT void U_EXPORT2
+utext_resetBOCU1(UText *t,
+                 const uint8_t *s, int32_t length,
+                 const int32_t *checkpoints, int32_t checkpointsLength,
+                 UErrorCode *pErrorCode);
+
 U_CDECL_END
 
 #ifdef XP_CPLUSPLUS